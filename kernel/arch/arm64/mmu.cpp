@@ -511,6 +511,48 @@ void ArmArchVmAspace::FlushTLBEntry(vaddr_t vaddr, bool terminal) {
     }
 }
 
+// Replace the block descriptor at page_table[index] with a page table of
+// next level entries that map the same range with the same attributes, so
+// that part of the block can be unmapped or have its permissions changed.
+zx_status_t ArmArchVmAspace::SplitBlock(vaddr_t vaddr, vaddr_t index, uint index_shift,
+                                        uint page_size_shift, volatile pte_t* page_table) {
+    pte_t pte = page_table[index];
+    DEBUG_ASSERT(index_shift > page_size_shift);
+    DEBUG_ASSERT((pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK);
+
+    LTRACEF("vaddr %#" PRIxPTR ", index shift %u, pte %#" PRIx64 "\n", vaddr, index_shift, pte);
+
+    paddr_t table_paddr;
+    zx_status_t status = AllocPageTable(&table_paddr, page_size_shift);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    uint next_shift = index_shift - (page_size_shift - 3);
+    paddr_t paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+    pte_t attrs = pte & ~(MMU_PTE_OUTPUT_ADDR_MASK | MMU_PTE_DESCRIPTOR_MASK);
+    attrs |= (next_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK
+                                            : MMU_PTE_L3_DESCRIPTOR_PAGE;
+
+    volatile pte_t* table = static_cast<volatile pte_t*>(paddr_to_physmap(table_paddr));
+    size_t count = 1UL << (page_size_shift - 3);
+    for (size_t i = 0; i < count; i++) {
+        table[i] = (paddr + (i << next_shift)) | attrs;
+    }
+
+    // The architecture requires break-before-make when changing the size of a
+    // live translation, so invalidate the block and flush it before installing
+    // the table.
+    page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+    DMB_ISHST;
+    FlushTLBEntry(vaddr, true);
+    DSB;
+
+    page_table[index] = table_paddr | MMU_PTE_L012_DESCRIPTOR_TABLE;
+    DMB_ISHST;
+    return ZX_OK;
+}
+
 // NOTE: caller must DSB afterwards to ensure TLB entries are flushed
 ssize_t ArmArchVmAspace::UnmapPageTable(vaddr_t vaddr, vaddr_t vaddr_rel,
                                         size_t size, uint index_shift,
@@ -539,6 +581,17 @@ ssize_t ArmArchVmAspace::UnmapPageTable(vaddr_t vaddr, vaddr_t vaddr_rel,
 
         pte = page_table[index];
 
+        // Unmapping part of a block requires breaking it up first.
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            zx_status_t status = SplitBlock(vaddr - vaddr_rem, index, index_shift,
+                                            page_size_shift, page_table);
+            if (status != ZX_OK) {
+                return status;
+            }
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -703,6 +756,18 @@ int ArmArchVmAspace::ProtectPageTable(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
         index = vaddr_rel >> index_shift;
         pte = page_table[index];
 
+        // Changing the permissions of part of a block requires breaking it up
+        // first.
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            ret = SplitBlock(vaddr - vaddr_rem, index, index_shift, page_size_shift,
+                             page_table);
+            if (ret != 0) {
+                return ret;
+            }
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
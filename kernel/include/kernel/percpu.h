@@ -31,6 +31,14 @@ struct percpu {
     struct list_node run_queue[NUM_PRIORITIES];
     uint32_t run_queue_bitmap;
 
+    // number of threads sitting in run_queue, used to pick cpus to balance against
+    uint32_t run_queue_len;
+
+    // next time the preemption timer should ask for a load balance pass and whether
+    // one has been requested; only touched by the local cpu with interrupts disabled
+    zx_time_t next_balance;
+    bool balance_pending;
+
 #if WITH_LOCK_DEP
     // state for runtime lock validation when in irq context
     lockdep_state_t lock_state;
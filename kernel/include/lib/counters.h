@@ -20,8 +20,9 @@ __BEGIN_CDECLS
 //   - after N seconds how many outstanding <x> things are allocated?
 //   - up to this point has <Y> ever happened?
 //
-// Currently the only query interface to the counters is the console
-// k counters command. Issue 'k counters help' to learn what it can do.
+// The counters can be queried with the console k counters command. Issue
+// 'k counters help' to learn what it can do. They are also exported
+// read-only to user space, see <lib/zircon-internal/kcounters.h>.
 //
 // Kernel counters public API:
 // 1- define a new counter.
@@ -68,6 +69,12 @@ static_assert(sizeof(struct k_counter_desc) ==
 // array bounded by these two symbols, sorted by name.
 extern const struct k_counter_desc kcountdesc_begin[], kcountdesc_end[];
 
+// Also via kernel.ld, the per-cpu slots wind up in a contiguous array that
+// starts and ends on a page boundary, so that it can be handed to user
+// space without exposing anything else.  kcounters_arena_end includes the
+// padding after the last slot.
+extern int64_t kcounters_arena[], kcounters_arena_end[];
+
 // The order of the descriptors is the order of the slots in each per-cpu array.
 static inline size_t kcounter_index(const struct k_counter_desc* var) {
     return var - kcountdesc_begin;
@@ -13,6 +13,7 @@
 #include <kernel/mp.h>
 #include <kernel/percpu.h>
 #include <kernel/thread.h>
+#include <lib/counters.h>
 #include <lib/ktrace.h>
 #include <list.h>
 #include <platform.h>
@@ -53,6 +54,14 @@
 // threads get 10ms to run before they use up their time slice and the scheduler is invoked
 #define THREAD_INITIAL_TIME_SLICE ZX_MSEC(10)
 
+// how often a cpu running time sliced threads checks whether to pull work from a busier cpu
+#define SCHED_BALANCE_INTERVAL ZX_MSEC(20)
+
+// counts the number of threads an idle cpu took from another cpu's run queue.
+KCOUNTER(sched_idle_steal_count, "kernel.sched.idle_steal");
+// counts the number of threads moved by the periodic load balancer.
+KCOUNTER(sched_balance_pull_count, "kernel.sched.balance_pull");
+
 static bool local_migrate_if_needed(thread_t* curr_thread);
 
 // compute the effective priority of a thread
@@ -216,8 +225,10 @@ static cpu_mask_t find_cpu_mask(thread_t* t) TA_REQ(thread_lock) {
 static void insert_in_run_queue_head(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
-    list_add_head(&percpu[cpu].run_queue[t->effec_priority], &t->queue_node);
-    percpu[cpu].run_queue_bitmap |= (1u << t->effec_priority);
+    struct percpu* c = &percpu[cpu];
+    list_add_head(&c->run_queue[t->effec_priority], &t->queue_node);
+    c->run_queue_bitmap |= (1u << t->effec_priority);
+    c->run_queue_len++;
 
     // mark the cpu as busy since the run queue now has at least one item in it
     mp_set_cpu_busy(cpu);
@@ -226,8 +237,10 @@ static void insert_in_run_queue_head(cpu_num_t cpu, thread_t* t) TA_REQ(thread_l
 static void insert_in_run_queue_tail(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
-    list_add_tail(&percpu[cpu].run_queue[t->effec_priority], &t->queue_node);
-    percpu[cpu].run_queue_bitmap |= (1u << t->effec_priority);
+    struct percpu* c = &percpu[cpu];
+    list_add_tail(&c->run_queue[t->effec_priority], &t->queue_node);
+    c->run_queue_bitmap |= (1u << t->effec_priority);
+    c->run_queue_len++;
 
     // mark the cpu as busy since the run queue now has at least one item in it
     mp_set_cpu_busy(cpu);
@@ -238,19 +251,24 @@ static void remove_from_run_queue(thread_t* t, int prio_queue) TA_REQ(thread_loc
     DEBUG_ASSERT(t->state == THREAD_READY);
     DEBUG_ASSERT(is_valid_cpu_num(t->curr_cpu));
 
+    struct percpu* c = &percpu[t->curr_cpu];
     list_delete(&t->queue_node);
+    c->run_queue_len--;
 
     // clear the old cpu's queue bitmap if that was the last entry
-    struct percpu* c = &percpu[t->curr_cpu];
     if (list_is_empty(&c->run_queue[prio_queue])) {
         c->run_queue_bitmap &= ~(1u << prio_queue);
     }
 }
 
+// find the highest priority set in a run queue bitmap, which must be non zero
+static uint highest_priority_in(uint32_t bitmap) {
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap) - (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
+
 // using the per cpu run queue bitmap, find the highest populated queue
 static uint highest_run_queue(const struct percpu* c) TA_REQ(thread_lock) {
-    return HIGHEST_PRIORITY - __builtin_clz(c->run_queue_bitmap) -
-           (sizeof(c->run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+    return highest_priority_in(c->run_queue_bitmap);
 }
 
 static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
@@ -262,6 +280,7 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
         uint highest_queue = highest_run_queue(c);
 
         thread_t* newthread = list_remove_head_type(&c->run_queue[highest_queue], thread_t, queue_node);
+        c->run_queue_len--;
 
         DEBUG_ASSERT(newthread);
         DEBUG_ASSERT_MSG(newthread->cpu_affinity & cpu_num_to_mask(cpu),
@@ -282,6 +301,109 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
     return &c->idle_thread;
 }
 
+// find the active cpu other than |cpu| with the most queued threads. returns INVALID_CPU
+// if no other cpu has anything queued.
+static cpu_num_t find_busiest_cpu(cpu_num_t cpu, uint32_t* queue_len) TA_REQ(thread_lock) {
+    cpu_mask_t active = mp_get_active_mask() & ~cpu_num_to_mask(cpu);
+    cpu_num_t busiest = INVALID_CPU;
+    uint32_t busiest_len = 0;
+
+    for (cpu_num_t i = 0; active != 0; i++, active >>= 1) {
+        if ((active & 1) && percpu[i].run_queue_len > busiest_len) {
+            busiest = i;
+            busiest_len = percpu[i].run_queue_len;
+        }
+    }
+
+    *queue_len = busiest_len;
+    return busiest;
+}
+
+// pull the highest priority thread that is allowed to run on |cpu| out of |victim|'s
+// run queue and hand it to |cpu|. returns null if nothing queued there may run on |cpu|.
+static thread_t* steal_thread(cpu_num_t cpu, cpu_num_t victim) TA_REQ(thread_lock) {
+    struct percpu* c = &percpu[victim];
+    cpu_mask_t cpu_mask = cpu_num_to_mask(cpu);
+    thread_t* stolen = nullptr;
+
+    for (uint32_t bitmap = c->run_queue_bitmap; bitmap != 0 && !stolen;) {
+        uint queue = highest_priority_in(bitmap);
+        bitmap &= ~(1u << queue);
+
+        // take the thread that has been waiting the longest, it is the least likely
+        // to still have a warm cache on the victim
+        thread_t* t;
+        list_for_every_entry (&c->run_queue[queue], t, thread_t, queue_node) {
+            if (t->cpu_affinity & cpu_mask) {
+                stolen = t;
+                break;
+            }
+        }
+
+        if (stolen) {
+            list_delete(&stolen->queue_node);
+            c->run_queue_len--;
+            if (list_is_empty(&c->run_queue[queue])) {
+                c->run_queue_bitmap &= ~(1u << queue);
+            }
+        }
+    }
+
+    if (stolen) {
+        DEBUG_ASSERT(stolen->state == THREAD_READY);
+        DEBUG_ASSERT(!thread_is_idle(stolen));
+        stolen->curr_cpu = cpu;
+        LOCAL_KTRACE2("sched_steal", victim, cpu);
+    }
+    return stolen;
+}
+
+// the local cpu has run out of work, try to take a thread from the busiest cpu instead
+// of going idle
+static thread_t* idle_steal(cpu_num_t cpu) TA_REQ(thread_lock) {
+    if (!mp_is_cpu_active(cpu)) {
+        return nullptr;
+    }
+
+    uint32_t busiest_len;
+    cpu_num_t busiest = find_busiest_cpu(cpu, &busiest_len);
+    if (busiest == INVALID_CPU) {
+        return nullptr;
+    }
+
+    thread_t* t = steal_thread(cpu, busiest);
+    if (t) {
+        kcounter_add(sched_idle_steal_count, 1);
+    }
+    return t;
+}
+
+// periodic balance pass requested by the preemption timer: if another cpu has at
+// least two more threads queued than we do, pull one over to even things out
+static void balance_local(cpu_num_t cpu) TA_REQ(thread_lock) {
+    if (!mp_is_cpu_active(cpu)) {
+        return;
+    }
+
+    uint32_t busiest_len;
+    cpu_num_t busiest = find_busiest_cpu(cpu, &busiest_len);
+    if (busiest == INVALID_CPU || busiest_len < percpu[cpu].run_queue_len + 2) {
+        return;
+    }
+
+    thread_t* t = steal_thread(cpu, busiest);
+    if (!t) {
+        return;
+    }
+
+    kcounter_add(sched_balance_pull_count, 1);
+    if (t->remaining_time_slice > 0) {
+        insert_in_run_queue_head(cpu, t);
+    } else {
+        insert_in_run_queue_tail(cpu, t);
+    }
+}
+
 void sched_init_thread(thread_t* t, int priority) {
     t->base_priority = priority;
     t->priority_boost = 0;
@@ -429,6 +551,14 @@ void sched_preempt() {
     DEBUG_ASSERT(current_thread->last_cpu == current_thread->curr_cpu);
     LOCAL_KTRACE0("sched_preempt");
 
+    // the preemption timer asked for a balance pass, pull work in before picking
+    // the next thread to run
+    struct percpu* c = &percpu[curr_cpu];
+    if (unlikely(c->balance_pending)) {
+        c->balance_pending = false;
+        balance_local(curr_cpu);
+    }
+
     current_thread->state = THREAD_READY;
 
     // idle thread doesn't go in the run queue
@@ -752,6 +882,13 @@ void sched_preempt_timer_tick(zx_time_t now) {
         // set a timer to go off on the time slice interval from now
         timer_preempt_reset(zx_time_add_duration(now, THREAD_INITIAL_TIME_SLICE));
 
+        // periodically have sched_preempt() look for a busier cpu to pull work from
+        struct percpu* c = get_local_percpu();
+        if (now >= c->next_balance) {
+            c->next_balance = zx_time_add_duration(now, SCHED_BALANCE_INTERVAL);
+            c->balance_pending = true;
+        }
+
         // Mark a reschedule as pending.  The irq handler will call back
         // into us with sched_preempt().
         thread_preempt_set_pending();
@@ -790,6 +927,15 @@ void sched_resched_internal() {
     // pick a new thread to run
     thread_t* newthread = sched_get_top_thread(cpu);
 
+    // nothing queued locally, see if another cpu has work we can take before idling
+    if (thread_is_idle(newthread)) {
+        thread_t* stolen = idle_steal(cpu);
+        if (stolen) {
+            newthread = stolen;
+            mp_set_cpu_busy(cpu);
+        }
+    }
+
     DEBUG_ASSERT(newthread);
 
     newthread->state = THREAD_RUNNING;
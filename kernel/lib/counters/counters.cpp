@@ -24,9 +24,6 @@
 
 #include <lib/console.h>
 
-// The arena is allocated in kernel.ld linker script.
-extern int64_t kcounters_arena[];
-
 struct watched_counter_t {
     list_node node;
     const k_counter_desc* desc;
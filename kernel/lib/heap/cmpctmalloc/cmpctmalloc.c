@@ -15,10 +15,13 @@
 
 #include <debug.h>
 #include <err.h>
+#include <kernel/align.h>
+#include <kernel/mp.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <vm/vm.h>
+#include <lib/counters.h>
 #include <lib/heap.h>
 #include <platform.h>
 #include <trace.h>
@@ -108,6 +111,15 @@
 //   Exception: to avoid OS free/alloc churn when right on the edge, the heap
 //   will try to hold onto one entirely-free, non-large OS allocation instead of
 //   returning it to the OS. See cached_os_alloc.
+//
+// Per-cpu caches:
+//   Small memory areas (up to CACHE_MAX_SIZE usable bytes) are recycled through
+//   per-cpu magazines, one per bucket, so that most small allocations and frees
+//   only take an uncontended per-cpu spinlock instead of theheap.lock. Areas in
+//   a magazine remain marked as allocated as far as the heap is concerned, so
+//   they are not coalesced until they are handed back. Magazines are refilled
+//   from and flushed to the heap CACHE_BATCH areas at a time, and are drained
+//   completely by cmpct_trim().
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -199,6 +211,45 @@ static struct heap theheap;
 
 static ssize_t heap_grow(size_t len);
 
+// Largest usable size, in bytes, of the memory areas kept in the per-cpu caches.
+#define CACHE_MAX_SIZE 512
+
+// Number of buckets with a per-cpu magazine, i.e. size_to_index_freeing(CACHE_MAX_SIZE) + 1.
+#define CACHE_BUCKETS 32
+
+// Capacity of each magazine, and how many areas move between a magazine and
+// the heap when it runs empty or overflows.
+#define CACHE_MAGAZINE_SIZE 16
+#define CACHE_BATCH (CACHE_MAGAZINE_SIZE / 2)
+
+typedef struct cache_magazine {
+    uint32_t count;
+    void* payloads[CACHE_MAGAZINE_SIZE];
+} cache_magazine_t;
+
+typedef struct cpu_cache {
+    // Guards the magazines. Normally only taken by the owning cpu, but a thread
+    // may migrate after picking a cache and cmpct_trim() drains all of them.
+    spin_lock_t lock;
+    cache_magazine_t magazines[CACHE_BUCKETS];
+} __CPU_ALIGN cpu_cache_t;
+
+static cpu_cache_t cpu_caches[SMP_MAX_CPUS];
+
+// False until cmpct_init() has run, and while the heap tests need to see
+// every free reach the free lists.
+static bool cache_enabled;
+
+// counts small allocations satisfied by the local cpu's cache.
+KCOUNTER(heap_cache_hit, "kernel.heap.cache.hit");
+// counts small allocations that had to refill the local cache from the heap.
+KCOUNTER(heap_cache_miss, "kernel.heap.cache.miss");
+// counts frees that overflowed the local cache and were flushed to the heap.
+KCOUNTER(heap_cache_flush, "kernel.heap.cache.flush");
+
+static void free_locked(void* payload) TA_REQ(theheap.lock);
+static void cache_drain_all(void);
+
 static void lock(void) TA_ACQ(theheap.lock) {
     mutex_acquire(&theheap.lock);
 }
@@ -739,7 +790,93 @@ static void cmpct_test_return_to_os(void) {
     ASSERT(remaining == theheap.remaining);
 }
 
+// Returns the number of areas in |cpu|'s magazine for allocations of |size|.
+static uint32_t cache_test_count(cpu_num_t cpu, size_t size) {
+    size_t rounded_up;
+    size_to_index_allocating(size, &rounded_up);
+    cpu_cache_t* cache = &cpu_caches[cpu];
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+    uint32_t count = cache->magazines[size_to_index_freeing(rounded_up)].count;
+    spin_unlock_irqrestore(&cache->lock, state);
+    return count;
+}
+
+// Exercises the per-cpu caches: refilling an empty magazine, reusing a freed
+// area, flushing a full magazine, freeing on a different cpu than the one that
+// allocated, and draining everything back to the heap.
+static void cmpct_test_cache(void) {
+    // An odd size, to stay clear of the buckets busiest elsewhere in the kernel.
+    const size_t size = 200;
+    void* ptrs[CACHE_MAGAZINE_SIZE * 2];
+
+    thread_t* self = get_current_thread();
+    cpu_mask_t old_affinity = self->cpu_affinity;
+    cpu_num_t cpu = arch_curr_cpu_num();
+    thread_set_cpu_affinity(self, cpu_num_to_mask(cpu));
+
+    cache_drain_all();
+    ASSERT(cache_test_count(cpu, size) == 0);
+
+    // A miss pulls in a whole batch and hands out one of it.
+    void* a = cmpct_alloc(size);
+    ASSERT(a != NULL);
+    ASSERT(cache_test_count(cpu, size) == CACHE_BATCH - 1);
+
+    // Frees go back to the magazine, and come straight back out.
+    cmpct_free(a);
+    ASSERT(cache_test_count(cpu, size) == CACHE_BATCH);
+    ASSERT(cmpct_alloc(size) == a);
+    cmpct_free(a);
+
+    // Freeing more than a magazine holds flushes the overflow to the heap.
+    for (size_t i = 0; i < countof(ptrs); i++) {
+        ptrs[i] = cmpct_alloc(size);
+        ASSERT(ptrs[i] != NULL);
+    }
+    for (size_t i = 0; i < countof(ptrs); i++) {
+        cmpct_free(ptrs[i]);
+        ASSERT(cache_test_count(cpu, size) <= CACHE_MAGAZINE_SIZE);
+    }
+    ASSERT(cache_test_count(cpu, size) > CACHE_BATCH);
+
+    cache_drain_all();
+    ASSERT(cache_test_count(cpu, size) == 0);
+
+    // An area allocated on one cpu and freed on another lands in the cache of
+    // the cpu that freed it.
+    cpu_mask_t online = mp_get_online_mask();
+    cpu_num_t other = cpu;
+    for (cpu_num_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if (i != cpu && (online & cpu_num_to_mask(i))) {
+            other = i;
+            break;
+        }
+    }
+    if (other != cpu) {
+        a = cmpct_alloc(size);
+        ASSERT(a != NULL);
+        uint32_t count = cache_test_count(cpu, size);
+        thread_set_cpu_affinity(self, cpu_num_to_mask(other));
+        ASSERT(arch_curr_cpu_num() == other);
+        cmpct_free(a);
+        ASSERT(cache_test_count(cpu, size) == count);
+        ASSERT(cache_test_count(other, size) == 1);
+        ASSERT(cmpct_alloc(size) == a);
+        cmpct_free(a);
+
+        cache_drain_all();
+        ASSERT(cache_test_count(other, size) == 0);
+    }
+
+    thread_set_cpu_affinity(self, old_affinity);
+}
+
 void cmpct_test(void) {
+    // The tests below inspect the free lists directly.
+    cache_enabled = false;
+    cache_drain_all();
+
     cmpct_test_buckets();
     cmpct_test_get_back_newly_freed();
     cmpct_test_return_to_os();
@@ -798,6 +935,9 @@ void cmpct_test(void) {
     }
 
     cmpct_dump(false);
+
+    cache_enabled = true;
+    cmpct_test_cache();
 }
 
 #else
@@ -805,6 +945,10 @@ void cmpct_test(void) {}
 #endif  // HEAP_ENABLE_TESTS
 
 void cmpct_trim(void) {
+    // Hand everything sitting in the per-cpu caches back to the heap first so
+    // it can be coalesced with its neighbors.
+    cache_drain_all();
+
     // Look at free list entries that are at least as large as one page plus a
     // header. They might be at the start or the end of a block, so we can trim
     // them and free the page(s).
@@ -897,22 +1041,10 @@ void cmpct_trim(void) {
     unlock();
 }
 
-void* cmpct_alloc(size_t size) {
-    if (size == 0u) {
-        return NULL;
-    }
-
-    // Large allocations are no longer allowed. See ZX-1318 for details.
-    if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
-        return NULL;
-    }
-
-    size_t rounded_up;
-    int start_bucket = size_to_index_allocating(size, &rounded_up);
-
-    rounded_up += sizeof(header_t);
-
-    lock();
+// Carves a memory area of |rounded_up| bytes, including the header, out of
+// the free lists, growing the heap if needed. |size| is the number of bytes
+// the caller will use.
+static void* alloc_locked(size_t size, size_t rounded_up, int start_bucket) TA_REQ(theheap.lock) {
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
         // Grow heap by at least 12% if we can.
@@ -923,7 +1055,6 @@ void* cmpct_alloc(size_t size) {
         // we succeed or get too small.
         while (heap_grow(growby) < 0) {
             if (growby <= rounded_up) {
-                unlock();
                 return NULL;
             }
             growby = MAX(growby >> 1, rounded_up);
@@ -955,6 +1086,167 @@ void* cmpct_alloc(size_t size) {
     memset(((char*)result) + size, PADDING_FILL,
            rounded_up - size - sizeof(header_t));
 #endif
+    return result;
+}
+
+// Refills the local cpu's magazine for |cache_bucket| from the heap and returns
+// one of the new areas, or NULL if the heap is out of memory. |usable| is the
+// usable size of the bucket.
+static void* cache_refill(int cache_bucket, size_t usable, int start_bucket) {
+    void* payloads[CACHE_BATCH];
+    size_t count = 0;
+
+    lock();
+    while (count < CACHE_BATCH) {
+        void* payload = alloc_locked(usable, usable + sizeof(header_t), start_bucket);
+        if (payload == NULL) {
+            break;
+        }
+        payloads[count++] = payload;
+    }
+    unlock();
+
+    if (count == 0) {
+        return NULL;
+    }
+    void* result = payloads[--count];
+
+    // Stash the rest; if the magazine filled up in the meantime, for instance
+    // because we migrated to another cpu, give the extras straight back.
+    cpu_cache_t* cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+    cache_magazine_t* mag = &cache->magazines[cache_bucket];
+    while (count > 0 && mag->count < CACHE_MAGAZINE_SIZE) {
+        mag->payloads[mag->count++] = payloads[--count];
+    }
+    spin_unlock_irqrestore(&cache->lock, state);
+
+    if (count > 0) {
+        lock();
+        while (count > 0) {
+            free_locked(payloads[--count]);
+        }
+        unlock();
+    }
+    return result;
+}
+
+static void* cache_alloc(size_t size, size_t usable, int start_bucket) {
+    int cache_bucket = size_to_index_freeing(usable);
+    DEBUG_ASSERT(cache_bucket < CACHE_BUCKETS);
+
+    cpu_cache_t* cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+    cache_magazine_t* mag = &cache->magazines[cache_bucket];
+    void* result = NULL;
+    if (mag->count > 0) {
+        result = mag->payloads[--mag->count];
+    }
+    spin_unlock_irqrestore(&cache->lock, state);
+
+    if (result != NULL) {
+        kcounter_add(heap_cache_hit, 1);
+    } else {
+        kcounter_add(heap_cache_miss, 1);
+        result = cache_refill(cache_bucket, usable, start_bucket);
+        if (result == NULL) {
+            return NULL;
+        }
+    }
+#ifdef CMPCT_DEBUG
+    memset(result, ALLOC_FILL, size);
+#endif
+    return result;
+}
+
+// Puts |payload| in the local cpu's cache, flushing part of the magazine to
+// the heap if it is full.
+static void cache_free(void* payload, size_t usable) {
+    int cache_bucket = size_to_index_freeing(usable);
+#ifdef CMPCT_DEBUG
+    memset(payload, FREE_FILL, usable);
+#endif
+
+    void* flush[CACHE_BATCH];
+    size_t flush_count = 0;
+
+    cpu_cache_t* cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+    cache_magazine_t* mag = &cache->magazines[cache_bucket];
+    if (mag->count == CACHE_MAGAZINE_SIZE) {
+        // Full: make room by taking the oldest half of the magazine back to the heap.
+        for (; flush_count < CACHE_BATCH; flush_count++) {
+            flush[flush_count] = mag->payloads[flush_count];
+        }
+        memmove(&mag->payloads[0], &mag->payloads[CACHE_BATCH],
+                (CACHE_MAGAZINE_SIZE - CACHE_BATCH) * sizeof(void*));
+        mag->count -= CACHE_BATCH;
+    }
+    mag->payloads[mag->count++] = payload;
+    spin_unlock_irqrestore(&cache->lock, state);
+
+    if (flush_count > 0) {
+        kcounter_add(heap_cache_flush, 1);
+        lock();
+        for (size_t i = 0; i < flush_count; i++) {
+            free_locked(flush[i]);
+        }
+        unlock();
+    }
+}
+
+// Returns every area held in every cpu's cache to the heap.
+static void cache_drain_all(void) {
+    for (cpu_num_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        cpu_cache_t* cache = &cpu_caches[cpu];
+        for (int bucket = 0; bucket < CACHE_BUCKETS; bucket++) {
+            void* payloads[CACHE_MAGAZINE_SIZE];
+            size_t count;
+
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&cache->lock, state);
+            cache_magazine_t* mag = &cache->magazines[bucket];
+            count = mag->count;
+            memcpy(payloads, mag->payloads, count * sizeof(void*));
+            mag->count = 0;
+            spin_unlock_irqrestore(&cache->lock, state);
+
+            if (count == 0) {
+                continue;
+            }
+            lock();
+            for (size_t i = 0; i < count; i++) {
+                free_locked(payloads[i]);
+            }
+            unlock();
+        }
+    }
+}
+
+void* cmpct_alloc(size_t size) {
+    if (size == 0u) {
+        return NULL;
+    }
+
+    // Large allocations are no longer allowed. See ZX-1318 for details.
+    if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
+        return NULL;
+    }
+
+    size_t rounded_up;
+    int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+    if (rounded_up <= CACHE_MAX_SIZE && cache_enabled) {
+        return cache_alloc(size, rounded_up, start_bucket);
+    }
+
+    rounded_up += sizeof(header_t);
+
+    lock();
+    void* result = alloc_locked(size, rounded_up, start_bucket);
     unlock();
     return result;
 }
@@ -995,14 +1287,12 @@ void* cmpct_memalign(size_t size, size_t alignment) {
     return payload;
 }
 
-void cmpct_free(void* payload) {
-    if (payload == NULL) {
-        return;
-    }
+// Returns the allocated memory area holding |payload| to the free lists,
+// coalescing it with free neighbors.
+static void free_locked(void* payload) TA_REQ(theheap.lock) {
     header_t* header = (header_t*)payload - 1;
     DEBUG_ASSERT(!is_tagged_as_free(header)); // Double free!
     size_t size = header->size;
-    lock();
     header_t* left = header->left;
     if (left != NULL && is_tagged_as_free(left)) {
         // Coalesce with left free object.
@@ -1031,6 +1321,21 @@ void cmpct_free(void* payload) {
             free_memory(header, left, size);
         }
     }
+}
+
+void cmpct_free(void* payload) {
+    if (payload == NULL) {
+        return;
+    }
+    header_t* header = (header_t*)payload - 1;
+    DEBUG_ASSERT(!is_tagged_as_free(header)); // Double free!
+    size_t usable = header->size - sizeof(header_t);
+    if (usable <= CACHE_MAX_SIZE && cache_enabled) {
+        cache_free(payload, usable);
+        return;
+    }
+    lock();
+    free_locked(payload);
     unlock();
 }
 
@@ -1134,4 +1439,10 @@ void cmpct_init(void) {
     theheap.remaining = 0;
 
     heap_grow(initial_alloc);
+
+    DEBUG_ASSERT(size_to_index_freeing(CACHE_MAX_SIZE) == CACHE_BUCKETS - 1);
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        spin_lock_init(&cpu_caches[i].lock);
+    }
+    cache_enabled = true;
 }
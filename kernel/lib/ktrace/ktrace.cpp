@@ -9,16 +9,24 @@
 #include <platform.h>
 #include <string.h>
 
+#include <arch/mp.h>
 #include <arch/ops.h>
 #include <arch/user_copy.h>
+#include <fbl/algorithm.h>
 #include <hypervisor/ktrace.h>
+#include <kernel/align.h>
+#include <kernel/atomic.h>
 #include <kernel/cmdline.h>
+#include <kernel/spinlock.h>
+#include <lib/counters.h>
 #include <lib/ktrace.h>
 #include <lk/init.h>
 #include <object/thread_dispatcher.h>
 #include <vm/vm_aspace.h>
 #include <zircon/thread_annotations.h>
 
+#include "ktrace_priv.h"
+
 #define ktrace_timestamp() current_ticks();
 #define ktrace_ticks_per_ms() (ticks_per_second() / 1000)
 
@@ -75,45 +83,111 @@ static void ktrace_report_probes(void) {
     }
 }
 
-typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
-
-    // mask of groups we allow, 0 == tracing disabled
-    int grpmask;
+static ktrace_state_t KTRACE_STATE;
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+// The version and tick rate records, which lead every trace.
+static ktrace_rec_32b_t ktrace_metadata[2];
+
+KCOUNTER(dropped_records, "kernel.ktrace.dropped");
+
+void* ktrace_reserve(ktrace_state_t* ks, ktrace_slot_t* slot, uint32_t len) {
+    arch_interrupt_save(&slot->irq_state, ARCH_DEFAULT_SPIN_LOCK_FLAG_INTERRUPTS);
+
+    ktrace_cpu_t* cpu = &ks->cpus[arch_curr_cpu_num()];
+    uint32_t size = ks->cpu_bufsize;
+    uint64_t head = atomic_load_u64(&cpu->head);
+    uint32_t pad = 0;
+    uint32_t pos;
+    if (atomic_load(&ks->streaming)) {
+        // Records never wrap around the end of the ring.  Whatever is left
+        // at the end is filled with a padding record instead.
+        pos = static_cast<uint32_t>(head % size);
+        if (size - pos < len) {
+            pad = size - pos;
+        }
+        if (size - (head - atomic_load_u64(&cpu->tail)) < pad + len) {
+            // the reader has fallen behind, drop the record
+            atomic_store_u64(&cpu->dropped, atomic_load_u64(&cpu->dropped) + 1);
+            arch_interrupt_restore(slot->irq_state, ARCH_DEFAULT_SPIN_LOCK_FLAG_INTERRUPTS);
+            kcounter_add(dropped_records, 1);
+            return nullptr;
+        }
+        if (pad) {
+            ktrace_header_t* hdr = (ktrace_header_t*) (cpu->buffer + pos);
+            hdr->tag = KTRACE_TAG_PAD(pad);
+            pos = 0;
+        }
+    } else {
+        if (head + len > size) {
+            // This cpu's slice is full, so drop its records from now on.
+            // The other cpus keep recording until theirs fill too.
+            if (atomic_swap(&cpu->full, 1) == 0 &&
+                atomic_add(&ks->full_cpus, 1) + 1 == static_cast<int>(ks->num_cpus)) {
+                atomic_store(&ks->grpmask, 0);
+            }
+            atomic_store_u64(&cpu->dropped, atomic_load_u64(&cpu->dropped) + 1);
+            arch_interrupt_restore(slot->irq_state, ARCH_DEFAULT_SPIN_LOCK_FLAG_INTERRUPTS);
+            kcounter_add(dropped_records, 1);
+            return nullptr;
+        }
+        pos = static_cast<uint32_t>(head);
+    }
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+    slot->cpu = cpu;
+    slot->head = head;
+    slot->next = head + pad + len;
+    return cpu->buffer + pos;
+}
 
-    // raw trace buffer
-    uint8_t* buffer;
-} ktrace_state_t;
+void ktrace_commit(ktrace_slot_t* slot) {
+    // If a rewind reset this buffer while the record was being written,
+    // the rewind wins and the record is discarded.
+    uint64_t head = slot->head;
+    atomic_cmpxchg_u64(&slot->cpu->head, &head, slot->next);
+    arch_interrupt_restore(slot->irq_state, ARCH_DEFAULT_SPIN_LOCK_FLAG_INTERRUPTS);
+}
 
-static ktrace_state_t KTRACE_STATE;
+void ktrace_reset(ktrace_state_t* ks) {
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        atomic_store_u64(&ks->cpus[i].head, 0);
+        atomic_store_u64(&ks->cpus[i].tail, 0);
+        atomic_store(&ks->cpus[i].full, 0);
+        atomic_store_u64(&ks->cpus[i].dropped, 0);
+    }
+    atomic_store(&ks->full_cpus, 0);
+    ks->header_pending = true;
+    ks->next_read_cpu = 0;
+}
 
-ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
-    ktrace_state_t* ks = &KTRACE_STATE;
+// Copies the bytes in [off, off + len) of |src|, which sits at |base| in the
+// trace, that fall inside the [*pos, end) window still to be read.
+static zx_status_t ktrace_copy_range(uint8_t* ptr, size_t len, uint64_t* pos, uint64_t base,
+                                     const void* src, uint64_t src_len) {
+    uint64_t end = *pos + len;
+    if (*pos >= base + src_len || end <= base) {
+        return ZX_OK;
+    }
+    uint64_t from = *pos - base;
+    uint64_t n = fbl::min(src_len - from, end - *pos);
+    if (arch_copy_to_user(ptr, static_cast<const uint8_t*>(src) + from, n) != ZX_OK) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    *pos += n;
+    return ZX_OK;
+}
 
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
-        }
+// The trace reads as the metadata records followed by each cpu's records in
+// turn.  Records are only ordered by timestamp within a cpu.
+static ssize_t ktrace_read_linear(ktrace_state_t* ks, uint8_t* ptr, uint32_t off, size_t len)
+    TA_REQ(ks->lock) {
+    uint64_t max = sizeof(ktrace_metadata);
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        max += atomic_load_u64(&ks->cpus[i].head);
     }
 
     // null read is a query for trace buffer size
     if (ptr == nullptr) {
-        return max;
+        return static_cast<ssize_t>(max);
     }
 
     // constrain read to available buffer
@@ -124,39 +198,143 @@ ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
         len = max - off;
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != ZX_OK) {
+    uint64_t pos = off;
+    uint64_t base = 0;
+    if (ktrace_copy_range(ptr, len, &pos, base, ktrace_metadata, sizeof(ktrace_metadata)) != ZX_OK) {
         return ZX_ERR_INVALID_ARGS;
     }
-    return len;
+    base += sizeof(ktrace_metadata);
+    for (uint32_t i = 0; i < ks->num_cpus && pos < off + len; i++) {
+        ktrace_cpu_t* cpu = &ks->cpus[i];
+        uint64_t head = atomic_load_u64(&cpu->head);
+        if (ktrace_copy_range(ptr + (pos - off), off + len - pos, &pos, base,
+                              cpu->buffer, head) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        base += head;
+    }
+    return static_cast<ssize_t>(pos - off);
+}
+
+// Moves whole records out of one cpu's ring, up to |len| bytes.
+static ssize_t ktrace_drain_cpu(ktrace_state_t* ks, ktrace_cpu_t* cpu, uint8_t* ptr, size_t len,
+                                ktrace_copy_func_t copy) TA_REQ(ks->lock) {
+    uint32_t size = ks->cpu_bufsize;
+    uint64_t head = atomic_load_u64(&cpu->head);
+    uint64_t tail = atomic_load_u64(&cpu->tail);
+    size_t copied = 0;
+    while (tail < head) {
+        // gather the records that are contiguous in the ring and fit
+        uint32_t pos = static_cast<uint32_t>(tail % size);
+        uint32_t run = 0;
+        while (tail + run < head && pos + run < size) {
+            uint32_t rec_len = KTRACE_LEN(*(uint32_t*) (cpu->buffer + pos + run));
+            if (rec_len == 0 || copied + run + rec_len > len) {
+                break;
+            }
+            run += rec_len;
+        }
+        if (run == 0) {
+            break;
+        }
+        if (copy(ptr + copied, cpu->buffer + pos, run) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        copied += run;
+        tail += run;
+        atomic_store_u64(&cpu->tail, tail);
+    }
+    return static_cast<ssize_t>(copied);
+}
+
+// Streaming reads consume what they return, so the offset is ignored.
+ssize_t ktrace_read_streaming(ktrace_state_t* ks, uint8_t* ptr, size_t len,
+                              ktrace_copy_func_t copy) {
+    // null read is a query for the bytes waiting to be read
+    if (ptr == nullptr) {
+        uint64_t avail = ks->header_pending ? sizeof(ktrace_metadata) : 0;
+        for (uint32_t i = 0; i < ks->num_cpus; i++) {
+            avail += atomic_load_u64(&ks->cpus[i].head) - atomic_load_u64(&ks->cpus[i].tail);
+        }
+        return static_cast<ssize_t>(avail);
+    }
+
+    size_t copied = 0;
+    if (ks->header_pending) {
+        if (len < sizeof(ktrace_metadata)) {
+            return 0;
+        }
+        if (copy(ptr, ktrace_metadata, sizeof(ktrace_metadata)) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        ks->header_pending = false;
+        copied = sizeof(ktrace_metadata);
+    }
+
+    uint32_t first = ks->next_read_cpu;
+    ks->next_read_cpu = (first + 1) % ks->num_cpus;
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        ktrace_cpu_t* cpu = &ks->cpus[(first + i) % ks->num_cpus];
+        ssize_t n = ktrace_drain_cpu(ks, cpu, ptr + copied, len - copied, copy);
+        if (n < 0) {
+            return n;
+        }
+        copied += n;
+    }
+    return static_cast<ssize_t>(copied);
+}
+
+ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    fbl::AutoLock lock(&ks->lock);
+    if (ks->num_cpus == 0) {
+        return 0;
+    }
+    if (atomic_load(&ks->streaming)) {
+        return ktrace_read_streaming(ks, static_cast<uint8_t*>(ptr), len, arch_copy_to_user);
+    }
+    return ktrace_read_linear(ks, static_cast<uint8_t*>(ptr), off, len);
+}
+
+static void ktrace_report_metadata(void) {
+    ktrace_report_syscalls(kt_syscall_info);
+    ktrace_report_probes();
+    ktrace_report_vcpu_meta();
 }
 
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     ktrace_state_t* ks = &KTRACE_STATE;
     switch (action) {
     case KTRACE_ACTION_START:
+    case KTRACE_ACTION_START_STREAMING: {
+        fbl::AutoLock lock(&ks->lock);
+        int streaming = action == KTRACE_ACTION_START_STREAMING;
+        if (streaming && ks->num_cpus == 0) {
+            return ZX_ERR_BAD_STATE;
+        }
+        if (streaming || atomic_load(&ks->streaming)) {
+            // The buffers change shape, so start over from empty.
+            atomic_store(&ks->grpmask, 0);
+            atomic_store(&ks->streaming, streaming);
+            ktrace_reset(ks);
+            ktrace_report_metadata();
+        }
         options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
         atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
         ktrace_report_live_processes();
         ktrace_report_live_threads();
         break;
-    case KTRACE_ACTION_STOP: {
+    }
+    case KTRACE_ACTION_STOP:
         atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
-        }
         break;
-    }
-    case KTRACE_ACTION_REWIND:
+    case KTRACE_ACTION_REWIND: {
         // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-        ktrace_report_syscalls(kt_syscall_info);
-        ktrace_report_probes();
-        ktrace_report_vcpu_meta();
+        fbl::AutoLock lock(&ks->lock);
+        ktrace_reset(ks);
+        ktrace_report_metadata();
         break;
+    }
     case KTRACE_ACTION_NEW_PROBE: {
         fbl::AutoLock lock(&probe_list_lock);
         ktrace_probe_info_t* probe;
@@ -193,19 +371,30 @@ void ktrace_init(unsigned level) {
 
     mb *= (1024*1024);
 
+    uint8_t* buffer;
     zx_status_t status;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, VmAspace::VMM_FLAG_COMMIT,
+    if ((status = aspace->Alloc("ktrace", mb, (void**)&buffer, 0, VmAspace::VMM_FLAG_COMMIT,
                                 ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
         dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
+    // Split the buffer evenly between the cpus, keeping each slice on its
+    // own cache lines.
+    uint32_t num_cpus = arch_max_num_cpus();
+    uint32_t cpu_bufsize = ROUNDDOWN(mb / num_cpus, MAX_CACHE_LINE);
+    for (uint32_t i = 0; i < num_cpus; i++) {
+        ks->cpus[i].buffer = buffer + i * cpu_bufsize;
+    }
+    ks->cpu_bufsize = cpu_bufsize;
+    {
+        fbl::AutoLock lock(&ks->lock);
+        ks->num_cpus = num_cpus;
+        ktrace_reset(ks);
+    }
 
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+    dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u per cpu)\n", buffer, mb, cpu_bufsize);
 
     // register all static probes
     {
@@ -217,9 +406,9 @@ void ktrace_init(unsigned level) {
         }
     }
 
-    // write metadata to the first two event slots
+    // fill in the metadata that leads the trace
     uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
+    ktrace_rec_32b_t* rec = ktrace_metadata;
     rec[0].tag = TAG_VERSION;
     rec[0].a = KTRACE_VERSION;
     rec[1].tag = TAG_TICKS_PER_MS;
@@ -227,7 +416,6 @@ void ktrace_init(unsigned level) {
     rec[1].b = (uint32_t)(n >> 32);
 
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
     ktrace_report_syscalls(kt_syscall_info);
     ktrace_report_probes();
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
@@ -249,37 +437,40 @@ void ktrace_tiny(uint32_t tag, uint32_t arg) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
+        ktrace_slot_t slot;
+        ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, &slot, KTRACE_HDRSIZE);
+        if (hdr) {
             hdr->ts = ktrace_timestamp();
             hdr->tag = tag;
             hdr->tid = arg;
+            ktrace_commit(&slot);
         }
     }
 }
 
-void* ktrace_open(uint32_t tag) {
+bool ktrace_emit(uint32_t tag, const void* payload, size_t len) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (!(tag & atomic_load(&ks->grpmask))) {
-        return nullptr;
+        return false;
     }
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
-        return nullptr;
+    ktrace_slot_t slot;
+    ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, &slot, KTRACE_LEN(tag));
+    if (!hdr) {
+        return false;
     }
 
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
     hdr->ts = ktrace_timestamp();
     hdr->tag = tag;
     hdr->tid = (uint32_t)get_current_thread()->user_tid;
-    return hdr + 1;
+    size_t payload_size = KTRACE_LEN(tag) - KTRACE_HDRSIZE;
+    len = fbl::min(len, payload_size);
+    if (len) {
+        memcpy(hdr + 1, payload, len);
+    }
+    memset((uint8_t*) (hdr + 1) + len, 0, payload_size - len);
+    ktrace_commit(&slot);
+    return true;
 }
 
 void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
@@ -290,17 +481,15 @@ void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name,
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
+        ktrace_slot_t slot;
+        ktrace_rec_name_t* rec = (ktrace_rec_name_t*) ktrace_reserve(ks, &slot, KTRACE_LEN(tag));
+        if (rec) {
             rec->tag = tag;
             rec->id = id;
             rec->arg = arg;
             memcpy(rec->name, name, len);
             rec->name[len] = 0;
+            ktrace_commit(&slot);
         }
     }
 }
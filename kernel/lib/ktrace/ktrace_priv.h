@@ -0,0 +1,96 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/ops.h>
+#include <fbl/mutex.h>
+#include <kernel/align.h>
+#include <kernel/spinlock.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <zircon/thread_annotations.h>
+#include <zircon/types.h>
+
+// Each cpu appends records to its own slice of the trace buffer, so tracing
+// does not bounce a shared offset between cpus.
+typedef struct ktrace_cpu {
+    // bytes ever committed to / drained from |buffer|.  In streaming mode the
+    // buffer is a ring and these are taken modulo ktrace_state.cpu_bufsize;
+    // otherwise |tail| stays 0 and the cpu stops recording when |head|
+    // reaches the end.
+    volatile uint64_t head;
+    volatile uint64_t tail;
+
+    // nonzero once a record no longer fits in a non-streaming buffer
+    volatile int full;
+
+    // records this cpu has dropped since the last reset
+    volatile uint64_t dropped;
+
+    // this cpu's slice of the raw trace buffer
+    uint8_t* buffer;
+} __CPU_ALIGN ktrace_cpu_t;
+
+typedef struct ktrace_state {
+    // mask of groups we allow, 0 == tracing disabled
+    int grpmask;
+
+    // nonzero if readers drain the per-cpu buffers while tracing continues
+    int streaming;
+
+    // size of each cpu's slice of the trace buffer
+    uint32_t cpu_bufsize;
+
+    // number of cpus with a slice of the trace buffer
+    uint32_t num_cpus;
+
+    // number of cpus whose non-streaming slice has filled; tracing is
+    // disabled once all of them have
+    int full_cpus;
+
+    // streaming mode: whether the metadata records have yet to be read
+    bool header_pending TA_GUARDED(lock);
+
+    // streaming mode: cpu to drain first, so that a busy cpu cannot
+    // starve the others when the reader's buffer is small
+    uint32_t next_read_cpu TA_GUARDED(lock);
+
+    // serializes readers with each other and with control actions
+    fbl::Mutex lock;
+
+    ktrace_cpu_t cpus[SMP_MAX_CPUS];
+} ktrace_state_t;
+
+// A record being written to the current cpu's buffer.  Interrupts stay
+// disabled from ktrace_reserve() until ktrace_commit(), so nothing else
+// writes to that buffer in between and the thread cannot migrate.
+typedef struct ktrace_slot {
+    spin_lock_saved_state_t irq_state;
+    ktrace_cpu_t* cpu;
+    uint64_t head;
+    uint64_t next;
+} ktrace_slot_t;
+
+// Copies a run of records out to a reader.
+typedef zx_status_t (*ktrace_copy_func_t)(void* dst, const void* src, size_t len);
+
+// The internals below operate on any ktrace_state_t, so that the unit tests
+// can exercise them on buffers of their own.
+
+// Returns space for a |len| byte record in the current cpu's buffer, or
+// nullptr if the record is dropped.  On success the record must be finished
+// with ktrace_commit().
+void* ktrace_reserve(ktrace_state_t* ks, ktrace_slot_t* slot, uint32_t len);
+void ktrace_commit(ktrace_slot_t* slot);
+
+// Empties every cpu's buffer.
+void ktrace_reset(ktrace_state_t* ks) TA_REQ(ks->lock);
+
+// Moves up to |len| bytes of whole records out of a streaming trace into
+// |ptr| using |copy|, draining the cpus in turn.
+ssize_t ktrace_read_streaming(ktrace_state_t* ks, uint8_t* ptr, size_t len,
+                              ktrace_copy_func_t copy) TA_REQ(ks->lock);
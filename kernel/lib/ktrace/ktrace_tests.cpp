@@ -0,0 +1,162 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <string.h>
+
+#include <arch/ops.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/auto_call.h>
+#include <fbl/auto_lock.h>
+#include <fbl/unique_ptr.h>
+#include <kernel/atomic.h>
+#include <kernel/cpu.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <lib/ktrace.h>
+#include <lib/unittest/unittest.h>
+
+#include "ktrace_priv.h"
+
+namespace {
+
+constexpr uint32_t kCpuBufSize = 1024;
+constexpr uint32_t kRecordSize = 48;
+constexpr uint32_t kRecordTag = KTRACE_TAG(1, KTRACE_GRP_PROBE, kRecordSize);
+constexpr uint32_t kRecordsPerRing = kCpuBufSize / kRecordSize;
+constexpr uint32_t kPadSize = kCpuBufSize % kRecordSize;
+
+static_assert(kPadSize != 0, "records must not fill the ring exactly");
+
+// A trace of its own, so the tests neither disturb nor see the system trace.
+ktrace_state_t test_state;
+
+zx_status_t copy_out(void* dst, const void* src, size_t len) {
+    memcpy(dst, src, len);
+    return ZX_OK;
+}
+
+// Records a |kRecordSize| byte record on the current cpu, naming the cpu as
+// its thread and |seq| as its timestamp.  Returns false if it was dropped.
+bool emit_record(ktrace_state_t* ks, uint64_t seq) {
+    ktrace_slot_t slot;
+    ktrace_header_t* hdr = static_cast<ktrace_header_t*>(ktrace_reserve(ks, &slot, kRecordSize));
+    if (hdr == nullptr) {
+        return false;
+    }
+    hdr->tag = kRecordTag;
+    hdr->tid = arch_curr_cpu_num();
+    hdr->ts = seq;
+    memset(hdr + 1, 0, kRecordSize - KTRACE_HDRSIZE);
+    ktrace_commit(&slot);
+    return true;
+}
+
+ssize_t drain(ktrace_state_t* ks, uint8_t* ptr, size_t len) {
+    fbl::AutoLock lock(&ks->lock);
+    return ktrace_read_streaming(ks, ptr, len, copy_out);
+}
+
+bool streaming_full_cpu() {
+    BEGIN_TEST;
+
+    cpu_mask_t online = mp_get_online_mask();
+    const cpu_num_t full_cpu = lowest_cpu_set(online);
+    online &= ~cpu_num_to_mask(full_cpu);
+    const bool have_other = online != 0;
+    const cpu_num_t other_cpu = have_other ? lowest_cpu_set(online) : full_cpu;
+
+    const uint32_t num_cpus = arch_max_num_cpus();
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buffer(new (&ac) uint8_t[num_cpus * kCpuBufSize]);
+    ASSERT_TRUE(ac.check(), "");
+    fbl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[2 * kCpuBufSize]);
+    ASSERT_TRUE(ac.check(), "");
+
+    ktrace_state_t* ks = &test_state;
+    {
+        fbl::AutoLock lock(&ks->lock);
+        for (uint32_t i = 0; i < num_cpus; i++) {
+            ks->cpus[i].buffer = buffer.get() + i * kCpuBufSize;
+        }
+        ks->cpu_bufsize = kCpuBufSize;
+        ks->num_cpus = num_cpus;
+        atomic_store(&ks->streaming, 1);
+        ktrace_reset(ks);
+        // Only the per-cpu records are of interest here.
+        ks->header_pending = false;
+    }
+
+    thread_t* t = get_current_thread();
+    const cpu_mask_t old_affinity = t->cpu_affinity;
+    auto restore_affinity = fbl::MakeAutoCall([t, old_affinity]() {
+        thread_set_cpu_affinity(t, old_affinity);
+    });
+
+    // Fill the ring of |full_cpu|.  Further records would overwrite unread
+    // ones, so they are dropped and counted.
+    thread_set_cpu_affinity(t, cpu_num_to_mask(full_cpu));
+    uint64_t seq = 0;
+    for (uint32_t i = 0; i < kRecordsPerRing; i++) {
+        EXPECT_TRUE(emit_record(ks, seq++), "");
+    }
+    EXPECT_FALSE(emit_record(ks, seq), "");
+    EXPECT_FALSE(emit_record(ks, seq), "");
+    EXPECT_EQ(2u, atomic_load_u64(&ks->cpus[full_cpu].dropped), "");
+
+    // Only that cpu stops; the others keep recording.
+    if (have_other) {
+        thread_set_cpu_affinity(t, cpu_num_to_mask(other_cpu));
+        EXPECT_TRUE(emit_record(ks, seq++), "");
+        EXPECT_EQ(0u, atomic_load_u64(&ks->cpus[other_cpu].dropped), "");
+    }
+
+    // Each cpu's records come out whole and in order.
+    ssize_t n = drain(ks, out.get(), 2 * kCpuBufSize);
+    const uint32_t expected = (kRecordsPerRing + (have_other ? 1 : 0)) * kRecordSize;
+    ASSERT_EQ(static_cast<ssize_t>(expected), n, "");
+    uint32_t full_seen = 0;
+    uint32_t other_seen = 0;
+    for (uint32_t off = 0; off < expected; off += kRecordSize) {
+        ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(out.get() + off);
+        EXPECT_EQ(kRecordTag, hdr->tag, "");
+        if (hdr->tid == full_cpu) {
+            EXPECT_EQ(full_seen, hdr->ts, "");
+            full_seen++;
+        } else {
+            EXPECT_EQ(other_cpu, hdr->tid, "");
+            other_seen++;
+        }
+    }
+    EXPECT_EQ(kRecordsPerRing, full_seen, "");
+    EXPECT_EQ(have_other ? 1u : 0u, other_seen, "");
+
+    // Once drained, |full_cpu| records again.  The next record does not fit
+    // before the end of the ring, so a pad record fills the gap and the
+    // record starts over at the beginning.
+    thread_set_cpu_affinity(t, cpu_num_to_mask(full_cpu));
+    EXPECT_TRUE(emit_record(ks, seq), "");
+    n = drain(ks, out.get(), 2 * kCpuBufSize);
+    ASSERT_EQ(static_cast<ssize_t>(kPadSize + kRecordSize), n, "");
+    ktrace_header_t* pad = reinterpret_cast<ktrace_header_t*>(out.get());
+    EXPECT_EQ(static_cast<uint32_t>(KTRACE_TAG_PAD(kPadSize)), pad->tag, "");
+    EXPECT_EQ(kPadSize, KTRACE_LEN(pad->tag), "");
+    ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(out.get() + kPadSize);
+    EXPECT_EQ(kRecordTag, hdr->tag, "");
+    EXPECT_EQ(full_cpu, hdr->tid, "");
+    EXPECT_EQ(seq, hdr->ts, "");
+    EXPECT_EQ(2u, atomic_load_u64(&ks->cpus[full_cpu].dropped), "");
+
+    // Nothing is left to read.
+    EXPECT_EQ(0, drain(ks, out.get(), 2 * kCpuBufSize), "");
+
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(ktrace_tests)
+UNITTEST("streaming with one cpu full", streaming_full_cpu)
+UNITTEST_END_TESTCASE(ktrace_tests, "ktrace", "ktrace per-cpu buffer tests");
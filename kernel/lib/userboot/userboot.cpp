@@ -17,6 +17,7 @@
 #include <kernel/cmdline.h>
 #include <vm/vm_object_paged.h>
 #include <lib/console.h>
+#include <lib/counters.h>
 #include <lib/vdso.h>
 #include <lk/init.h>
 #include <mexec.h>
@@ -30,6 +31,7 @@
 #include <object/vm_address_region_dispatcher.h>
 #include <object/vm_object_dispatcher.h>
 
+#include <lib/zircon-internal/kcounters.h>
 #include <zircon/processargs.h>
 #include <zircon/stack.h>
 
@@ -182,6 +184,8 @@ enum bootstrap_handle_index {
     BOOTSTRAP_JOB,
     BOOTSTRAP_VMAR_ROOT,
     BOOTSTRAP_CRASHLOG,
+    BOOTSTRAP_COUNTER_DESC,
+    BOOTSTRAP_COUNTER_ARENA,
 #if ENABLE_ENTROPY_COLLECTOR_TEST
     BOOTSTRAP_ENTROPY_FILE,
 #endif
@@ -241,9 +245,15 @@ static fbl::unique_ptr<MessagePacket> prepare_bootstrap_message() {
         case BOOTSTRAP_CRASHLOG:
             info = PA_HND(PA_VMO_KERNEL_FILE, 0);
             break;
+        case BOOTSTRAP_COUNTER_DESC:
+            info = PA_HND(PA_VMO_KERNEL_FILE, 1);
+            break;
+        case BOOTSTRAP_COUNTER_ARENA:
+            info = PA_HND(PA_VMO_KERNEL_FILE, 2);
+            break;
 #if ENABLE_ENTROPY_COLLECTOR_TEST
         case BOOTSTRAP_ENTROPY_FILE:
-            info = PA_HND(PA_VMO_KERNEL_FILE, 1);
+            info = PA_HND(PA_VMO_KERNEL_FILE, 3);
             break;
 #endif
         case BOOTSTRAP_HANDLES:
@@ -284,6 +294,50 @@ static zx_status_t crashlog_to_vmo(fbl::RefPtr<VmObject>* out) {
     return ZX_OK;
 }
 
+// The counter arena VMO is made of the kernel's own pages, which the VMO
+// would free if it were ever destroyed, so the kernel keeps it alive.
+static fbl::RefPtr<VmObject> kcounters_arena_vmo;
+
+// Exports the kernel counters as a VMO naming them and a VMO of the live
+// per-cpu arena.  The layout is described in <lib/zircon-internal/kcounters.h>.
+static zx_status_t counters_to_vmos(fbl::RefPtr<VmObject>* desc_out,
+                                    fbl::RefPtr<VmObject>* arena_out) {
+    size_t arena_size = (kcounters_arena_end - kcounters_arena) * sizeof(int64_t);
+    zx_status_t status = VmObjectPaged::CreateFromROData(kcounters_arena, arena_size,
+                                                         &kcounters_arena_vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+    kcounters_arena_vmo->set_name(KCOUNTER_ARENA_VMO_NAME, sizeof(KCOUNTER_ARENA_VMO_NAME) - 1);
+
+    const size_t num_counters = kcountdesc_end - kcountdesc_begin;
+    fbl::RefPtr<VmObject> desc_vmo;
+    status = VmObjectPaged::Create(
+        PMM_ALLOC_FLAG_ANY, 0u,
+        sizeof(kcounter_desc_vmo_t) + num_counters * sizeof(kcounter_desc_entry_t), &desc_vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+    kcounter_desc_vmo_t header = {};
+    header.magic = KCOUNTER_DESC_MAGIC;
+    header.max_cpus = SMP_MAX_CPUS;
+    header.num_counters = static_cast<uint32_t>(num_counters);
+    status = desc_vmo->Write(&header, 0, sizeof(header));
+    for (size_t i = 0; status == ZX_OK && i < num_counters; ++i) {
+        kcounter_desc_entry_t entry = {};
+        strlcpy(entry.name, kcountdesc_begin[i].name, sizeof(entry.name));
+        status = desc_vmo->Write(&entry, sizeof(header) + i * sizeof(entry), sizeof(entry));
+    }
+    if (status != ZX_OK) {
+        return status;
+    }
+    desc_vmo->set_name(KCOUNTER_DESC_VMO_NAME, sizeof(KCOUNTER_DESC_VMO_NAME) - 1);
+
+    *desc_out = fbl::move(desc_vmo);
+    *arena_out = kcounters_arena_vmo;
+    return ZX_OK;
+}
+
 static zx_status_t attempt_userboot() {
     size_t rsize;
     void* rbase = platform_get_ramdisk(&rsize);
@@ -307,6 +361,11 @@ static zx_status_t attempt_userboot() {
     if (status != ZX_OK)
         return status;
 
+    fbl::RefPtr<VmObject> counter_desc_vmo, counter_arena_vmo;
+    status = counters_to_vmos(&counter_desc_vmo, &counter_arena_vmo);
+    if (status != ZX_OK)
+        return status;
+
     // Prepare the bootstrap message packet.  This puts its data (the
     // kernel command line) in place, and allocates space for its handles.
     // We'll fill in the handles as we create things.
@@ -325,6 +384,12 @@ static zx_status_t attempt_userboot() {
     if (status == ZX_OK)
         status = get_vmo_handle(crashlog_vmo, true, nullptr,
                                 &handles[BOOTSTRAP_CRASHLOG]);
+    if (status == ZX_OK)
+        status = get_vmo_handle(counter_desc_vmo, true, nullptr,
+                                &handles[BOOTSTRAP_COUNTER_DESC]);
+    if (status == ZX_OK)
+        status = get_vmo_handle(counter_arena_vmo, true, nullptr,
+                                &handles[BOOTSTRAP_COUNTER_ARENA]);
     if (status == ZX_OK)
         status = get_resource_handle(&handles[BOOTSTRAP_RESOURCE_ROOT]);
 
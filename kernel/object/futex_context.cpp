@@ -23,7 +23,12 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+#if LK_DEBUGLEVEL > 0
+    for (Bucket& bucket : buckets_) {
+        Guard<fbl::Mutex> guard{&bucket.lock};
+        DEBUG_ASSERT(bucket.futex_table.is_empty());
+    }
+#endif
 }
 
 zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int current_value, zx_time_t deadline) {
@@ -39,7 +44,8 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int curren
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    Guard<fbl::Mutex> guard{&lock_};
+    Bucket* bucket = GetBucket(futex_key);
+    Guard<fbl::Mutex> guard{&bucket->lock};
 
     int value;
     zx_status_t result = value_ptr.copy_from_user(&value);
@@ -54,9 +60,9 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int curren
     node.set_hash_key(futex_key);
     node.SetAsSingletonList();
 
-    QueueNodesLocked(&node);
+    QueueNodesLocked(bucket, &node);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
+    // Block current thread.  This releases the bucket lock and does not reacquire it.
     result = node.BlockThread(guard.take(), deadline);
     if (result == ZX_OK) {
         DEBUG_ASSERT(!node.IsInQueue());
@@ -70,9 +76,24 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int curren
     //
     // We need to ensure that the thread's node is removed from the wait
     // queue, because FutexWake() probably didn't do that.
-    Guard<fbl::Mutex> guard2{&lock_};
-    if (UnqueueNodeLocked(&node)) {
-        return result;
+    //
+    // FutexRequeue() may have moved the node to another futex, and so to
+    // another bucket, since we last held a lock.  The key only changes with
+    // the lock for its current bucket held, so the key read here without a
+    // lock only says which bucket to try.  Once that bucket's lock is held
+    // the key is read again, and if the node has moved in between we go
+    // after it.
+    for (;;) {
+        uintptr_t key = node.GetKey();
+        bucket = GetBucket(key);
+        Guard<fbl::Mutex> guard2{&bucket->lock};
+        if (node.GetKey() != key) {
+            continue;
+        }
+        if (UnqueueNodeLocked(bucket, &node)) {
+            return result;
+        }
+        break;
     }
     // The current thread was not found on the wait queue.  This means
     // that, although we hit the deadline (or were suspended/killed), we
@@ -106,11 +127,13 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const int> value_ptr,
     if (futex_key % sizeof(int))
         return ZX_ERR_INVALID_ARGS;
 
+    Bucket* bucket = GetBucket(futex_key);
+
     AutoReschedDisable resched_disable; // Must come before the Guard.
     resched_disable.Disable();
-    Guard<fbl::Mutex> guard{&lock_};
+    Guard<fbl::Mutex> guard{&bucket->lock};
 
-    FutexNode* node = futex_table_.erase(futex_key);
+    FutexNode* node = bucket->futex_table.erase(futex_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return ZX_OK;
@@ -122,7 +145,7 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const int> value_ptr,
 
     if (remaining_waiters) {
         DEBUG_ASSERT(remaining_waiters->GetKey() == futex_key);
-        futex_table_.insert(remaining_waiters);
+        bucket->futex_table.insert(remaining_waiters);
     }
 
     return ZX_OK;
@@ -135,8 +158,36 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const int> wake_ptr, uint32_t
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return ZX_ERR_INVALID_ARGS;
 
+    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
+    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
+    if (wake_key == requeue_key) return ZX_ERR_INVALID_ARGS;
+    if (wake_key % sizeof(int) || requeue_key % sizeof(int))
+        return ZX_ERR_INVALID_ARGS;
+
+    Bucket* wake_bucket = GetBucket(wake_key);
+    Bucket* requeue_bucket = GetBucket(requeue_key);
+
+    // Both buckets stay locked for the whole operation so that the waiters
+    // move from one futex to the other atomically with respect to every
+    // other futex operation on either address.
     AutoReschedDisable resched_disable; // Must come before the Guard.
-    Guard<fbl::Mutex> guard{&lock_};
+    if (wake_bucket == requeue_bucket) {
+        Guard<fbl::Mutex> guard{&wake_bucket->lock};
+        return FutexRequeueLocked(wake_bucket, wake_ptr, wake_count, current_value,
+                                  requeue_bucket, requeue_key, requeue_count, &resched_disable);
+    }
+    GuardMultiple<2, fbl::Mutex> guard{&wake_bucket->lock, &requeue_bucket->lock};
+    return FutexRequeueLocked(wake_bucket, wake_ptr, wake_count, current_value,
+                              requeue_bucket, requeue_key, requeue_count, &resched_disable);
+}
+
+zx_status_t FutexContext::FutexRequeueLocked(Bucket* wake_bucket, user_in_ptr<const int> wake_ptr,
+                                             uint32_t wake_count, int current_value,
+                                             Bucket* requeue_bucket, uintptr_t requeue_key,
+                                             uint32_t requeue_count,
+                                             AutoReschedDisable* resched_disable) {
+    DEBUG_ASSERT(wake_bucket->lock.lock().IsHeld());
+    DEBUG_ASSERT(requeue_bucket->lock.lock().IsHeld());
 
     int value;
     zx_status_t result = wake_ptr.copy_from_user(&value);
@@ -144,15 +195,11 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const int> wake_ptr, uint32_t
     if (value != current_value) return ZX_ERR_BAD_STATE;
 
     uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
-    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
-    if (wake_key == requeue_key) return ZX_ERR_INVALID_ARGS;
-    if (wake_key % sizeof(int) || requeue_key % sizeof(int))
-        return ZX_ERR_INVALID_ARGS;
 
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on futex_table look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->futex_table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return ZX_OK;
@@ -160,7 +207,7 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const int> wake_ptr, uint32_t
 
     // This must come before WakeThreads() to be useful, but we want to
     // avoid doing it before copy_from_user() in case that faults.
-    resched_disable.Disable();
+    resched_disable->Disable();
 
     if (wake_count > 0) {
         node = FutexNode::WakeThreads(node, wake_count, wake_key);
@@ -176,21 +223,21 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const int> wake_ptr, uint32_t
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->futex_table.insert(node);
     }
 
     return ZX_OK;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.lock().IsHeld());
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.lock().IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -198,15 +245,15 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->futex_table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.lock().IsHeld());
+bool FutexContext::UnqueueNodeLocked(Bucket* bucket, FutexNode* node) {
+    DEBUG_ASSERT(bucket->lock.lock().IsHeld());
 
     if (!node->IsInQueue())
         return false;
@@ -217,10 +264,11 @@ bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
     // FutexRequeue(), so we need to re-get the hash table key here.
     uintptr_t futex_key = node->GetKey();
 
-    FutexNode* old_head = futex_table_.erase(futex_key);
+    DEBUG_ASSERT(GetBucket(futex_key) == bucket);
+    FutexNode* old_head = bucket->futex_table.erase(futex_key);
     DEBUG_ASSERT(old_head);
     FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
     if (new_head)
-        futex_table_.insert(new_head);
+        bucket->futex_table.insert(new_head);
     return true;
 }
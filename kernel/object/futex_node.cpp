@@ -83,8 +83,9 @@ FutexNode* FutexNode::WakeThreads(FutexNode* node, uint32_t count,
     FutexNode* const list_end = node->queue_prev_;
     for (uint32_t i = 0; i < count; i++) {
         DEBUG_ASSERT(node->GetKey() == old_hash_key);
-        // Clear this field to avoid any possible confusion.
-        node->set_hash_key(0);
+        // The key is deliberately left in place: a FutexWait() that times
+        // out while racing with this wake uses it to find the bucket lock
+        // held by our caller, and so waits for us to finish with |node|.
 
         const bool is_last_node = (node == list_end);
         FutexNode* next = node->queue_next_;
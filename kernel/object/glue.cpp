@@ -24,6 +24,7 @@
 #include <object/diagnostics.h>
 #include <object/excp_port.h>
 #include <object/job_dispatcher.h>
+#include <object/message_packet.h>
 #include <object/policy_manager.h>
 #include <object/port_dispatcher.h>
 #include <object/process_dispatcher.h>
@@ -78,6 +79,9 @@ static void object_glue_init(uint level) TA_NO_THREAD_SAFETY_ANALYSIS {
     root_job = JobDispatcher::CreateRootJob();
     policy_manager = PolicyManager::Create();
     PortDispatcher::Init();
+    // Be sure to update kernel_cmdline.md if this default changes.
+    MessagePacket::Init(cmdline_get_uint32("kernel.channel.paged-min-size",
+                                           kPagedMessageMinSize));
     // Be sure to update kernel_cmdline.md if any of these defaults change.
     oom_init(cmdline_get_bool("kernel.oom.enable", true),
              ZX_SEC(cmdline_get_uint64("kernel.oom.sleep-sec", 1)),
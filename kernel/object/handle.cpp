@@ -7,10 +7,15 @@
 #include <object/handle.h>
 
 #include <object/dispatcher.h>
+#include <arch/ops.h>
 #include <fbl/arena.h>
+#include <fbl/atomic.h>
 #include <fbl/mutex.h>
+#include <kernel/align.h>
+#include <kernel/spinlock.h>
 #include <lib/counters.h>
 #include <pow2.h>
+#include <string.h>
 
 namespace {
 
@@ -24,6 +29,29 @@ constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
 KCOUNTER(handle_count_new, "kernel.handles.new");
 KCOUNTER(handle_count_duped, "kernel.handles.duped");
 KCOUNTER(handle_count_freed, "kernel.handles.freed");
+KCOUNTER(handle_cache_hit, "kernel.handles.cache.hit");
+KCOUNTER(handle_cache_refill, "kernel.handles.cache.refill");
+KCOUNTER(handle_cache_flush, "kernel.handles.cache.flush");
+
+// Free handle slots are cached per cpu so that most Make/Dup/Delete calls
+// never touch ArenaLock. A cache is refilled from the arena kCacheBatch slots
+// at a time, and gives the oldest kCacheBatch slots back once it holds
+// kCacheMax. A cached slot still has its stashed base_value, so handle
+// values keep cycling through generations exactly as with the bare arena.
+constexpr size_t kCacheBatch = 16;
+constexpr size_t kCacheMax = 2 * kCacheBatch;
+
+struct HandleCache {
+    DECLARE_SPINLOCK(HandleCache) lock;
+    size_t count TA_GUARDED(lock) = 0;
+    void* slots[kCacheMax] TA_GUARDED(lock);
+} __CPU_ALIGN;
+
+HandleCache handle_caches[SMP_MAX_CPUS];
+
+// Handles that have been allocated and not yet deleted. The arena's own count
+// also includes the slots sitting in the caches.
+fbl::atomic<size_t> outstanding_handle_count;
 
 // Masks for building a Handle's base_value, which ProcessDispatcher
 // uses to create zx_handle_t values.
@@ -59,7 +87,7 @@ void Handle::Init() TA_NO_THREAD_SAFETY_ANALYSIS {
 // Returns a new |base_value| based on the value stored in the free
 // arena slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(ArenaLock::Get()) {
+uint32_t Handle::GetNewBaseValue(void* addr) {
     // Get the index of this slot within the arena.
     uint32_t handle_index = HandleToIndex(reinterpret_cast<Handle*>(addr));
     DEBUG_ASSERT((handle_index & ~kHandleIndexMask) == 0);
@@ -77,33 +105,124 @@ uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(ArenaLock::Get()) {
     return (handle_index | new_gen);
 }
 
+// Take a free slot from the current cpu's cache, refilling the cache from the
+// arena if it is empty.
+void* Handle::AllocSlot() {
+    {
+        HandleCache& cache = handle_caches[arch_curr_cpu_num()];
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+        if (likely(cache.count > 0)) {
+            kcounter_add(handle_cache_hit, 1);
+            return cache.slots[--cache.count];
+        }
+    }
+
+    void* batch[kCacheBatch];
+    size_t count = 0;
+    {
+        Guard<fbl::Mutex> guard{ArenaLock::Get()};
+        while (count < kCacheBatch && (batch[count] = arena_.Alloc()) != nullptr) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        // The arena is exhausted, but some free slots may be stranded in
+        // the caches of other cpus.
+        FlushCaches();
+        Guard<fbl::Mutex> guard{ArenaLock::Get()};
+        return arena_.Alloc();
+    }
+    kcounter_add(handle_cache_refill, 1);
+
+    // Keep the first slot for the caller. We may have migrated while the
+    // arena was locked, so stash the rest on whichever cpu we are on now,
+    // and give back anything that no longer fits.
+    size_t i = 1;
+    {
+        HandleCache& cache = handle_caches[arch_curr_cpu_num()];
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+        while (i < count && cache.count < kCacheMax) {
+            cache.slots[cache.count++] = batch[i++];
+        }
+    }
+    if (i < count) {
+        Guard<fbl::Mutex> guard{ArenaLock::Get()};
+        while (i < count) {
+            arena_.Free(batch[i++]);
+        }
+    }
+    return batch[0];
+}
+
+// Return a torn down slot to the current cpu's cache, handing a batch back to
+// the arena if the cache is full.
+void Handle::FreeSlot(void* addr) {
+    void* batch[kCacheBatch];
+    {
+        HandleCache& cache = handle_caches[arch_curr_cpu_num()];
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+        if (likely(cache.count < kCacheMax)) {
+            cache.slots[cache.count++] = addr;
+            return;
+        }
+        // Keep the most recently freed slots, which are more likely to still
+        // be in the cpu's data cache.
+        memcpy(batch, cache.slots, sizeof(batch));
+        memmove(cache.slots, cache.slots + kCacheBatch,
+                (kCacheMax - kCacheBatch) * sizeof(cache.slots[0]));
+        cache.count -= kCacheBatch;
+        cache.slots[cache.count++] = addr;
+    }
+    kcounter_add(handle_cache_flush, 1);
+
+    Guard<fbl::Mutex> guard{ArenaLock::Get()};
+    for (void* slot : batch) {
+        arena_.Free(slot);
+    }
+}
+
+// Return every cached slot on every cpu to the arena.
+void Handle::FlushCaches() {
+    for (HandleCache& cache : handle_caches) {
+        void* slots[kCacheMax];
+        size_t count;
+        {
+            Guard<SpinLock, IrqSave> guard{&cache.lock};
+            count = cache.count;
+            memcpy(slots, cache.slots, count * sizeof(slots[0]));
+            cache.count = 0;
+        }
+        if (count > 0) {
+            Guard<fbl::Mutex> guard{ArenaLock::Get()};
+            for (size_t i = 0; i < count; i++) {
+                arena_.Free(slots[i]);
+            }
+        }
+    }
+}
+
 // Allocate space for a Handle from the arena, but don't instantiate the
 // object.  |base_value| gets the value for Handle::base_value_.  |what|
 // says whether this is allocation or duplication, for the error message.
 void* Handle::Alloc(const fbl::RefPtr<Dispatcher>& dispatcher,
                     const char* what, uint32_t* base_value) {
-    size_t outstanding_handles;
-    {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
-        void* addr = arena_.Alloc();
-        outstanding_handles = arena_.DiagnosticCount();
-        if (likely(addr)) {
-            if (outstanding_handles > kHighHandleCount) {
-                // TODO: Avoid calling this for every handle after
-                // kHighHandleCount; printfs are slow and we're
-                // holding the mutex.
-                printf("WARNING: High handle count: %zu handles\n",
-                       outstanding_handles);
-            }
-            dispatcher->increment_handle_count();
-            *base_value = GetNewBaseValue(addr);
-            return addr;
-        }
+    void* addr = AllocSlot();
+    if (unlikely(!addr)) {
+        printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
+               what, outstanding_handle_count.load());
+        return nullptr;
     }
 
-    printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
-           what, outstanding_handles);
-    return nullptr;
+    size_t outstanding_handles = outstanding_handle_count.fetch_add(1) + 1;
+    if (outstanding_handles > kHighHandleCount) {
+        // TODO: Avoid calling this for every handle after
+        // kHighHandleCount; printfs are slow.
+        printf("WARNING: High handle count: %zu handles\n",
+               outstanding_handles);
+    }
+    dispatcher->increment_handle_count();
+    *base_value = GetNewBaseValue(addr);
+    return addr;
 }
 
 HandleOwner Handle::Make(fbl::RefPtr<Dispatcher> dispatcher,
@@ -177,12 +296,9 @@ void Handle::Delete() {
 
     TearDown();
 
-    bool zero_handles = false;
-    {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
-        zero_handles = disp->decrement_handle_count();
-        arena_.Free(this);
-    }
+    bool zero_handles = disp->decrement_handle_count();
+    outstanding_handle_count.fetch_sub(1);
+    FreeSlot(this);
 
     if (zero_handles)
         disp->on_zero_handles();
@@ -204,17 +320,22 @@ Handle* Handle::FromU32(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
 }
 
 uint32_t Handle::Count(const fbl::RefPtr<const Dispatcher>& dispatcher) {
-    // Handle::ArenaLock also guards Dispatcher::handle_count_.
-    Guard<fbl::Mutex> guard{ArenaLock::Get()};
     return dispatcher->current_handle_count();
 }
 
 size_t Handle::diagnostics::OutstandingHandles() {
-    Guard<fbl::Mutex> guard{ArenaLock::Get()};
-    return arena_.DiagnosticCount();
+    return outstanding_handle_count.load();
 }
 
 void Handle::diagnostics::DumpTableInfo() {
+    size_t cached = 0;
+    for (HandleCache& cache : handle_caches) {
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+        cached += cache.count;
+    }
+    printf("handles: %zu outstanding, %zu free slots in per-cpu caches\n",
+           outstanding_handle_count.load(), cached);
+
     Guard<fbl::Mutex> guard{ArenaLock::Get()};
     arena_.Dump();
 }
@@ -0,0 +1,98 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/handle.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <lib/unittest/unittest.h>
+#include <object/event_dispatcher.h>
+
+namespace {
+
+// A freed slot that is handed out again must come back with a new value, so
+// stale values held by user space do not resolve to the new handle.
+static bool reuse_changes_value() {
+    BEGIN_TEST;
+    fbl::RefPtr<Dispatcher> event;
+    zx_rights_t rights;
+    ASSERT_EQ(ZX_OK, EventDispatcher::Create(0u, &event, &rights), "");
+
+    HandleOwner first = Handle::Make(event, rights);
+    ASSERT_TRUE(first, "");
+    Handle* first_ptr = first.get();
+    uint32_t first_value = first->base_value();
+    EXPECT_EQ(first_ptr, Handle::FromU32(first_value), "");
+
+    first.reset(nullptr);
+    EXPECT_NULL(Handle::FromU32(first_value), "stale value must not resolve");
+
+    // The slot just freed is normally the next one handed out on this cpu.
+    HandleOwner second = Handle::Make(event, rights);
+    ASSERT_TRUE(second, "");
+    EXPECT_NE(first_value, second->base_value(), "");
+    EXPECT_NULL(Handle::FromU32(first_value), "stale value must not resolve");
+    EXPECT_EQ(second.get(), Handle::FromU32(second->base_value()), "");
+    END_TEST;
+}
+
+static bool count_follows_handles() {
+    BEGIN_TEST;
+    fbl::RefPtr<Dispatcher> event;
+    zx_rights_t rights;
+    ASSERT_EQ(ZX_OK, EventDispatcher::Create(0u, &event, &rights), "");
+
+    HandleOwner original = Handle::Make(event, rights);
+    ASSERT_TRUE(original, "");
+    HandleOwner dup = Handle::Dup(original.get(), rights);
+    ASSERT_TRUE(dup, "");
+    EXPECT_EQ(2u, Handle::Count(event), "");
+
+    original.reset(nullptr);
+    EXPECT_EQ(1u, Handle::Count(event), "");
+    dup.reset(nullptr);
+    EXPECT_EQ(0u, Handle::Count(event), "");
+    END_TEST;
+}
+
+// Allocates and frees enough handles to overflow the per-cpu caches in both
+// directions.
+static bool many_handles() {
+    BEGIN_TEST;
+    constexpr size_t kCount = 256;
+    fbl::RefPtr<Dispatcher> event;
+    zx_rights_t rights;
+    ASSERT_EQ(ZX_OK, EventDispatcher::Create(0u, &event, &rights), "");
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<HandleOwner[]> handles(new (&ac) HandleOwner[kCount]);
+    ASSERT_TRUE(ac.check(), "");
+
+    for (size_t i = 0; i < kCount; i++) {
+        handles[i] = Handle::Make(event, rights);
+        ASSERT_TRUE(handles[i], "");
+    }
+    EXPECT_EQ(kCount, Handle::Count(event), "");
+
+    // Every live handle resolves to itself, so no slot was handed out twice.
+    for (size_t i = 0; i < kCount; i++) {
+        EXPECT_EQ(handles[i].get(), Handle::FromU32(handles[i]->base_value()), "");
+    }
+
+    for (size_t i = 0; i < kCount; i++) {
+        handles[i].reset(nullptr);
+    }
+    EXPECT_EQ(0u, Handle::Count(event), "");
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(handle_tests)
+UNITTEST("reuse changes value", reuse_changes_value)
+UNITTEST("count follows handles", count_follows_handles)
+UNITTEST("many handles", many_handles)
+UNITTEST_END_TESTCASE(handle_tests, "handle", "Handle allocation tests");
@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <fbl/atomic.h>
 #include <fbl/auto_lock.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
@@ -100,21 +101,17 @@ public:
 
     zx_koid_t get_koid() const { return koid_; }
 
-    // Must be called under the handle table lock.
     void increment_handle_count() {
-        ++handle_count_;
+        handle_count_.fetch_add(1u);
     }
 
-    // Must be called under the handle table lock.
     // Returns true exactly when the handle count goes to zero.
     bool decrement_handle_count() {
-        --handle_count_;
-        return handle_count_ == 0u;
+        return handle_count_.fetch_sub(1u) == 1u;
     }
 
-    // Must be called under the handle table lock.
     uint32_t current_handle_count() const {
-        return handle_count_;
+        return handle_count_.load();
     }
 
     // The following are only to be called when |has_state_tracker| reports true.
@@ -218,7 +215,7 @@ private:
                               zx_signals_t signals) TA_REQ(get_lock());
 
     const zx_koid_t koid_;
-    uint32_t handle_count_;
+    fbl::atomic<uint32_t> handle_count_;
 
     zx_signals_t signals_ TA_GUARDED(get_lock());
 
@@ -33,6 +33,13 @@ public:
     zx_status_t ReadToUser(size_t elem_size, user_out_ptr<uint8_t> dst, size_t count,
                            size_t* actual);
 
+    // Property methods.  The thresholds are in elements, and zero disables
+    // them.
+    size_t GetReadThreshold() const;
+    zx_status_t SetReadThreshold(size_t value);
+    size_t GetWriteThreshold() const;
+    zx_status_t SetWriteThreshold(size_t value);
+
     // PeeredDispatcher implementation.
     void on_zero_handles_locked() TA_REQ(get_lock());
     void OnPeerZeroHandlesLocked() TA_REQ(get_lock());
@@ -54,6 +61,8 @@ private:
     uint32_t head_ TA_GUARDED(get_lock());
     uint32_t tail_ TA_GUARDED(get_lock());
     fbl::unique_ptr<uint8_t[]> data_ TA_GUARDED(get_lock());
+    uint32_t read_threshold_ TA_GUARDED(get_lock());
+    uint32_t write_threshold_ TA_GUARDED(get_lock());
 
-    static constexpr uint32_t kMaxSizeBytes = PAGE_SIZE;
+    static constexpr uint32_t kMaxSizeBytes = ZX_FIFO_MAX_SIZE_BYTES;
 };
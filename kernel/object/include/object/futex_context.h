@@ -10,6 +10,7 @@
 #include <zircon/types.h>
 #include <fbl/mutex.h>
 #include <kernel/lockdep.h>
+#include <kernel/thread.h>
 #include <object/futex_node.h>
 
 // FutexContext is a class that encapsulates support for futex operations.
@@ -24,6 +25,9 @@
 // When the thread at the head of the futex's blocked thread list is resumed,
 // The FutexNode for the new head of the blocked thread list is set as the hash table value
 // for the futex.
+// The hash table is split into kNumBuckets buckets, each with its own lock and table, so
+// that operations on unrelated futexes in the same process do not contend.  A futex is
+// always found in the bucket selected by its address.
 class FutexContext {
 public:
     FutexContext();
@@ -52,14 +56,42 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    static constexpr size_t kNumBucketsShift = 4;
+    static constexpr size_t kNumBuckets = 1u << kNumBucketsShift;
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    struct Bucket {
+        // protects futex_table
+        DECLARE_MUTEX(Bucket) lock;
 
-    // protects futex_table_
-    DECLARE_MUTEX(FutexContext) lock_;
+        // Hash table for the futexes that map to this bucket.
+        // Key is futex address, value is the FutexNode for the head of futex's blocked
+        // thread list.
+        FutexNode::HashTable futex_table TA_GUARDED(lock);
+    };
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket* GetBucket(uintptr_t futex_key) {
+        // Neighbouring futexes are often part of the same structure, so mix the
+        // address bits rather than taking the low ones.
+        uint64_t hash = static_cast<uint64_t>(futex_key >> 2) * 0x9e3779b97f4a7c15ull;
+        return &buckets_[hash >> (64 - kNumBucketsShift)];
+    }
+
+    // The body of FutexRequeue(), called with the locks of both buckets held.  The two
+    // buckets may be the same.
+    //
+    // The analysis cannot follow this: the caller takes the two locks with a GuardMultiple,
+    // which it does not see as acquiring them, or takes a single lock when both buckets are
+    // the same, which it cannot tell apart from holding only |wake_bucket->lock|.  The locks
+    // are checked at runtime instead.
+    zx_status_t FutexRequeueLocked(Bucket* wake_bucket, user_in_ptr<const int> wake_ptr,
+                                   uint32_t wake_count, int current_value,
+                                   Bucket* requeue_bucket, uintptr_t requeue_key,
+                                   uint32_t requeue_count, AutoReschedDisable* resched_disable)
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
+    void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
+
+    bool UnqueueNodeLocked(Bucket* bucket, FutexNode* node) TA_REQ(bucket->lock);
+
+    Bucket buckets_[kNumBuckets];
 };
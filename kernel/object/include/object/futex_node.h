@@ -11,6 +11,7 @@
 #include <kernel/wait.h>
 #include <list.h>
 #include <zircon/types.h>
+#include <fbl/atomic.h>
 #include <fbl/intrusive_hash_table.h>
 #include <fbl/mutex.h>
 
@@ -18,7 +19,11 @@
 // Intended to be embedded within a ThreadDispatcher Instance
 class FutexNode : public fbl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = fbl::HashTable<uintptr_t, FutexNode*>;
+    // Each FutexContext bucket has its own table, so the tables are kept
+    // small.
+    static constexpr size_t kHashTableBuckets = 8;
+    using HashTable = fbl::HashTable<uintptr_t, FutexNode*, fbl::SinglyLinkedList<FutexNode*>,
+                                     size_t, kHashTableBuckets>;
 
     FutexNode();
     ~FutexNode();
@@ -47,11 +52,11 @@ public:
     zx_status_t BlockThread(Guard<fbl::Mutex>&& adopt_guard, zx_time_t deadline);
 
     void set_hash_key(uintptr_t key) {
-        hash_key_ = key;
+        hash_key_.store(key, fbl::memory_order_relaxed);
     }
 
     // Trait implementation for fbl::HashTable
-    uintptr_t GetKey() const { return hash_key_; }
+    uintptr_t GetKey() const { return hash_key_.load(fbl::memory_order_relaxed); }
     static size_t GetHash(uintptr_t key) { return (key >> 3); }
 
 private:
@@ -64,11 +69,15 @@ private:
 
     // hash_key_ contains the futex address.  This field has two roles:
     //  * It is used by FutexWait() to determine which queue to remove the
-    //    thread from when a wait operation times out.
+    //    thread from when a wait operation times out, and so which
+    //    FutexContext bucket lock to take.
     //  * Additionally, when this FutexNode is the head of a futex wait
     //    queue, this field is used by the HashTable (because it uses
     //    intrusive SinglyLinkedLists).
-    uintptr_t hash_key_;
+    // It only changes with the lock of the FutexContext bucket it maps to
+    // held, but FutexWait() reads it without a lock to find that bucket, so
+    // it is atomic.  The bucket lock orders everything else.
+    fbl::atomic<uintptr_t> hash_key_{0};
 
     // Used for waking the thread corresponding to the FutexNode.
     WaitQueue wait_queue_;
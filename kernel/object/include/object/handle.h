@@ -147,6 +147,9 @@ private:
     static void* Alloc(const fbl::RefPtr<Dispatcher>&, const char* what,
                        uint32_t* base_value);
     static uint32_t GetNewBaseValue(void* addr);
+    static void* AllocSlot();
+    static void FreeSlot(void* addr);
+    static void FlushCaches();
 
     // Handle should never be destroyed by anything other than Delete,
     // which uses TearDown to do the actual destruction.
@@ -165,7 +168,8 @@ private:
     const zx_rights_t rights_;
     const uint32_t base_value_;
 
-    // The handle arena and its mutex; also guards Dispatcher::handle_count_.
+    // The handle arena and its mutex.  Most allocations and frees are
+    // satisfied by the per-cpu slot caches in handle.cpp instead.
     DECLARE_SINGLETON_MUTEX(ArenaLock);
     static fbl::Arena TA_GUARDED(ArenaLock::Get()) arena_;
 
@@ -18,16 +18,26 @@
 
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 64u;
+constexpr uint32_t kMaxMessageIovecs = 64u;
+
+// By default, messages from user space at least this large keep their payload
+// in whole pages of their own, which CopyDataTo() can move into the reader's
+// buffer.  See MessagePacket::Init().
+constexpr uint32_t kPagedMessageMinSize = 16384u;
 
 // ensure public constants are aligned
 static_assert(ZX_CHANNEL_MAX_MSG_BYTES == kMaxMessageSize, "");
 static_assert(ZX_CHANNEL_MAX_MSG_HANDLES == kMaxMessageHandles, "");
+static_assert(ZX_CHANNEL_MAX_MSG_IOVECS == kMaxMessageIovecs, "");
 
 class Handle;
 
 class MessagePacket final : public fbl::DoublyLinkedListable<fbl::unique_ptr<MessagePacket>>,
                             fbl::Recyclable<MessagePacket> {
 public:
+    // Sets the size from which messages keep their payload in whole pages.
+    static void Init(uint32_t paged_min_size);
+
     // Creates a message packet containing the provided data and space for
     // |num_handles| handles. The handles array is uninitialized and must
     // be completely overwritten by clients.
@@ -37,14 +47,33 @@ public:
     static zx_status_t Create(const void* data, uint32_t data_size,
                               uint32_t num_handles,
                               fbl::unique_ptr<MessagePacket>* msg);
+    // Same as above, except the data is gathered from the |num_iovecs|
+    // fragments described by |iovecs|, in order, straight into the packet.
+    static zx_status_t Create(user_in_ptr<const zx_channel_iovec_t> iovecs, uint32_t num_iovecs,
+                              uint32_t num_handles,
+                              fbl::unique_ptr<MessagePacket>* msg);
+
+    // Sums the capacities of the |num_iovecs| fragments described by |iovecs|
+    // into |size|, saturating at UINT32_MAX.
+    static zx_status_t IovecSize(user_in_ptr<const zx_channel_iovec_t> iovecs,
+                                 uint32_t num_iovecs, uint32_t* size);
 
     uint32_t data_size() const { return data_size_; }
 
     // Copies the packet's |data_size()| bytes to |buf|.
     // Returns an error if |buf| points to a bad user address.
-    zx_status_t CopyDataTo(user_out_ptr<void> buf) const {
-        return buffer_chain_->CopyOut(buf, payload_offset_, data_size_);
-    }
+    //
+    // If the payload is kept in whole pages and |buf| is page aligned, the
+    // pages it fills completely are moved into the writable mappings behind
+    // |buf| instead of copied, so the data can only be taken out once.
+    zx_status_t CopyDataTo(user_out_ptr<void> buf);
+
+    // Scatters the packet's |data_size()| bytes over the |num_iovecs|
+    // fragments described by |iovecs|, filling each one before the next.
+    // Returns an error if a fragment points to a bad user address or the
+    // fragments cannot hold all of the data.
+    zx_status_t CopyDataTo(user_in_ptr<const zx_channel_iovec_t> iovecs,
+                           uint32_t num_iovecs) const;
 
     uint32_t num_handles() const { return num_handles_; }
     Handle* const* handles() const { return handles_; }
@@ -59,22 +88,21 @@ public:
             return 0;
         }
         // The first few bytes of the payload are a zx_txid_t.
-        void* payload_start = buffer_chain_->buffers()->front().data() + payload_offset_;
-        return *reinterpret_cast<zx_txid_t*>(payload_start);
+        return *reinterpret_cast<zx_txid_t*>(payload_start());
     }
 
     void set_txid(zx_txid_t txid) {
         if (data_size_ >= sizeof(zx_txid_t)) {
-            void* payload_start = buffer_chain_->buffers()->front().data() + payload_offset_;
-            *(reinterpret_cast<zx_txid_t*>(payload_start)) = txid;
+            *(reinterpret_cast<zx_txid_t*>(payload_start())) = txid;
         }
     }
 
 private:
     MessagePacket(BufferChain* chain, uint32_t data_size, uint32_t payload_offset,
-                  uint16_t num_handles, Handle** handles)
+                  uint16_t num_handles, Handle** handles, bool paged)
         : buffer_chain_(chain), handles_(handles), data_size_(data_size),
-          payload_offset_(payload_offset), num_handles_(num_handles), owns_handles_(false) {}
+          payload_offset_(payload_offset), num_handles_(num_handles), owns_handles_(false),
+          paged_(paged) {}
 
     friend class fbl::unique_ptr<MessagePacket>;
     ~MessagePacket() {
@@ -90,13 +118,31 @@ private:
     friend class fbl::Recyclable<MessagePacket>;
     void fbl_recycle();
 
-    static zx_status_t CreateCommon(uint32_t data_size, uint32_t num_handles,
+    static zx_status_t CreateCommon(uint32_t data_size, uint32_t num_handles, bool paged,
                                     fbl::unique_ptr<MessagePacket>* msg);
 
+    // Returns the first byte of the payload, which is followed by at least
+    // sizeof(zx_txid_t) contiguous bytes of it.
+    char* payload_start() const;
+
+    // Copy |len| bytes of the payload starting at |offset| in or out,
+    // wherever the payload is kept.
+    zx_status_t CopyPayloadIn(user_in_ptr<const void> src, size_t offset, size_t len);
+    zx_status_t CopyPayloadOut(user_out_ptr<void> dst, size_t offset, size_t len) const;
+
+    static uint32_t paged_min_size_;
+
     BufferChain* buffer_chain_;
     Handle** const handles_;
     const uint32_t data_size_;
     const uint32_t payload_offset_;
     const uint16_t num_handles_;
     bool owns_handles_;
+
+    // If set, the payload is kept in |payload_pages_| rather than after the
+    // handles.  The first |moved_pages_| pages of it have already been given
+    // away by CopyDataTo() and are no longer on the list.
+    const bool paged_;
+    uint16_t moved_pages_ = 0;
+    list_node payload_pages_ = LIST_INITIAL_VALUE(payload_pages_);
 };
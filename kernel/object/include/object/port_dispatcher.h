@@ -176,6 +176,10 @@ public:
     zx_status_t QueueUser(const zx_port_packet_t& packet);
     bool QueueInterruptPacket(PortInterruptPacket* port_packet, zx_time_t timestamp);
     zx_status_t Dequeue(zx_time_t deadline, zx_port_packet_t* packet);
+    // Like Dequeue(), but once a packet is available also takes up to
+    // |count| - 1 more that are already queued, in FIFO order.
+    zx_status_t DequeueBatch(zx_time_t deadline, zx_port_packet_t* packets, size_t count,
+                             size_t* actual);
     bool RemoveInterruptPacket(PortInterruptPacket* port_packet);
 
     // Decides who is going to destroy the observer. If it returns |true| it
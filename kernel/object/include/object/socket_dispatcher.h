@@ -12,6 +12,7 @@
 #include <object/dispatcher.h>
 #include <object/handle.h>
 #include <object/mbuf.h>
+#include <object/socket_ring.h>
 
 #include <zircon/types.h>
 #include <fbl/canary.h>
@@ -44,6 +45,13 @@ public:
 
     zx_status_t ReadControl(user_out_ptr<void> dst, size_t len, size_t* nread);
 
+    // Discard up to |len| bytes of a ZX_SOCKET_RING socket's receive ring,
+    // after the caller has read them through the ring VMO.
+    zx_status_t Consume(size_t len, size_t* nconsumed);
+
+    // Returns the VMO backing the receive ring of a ZX_SOCKET_RING socket.
+    zx_status_t GetRing(fbl::RefPtr<VmObject>* vmo);
+
     // On success, the share queue takes ownership of |h|. On failure,
     // |h| is closed.
     zx_status_t Share(HandleOwner h);
@@ -75,19 +83,33 @@ public:
     void OnPeerZeroHandlesLocked() TA_REQ(get_lock());
 
 private:
-    // |control_msg| may be null.
+    // |control_msg| and |ring| may be null.
     SocketDispatcher(fbl::RefPtr<PeerHolder<SocketDispatcher>> holder,
                      zx_signals_t starting_signals, uint32_t flags,
-                     fbl::unique_ptr<ControlMsg> control_msg);
+                     fbl::unique_ptr<ControlMsg> control_msg,
+                     fbl::unique_ptr<SocketRing> ring);
     void Init(fbl::RefPtr<SocketDispatcher> other);
     zx_status_t WriteSelfLocked(user_in_ptr<const void> src, size_t len, size_t* nwritten) TA_REQ(get_lock());
     zx_status_t WriteControlSelfLocked(user_in_ptr<const void> src, size_t len) TA_REQ(get_lock());
     zx_status_t UserSignalSelfLocked(uint32_t clear_mask, uint32_t set_mask) TA_REQ(get_lock());
     zx_status_t ShutdownOtherLocked(uint32_t how) TA_REQ(get_lock());
     zx_status_t ShareSelfLocked(HandleOwner h) TA_REQ(get_lock());
-
-    bool is_full() const TA_REQ(get_lock()) { return data_.is_full(); }
-    bool is_empty() const TA_REQ(get_lock()) { return data_.is_empty(); }
+    void UpdateReadSignalsLocked(bool was_full, size_t nread) TA_REQ(get_lock());
+
+    // The receive buffer is |ring_| for ZX_SOCKET_RING sockets and |data_|
+    // for all others.
+    bool is_full() const TA_REQ(get_lock()) {
+        return ring_ ? ring_->is_full() : data_.is_full();
+    }
+    bool is_empty() const TA_REQ(get_lock()) {
+        return ring_ ? ring_->is_empty() : data_.is_empty();
+    }
+    size_t data_size() const TA_REQ(get_lock()) {
+        return ring_ ? ring_->size() : data_.size();
+    }
+    size_t data_max_size() const TA_REQ(get_lock()) {
+        return ring_ ? ring_->max_size() : data_.max_size();
+    }
 
     fbl::Canary<fbl::magic("SOCK")> canary_;
 
@@ -95,6 +117,7 @@ private:
 
     // The shared |get_lock()| protects all members below.
     MBufChain data_ TA_GUARDED(get_lock());
+    const fbl::unique_ptr<SocketRing> ring_;
     fbl::unique_ptr<ControlMsg> control_msg_ TA_GUARDED(get_lock());
     size_t control_msg_len_ TA_GUARDED(get_lock());
     HandleOwner accept_queue_ TA_GUARDED(get_lock());
@@ -0,0 +1,76 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fbl/ref_ptr.h>
+#include <fbl/unique_ptr.h>
+#include <lib/user_copy/user_ptr.h>
+#include <vm/vm_address_region.h>
+#include <vm/vm_object.h>
+#include <zircon/types.h>
+
+// SocketRing is the receive buffer of a ZX_SOCKET_RING socket: a fixed-size
+// byte ring in a VMO that the kernel keeps committed and mapped for the life
+// of the socket.  Unlike MBufChain it never allocates after creation, and
+// the reader can map the VMO to consume data in place.
+//
+// The head and tail indices live in the ring object and are mirrored into
+// the zx_socket_ring_header_t at the start of the VMO after every change.
+// The mirror is only ever written, never read back, so whatever user space
+// does with its mapping cannot confuse the kernel.
+//
+// Like MBufChain it does no locking of its own.
+class SocketRing {
+public:
+    // Size of the ring proper, not counting the header page.
+    static constexpr size_t kSize = 256 * 1024;
+
+    static zx_status_t Create(fbl::unique_ptr<SocketRing>* ring);
+
+    ~SocketRing();
+
+    // Copies up to |len| bytes from |src| into the free space of the ring and
+    // sets |written| to the number of bytes copied.
+    //
+    // Returns ZX_ERR_SHOULD_WAIT if the ring is full.
+    zx_status_t Write(user_in_ptr<const void> src, size_t len, size_t* written);
+
+    // Copies up to |len| bytes out of the ring into |dst| and consumes them.
+    //
+    // Returns number of bytes read.
+    size_t Read(user_out_ptr<void> dst, size_t len);
+
+    // Consumes up to |len| bytes without copying them anywhere, for readers
+    // that have already looked at them through a mapping of vmo().
+    //
+    // Returns number of bytes consumed.
+    size_t Consume(size_t len);
+
+    bool is_full() const { return size() == kSize; }
+    bool is_empty() const { return size() == 0; }
+
+    // Returns number of bytes stored in the ring.
+    size_t size() const { return static_cast<size_t>(head_ - tail_); }
+
+    // Returns the maximum number of bytes that can be stored in the ring.
+    size_t max_size() const { return kSize; }
+
+    const fbl::RefPtr<VmObject>& vmo() const { return vmo_; }
+
+private:
+    SocketRing(fbl::RefPtr<VmObject> vmo, fbl::RefPtr<VmMapping> mapping);
+
+    char* data() const { return reinterpret_cast<char*>(header_) + ZX_SOCKET_RING_DATA_OFFSET; }
+
+    const fbl::RefPtr<VmObject> vmo_;
+    const fbl::RefPtr<VmMapping> mapping_;
+    zx_socket_ring_header_t* const header_;
+    uint64_t head_ = 0u;
+    uint64_t tail_ = 0u;
+};
@@ -8,10 +8,15 @@
 
 #include <err.h>
 #include <fbl/algorithm.h>
+#include <lib/counters.h>
 #include <stdint.h>
 #include <string.h>
+#include <vm/vm_address_region.h>
+#include <vm/vm_aspace.h>
 #include <zxcpp/new.h>
 
+KCOUNTER(channel_pages_moved, "kernel.channel.pages_moved");
+
 // MessagePackets have special allocation requirements because they can contain a variable number of
 // handles and a variable size payload.
 //
@@ -21,6 +26,10 @@
 //
 // The first buffer in a MessagePacket's BufferChain contains the MessagePacket object, followed by
 // its handles (if any), and finally its payload data (if any).
+//
+// Large messages from user space instead keep their payload in a list of whole pages, starting at
+// the beginning of the first one.  When the reader's buffer is page aligned, those pages can be
+// moved into the reader's address space rather than copied a second time.
 
 // The MessagePacket object, its handles and zx_txid_t must all fit in the first buffer.
 static constexpr size_t kContiguousBytes =
@@ -36,6 +45,14 @@ static inline uint32_t PayloadOffset(uint32_t num_handles) {
     return kHandlesOffset + num_handles * static_cast<uint32_t>(sizeof(Handle*));
 }
 
+uint32_t MessagePacket::paged_min_size_ = kPagedMessageMinSize;
+
+// static
+void MessagePacket::Init(uint32_t paged_min_size) {
+    // A payload smaller than a page has no whole page to move.
+    paged_min_size_ = fbl::max(paged_min_size, static_cast<uint32_t>(PAGE_SIZE));
+}
+
 // Creates a MessagePacket in |msg| sufficient to hold |data_size| bytes and |num_handles|.
 //
 // Note: This method does not write the payload into the MessagePacket.
@@ -44,17 +61,32 @@ static inline uint32_t PayloadOffset(uint32_t num_handles) {
 //
 // static
 inline zx_status_t MessagePacket::CreateCommon(uint32_t data_size, uint32_t num_handles,
+                                               bool paged,
                                                fbl::unique_ptr<MessagePacket>* msg) {
     if (unlikely(data_size > kMaxMessageSize || num_handles > kMaxMessageHandles)) {
         return ZX_ERR_OUT_OF_RANGE;
     }
+    paged = paged && data_size >= paged_min_size_;
 
     const uint32_t payload_offset = PayloadOffset(num_handles);
 
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    if (paged) {
+        const size_t num_pages = ROUNDUP_PAGE_SIZE(data_size) / PAGE_SIZE;
+        if (unlikely(pmm_alloc_pages(num_pages, 0, &pages) != ZX_OK)) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        vm_page_t* page;
+        list_for_every_entry (&pages, page, vm_page_t, queue_node) {
+            page->state = VM_PAGE_STATE_IPC;
+        }
+    }
+
     // MessagePackets lives *inside* a list of buffers.  The first buffer holds the MessagePacket
     // object, followed by its handles (if any), and finally the payload data.
-    BufferChain* chain = BufferChain::Alloc(payload_offset + data_size);
+    BufferChain* chain = BufferChain::Alloc(payload_offset + (paged ? 0 : data_size));
     if (unlikely(!chain)) {
+        pmm_free(&pages);
         return ZX_ERR_NO_MEMORY;
     }
     DEBUG_ASSERT(!chain->buffers()->is_empty());
@@ -66,8 +98,9 @@ inline zx_status_t MessagePacket::CreateCommon(uint32_t data_size, uint32_t num_
     MessagePacket* const packet = reinterpret_cast<MessagePacket*>(data);
     static_assert(kMaxMessageHandles <= UINT16_MAX, "");
     msg->reset(new (packet) MessagePacket(chain, data_size, payload_offset,
-                                          static_cast<uint16_t>(num_handles), handles));
-    // The MessagePacket now owns the BufferChain and msg owns the MessagePacket.
+                                          static_cast<uint16_t>(num_handles), handles, paged));
+    list_move(&pages, &packet->payload_pages_);
+    // The MessagePacket now owns the BufferChain and payload pages, and msg owns the MessagePacket.
 
     return ZX_OK;
 }
@@ -76,23 +109,128 @@ inline zx_status_t MessagePacket::CreateCommon(uint32_t data_size, uint32_t num_
 zx_status_t MessagePacket::Create(user_in_ptr<const void> data, uint32_t data_size,
                                   uint32_t num_handles, fbl::unique_ptr<MessagePacket>* msg) {
     fbl::unique_ptr<MessagePacket> new_msg;
-    zx_status_t status = CreateCommon(data_size, num_handles, &new_msg);
+    zx_status_t status = CreateCommon(data_size, num_handles, true, &new_msg);
+    if (unlikely(status != ZX_OK)) {
+        return status;
+    }
+    status = new_msg->CopyPayloadIn(data, 0, data_size);
+    if (unlikely(status != ZX_OK)) {
+        return status;
+    }
+    *msg = fbl::move(new_msg);
+    return ZX_OK;
+}
+
+// Calls |func| on each of the |num_iovecs| fragments described by |iovecs|, in order, and stops
+// at the first one for which it does not return ZX_OK.  The fragments are copied in a few at a
+// time to keep them off the stack.
+template <typename Func>
+static zx_status_t ForEachIovec(user_in_ptr<const zx_channel_iovec_t> iovecs, uint32_t num_iovecs,
+                                Func func) {
+    if (unlikely(num_iovecs > kMaxMessageIovecs)) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    constexpr uint32_t kChunk = 16u;
+    zx_channel_iovec_t chunk[kChunk];
+    for (uint32_t base = 0; base < num_iovecs; base += kChunk) {
+        const uint32_t count = fbl::min(kChunk, num_iovecs - base);
+        if (unlikely(iovecs.copy_array_from_user(chunk, count, base) != ZX_OK)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            if (unlikely(chunk[i].reserved != 0)) {
+                return ZX_ERR_INVALID_ARGS;
+            }
+            const zx_status_t status = func(chunk[i]);
+            if (unlikely(status != ZX_OK)) {
+                return status;
+            }
+        }
+    }
+    return ZX_OK;
+}
+
+// static
+zx_status_t MessagePacket::IovecSize(user_in_ptr<const zx_channel_iovec_t> iovecs,
+                                     uint32_t num_iovecs, uint32_t* size) {
+    uint64_t total = 0;
+    zx_status_t status = ForEachIovec(iovecs, num_iovecs, [&total](const zx_channel_iovec_t& iov) {
+        total += iov.capacity;
+        return ZX_OK;
+    });
+    if (unlikely(status != ZX_OK)) {
+        return status;
+    }
+    *size = static_cast<uint32_t>(fbl::min<uint64_t>(total, UINT32_MAX));
+    return ZX_OK;
+}
+
+// static
+zx_status_t MessagePacket::Create(user_in_ptr<const zx_channel_iovec_t> iovecs,
+                                  uint32_t num_iovecs, uint32_t num_handles,
+                                  fbl::unique_ptr<MessagePacket>* msg) {
+    uint32_t data_size;
+    zx_status_t status = IovecSize(iovecs, num_iovecs, &data_size);
+    if (unlikely(status != ZX_OK)) {
+        return status;
+    }
+    fbl::unique_ptr<MessagePacket> new_msg;
+    status = CreateCommon(data_size, num_handles, true, &new_msg);
     if (unlikely(status != ZX_OK)) {
         return status;
     }
-    status = new_msg->buffer_chain_->CopyIn(data, PayloadOffset(num_handles), data_size);
+
+    // The fragments are read again from user memory, so they may have changed since they were
+    // sized.  Never copy past the end of the packet, and insist that they still fill it.
+    MessagePacket* packet = new_msg.get();
+    uint32_t copied = 0;
+    status = ForEachIovec(iovecs, num_iovecs, [&](const zx_channel_iovec_t& iov) {
+        if (iov.capacity > data_size - copied) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        auto src = make_user_in_ptr(static_cast<const void*>(iov.buffer));
+        if (packet->CopyPayloadIn(src, copied, iov.capacity) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        copied += iov.capacity;
+        return ZX_OK;
+    });
     if (unlikely(status != ZX_OK)) {
         return status;
     }
+    if (unlikely(copied != data_size)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
     *msg = fbl::move(new_msg);
     return ZX_OK;
 }
 
+zx_status_t MessagePacket::CopyDataTo(user_in_ptr<const zx_channel_iovec_t> iovecs,
+                                      uint32_t num_iovecs) const {
+    uint32_t copied = 0;
+    zx_status_t status = ForEachIovec(iovecs, num_iovecs, [&](const zx_channel_iovec_t& iov) {
+        const uint32_t len = fbl::min(iov.capacity, data_size_ - copied);
+        if (len == 0) {
+            return ZX_OK;
+        }
+        auto dst = make_user_out_ptr(iov.buffer);
+        if (CopyPayloadOut(dst, copied, len) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        copied += len;
+        return ZX_OK;
+    });
+    if (unlikely(status != ZX_OK)) {
+        return status;
+    }
+    return copied == data_size_ ? ZX_OK : ZX_ERR_INVALID_ARGS;
+}
+
 // static
 zx_status_t MessagePacket::Create(const void* data, uint32_t data_size, uint32_t num_handles,
                                   fbl::unique_ptr<MessagePacket>* msg) {
     fbl::unique_ptr<MessagePacket> new_msg;
-    zx_status_t status = CreateCommon(data_size, num_handles, &new_msg);
+    zx_status_t status = CreateCommon(data_size, num_handles, false, &new_msg);
     if (unlikely(status != ZX_OK)) {
         return status;
     }
@@ -104,10 +242,131 @@ zx_status_t MessagePacket::Create(const void* data, uint32_t data_size, uint32_t
     return ZX_OK;
 }
 
+// Walks the payload pages that hold [offset, offset + len) of the payload, calling
+// |func(char* data, size_t len)| on each piece in order until it fails.
+template <typename Func>
+static zx_status_t ForEachPayloadPage(list_node* pages, size_t first_page, size_t offset,
+                                      size_t len, Func func) {
+    size_t page_offset = first_page * PAGE_SIZE;
+    vm_page_t* page;
+    list_for_every_entry (pages, page, vm_page_t, queue_node) {
+        if (len == 0) {
+            break;
+        }
+        if (offset >= page_offset + PAGE_SIZE) {
+            page_offset += PAGE_SIZE;
+            continue;
+        }
+        DEBUG_ASSERT(offset >= page_offset);
+        const size_t in_page = offset - page_offset;
+        const size_t chunk = fbl::min(len, PAGE_SIZE - in_page);
+        char* data = static_cast<char*>(paddr_to_physmap(page->paddr())) + in_page;
+        const zx_status_t status = func(data, chunk);
+        if (unlikely(status != ZX_OK)) {
+            return status;
+        }
+        offset += chunk;
+        len -= chunk;
+        page_offset += PAGE_SIZE;
+    }
+    return len == 0 ? ZX_OK : ZX_ERR_BAD_STATE;
+}
+
+char* MessagePacket::payload_start() const {
+    if (!paged_) {
+        return buffer_chain_->buffers()->front().data() + payload_offset_;
+    }
+    DEBUG_ASSERT(moved_pages_ == 0);
+    list_node* pages = const_cast<list_node*>(&payload_pages_);
+    const vm_page_t* page = list_peek_head_type(pages, vm_page_t, queue_node);
+    return static_cast<char*>(paddr_to_physmap(page->paddr()));
+}
+
+zx_status_t MessagePacket::CopyPayloadIn(user_in_ptr<const void> src, size_t offset, size_t len) {
+    if (!paged_) {
+        return buffer_chain_->CopyIn(src, payload_offset_ + offset, len);
+    }
+    return ForEachPayloadPage(&payload_pages_, moved_pages_, offset, len,
+                              [&src](char* data, size_t chunk) {
+        const zx_status_t status = src.copy_array_from_user(data, chunk);
+        src = src.byte_offset(chunk);
+        return status;
+    });
+}
+
+zx_status_t MessagePacket::CopyPayloadOut(user_out_ptr<void> dst, size_t offset,
+                                          size_t len) const {
+    if (!paged_) {
+        return buffer_chain_->CopyOut(dst, payload_offset_ + offset, len);
+    }
+    return ForEachPayloadPage(const_cast<list_node*>(&payload_pages_), moved_pages_, offset, len,
+                              [&dst](char* data, size_t chunk) {
+        const zx_status_t status = dst.copy_array_to_user(data, chunk);
+        dst = dst.byte_offset(chunk);
+        return status;
+    });
+}
+
+// Sets the state of the first |count| pages on |pages|.
+static void SetPageStates(list_node* pages, size_t count, vm_page_state state) {
+    vm_page_t* page;
+    list_for_every_entry (pages, page, vm_page_t, queue_node) {
+        if (count-- == 0) {
+            break;
+        }
+        page->state = state;
+    }
+}
+
+zx_status_t MessagePacket::CopyDataTo(user_out_ptr<void> buf) {
+    const vaddr_t base = reinterpret_cast<vaddr_t>(buf.get());
+    const size_t whole_pages = data_size_ / PAGE_SIZE;
+    VmAspace* aspace = VmAspace::vaddr_to_aspace(base);
+    if (!paged_ || !IS_PAGE_ALIGNED(base) || whole_pages == 0 || !aspace || !aspace->is_user()) {
+        return CopyPayloadOut(buf, 0, data_size_);
+    }
+
+    // Move the pages that |buf| covers entirely into the mappings behind it, one batch per
+    // mapping so that each mapping's range is unmapped and shot down only once, for as long as
+    // the mappings take them.  Whatever is left gets copied.  Moved pages are mapped in right
+    // away so the reader does not fault on each one.
+    while (moved_pages_ < whole_pages) {
+        const vaddr_t va = base + moved_pages_ * PAGE_SIZE;
+        fbl::RefPtr<VmAddressRegionOrMapping> region = aspace->FindRegion(va);
+        fbl::RefPtr<VmMapping> mapping = region ? region->as_vm_mapping() : nullptr;
+        if (!mapping) {
+            break;
+        }
+
+        const size_t offset = va - mapping->base();
+        const size_t run = fbl::min(whole_pages - moved_pages_,
+                                    (mapping->size() - offset) / PAGE_SIZE);
+        SetPageStates(&payload_pages_, run, VM_PAGE_STATE_ALLOC);
+        size_t replaced = 0;
+        mapping->ReplacePages(offset, &payload_pages_, run, &replaced);
+        SetPageStates(&payload_pages_, run - replaced, VM_PAGE_STATE_IPC);
+        if (replaced == 0) {
+            break;
+        }
+        moved_pages_ = static_cast<uint16_t>(moved_pages_ + replaced);
+        mapping->MapRange(offset, replaced * PAGE_SIZE, false);
+        if (replaced < run) {
+            break;
+        }
+    }
+    kcounter_add(channel_pages_moved, moved_pages_);
+
+    const size_t moved = moved_pages_ * PAGE_SIZE;
+    return CopyPayloadOut(buf.byte_offset(moved), moved, data_size_ - moved);
+}
+
 void MessagePacket::fbl_recycle() {
     // This function invokes the destructor so be careful about taking any references to |this|.
     BufferChain* chain = buffer_chain_;
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    list_move(&payload_pages_, &pages);
     this->~MessagePacket();
     // |this| has been destroyed.
     BufferChain::Free(chain);
+    pmm_free(&pages);
 }
@@ -6,6 +6,7 @@
 
 #include <object/message_packet.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/unique_ptr.h>
 #include <lib/unittest/unittest.h>
 #include <lib/unittest/user_memory.h>
@@ -141,6 +142,125 @@ static bool copy_bad_mem() {
     END_TEST;
 }
 
+// Gather a MessagePacket from several fragments, then scatter it over
+// fragments of different sizes.
+static bool create_iovec() {
+    BEGIN_TEST;
+    // The iovec arrays go at the start of user memory, followed by the
+    // fragments and then the buffer the message is copied out to.
+    constexpr uint32_t kSizes[] = {10, 5000, 3};
+    constexpr uint32_t kTotal = 10 + 5000 + 3;
+    constexpr size_t kDataOffset = PAGE_SIZE;
+    constexpr size_t kOutOffset = 4 * PAGE_SIZE;
+    fbl::unique_ptr<UserMemory> mem = UserMemory::Create(8 * PAGE_SIZE);
+    char* const base = static_cast<char*>(mem->out());
+
+    fbl::AllocChecker ac;
+    auto buf = fbl::unique_ptr<char[]>(new (&ac) char[kTotal]);
+    ASSERT_TRUE(ac.check(), "");
+    for (uint32_t i = 0; i < kTotal; ++i) {
+        buf[i] = static_cast<char>(i % 251);
+    }
+    auto data_out = make_user_out_ptr(static_cast<void*>(base + kDataOffset));
+    ASSERT_EQ(ZX_OK, data_out.copy_array_to_user(buf.get(), kTotal), "");
+
+    zx_channel_iovec_t iovecs[fbl::count_of(kSizes)];
+    size_t offset = 0;
+    for (size_t i = 0; i < fbl::count_of(kSizes); ++i) {
+        iovecs[i] = {base + kDataOffset + offset, kSizes[i], 0};
+        offset += kSizes[i];
+    }
+    auto iovecs_out = make_user_out_ptr(reinterpret_cast<zx_channel_iovec_t*>(base));
+    ASSERT_EQ(ZX_OK, iovecs_out.copy_array_to_user(iovecs, fbl::count_of(iovecs)), "");
+    auto iovecs_in = make_user_in_ptr(reinterpret_cast<const zx_channel_iovec_t*>(base));
+
+    uint32_t size = 0;
+    EXPECT_EQ(ZX_OK, MessagePacket::IovecSize(iovecs_in, fbl::count_of(iovecs), &size), "");
+    EXPECT_EQ(kTotal, size, "");
+
+    fbl::unique_ptr<MessagePacket> mp;
+    ASSERT_EQ(ZX_OK, MessagePacket::Create(iovecs_in, fbl::count_of(iovecs), 2, &mp), "");
+    ASSERT_EQ(kTotal, mp->data_size(), "");
+
+    auto result_buf = fbl::unique_ptr<char[]>(new (&ac) char[kTotal]);
+    ASSERT_TRUE(ac.check(), "");
+    auto out = make_user_out_ptr(static_cast<void*>(base + kOutOffset));
+    ASSERT_EQ(ZX_OK, mp->CopyDataTo(out), "");
+    auto out_in = make_user_in_ptr(static_cast<const void*>(base + kOutOffset));
+    ASSERT_EQ(ZX_OK, out_in.copy_array_from_user(result_buf.get(), kTotal), "");
+    EXPECT_EQ(0, memcmp(buf.get(), result_buf.get(), kTotal), "");
+
+    // Scatter into two fragments that hold more than the message.
+    zx_channel_iovec_t read_iovecs[2] = {
+        {base + kOutOffset, 100, 0},
+        {base + kOutOffset + 100, 6000, 0},
+    };
+    ASSERT_EQ(ZX_OK, iovecs_out.copy_array_to_user(read_iovecs, 2), "");
+    memset(result_buf.get(), 0, kTotal);
+    ASSERT_EQ(ZX_OK, out.copy_array_to_user(result_buf.get(), kTotal), "");
+    ASSERT_EQ(ZX_OK, mp->CopyDataTo(iovecs_in, 2), "");
+    ASSERT_EQ(ZX_OK, out_in.copy_array_from_user(result_buf.get(), kTotal), "");
+    EXPECT_EQ(0, memcmp(buf.get(), result_buf.get(), kTotal), "");
+
+    // Fragments too small for the message.
+    read_iovecs[1].capacity = 10;
+    ASSERT_EQ(ZX_OK, iovecs_out.copy_array_to_user(read_iovecs, 2), "");
+    EXPECT_EQ(ZX_ERR_INVALID_ARGS, mp->CopyDataTo(iovecs_in, 2), "");
+    END_TEST;
+}
+
+// Copy a large MessagePacket out to page aligned memory, where its whole pages
+// are moved rather than copied, and to unaligned memory, where they are not.
+static bool copy_paged() {
+    BEGIN_TEST;
+    constexpr size_t kSize = 5 * PAGE_SIZE + 123;
+    static_assert(kSize >= kPagedMessageMinSize, "");
+    fbl::unique_ptr<UserMemory> src = UserMemory::Create(kSize);
+    fbl::unique_ptr<UserMemory> dst = UserMemory::Create(kSize + PAGE_SIZE);
+    auto src_in = make_user_in_ptr(src->in());
+    auto src_out = make_user_out_ptr(src->out());
+
+    fbl::AllocChecker ac;
+    auto buf = fbl::unique_ptr<char[]>(new (&ac) char[kSize]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kSize; ++i) {
+        buf[i] = static_cast<char>(i % 253);
+    }
+    ASSERT_EQ(ZX_OK, src_out.copy_array_to_user(buf.get(), kSize), "");
+    auto result_buf = fbl::unique_ptr<char[]>(new (&ac) char[kSize]);
+    ASSERT_TRUE(ac.check(), "");
+
+    constexpr size_t kMisalignments[] = {0, 8};
+    for (size_t misalign : kMisalignments) {
+        // Fault the destination in first, so moving pages has to replace them.
+        auto dst_out = make_user_out_ptr(
+            static_cast<void*>(static_cast<char*>(dst->out()) + misalign));
+        auto dst_in = make_user_in_ptr(
+            static_cast<const void*>(static_cast<const char*>(dst->in()) + misalign));
+        memset(result_buf.get(), 'E', kSize);
+        ASSERT_EQ(ZX_OK, dst_out.copy_array_to_user(result_buf.get(), kSize), "");
+
+        fbl::unique_ptr<MessagePacket> mp;
+        ASSERT_EQ(ZX_OK, MessagePacket::Create(src_in, kSize, 0, &mp), "");
+        ASSERT_EQ(ZX_OK, mp->CopyDataTo(dst_out), "");
+        ASSERT_EQ(ZX_OK, dst_in.copy_array_from_user(result_buf.get(), kSize), "");
+        EXPECT_EQ(0, memcmp(buf.get(), result_buf.get(), kSize), "");
+    }
+    END_TEST;
+}
+
+// Attempt to create a MessagePacket from too many fragments.
+static bool create_too_many_iovecs() {
+    BEGIN_TEST;
+    fbl::unique_ptr<UserMemory> mem = UserMemory::Create(PAGE_SIZE);
+    auto iovecs_in = make_user_in_ptr(static_cast<const zx_channel_iovec_t*>(mem->in()));
+
+    fbl::unique_ptr<MessagePacket> mp;
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE,
+              MessagePacket::Create(iovecs_in, kMaxMessageIovecs + 1, 0, &mp), "");
+    END_TEST;
+}
+
 }  // namespace
 
 UNITTEST_START_TESTCASE(message_packet_tests)
@@ -150,4 +270,7 @@ UNITTEST("create_zero", create_zero)
 UNITTEST("create_too_many_handles", create_too_many_handles)
 UNITTEST("create_bad_mem", create_bad_mem)
 UNITTEST("copy_bad_mem", copy_bad_mem)
+UNITTEST("create_iovec", create_iovec)
+UNITTEST("copy_paged", copy_paged)
+UNITTEST("create_too_many_iovecs", create_too_many_iovecs)
 UNITTEST_END_TESTCASE(message_packet_tests, "message_packet", "MessagePacket tests");
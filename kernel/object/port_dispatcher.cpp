@@ -282,31 +282,47 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
 }
 
 zx_status_t PortDispatcher::Dequeue(zx_time_t deadline, zx_port_packet_t* out_packet) {
+    size_t actual;
+    return DequeueBatch(deadline, out_packet, 1u, &actual);
+}
+
+zx_status_t PortDispatcher::DequeueBatch(zx_time_t deadline, zx_port_packet_t* out_packets,
+                                         size_t count, size_t* actual) {
     canary_.Assert();
+    DEBUG_ASSERT(count > 0u);
 
     while (true) {
+        size_t n = 0u;
         if (options_ == ZX_PORT_BIND_TO_INTERRUPT) {
             Guard<SpinLock, IrqSave> guard{&spinlock_};
-            PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
-            if (port_interrupt_packet != nullptr) {
+            PortInterruptPacket* port_interrupt_packet;
+            while (n < count &&
+                   (port_interrupt_packet = interrupt_packets_.pop_front()) != nullptr) {
+                zx_port_packet_t* out_packet = &out_packets[n++];
                 *out_packet = {};
                 out_packet->key = port_interrupt_packet->key;
                 out_packet->type = ZX_PKT_TYPE_INTERRUPT;
                 out_packet->status = ZX_OK;
                 out_packet->interrupt.timestamp = port_interrupt_packet->timestamp;
-                return ZX_OK;
             }
         }
-        {
+        if (n < count) {
             Guard<fbl::Mutex> guard{get_lock()};
-            PortPacket* port_packet = packets_.pop_front();
-            if (port_packet != nullptr) {
+            PortPacket* port_packet;
+            while (n < count && (port_packet = packets_.pop_front()) != nullptr) {
                 --num_packets_;
-                *out_packet = port_packet->packet;
+                out_packets[n++] = port_packet->packet;
                 FreePacket(port_packet);
-                return ZX_OK;
             }
         }
+        if (n > 0u) {
+            // Packets taken beyond the first leave their semaphore counts
+            // behind.  Waiters that pick those up find the queue empty and
+            // go back to waiting, as they already do when a packet is
+            // taken without waiting at all.
+            *actual = n;
+            return ZX_OK;
+        }
 
         {
             ThreadDispatcher::AutoBlocked by(ThreadDispatcher::Blocked::PORT);
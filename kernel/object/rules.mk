@@ -43,6 +43,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/resource.cpp \
     $(LOCAL_DIR)/semaphore.cpp \
     $(LOCAL_DIR)/socket_dispatcher.cpp \
+    $(LOCAL_DIR)/socket_ring.cpp \
     $(LOCAL_DIR)/suspend_token_dispatcher.cpp \
     $(LOCAL_DIR)/thread_dispatcher.cpp \
     $(LOCAL_DIR)/timer_dispatcher.cpp \
@@ -55,8 +56,10 @@ MODULE_SRCS := \
 # Tests
 MODULE_SRCS += \
     $(LOCAL_DIR)/buffer_chain_tests.cpp \
+    $(LOCAL_DIR)/handle_tests.cpp \
     $(LOCAL_DIR)/mbuf_tests.cpp \
     $(LOCAL_DIR)/message_packet_tests.cpp \
+    $(LOCAL_DIR)/socket_ring_tests.cpp \
     $(LOCAL_DIR)/state_tracker_tests.cpp \
 
 MODULE_DEPS := \
@@ -36,6 +36,10 @@ zx_status_t SocketDispatcher::Create(uint32_t flags,
     if (flags & ~ZX_SOCKET_CREATE_MASK)
         return ZX_ERR_INVALID_ARGS;
 
+    // A ring holds a byte stream, so it has no room for datagram boundaries.
+    if ((flags & ZX_SOCKET_RING) && (flags & ZX_SOCKET_DATAGRAM))
+        return ZX_ERR_INVALID_ARGS;
+
     fbl::AllocChecker ac;
 
     zx_signals_t starting_signals = ZX_SOCKET_WRITABLE;
@@ -59,18 +63,33 @@ zx_status_t SocketDispatcher::Create(uint32_t flags,
             return ZX_ERR_NO_MEMORY;
     }
 
+    fbl::unique_ptr<SocketRing> ring0;
+    fbl::unique_ptr<SocketRing> ring1;
+
+    if (flags & ZX_SOCKET_RING) {
+        zx_status_t status = SocketRing::Create(&ring0);
+        if (status != ZX_OK)
+            return status;
+
+        status = SocketRing::Create(&ring1);
+        if (status != ZX_OK)
+            return status;
+    }
+
     auto holder0 = fbl::AdoptRef(new (&ac) PeerHolder<SocketDispatcher>());
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
     auto holder1 = holder0;
 
     auto socket0 = fbl::AdoptRef(new (&ac) SocketDispatcher(fbl::move(holder0), starting_signals,
-                                                            flags, fbl::move(control0)));
+                                                            flags, fbl::move(control0),
+                                                            fbl::move(ring0)));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
     auto socket1 = fbl::AdoptRef(new (&ac) SocketDispatcher(fbl::move(holder1), starting_signals,
-                                                            flags, fbl::move(control1)));
+                                                            flags, fbl::move(control1),
+                                                            fbl::move(ring1)));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
@@ -85,9 +104,11 @@ zx_status_t SocketDispatcher::Create(uint32_t flags,
 
 SocketDispatcher::SocketDispatcher(fbl::RefPtr<PeerHolder<SocketDispatcher>> holder,
                                    zx_signals_t starting_signals, uint32_t flags,
-                                   fbl::unique_ptr<ControlMsg> control_msg)
+                                   fbl::unique_ptr<ControlMsg> control_msg,
+                                   fbl::unique_ptr<SocketRing> ring)
     : PeeredDispatcher(fbl::move(holder), starting_signals),
       flags_(flags),
+      ring_(fbl::move(ring)),
       control_msg_(fbl::move(control_msg)),
       control_msg_len_(0),
       read_threshold_(0),
@@ -256,7 +277,9 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
 
     size_t st = 0u;
     zx_status_t status;
-    if (flags_ & ZX_SOCKET_DATAGRAM) {
+    if (ring_) {
+        status = ring_->Write(src, len, &st);
+    } else if (flags_ & ZX_SOCKET_DATAGRAM) {
         status = data_.WriteDatagram(src, len, &st);
     } else {
         status = data_.WriteStream(src, len, &st);
@@ -271,7 +294,7 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
         if (was_empty)
             set |= ZX_SOCKET_READABLE;
         // Assert signal if we go above the read threshold
-        if ((read_threshold_ > 0) && (data_.size() >= read_threshold_))
+        if ((read_threshold_ > 0) && (data_size() >= read_threshold_))
             set |= ZX_SOCKET_READ_THRESHOLD;
         if (set) {
             UpdateStateLocked(0u, set);
@@ -280,7 +303,7 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
             size_t peer_write_threshold = peer_->write_threshold_;
             // If free space falls below threshold, de-signal
             if ((peer_write_threshold > 0) &&
-                ((data_.max_size() - data_.size()) < peer_write_threshold))
+                ((data_max_size() - data_size()) < peer_write_threshold))
                 clear |= ZX_SOCKET_WRITE_THRESHOLD;
         }
     }
@@ -305,7 +328,7 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
 
     // Just query for bytes outstanding.
     if (!dst && len == 0) {
-        *nread = data_.size(flags_ & ZX_SOCKET_DATAGRAM);
+        *nread = ring_ ? ring_->size() : data_.size(flags_ & ZX_SOCKET_DATAGRAM);
         return ZX_OK;
     }
 
@@ -324,13 +347,49 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
 
     bool was_full = is_full();
 
-    auto st = data_.Read(dst, len, flags_ & ZX_SOCKET_DATAGRAM);
+    size_t st;
+    if (ring_) {
+        st = ring_->Read(dst, len);
+    } else {
+        st = data_.Read(dst, len, flags_ & ZX_SOCKET_DATAGRAM);
+    }
+    UpdateReadSignalsLocked(was_full, st);
+
+    *nread = st;
+    return ZX_OK;
+}
+
+zx_status_t SocketDispatcher::Consume(size_t len, size_t* nconsumed) TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+
+    if (!ring_)
+        return ZX_ERR_NOT_SUPPORTED;
+
+    Guard<fbl::Mutex> guard{get_lock()};
+
+    if (is_empty()) {
+        if (!peer_)
+            return ZX_ERR_PEER_CLOSED;
+        if (read_disabled_)
+            return ZX_ERR_BAD_STATE;
+        return ZX_ERR_SHOULD_WAIT;
+    }
+
+    bool was_full = is_full();
+    size_t st = ring_->Consume(len);
+    UpdateReadSignalsLocked(was_full, st);
+
+    *nconsumed = st;
+    return ZX_OK;
+}
 
+void SocketDispatcher::UpdateReadSignalsLocked(bool was_full, size_t nread)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
     zx_signals_t clear = 0u;
     zx_signals_t set = 0u;
 
     // Deassert signal if we fell below the read threshold
-    if ((read_threshold_ > 0) && (data_.size() < read_threshold_))
+    if ((read_threshold_ > 0) && (data_size() < read_threshold_))
         clear |= ZX_SOCKET_READ_THRESHOLD;
 
     if (is_empty()) {
@@ -345,16 +404,13 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
         // threshold.
         size_t peer_write_threshold = peer_->write_threshold_;
         if (peer_write_threshold > 0 &&
-            ((data_.max_size() - data_.size()) >= peer_write_threshold))
+            ((data_max_size() - data_size()) >= peer_write_threshold))
             set |= ZX_SOCKET_WRITE_THRESHOLD;
-        if (was_full && (st > 0))
+        if (was_full && (nread > 0))
             set |= ZX_SOCKET_WRITABLE;
         if (set)
             peer_->UpdateStateLocked(0u, set);
     }
-
-    *nread = static_cast<size_t>(st);
-    return ZX_OK;
 }
 
 zx_status_t SocketDispatcher::ReadControl(user_out_ptr<void> dst, size_t len,
@@ -383,6 +439,16 @@ zx_status_t SocketDispatcher::ReadControl(user_out_ptr<void> dst, size_t len,
     return ZX_OK;
 }
 
+zx_status_t SocketDispatcher::GetRing(fbl::RefPtr<VmObject>* vmo) {
+    canary_.Assert();
+
+    if (!ring_)
+        return ZX_ERR_NOT_SUPPORTED;
+
+    *vmo = ring_->vmo();
+    return ZX_OK;
+}
+
 zx_status_t SocketDispatcher::CheckShareable(SocketDispatcher* to_send) {
     // We disallow sharing of sockets that support sharing themselves
     // and disallow sharing either end of the socket we're going to
@@ -447,13 +513,13 @@ zx_status_t SocketDispatcher::Accept(HandleOwner* h) TA_NO_THREAD_SAFETY_ANALYSI
 size_t SocketDispatcher::ReceiveBufferMax() const {
     canary_.Assert();
     Guard<fbl::Mutex> guard{get_lock()};
-    return data_.max_size();
+    return data_max_size();
 }
 
 size_t SocketDispatcher::ReceiveBufferSize() const {
     canary_.Assert();
     Guard<fbl::Mutex> guard{get_lock()};
-    return data_.size();
+    return data_size();
 }
 
 // NOTE(abdulla): peer_ is protected by get_lock() while peer_->data_
@@ -464,13 +530,13 @@ size_t SocketDispatcher::ReceiveBufferSize() const {
 size_t SocketDispatcher::TransmitBufferMax() const TA_NO_THREAD_SAFETY_ANALYSIS {
     canary_.Assert();
     Guard<fbl::Mutex> guard{get_lock()};
-    return peer_ ? peer_->data_.max_size() : 0;
+    return peer_ ? peer_->data_max_size() : 0;
 }
 
 size_t SocketDispatcher::TransmitBufferSize() const TA_NO_THREAD_SAFETY_ANALYSIS {
     canary_.Assert();
     Guard<fbl::Mutex> guard{get_lock()};
-    return peer_ ? peer_->data_.size() : 0;
+    return peer_ ? peer_->data_size() : 0;
 }
 
 void SocketDispatcher::GetInfo(zx_info_socket_t* info) const TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -478,10 +544,10 @@ void SocketDispatcher::GetInfo(zx_info_socket_t* info) const TA_NO_THREAD_SAFETY
     Guard<fbl::Mutex> guard{get_lock()};
     *info = zx_info_socket_t{
         .options = flags_,
-        .rx_buf_max = data_.max_size(),
-        .rx_buf_size = data_.size(),
-        .tx_buf_max = peer_ ? peer_->data_.max_size() : 0,
-        .tx_buf_size = peer_ ? peer_->data_.size() : 0,
+        .rx_buf_max = data_max_size(),
+        .rx_buf_size = data_size(),
+        .tx_buf_max = peer_ ? peer_->data_max_size() : 0,
+        .tx_buf_size = peer_ ? peer_->data_size() : 0,
     };
 }
 
@@ -500,14 +566,14 @@ size_t SocketDispatcher::GetWriteThreshold() const TA_NO_THREAD_SAFETY_ANALYSIS
 zx_status_t SocketDispatcher::SetReadThreshold(size_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
     canary_.Assert();
     Guard<fbl::Mutex> guard{get_lock()};
-    if (value > data_.max_size())
+    if (value > data_max_size())
         return ZX_ERR_INVALID_ARGS;
     read_threshold_ = value;
     // Setting 0 disables thresholding. Deassert signal unconditionally.
     if (value == 0) {
         UpdateStateLocked(ZX_SOCKET_READ_THRESHOLD, 0u);
     } else {
-        if (data_.size() >= read_threshold_) {
+        if (data_size() >= read_threshold_) {
             // Assert signal if we have queued data above the read threshold
             UpdateStateLocked(0u, ZX_SOCKET_READ_THRESHOLD);
         } else {
@@ -523,7 +589,7 @@ zx_status_t SocketDispatcher::SetWriteThreshold(size_t value) TA_NO_THREAD_SAFET
     Guard<fbl::Mutex> guard{get_lock()};
     if (peer_ == NULL)
         return ZX_ERR_PEER_CLOSED;
-    if (value > peer_->data_.max_size())
+    if (value > peer_->data_max_size())
         return ZX_ERR_INVALID_ARGS;
     write_threshold_ = value;
     // Setting 0 disables thresholding. Deassert signal unconditionally.
@@ -531,7 +597,7 @@ zx_status_t SocketDispatcher::SetWriteThreshold(size_t value) TA_NO_THREAD_SAFET
         UpdateStateLocked(ZX_SOCKET_WRITE_THRESHOLD, 0u);
     } else {
         // Assert signal if we have available space above the write threshold
-        if ((peer_->data_.max_size() - peer_->data_.size()) >= write_threshold_) {
+        if ((peer_->data_max_size() - peer_->data_size()) >= write_threshold_) {
             // Assert signal if we have available space above the write threshold
             UpdateStateLocked(0u, ZX_SOCKET_WRITE_THRESHOLD);
         } else {
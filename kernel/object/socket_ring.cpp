@@ -0,0 +1,123 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/socket_ring.h>
+
+#include <err.h>
+#include <kernel/atomic.h>
+#include <vm/vm.h>
+#include <vm/vm_aspace.h>
+#include <vm/vm_object_paged.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+
+static_assert(ZX_SOCKET_RING_DATA_OFFSET % PAGE_SIZE == 0,
+              "the ring must start on a page boundary");
+static_assert((SocketRing::kSize & (SocketRing::kSize - 1)) == 0 &&
+                  SocketRing::kSize % PAGE_SIZE == 0,
+              "the ring must be a power of two pages");
+
+// static
+zx_status_t SocketRing::Create(fbl::unique_ptr<SocketRing>* ring) {
+    constexpr uint64_t kVmoSize = ZX_SOCKET_RING_DATA_OFFSET + kSize;
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, kVmoSize, &vmo);
+    if (status != ZX_OK)
+        return status;
+
+    static constexpr char kName[] = "socket-ring";
+    vmo->set_name(kName, sizeof(kName));
+
+    // Commit and map everything up front, so copying in and out of the ring
+    // never has to allocate or fault.
+    uint64_t committed;
+    status = vmo->CommitRange(0, kVmoSize, &committed);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<VmMapping> mapping;
+    status = VmAspace::kernel_aspace()->RootVmar()->CreateVmMapping(
+        0 /* ignored */, kVmoSize, 0 /* align pow2 */, 0 /* vmar flags */,
+        vmo, 0, ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE, kName, &mapping);
+    if (status != ZX_OK)
+        return status;
+
+    status = mapping->MapRange(0, kVmoSize, true);
+    if (status != ZX_OK) {
+        mapping->Destroy();
+        return status;
+    }
+
+    fbl::AllocChecker ac;
+    ring->reset(new (&ac) SocketRing(fbl::move(vmo), mapping));
+    if (!ac.check()) {
+        mapping->Destroy();
+        return ZX_ERR_NO_MEMORY;
+    }
+    return ZX_OK;
+}
+
+SocketRing::SocketRing(fbl::RefPtr<VmObject> vmo, fbl::RefPtr<VmMapping> mapping)
+    : vmo_(fbl::move(vmo)),
+      mapping_(fbl::move(mapping)),
+      header_(reinterpret_cast<zx_socket_ring_header_t*>(mapping_->base())) {
+    header_->size = kSize;
+}
+
+SocketRing::~SocketRing() {
+    mapping_->Destroy();
+}
+
+zx_status_t SocketRing::Write(user_in_ptr<const void> src, size_t len, size_t* written) {
+    if (is_full())
+        return ZX_ERR_SHOULD_WAIT;
+
+    len = fbl::min(len, kSize - size());
+    size_t pos = 0;
+    while (pos < len) {
+        size_t offset = static_cast<size_t>(head_ % kSize);
+        size_t copy_len = fbl::min(len - pos, kSize - offset);
+        if (src.byte_offset(pos).copy_array_from_user(data() + offset, copy_len) != ZX_OK)
+            break;
+        pos += copy_len;
+        head_ += copy_len;
+    }
+
+    if (pos == 0)
+        return ZX_ERR_INVALID_ARGS; // Bad user buffer.
+
+    atomic_store_u64(&header_->head, head_);
+    *written = pos;
+    return ZX_OK;
+}
+
+size_t SocketRing::Read(user_out_ptr<void> dst, size_t len) {
+    len = fbl::min(len, size());
+    size_t pos = 0;
+    while (pos < len) {
+        size_t offset = static_cast<size_t>(tail_ % kSize);
+        size_t copy_len = fbl::min(len - pos, kSize - offset);
+        if (dst.byte_offset(pos).copy_array_to_user(data() + offset, copy_len) != ZX_OK)
+            break;
+        pos += copy_len;
+        tail_ += copy_len;
+    }
+
+    if (pos > 0)
+        atomic_store_u64(&header_->tail, tail_);
+    return pos;
+}
+
+size_t SocketRing::Consume(size_t len) {
+    len = fbl::min(len, size());
+    if (len > 0) {
+        tail_ += len;
+        atomic_store_u64(&header_->tail, tail_);
+    }
+    return len;
+}
@@ -0,0 +1,140 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/socket_ring.h>
+
+#include <string.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <lib/unittest/unittest.h>
+#include <lib/unittest/user_memory.h>
+
+namespace {
+
+using testing::UserMemory;
+
+// Reads the header the ring mirrors into its VMO.
+static bool read_header(const SocketRing& ring, zx_socket_ring_header_t* header) {
+    return ring.vmo()->Read(header, 0, sizeof(*header)) == ZX_OK;
+}
+
+static bool initial_state() {
+    BEGIN_TEST;
+    fbl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+    EXPECT_TRUE(ring->is_empty(), "");
+    EXPECT_FALSE(ring->is_full(), "");
+    EXPECT_EQ(0U, ring->size(), "");
+    EXPECT_EQ(SocketRing::kSize, ring->max_size(), "");
+    EXPECT_EQ(ZX_SOCKET_RING_DATA_OFFSET + SocketRing::kSize, ring->vmo()->size(), "");
+
+    zx_socket_ring_header_t header;
+    ASSERT_TRUE(read_header(*ring, &header), "");
+    EXPECT_EQ(0U, header.head, "");
+    EXPECT_EQ(0U, header.tail, "");
+    EXPECT_EQ(SocketRing::kSize, header.size, "");
+    END_TEST;
+}
+
+// Tests that data written across the end of the ring reads back intact, and
+// that the header follows along.
+static bool write_read_wrap() {
+    BEGIN_TEST;
+    constexpr size_t kLen = SocketRing::kSize / 2 + 100;
+
+    fbl::unique_ptr<UserMemory> mem = UserMemory::Create(kLen);
+    auto mem_in = make_user_in_ptr(mem->in());
+    auto mem_out = make_user_out_ptr(mem->out());
+
+    fbl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+
+    // Move the indices past the middle so the next write has to wrap.
+    size_t written = 0;
+    ASSERT_EQ(ZX_OK, ring->Write(mem_in, kLen, &written), "");
+    ASSERT_EQ(kLen, written, "");
+    ASSERT_EQ(kLen, ring->Read(mem_out, kLen), "");
+    EXPECT_TRUE(ring->is_empty(), "");
+
+    fbl::AllocChecker ac;
+    auto expected = fbl::unique_ptr<char[]>(new (&ac) char[kLen]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kLen; i++)
+        expected[i] = static_cast<char>(i * 7);
+    ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(expected.get(), kLen), "");
+    ASSERT_EQ(ZX_OK, ring->Write(mem_in, kLen, &written), "");
+    ASSERT_EQ(kLen, written, "");
+    EXPECT_EQ(kLen, ring->size(), "");
+
+    zx_socket_ring_header_t header;
+    ASSERT_TRUE(read_header(*ring, &header), "");
+    EXPECT_EQ(2 * kLen, header.head, "");
+    EXPECT_EQ(kLen, header.tail, "");
+
+    ASSERT_EQ(kLen, ring->Read(mem_out, kLen), "");
+    auto actual = fbl::unique_ptr<char[]>(new (&ac) char[kLen]);
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_EQ(ZX_OK, mem_in.copy_array_from_user(actual.get(), kLen), "");
+    EXPECT_EQ(0, memcmp(expected.get(), actual.get(), kLen), "");
+    END_TEST;
+}
+
+// Tests that writes stop exactly when the ring is full.
+static bool write_until_full() {
+    BEGIN_TEST;
+    constexpr size_t kWriteLen = 65536 + 1;
+    fbl::unique_ptr<UserMemory> mem = UserMemory::Create(kWriteLen);
+    auto mem_in = make_user_in_ptr(mem->in());
+
+    fbl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+
+    size_t total_written = 0;
+    size_t written = 0;
+    while (ring->Write(mem_in, kWriteLen, &written) == ZX_OK)
+        total_written += written;
+    EXPECT_TRUE(ring->is_full(), "");
+    EXPECT_EQ(SocketRing::kSize, total_written, "");
+    EXPECT_EQ(SocketRing::kSize, ring->size(), "");
+    EXPECT_EQ(ZX_ERR_SHOULD_WAIT, ring->Write(mem_in, 1, &written), "");
+    END_TEST;
+}
+
+// Tests that Consume discards bytes without copying them and stops at the
+// end of the data.
+static bool consume() {
+    BEGIN_TEST;
+    constexpr size_t kLen = 1000;
+    fbl::unique_ptr<UserMemory> mem = UserMemory::Create(kLen);
+    auto mem_in = make_user_in_ptr(mem->in());
+
+    fbl::unique_ptr<SocketRing> ring;
+    ASSERT_EQ(ZX_OK, SocketRing::Create(&ring), "");
+    EXPECT_EQ(0U, ring->Consume(1), "");
+
+    size_t written = 0;
+    ASSERT_EQ(ZX_OK, ring->Write(mem_in, kLen, &written), "");
+    EXPECT_EQ(400U, ring->Consume(400), "");
+    EXPECT_EQ(kLen - 400, ring->size(), "");
+    EXPECT_EQ(kLen - 400, ring->Consume(kLen), "");
+    EXPECT_TRUE(ring->is_empty(), "");
+
+    zx_socket_ring_header_t header;
+    ASSERT_TRUE(read_header(*ring, &header), "");
+    EXPECT_EQ(kLen, header.head, "");
+    EXPECT_EQ(kLen, header.tail, "");
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(socket_ring_tests)
+UNITTEST("initial_state", initial_state)
+UNITTEST("write_read_wrap", write_read_wrap)
+UNITTEST("write_until_full", write_until_full)
+UNITTEST("consume", consume)
+UNITTEST_END_TESTCASE(socket_ring_tests, "socket_ring", "SocketRing test");
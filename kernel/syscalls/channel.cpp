@@ -127,10 +127,21 @@ static zx_status_t channel_read(zx_handle_t handle_value, uint32_t options,
     if (result != ZX_OK)
         return result;
 
-    // Currently MAY_DISCARD is the only allowable option.
-    if (options & ~ZX_CHANNEL_READ_MAY_DISCARD)
+    if (options & ~(ZX_CHANNEL_READ_MAY_DISCARD | ZX_CHANNEL_READ_USE_IOVEC))
         return ZX_ERR_NOT_SUPPORTED;
 
+    // With USE_IOVEC, |bytes| is an array of |num_bytes| zx_channel_iovec_t
+    // and the space available is the sum of their capacities.
+    const bool use_iovec = (options & ZX_CHANNEL_READ_USE_IOVEC) != 0;
+    const uint32_t num_iovecs = num_bytes;
+    auto iovecs = make_user_in_ptr(
+        reinterpret_cast<const zx_channel_iovec_t*>(bytes.get()));
+    if (use_iovec) {
+        result = MessagePacket::IovecSize(iovecs, num_iovecs, &num_bytes);
+        if (result != ZX_OK)
+            return result;
+    }
+
     fbl::unique_ptr<MessagePacket> msg;
     result = channel->Read(&num_bytes, &num_handles, &msg,
                            options & ZX_CHANNEL_READ_MAY_DISCARD);
@@ -154,7 +165,9 @@ static zx_status_t channel_read(zx_handle_t handle_value, uint32_t options,
         return result;
 
     if (num_bytes > 0u) {
-        if (msg->CopyDataTo(bytes) != ZX_OK)
+        zx_status_t status = use_iovec ? msg->CopyDataTo(iovecs, num_iovecs)
+                                       : msg->CopyDataTo(bytes);
+        if (status != ZX_OK)
             return ZX_ERR_INVALID_ARGS;
     }
 
@@ -283,7 +296,7 @@ zx_status_t sys_channel_write(zx_handle_t handle_value, uint32_t options,
 
     auto up = ProcessDispatcher::GetCurrent();
 
-    if (options != 0u) {
+    if (options & ~ZX_CHANNEL_WRITE_USE_IOVEC) {
         up->RemoveHandles(user_handles, num_handles);
         return ZX_ERR_INVALID_ARGS;
     }
@@ -295,8 +308,16 @@ zx_status_t sys_channel_write(zx_handle_t handle_value, uint32_t options,
         return status;
     }
 
+    // With USE_IOVEC, |user_bytes| is an array of |num_bytes|
+    // zx_channel_iovec_t whose fragments are gathered into the message.
     fbl::unique_ptr<MessagePacket> msg;
-    status = MessagePacket::Create(user_bytes, num_bytes, num_handles, &msg);
+    if (options & ZX_CHANNEL_WRITE_USE_IOVEC) {
+        auto iovecs = make_user_in_ptr(
+            reinterpret_cast<const zx_channel_iovec_t*>(user_bytes.get()));
+        status = MessagePacket::Create(iovecs, num_bytes, num_handles, &msg);
+    } else {
+        status = MessagePacket::Create(user_bytes, num_bytes, num_handles, &msg);
+    }
     if (status != ZX_OK) {
         up->RemoveHandles(user_handles, num_handles);
         return status;
@@ -309,11 +330,12 @@ zx_status_t sys_channel_write(zx_handle_t handle_value, uint32_t options,
             return status;
     }
 
+    const uint32_t msg_size = msg->data_size();
     status = channel->Write(fbl::move(msg));
     if (status != ZX_OK)
         return status;
 
-    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), msg_size, num_handles, 0);
     return ZX_OK;
 }
 
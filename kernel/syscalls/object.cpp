@@ -20,6 +20,7 @@
 
 #include <object/bus_transaction_initiator_dispatcher.h>
 #include <object/diagnostics.h>
+#include <object/fifo_dispatcher.h>
 #include <object/handle.h>
 #include <object/job_dispatcher.h>
 #include <object/process_dispatcher.h>
@@ -731,6 +732,24 @@ zx_status_t sys_object_get_property(zx_handle_t handle_value, uint32_t property,
         size_t value = socket->GetWriteThreshold();
         return _value.reinterpret<size_t>().copy_to_user(value);
     }
+    case ZX_PROP_FIFO_RX_THRESHOLD: {
+        if (size < sizeof(size_t))
+            return ZX_ERR_BUFFER_TOO_SMALL;
+        auto fifo = DownCastDispatcher<FifoDispatcher>(&dispatcher);
+        if (!fifo)
+            return ZX_ERR_WRONG_TYPE;
+        size_t value = fifo->GetReadThreshold();
+        return _value.reinterpret<size_t>().copy_to_user(value);
+    }
+    case ZX_PROP_FIFO_TX_THRESHOLD: {
+        if (size < sizeof(size_t))
+            return ZX_ERR_BUFFER_TOO_SMALL;
+        auto fifo = DownCastDispatcher<FifoDispatcher>(&dispatcher);
+        if (!fifo)
+            return ZX_ERR_WRONG_TYPE;
+        size_t value = fifo->GetWriteThreshold();
+        return _value.reinterpret<size_t>().copy_to_user(value);
+    }
     case ZX_PROP_CHANNEL_TX_MSG_MAX: {
         if (size < sizeof(size_t)) {
             return ZX_ERR_BUFFER_TOO_SMALL;
@@ -852,6 +871,30 @@ zx_status_t sys_object_set_property(zx_handle_t handle_value, uint32_t property,
             return status;
         return socket->SetWriteThreshold(value);
     }
+    case ZX_PROP_FIFO_RX_THRESHOLD: {
+        if (size < sizeof(size_t))
+            return ZX_ERR_BUFFER_TOO_SMALL;
+        auto fifo = DownCastDispatcher<FifoDispatcher>(&dispatcher);
+        if (!fifo)
+            return ZX_ERR_WRONG_TYPE;
+        size_t value = 0;
+        zx_status_t status = _value.reinterpret<const size_t>().copy_from_user(&value);
+        if (status != ZX_OK)
+            return status;
+        return fifo->SetReadThreshold(value);
+    }
+    case ZX_PROP_FIFO_TX_THRESHOLD: {
+        if (size < sizeof(size_t))
+            return ZX_ERR_BUFFER_TOO_SMALL;
+        auto fifo = DownCastDispatcher<FifoDispatcher>(&dispatcher);
+        if (!fifo)
+            return ZX_ERR_WRONG_TYPE;
+        size_t value = 0;
+        zx_status_t status = _value.reinterpret<const size_t>().copy_from_user(&value);
+        if (status != ZX_OK)
+            return status;
+        return fifo->SetWriteThreshold(value);
+    }
     case ZX_PROP_JOB_KILL_ON_OOM: {
         auto job = DownCastDispatcher<JobDispatcher>(&dispatcher);
         if (!job)
@@ -17,6 +17,7 @@
 #include <object/handle.h>
 #include <object/process_dispatcher.h>
 #include <object/socket_dispatcher.h>
+#include <object/vm_object_dispatcher.h>
 
 #include <zircon/syscalls/policy.h>
 #include <fbl/ref_ptr.h>
@@ -94,7 +95,8 @@ zx_status_t sys_socket_read(zx_handle_t handle, uint32_t options,
                             user_out_ptr<size_t> actual) {
     LTRACEF("handle %x\n", handle);
 
-    if (!buffer && size > 0)
+    // ZX_SOCKET_CONSUME takes only a byte count.
+    if (!buffer && size > 0 && options != ZX_SOCKET_CONSUME)
         return ZX_ERR_INVALID_ARGS;
 
     auto up = ProcessDispatcher::GetCurrent();
@@ -113,6 +115,9 @@ zx_status_t sys_socket_read(zx_handle_t handle, uint32_t options,
     case ZX_SOCKET_CONTROL:
         status = socket->ReadControl(buffer, size, &nread);
         break;
+    case ZX_SOCKET_CONSUME:
+        status = socket->Consume(size, &nread);
+        break;
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -173,3 +178,31 @@ zx_status_t sys_socket_accept(zx_handle_t handle, user_out_handle* out) {
 
     return out->transfer(fbl::move(outhandle));
 }
+
+// zx_status_t zx_socket_get_ring
+zx_status_t sys_socket_get_ring(zx_handle_t handle, uint32_t options, user_out_handle* out) {
+    if (options != 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<SocketDispatcher> socket;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &socket);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<VmObject> vmo;
+    status = socket->GetRing(&vmo);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    status = VmObjectDispatcher::Create(fbl::move(vmo), &dispatcher, &rights);
+    if (status != ZX_OK)
+        return status;
+
+    // The ring may be mapped and read, but only the kernel writes to it.
+    rights &= ~(ZX_RIGHT_WRITE | ZX_RIGHT_EXECUTE | ZX_RIGHT_SET_PROPERTY);
+    return out->make(fbl::move(dispatcher), rights);
+}
@@ -11,6 +11,7 @@
 #include <debug.h>
 #include <err.h>
 #include <fbl/algorithm.h>
+#include <fbl/atomic.h>
 #include <fbl/mutex.h>
 #include <inttypes.h>
 #include <kernel/event.h>
@@ -785,6 +786,95 @@ __NO_INLINE static void affinity_test() {
     printf("done with affinity test\n");
 }
 
+struct steal_test_worker {
+    thread_t* thread;
+    fbl::atomic<cpu_mask_t> ran_on;
+};
+
+static fbl::atomic<bool> steal_test_stop;
+
+static int steal_test_thread(void* arg) {
+    auto worker = static_cast<steal_test_worker*>(arg);
+
+    while (!steal_test_stop.load()) {
+        worker->ran_on.fetch_or(cpu_num_to_mask(arch_curr_cpu_num()));
+    }
+    return 0;
+}
+
+// queue a pile of runnable threads on one cpu and then let them run anywhere. the
+// scheduler leaves ready threads where they are when their affinity widens, so they
+// only spread out if idle cpus steal them or the balancer pulls them over. a thread
+// that stays pinned to the loaded cpu must never be moved.
+__NO_INLINE static void steal_test() {
+    printf("starting work stealing test\n");
+
+    cpu_mask_t online = mp_get_online_mask();
+    if (!online || ispow2(online)) {
+        printf("aborting test, not enough online cpus\n");
+        return;
+    }
+
+    // load up a cpu other than ours; we go idle below, which gives us a chance to steal
+    cpu_num_t curr = arch_curr_cpu_num();
+    cpu_num_t loaded = curr;
+    do {
+        loaded = (loaded + 1) % SMP_MAX_CPUS;
+    } while (!(online & cpu_num_to_mask(loaded)));
+
+    // with a third cpu around, keep the workers off one more cpu to check that stealing
+    // and balancing honor the affinity mask
+    cpu_mask_t allowed = online;
+    for (cpu_num_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if ((online & cpu_num_to_mask(i)) && i != curr && i != loaded) {
+            allowed &= ~cpu_num_to_mask(i);
+            break;
+        }
+    }
+
+    static steal_test_worker workers[6];
+    steal_test_worker* pinned = &workers[0];
+    steal_test_stop.store(false);
+    for (auto& w : workers) {
+        w.ran_on.store(0);
+        w.thread = thread_create("steal_tester", &steal_test_thread, &w, LOW_PRIORITY);
+        ASSERT(w.thread);
+        thread_set_cpu_affinity(w.thread, cpu_num_to_mask(loaded));
+    }
+    for (auto& w : workers) {
+        thread_resume(w.thread);
+    }
+
+    for (auto& w : workers) {
+        if (&w != pinned) {
+            thread_set_cpu_affinity(w.thread, allowed);
+        }
+    }
+
+    // idle this cpu for a while so it steals, and let the balancer run a few times
+    thread_sleep_relative(ZX_MSEC(500));
+
+    steal_test_stop.store(true);
+    for (auto& w : workers) {
+        thread_join(w.thread, nullptr, ZX_TIME_INFINITE);
+    }
+
+    cpu_mask_t moved = 0;
+    for (auto& w : workers) {
+        cpu_mask_t ran_on = w.ran_on.load();
+        printf("worker %td ran on cpus %#x\n", &w - workers, ran_on);
+        if (&w == pinned) {
+            ASSERT(ran_on == cpu_num_to_mask(loaded));
+        } else {
+            ASSERT((ran_on & ~allowed) == 0);
+            moved |= ran_on & ~cpu_num_to_mask(loaded);
+        }
+    }
+    ASSERT_MSG(moved != 0, "no thread left cpu %u\n", loaded);
+
+    printf("done with work stealing test\n");
+}
+
 #define TLS_TEST_TAGV   ((void*)0x666)
 
 static void tls_test_callback(void *tls) {
@@ -924,6 +1014,8 @@ int thread_tests(int, const cmd_args*, uint32_t) {
 
     affinity_test();
 
+    steal_test();
+
     tls_tests();
 
     priority_test();
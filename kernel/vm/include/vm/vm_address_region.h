@@ -426,10 +426,18 @@ public:
     uint64_t object_offset() const { return object_offset_; }
     const fbl::RefPtr<VmObject>& vmo() const { return object_; }
 
+    // Size of the large pages used to map physically contiguous objects.
+    static constexpr size_t kLargePageSize = 1ul << 21;
+
     // Convenience wrapper for vmo()->DecommitRange() with the necessary
     // offset modification and locking.
     zx_status_t DecommitRange(size_t offset, size_t len, size_t* decommitted);
 
+    // Convenience wrapper for vmo()->ReplacePages() with the necessary offset
+    // modification and locking.  |count| is clamped to the end of the mapping.
+    // Fails with ZX_ERR_ACCESS_DENIED if the mapping is not writable.
+    zx_status_t ReplacePages(size_t offset, list_node* pages, size_t count, size_t* replaced);
+
     // Map in pages from the underlying vm object, optionally committing pages as it goes
     zx_status_t MapRange(size_t offset, size_t len, bool commit);
 
@@ -493,6 +501,13 @@ private:
     // in Clang around capability aliasing, we need to relax the analysis.
     void ActivateLocked();
 
+    // Maps the whole large page containing |va| when the object is physically
+    // contiguous and the page fits this mapping, with |pa| the physical address
+    // backing |va|.  Returns false if the caller should map a single page
+    // instead.  Requires the object_ lock, with the same annotation caveat as
+    // ActivateLocked().
+    bool MapLargePageLocked(vaddr_t va, paddr_t pa);
+
     // pointer and region of the object we are mapping
     fbl::RefPtr<VmObject> object_;
     uint64_t object_offset_ = 0;
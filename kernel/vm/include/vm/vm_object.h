@@ -84,6 +84,17 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // Moves up to |count| pages off the head of |pages| into the object at
+    // consecutive pages starting at the page aligned |offset|, freeing the
+    // pages they replace, with the same effect as writing those pages.  The
+    // range is unmapped once for the whole batch.  The pages must be in the
+    // ALLOC state.  |replaced| is set to the number of pages moved; the caller
+    // keeps the rest.  Fails without moving any pages if none can be moved.
+    virtual zx_status_t ReplacePages(uint64_t offset, list_node* pages, size_t count,
+                                     size_t* replaced) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     // Unpin the given range of the vmo.  This asserts if it tries to unpin a
     // page that is already not pinned (do not expose this function to
     // usermode).
@@ -63,6 +63,9 @@ public:
     zx_status_t Pin(uint64_t offset, uint64_t len) override;
     void Unpin(uint64_t offset, uint64_t len) override;
 
+    zx_status_t ReplacePages(uint64_t offset, list_node* pages, size_t count,
+                             size_t* replaced) override;
+
     zx_status_t Read(void* ptr, uint64_t offset, size_t len) override;
     zx_status_t Write(const void* ptr, uint64_t offset, size_t len) override;
     zx_status_t Lookup(uint64_t offset, uint64_t len, uint pf_flags,
@@ -8,15 +8,15 @@
 
 #include <err.h>
 #include <fbl/canary.h>
-#include <fbl/intrusive_wavl_tree.h>
 #include <fbl/macros.h>
-#include <fbl/unique_ptr.h>
+#include <fbl/type_support.h>
 #include <vm/vm.h>
 #include <zircon/types.h>
 
 struct vm_page;
 
-class VmPageListNode final : public fbl::WAVLTreeContainable<fbl::unique_ptr<VmPageListNode>> {
+// leaf of the VmPageList radix tree, holding kPageFanOut consecutive pages
+class VmPageListNode final {
 public:
     explicit VmPageListNode(uint64_t offset);
     ~VmPageListNode();
@@ -27,7 +27,6 @@ public:
 
     // accessors
     uint64_t offset() const { return obj_offset_; }
-    uint64_t GetKey() const { return obj_offset_; }
 
     // for every valid page in the node call the passed in function
     template <typename T>
@@ -101,6 +100,38 @@ private:
     vm_page* pages_[kPageFanOut] = {};
 };
 
+// interior node of the VmPageList radix tree. on the lowest interior level the
+// children are leaf VmPageListNodes, above that they are further interior nodes.
+class VmPageListInnerNode final {
+public:
+    VmPageListInnerNode();
+    ~VmPageListInnerNode();
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageListInnerNode);
+
+    static const size_t kFanOutShift = 6;
+    static const size_t kFanOut = 1u << kFanOutShift;
+
+private:
+    friend class VmPageList;
+
+    union Child {
+        VmPageListInnerNode* inner;
+        VmPageListNode* leaf;
+    };
+
+    fbl::Canary<fbl::magic("PLIN")> canary_;
+
+    // number of non null children
+    size_t count_ = 0;
+    Child children_[kFanOut] = {};
+};
+
+// list of the pages of a VmObjectPaged, indexed by offset.
+//
+// implemented as a radix tree whose height grows with the highest offset in use,
+// so looking up a page in even a multi-GB object is a handful of array indexing
+// steps rather than a search through a balanced tree.
 class VmPageList final {
 public:
     VmPageList();
@@ -108,92 +139,125 @@ public:
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageList);
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page
     template <typename T>
     zx_status_t ForEveryPage(T per_page_func) {
-        for (auto& pl : list_) {
-            zx_status_t status = pl.ForEveryPage(per_page_func, pl.offset(),
-                                                 pl.offset() + pl.kPageFanOut * PAGE_SIZE);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryPageInRange(per_page_func, 0, kMaxOffset);
     }
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page
     template <typename T>
     zx_status_t ForEveryPage(T per_page_func) const {
-        for (auto& pl : list_) {
-            zx_status_t status = pl.ForEveryPage(per_page_func, pl.offset(),
-                                                 pl.offset() + pl.kPageFanOut * PAGE_SIZE);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryPageInRange(per_page_func, 0, kMaxOffset);
     }
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page in
+    // [start_offset, end_offset)
     template <typename T>
     zx_status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) {
         DEBUG_ASSERT(IS_PAGE_ALIGNED(start_offset) && IS_PAGE_ALIGNED(end_offset));
-        // Find the first node with a start after start_offset; if start_offset
-        // is in a node, it'll be in the one before it.
-        auto start = --list_.upper_bound(start_offset);
-        if (!start.IsValid()) {
-            start = list_.begin();
+        if (!root_) {
+            return ZX_OK;
         }
-        const auto end = list_.lower_bound(end_offset);
-        for (auto itr = start; itr != end; ++itr) {
-            auto& pl = *itr;
-            zx_status_t status = pl.ForEveryPage(per_page_func, start_offset, end_offset);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        zx_status_t status = ForEveryPageInNode(root_, height_, 0, per_page_func,
+                                                start_offset, end_offset);
+        return (status == ZX_ERR_NEXT || status == ZX_ERR_STOP) ? ZX_OK : status;
     }
 
     template <typename T>
     zx_status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset,
                                     uint64_t end_offset) const {
         DEBUG_ASSERT(IS_PAGE_ALIGNED(start_offset) && IS_PAGE_ALIGNED(end_offset));
-        // Find the first node with a start after start_offset; if start_offset
-        // is in a node, it'll be in the one before it.
-        auto start = --list_.upper_bound(start_offset);
-        if (!start.IsValid()) {
-            start = list_.begin();
+        if (!root_) {
+            return ZX_OK;
         }
-        const auto end = list_.lower_bound(end_offset);
-        for (auto itr = start; itr != end; ++itr) {
-            auto& pl = *itr;
-            zx_status_t status = pl.ForEveryPage(per_page_func, start_offset, end_offset);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        const VmPageListInnerNode* root = root_;
+        zx_status_t status = ForEveryPageInNode(root, height_, 0, per_page_func,
+                                                start_offset, end_offset);
+        return (status == ZX_ERR_NEXT || status == ZX_ERR_STOP) ? ZX_OK : status;
     }
 
     zx_status_t AddPage(vm_page*, uint64_t offset);
     vm_page* GetPage(uint64_t offset);
     zx_status_t FreePage(uint64_t offset);
+    // put |p| at |offset|, returning the page it displaces (or nullptr) in |old|
+    zx_status_t ReplacePage(vm_page* p, uint64_t offset, vm_page** old);
+    // free every page in [start_offset, end_offset), returning how many were freed
+    size_t FreePages(uint64_t start_offset, uint64_t end_offset);
     size_t FreeAllPages();
     bool IsEmpty();
 
 private:
-    fbl::WAVLTree<uint64_t, fbl::unique_ptr<VmPageListNode>> list_;
+    // largest page aligned offset, used as the exclusive end of whole tree walks
+    static const uint64_t kMaxOffset = ~static_cast<uint64_t>(PAGE_SIZE - 1);
+
+    // each leaf covers kPageFanOut pages
+    static const uint kLeafShift = PAGE_SIZE_SHIFT + 4;
+    static_assert((1u << (kLeafShift - PAGE_SIZE_SHIFT)) == VmPageListNode::kPageFanOut, "");
+
+    // interior levels are numbered from 1, the level whose children are leaves.
+    // each child of a node on |level| covers 1 << ChildShift(level) bytes.
+    static constexpr uint ChildShift(uint level) {
+        return kLeafShift + (level - 1) * VmPageListInnerNode::kFanOutShift;
+    }
+    static size_t ChildIndex(uint64_t offset, uint level) {
+        return (offset >> ChildShift(level)) & (VmPageListInnerNode::kFanOut - 1);
+    }
+
+    // whether |offset| can be stored without adding levels to the tree
+    bool InRange(uint64_t offset) const {
+        uint shift = ChildShift(height_) + VmPageListInnerNode::kFanOutShift;
+        return shift >= 64 || (offset >> shift) == 0;
+    }
+
+    VmPageListNode* FindLeaf(uint64_t offset) const;
+    void PrunePath(uint64_t offset);
+    bool PruneRange(VmPageListInnerNode* node, uint level, uint64_t node_base,
+                    uint64_t start_offset, uint64_t end_offset);
+    void DeleteTree(VmPageListInnerNode* node, uint level);
+
+    template <typename Node, typename T>
+    static zx_status_t ForEveryPageInNode(Node* node, uint level, uint64_t node_base,
+                                          T& per_page_func, uint64_t start_offset,
+                                          uint64_t end_offset) {
+        using Leaf = typename fbl::conditional<fbl::is_const<Node>::value,
+                                               const VmPageListNode, VmPageListNode>::type;
+        using Inner = typename fbl::conditional<fbl::is_const<Node>::value,
+                                                const VmPageListInnerNode,
+                                                VmPageListInnerNode>::type;
+
+        const uint shift = ChildShift(level);
+        size_t first = 0;
+        if (start_offset > node_base) {
+            first = static_cast<size_t>((start_offset - node_base) >> shift);
+        }
+        for (size_t i = first; i < VmPageListInnerNode::kFanOut; i++) {
+            uint64_t child_base = node_base + (static_cast<uint64_t>(i) << shift);
+            if (child_base >= end_offset) {
+                break;
+            }
+
+            zx_status_t status = ZX_ERR_NEXT;
+            if (level == 1) {
+                Leaf* leaf = node->children_[i].leaf;
+                if (leaf) {
+                    status = leaf->ForEveryPage(per_page_func, start_offset, end_offset);
+                }
+            } else {
+                Inner* inner = node->children_[i].inner;
+                if (inner) {
+                    status = ForEveryPageInNode(inner, level - 1, child_base, per_page_func,
+                                                start_offset, end_offset);
+                }
+            }
+            if (unlikely(status != ZX_ERR_NEXT)) {
+                return status;
+            }
+        }
+        return ZX_ERR_NEXT;
+    }
+
+    // interior levels in the tree, 0 when the list is empty
+    uint height_ = 0;
+    VmPageListInnerNode* root_ = nullptr;
 };
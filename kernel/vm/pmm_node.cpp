@@ -7,6 +7,7 @@
 
 #include <inttypes.h>
 #include <kernel/mp.h>
+#include <lib/counters.h>
 #include <trace.h>
 #include <vm/bootalloc.h>
 #include <vm/physmap.h>
@@ -18,6 +19,13 @@
 
 namespace {
 
+// counts single page allocations satisfied by the local cpu's free page cache.
+KCOUNTER(pmm_cache_hit, "kernel.pmm.cache.hit");
+// counts refills of a cpu's free page cache from the global free list.
+KCOUNTER(pmm_cache_refill, "kernel.pmm.cache.refill");
+// counts batches of pages flushed from a full cpu cache to the global free list.
+KCOUNTER(pmm_cache_flush, "kernel.pmm.cache.flush");
+
 void set_state_alloc(vm_page* page) {
     LTRACEF("page %p: prev state %s\n", page, page_state_to_string(page->state));
 
@@ -91,24 +99,164 @@ void PmmNode::AddFreePages(list_node* list) TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACEF("free count now %" PRIu64 "\n", free_count_);
 }
 
-zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
-    Guard<fbl::Mutex> guard{&lock_};
+// Each cpu keeps a small cache of free pages so that the common single page
+// allocations and frees, e.g. when faulting in fresh VMO pages, only take an
+// uncontended per cpu spinlock. Caches are refilled from and flushed to the
+// global free list kCacheBatch pages at a time under lock_.
+PmmNode::CpuCache* PmmNode::LocalCache() {
+    // a thread may migrate after picking a cache; that's harmless since the
+    // cache is locked anyway, it just costs a little locality
+    return &cpu_caches_[arch_curr_cpu_num()];
+}
+
+// move up to |count| pages from the local cache to |list|, returning how many were moved
+size_t PmmNode::AllocFromCache(size_t count, list_node* list) {
+    CpuCache* cache = LocalCache();
+    size_t taken = 0;
+
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+    while (taken < count) {
+        vm_page* page = list_remove_head_type(&cache->free_list, vm_page, queue_node);
+        if (!page) {
+            break;
+        }
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+        cache->count--;
+        list_add_tail(list, &page->queue_node);
+        taken++;
+    }
+    cached_count_.fetch_sub(taken);
+    return taken;
+}
+
+// the local cache ran dry, take a batch from the global free list, hand one page
+// to the caller and park the rest in the cache
+zx_status_t PmmNode::RefillCacheAndAlloc(vm_page** page_out) {
+    list_node batch = LIST_INITIAL_VALUE(batch);
+    size_t count = 0;
+
+    {
+        Guard<fbl::Mutex> guard{&lock_};
+
+        // other cpus' caches count as free memory; take them back rather than fail
+        if (list_is_empty(&free_list_)) {
+            DrainCachesLocked();
+        }
+
+        while (count < kCacheBatch) {
+            vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
+            if (!page) {
+                break;
+            }
+
+            DEBUG_ASSERT(free_count_ > 0);
+            free_count_--;
+
+            DEBUG_ASSERT(page->is_free());
+            set_state_alloc(page);
+
+#if PMM_ENABLE_FREE_FILL
+            CheckFreeFill(page);
+#endif
+            list_add_tail(&batch, &page->queue_node);
+            count++;
+        }
+    }
 
-    vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
-    if (!page) {
+    if (count == 0) {
         return ZX_ERR_NO_MEMORY;
     }
 
-    DEBUG_ASSERT(free_count_ > 0);
-    free_count_--;
+    kcounter_add(pmm_cache_refill, 1);
+    *page_out = list_remove_head_type(&batch, vm_page, queue_node);
+    count--;
+
+    if (count > 0) {
+        CpuCache* cache = LocalCache();
+        Guard<SpinLock, IrqSave> guard{&cache->lock};
+        list_splice_after(&batch, &cache->free_list);
+        cache->count += count;
+        cached_count_.fetch_add(count);
+    }
 
-    DEBUG_ASSERT(page->is_free());
+    return ZX_OK;
+}
 
-    set_state_alloc(page);
+// put the pages in |list| into the local cache. if that overflows the cache, the
+// oldest kCacheBatch pages go back to the global free list.
+void PmmNode::FreeToCache(list_node* list) {
+    list_node flush = LIST_INITIAL_VALUE(flush);
+    size_t added = 0;
+
+    {
+        CpuCache* cache = LocalCache();
+        Guard<SpinLock, IrqSave> guard{&cache->lock};
+
+        vm_page* page;
+        while ((page = list_remove_head_type(list, vm_page, queue_node)) != nullptr) {
+            DEBUG_ASSERT(page->state != VM_PAGE_STATE_OBJECT || page->object.pin_count == 0);
+            DEBUG_ASSERT(!page->is_free());
 
 #if PMM_ENABLE_FREE_FILL
-    CheckFreeFill(page);
+            FreeFill(page);
 #endif
+            page->state = VM_PAGE_STATE_ALLOC;
+
+            // recently freed pages go to the head, they are the most likely to still be cached
+            list_add_head(&cache->free_list, &page->queue_node);
+            cache->count++;
+            added++;
+
+            if (cache->count > kCacheMax) {
+                for (size_t i = 0; i < kCacheBatch; i++) {
+                    vm_page* old = list_remove_tail_type(&cache->free_list, vm_page, queue_node);
+                    list_add_tail(&flush, &old->queue_node);
+                }
+                cache->count -= kCacheBatch;
+                added -= kCacheBatch;
+            }
+        }
+        cached_count_.fetch_add(added);
+    }
+
+    if (!list_is_empty(&flush)) {
+        kcounter_add(pmm_cache_flush, 1);
+        Guard<fbl::Mutex> guard{&lock_};
+        FreeListLocked(&flush);
+    }
+}
+
+// return every cached page to the global free list, so that searches for specific
+// or contiguous pages can see them
+void PmmNode::DrainCachesLocked() {
+    for (auto& cache : cpu_caches_) {
+        list_node pages = LIST_INITIAL_VALUE(pages);
+        {
+            Guard<SpinLock, IrqSave> guard{&cache.lock};
+            if (cache.count == 0) {
+                continue;
+            }
+            list_move(&cache.free_list, &pages);
+            cached_count_.fetch_sub(cache.count);
+            cache.count = 0;
+        }
+        FreeListLocked(&pages);
+    }
+}
+
+zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
+    vm_page* page;
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    if (AllocFromCache(1, &list) == 1) {
+        kcounter_add(pmm_cache_hit, 1);
+        page = list_remove_head_type(&list, vm_page, queue_node);
+    } else {
+        zx_status_t status = RefillCacheAndAlloc(&page);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
 
     if (pa_out) {
         *pa_out = page->paddr();
@@ -133,11 +281,27 @@ zx_status_t PmmNode::AllocPages(size_t count, uint alloc_flags, list_node* list)
         return ZX_OK;
     }
 
+    // bulk fast path: take what the local cache has first, the rest comes from the
+    // global free list under a single acquisition of the lock
+    count -= AllocFromCache(count, list);
+    if (count == 0) {
+        return ZX_OK;
+    }
+
     Guard<fbl::Mutex> guard{&lock_};
 
+    bool drained = false;
     while (count > 0) {
         vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
         if (unlikely(!page)) {
+            // other cpus' caches count as free memory; take them back and retry
+            // before giving up
+            if (!drained) {
+                drained = true;
+                DrainCachesLocked();
+                continue;
+            }
+
             // free pages that have already been allocated
             FreeListLocked(list);
             return ZX_ERR_NO_MEMORY;
@@ -178,6 +342,10 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
 
     Guard<fbl::Mutex> guard{&lock_};
 
+    // the per cpu caches hold on to free pages without them looking free, so put
+    // them back before searching for specific pages
+    DrainCachesLocked();
+
     // walk through the arenas, looking to see if the physical page belongs to it
     for (auto& a : arena_list_) {
         while (allocated < count && a.address_in_arena(address)) {
@@ -232,6 +400,10 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
 
     Guard<fbl::Mutex> guard{&lock_};
 
+    // the per cpu caches hold on to free pages without them looking free, so put
+    // them back before searching for a run
+    DrainCachesLocked();
+
     for (auto& a : arena_list_) {
         vm_page_t* p = a.FindFreeContiguous(count, alignment_log2);
         if (!p) {
@@ -291,9 +463,16 @@ void PmmNode::FreePageLocked(vm_page* page) {
 }
 
 void PmmNode::FreePage(vm_page* page) {
-    Guard<fbl::Mutex> guard{&lock_};
+    LTRACEF("page %p state %u paddr %#" PRIxPTR "\n", page, page->state, page->paddr());
 
-    FreePageLocked(page);
+    // remove it from its old queue
+    if (list_in_list(&page->queue_node)) {
+        list_delete(&page->queue_node);
+    }
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    list_add_tail(&list, &page->queue_node);
+    FreeToCache(&list);
 }
 
 void PmmNode::FreeListLocked(list_node* list) {
@@ -307,6 +486,15 @@ void PmmNode::FreeListLocked(list_node* list) {
 }
 
 void PmmNode::FreeList(list_node* list) {
+    DEBUG_ASSERT(list);
+
+    // small lists, such as a handful of pages from a short lived VMO, go through
+    // the local cache. big ones would only be flushed straight back out of it.
+    if (list_length(list) <= kCacheBatch) {
+        FreeToCache(list);
+        return;
+    }
+
     Guard<fbl::Mutex> guard{&lock_};
 
     FreeListLocked(list);
@@ -314,7 +502,7 @@ void PmmNode::FreeList(list_node* list) {
 
 // okay if accessed outside of a lock
 uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS {
-    return free_count_;
+    return free_count_ + cached_count_.load();
 }
 
 uint64_t PmmNode::CountTotalBytes() const TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -338,8 +526,9 @@ void PmmNode::DumpFree() const TA_NO_THREAD_SAFETY_ANALYSIS {
 void PmmNode::Dump(bool is_panic) const {
     // No lock analysis here, as we want to just go for it in the panic case without the lock.
     auto dump = [this]() TA_NO_THREAD_SAFETY_ANALYSIS {
-        printf("pmm node %p: free_count %zu (%zu bytes), total size %zu\n",
-               this, free_count_, free_count_ * PAGE_SIZE, arena_cumulative_size_);
+        printf("pmm node %p: free_count %zu (%zu bytes), cached %" PRIu64 ", total size %zu\n",
+               this, free_count_, free_count_ * PAGE_SIZE, cached_count_.load(),
+               arena_cumulative_size_);
         for (auto& a : arena_list_) {
             a.Dump(false, false);
         }
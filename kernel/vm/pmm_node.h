@@ -5,11 +5,14 @@
 // https://opensource.org/licenses/MIT
 #pragma once
 
+#include <fbl/atomic.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 
+#include <kernel/align.h>
 #include <kernel/lockdep.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <vm/pmm.h>
 
 #include "pmm_arena.h"
@@ -59,6 +62,32 @@ private:
     void FreePageLocked(vm_page* page) TA_REQ(lock_);
     void FreeListLocked(list_node* list) TA_REQ(lock_);
 
+    // per cpu free page caches, see pmm_node.cpp
+    struct CpuCache;
+    CpuCache* LocalCache();
+    size_t AllocFromCache(size_t count, list_node* list);
+    zx_status_t RefillCacheAndAlloc(vm_page** page_out);
+    void FreeToCache(list_node* list);
+    void DrainCachesLocked() TA_REQ(lock_);
+
+    // pages move between the global free list and the per cpu caches in batches of
+    // kCacheBatch, and a cache never holds more than kCacheMax pages
+    static constexpr size_t kCacheBatch = 32;
+    static constexpr size_t kCacheMax = 2 * kCacheBatch;
+
+    struct CpuCache {
+        DECLARE_SPINLOCK(PmmNode) lock;
+        // pages here are in the ALLOC state, so the arena scans in AllocRange and
+        // AllocContiguous do not consider them free
+        list_node free_list TA_GUARDED(lock) = LIST_INITIAL_VALUE(free_list);
+        size_t count TA_GUARDED(lock) = 0;
+    } __CPU_ALIGN;
+
+    CpuCache cpu_caches_[SMP_MAX_CPUS];
+
+    // number of pages sitting in all of the per cpu caches
+    fbl::atomic<uint64_t> cached_count_ = 0;
+
     fbl::Canary<fbl::magic("PNOD")> canary_;
 
     mutable DECLARE_MUTEX(PmmNode) lock_;
@@ -9,9 +9,11 @@
 #include "vm_priv.h"
 #include <assert.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <inttypes.h>
+#include <lib/counters.h>
 #include <trace.h>
 #include <vm/fault.h>
 #include <vm/vm.h>
@@ -21,6 +23,8 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_large_page_faults, "kernel.vm.fault.large_page");
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      fbl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags,
@@ -398,15 +402,28 @@ public:
     // no longer valid.
     zx_status_t Append(vaddr_t vaddr, paddr_t paddr) {
         DEBUG_ASSERT(!aborted_);
+        // A physically contiguous run is allowed to grow past the end of
+        // |phys_|, since only its first address is needed to map it.  This
+        // lets the arch layer use large pages where the alignment allows.
+        bool extends_run = count_ > 0 && contiguous_ &&
+                           paddr == phys_[0] + count_ * PAGE_SIZE;
         // If this isn't the expected vaddr, flush the run we have first.
-        if (count_ >= fbl::count_of(phys_) || vaddr != base_ + count_ * PAGE_SIZE) {
+        if ((count_ >= fbl::count_of(phys_) && !extends_run) ||
+            vaddr != base_ + count_ * PAGE_SIZE) {
             zx_status_t status = Flush();
             if (status != ZX_OK) {
                 return status;
             }
             base_ = vaddr;
         }
-        phys_[count_] = paddr;
+        if (count_ == 0) {
+            contiguous_ = true;
+        } else if (!extends_run) {
+            contiguous_ = false;
+        }
+        if (count_ < fbl::count_of(phys_)) {
+            phys_[count_] = paddr;
+        }
         ++count_;
         return ZX_OK;
     }
@@ -428,11 +445,12 @@ private:
     vaddr_t base_;
     paddr_t phys_[16];
     size_t count_;
+    bool contiguous_;
     bool aborted_;
 };
 
 VmMappingCoalescer::VmMappingCoalescer(VmMapping* mapping, vaddr_t base)
-    : mapping_(mapping), base_(base), count_(0), aborted_(false) {}
+    : mapping_(mapping), base_(base), count_(0), contiguous_(true), aborted_(false) {}
 
 VmMappingCoalescer::~VmMappingCoalescer() {
     // Make sure we've flushed or aborted
@@ -447,8 +465,13 @@ zx_status_t VmMappingCoalescer::Flush() {
     uint flags = mapping_->arch_mmu_flags();
     if (flags & ARCH_MMU_FLAG_PERM_RWX_MASK) {
         size_t mapped;
-        zx_status_t ret = mapping_->aspace()->arch_aspace().Map(base_, phys_, count_, flags,
-                                                                &mapped);
+        zx_status_t ret;
+        if (contiguous_) {
+            ret = mapping_->aspace()->arch_aspace().MapContiguous(base_, phys_[0], count_, flags,
+                                                                  &mapped);
+        } else {
+            ret = mapping_->aspace()->arch_aspace().Map(base_, phys_, count_, flags, &mapped);
+        }
         if (ret != ZX_OK) {
             TRACEF("error %d mapping %zu pages starting at va %#" PRIxPTR "\n", ret, count_, base_);
             aborted_ = true;
@@ -548,6 +571,28 @@ zx_status_t VmMapping::DecommitRange(size_t offset, size_t len,
     return object_->DecommitRange(object_offset_ + offset, len, decommitted);
 }
 
+zx_status_t VmMapping::ReplacePages(size_t offset, list_node* pages, size_t count,
+                                    size_t* replaced) {
+    canary_.Assert();
+    LTRACEF("%p [%#zx+%#zx], offset %#zx, count %zu\n", this, base_, size_, offset, count);
+
+    *replaced = 0;
+    Guard<fbl::Mutex> guard{aspace_->lock()};
+    if (state_ != LifeCycleState::ALIVE) {
+        return ZX_ERR_BAD_STATE;
+    }
+    if (!IS_PAGE_ALIGNED(offset) || offset >= size_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    if (!(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE)) {
+        return ZX_ERR_ACCESS_DENIED;
+    }
+    count = fbl::min(count, (size_ - offset) / PAGE_SIZE);
+    // VmObject::ReplacePages will typically call back into our instance's
+    // VmMapping::UnmapVmoRangeLocked.
+    return object_->ReplacePages(object_offset_ + offset, pages, count, replaced);
+}
+
 zx_status_t VmMapping::DestroyLocked() {
     canary_.Assert();
     DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
@@ -724,6 +769,10 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         // assert that we're not accidentally mapping the zero page writable
         DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
+        if (object_->is_contiguous() && MapLargePageLocked(va, new_pa)) {
+            return ZX_OK;
+        }
+
         size_t mapped;
         status = aspace_->arch_aspace().MapContiguous(va, new_pa, 1, mmu_flags, &mapped);
         if (status != ZX_OK) {
@@ -744,6 +793,44 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     return ZX_OK;
 }
 
+bool VmMapping::MapLargePageLocked(vaddr_t va, paddr_t pa) {
+    DEBUG_ASSERT(object_->is_contiguous());
+
+    // The large page around |va| has to sit entirely inside both this mapping
+    // and the object, and has to start on a large page boundary physically.
+    vaddr_t large_va = ROUNDDOWN(va, kLargePageSize);
+    paddr_t large_pa = pa - (va - large_va);
+    if (size_ < kLargePageSize || large_va < base_ ||
+        large_va - base_ > size_ - kLargePageSize || !IS_ALIGNED(large_pa, kLargePageSize)) {
+        return false;
+    }
+    uint64_t vmo_offset = large_va - base_ + object_offset_;
+    if (vmo_offset + kLargePageSize > object_->size()) {
+        return false;
+    }
+
+    // Every page of a contiguous object is present and the same page is
+    // returned for reads and writes, so the region's full permissions are used
+    // rather than mapping read-only and taking a second fault on write.  This
+    // can fail if part of the range was already mapped a page at a time, in
+    // which case the caller falls back to mapping just the faulting page.
+    size_t mapped;
+    zx_status_t status = aspace_->arch_aspace().MapContiguous(
+        large_va, large_pa, kLargePageSize / PAGE_SIZE, arch_mmu_flags_, &mapped);
+    if (status != ZX_OK) {
+        return false;
+    }
+    DEBUG_ASSERT(mapped == kLargePageSize / PAGE_SIZE);
+    kcounter_add(vm_large_page_faults, 1);
+
+#if ARCH_ARM64
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE) {
+        arch_sync_cache_range(large_va, kLargePageSize);
+    }
+#endif
+    return true;
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
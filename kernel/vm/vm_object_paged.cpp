@@ -11,6 +11,7 @@
 #include <arch/ops.h>
 #include <assert.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <inttypes.h>
@@ -665,19 +666,71 @@ zx_status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(start, page_aligned_len);
 
-    // iterate through the pages, freeing them
-    // TODO: use page_list iterator, move pages to list, free at once
-    while (start < end) {
-        auto status = page_list_.FreePage(start);
-        if (status == ZX_OK && decommitted) {
-            *decommitted += PAGE_SIZE;
-        }
-        start += PAGE_SIZE;
+    // free all of the pages in the range at once
+    size_t freed = page_list_.FreePages(start, end);
+    if (decommitted) {
+        *decommitted += freed * PAGE_SIZE;
     }
 
     return ZX_OK;
 }
 
+zx_status_t VmObjectPaged::ReplacePages(uint64_t offset, list_node* pages, size_t count,
+                                        size_t* replaced) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", count %zu\n", offset, count);
+
+    *replaced = 0;
+    if (!IS_PAGE_ALIGNED(offset)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    // Contiguous objects must stay contiguous, and pages of an uncached
+    // object would need cache maintenance first.
+    if (options_ & kContiguous) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    Guard<fbl::Mutex> guard{&lock_};
+
+    if (cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    if (offset >= size_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    count = fbl::min(count, static_cast<size_t>((size_ - offset) / PAGE_SIZE));
+    const uint64_t len = count * PAGE_SIZE;
+    if (count == 0 || AnyPagesPinnedLocked(offset, len)) {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    // unmap the old pages everywhere before freeing them, once for the whole range
+    RangeChangeUpdateLocked(offset, len);
+
+    list_node freed = LIST_INITIAL_VALUE(freed);
+    zx_status_t status = ZX_OK;
+    size_t i = 0;
+    for (; i < count; i++) {
+        vm_page_t* page = list_remove_head_type(pages, vm_page_t, queue_node);
+        DEBUG_ASSERT(page);
+        InitializeVmPage(page);
+        vm_page_t* old;
+        status = page_list_.ReplacePage(page, offset + i * PAGE_SIZE, &old);
+        if (status != ZX_OK) {
+            page->state = VM_PAGE_STATE_ALLOC;
+            list_add_head(pages, &page->queue_node);
+            break;
+        }
+        if (old) {
+            list_add_tail(&freed, &old->queue_node);
+        }
+    }
+    pmm_free(&freed);
+
+    *replaced = i;
+    return i > 0 ? ZX_OK : status;
+}
+
 zx_status_t VmObjectPaged::Pin(uint64_t offset, uint64_t len) {
     canary_.Assert();
 
@@ -826,12 +879,8 @@ zx_status_t VmObjectPaged::ResizeLocked(uint64_t s) {
         // unmap all of the pages in this range on all the mapping regions
         RangeChangeUpdateLocked(start, len);
 
-        // iterate through the pages, freeing them
-        // TODO: use page_list iterator, move pages to list, free at once
-        while (start < end) {
-            page_list_.FreePage(start);
-            start += PAGE_SIZE;
-        }
+        // free all of the pages past the new end at once
+        page_list_.FreePages(start, end);
     } else if (s > size_) {
         // expanding
         // figure the starting and ending page offset that is affected
@@ -62,13 +62,38 @@ zx_status_t VmPageListNode::AddPage(vm_page* p, size_t index) {
     return ZX_OK;
 }
 
+VmPageListInnerNode::VmPageListInnerNode() {
+    LTRACEF("%p\n", this);
+}
+
+VmPageListInnerNode::~VmPageListInnerNode() {
+    LTRACEF("%p\n", this);
+    canary_.Assert();
+    DEBUG_ASSERT(count_ == 0);
+}
+
 VmPageList::VmPageList() {
     LTRACEF("%p\n", this);
 }
 
 VmPageList::~VmPageList() {
     LTRACEF("%p\n", this);
-    DEBUG_ASSERT(list_.is_empty());
+    DEBUG_ASSERT(root_ == nullptr);
+}
+
+VmPageListNode* VmPageList::FindLeaf(uint64_t offset) const {
+    if (!root_ || !InRange(offset)) {
+        return nullptr;
+    }
+
+    VmPageListInnerNode* node = root_;
+    for (uint level = height_; level > 1; level--) {
+        node = node->children_[ChildIndex(offset, level)].inner;
+        if (!node) {
+            return nullptr;
+        }
+    }
+    return node->children_[ChildIndex(offset, 1)].leaf;
 }
 
 zx_status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
@@ -78,54 +103,154 @@ zx_status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
     LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, p, offset,
                   node_offset, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
-        fbl::AllocChecker ac;
-        fbl::unique_ptr<VmPageListNode> pl =
-            fbl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
+    fbl::AllocChecker ac;
+
+    // make sure the tree is tall enough to hold this offset by pushing the
+    // current root down as the first child of a new one
+    if (!root_) {
+        root_ = new (&ac) VmPageListInnerNode();
         if (!ac.check()) {
+            root_ = nullptr;
             return ZX_ERR_NO_MEMORY;
         }
+        height_ = 1;
+    }
+    while (!InRange(offset)) {
+        auto new_root = new (&ac) VmPageListInnerNode();
+        if (!ac.check()) {
+            if (root_->count_ == 0) {
+                delete root_;
+                root_ = nullptr;
+                height_ = 0;
+            }
+            return ZX_ERR_NO_MEMORY;
+        }
+        LTRACEF("growing tree to height %u\n", height_ + 1);
+        new_root->children_[0].inner = root_;
+        new_root->count_ = 1;
+        root_ = new_root;
+        height_++;
+    }
 
-        LTRACEF("allocating new inner node %p\n", pl.get());
-        __UNUSED auto status = pl->AddPage(p, index);
-        DEBUG_ASSERT(status == ZX_OK);
+    // walk down to the leaf, filling in missing interior nodes
+    VmPageListInnerNode* node = root_;
+    for (uint level = height_; level > 1; level--) {
+        auto& child = node->children_[ChildIndex(offset, level)];
+        if (!child.inner) {
+            child.inner = new (&ac) VmPageListInnerNode();
+            if (!ac.check()) {
+                child.inner = nullptr;
+                PrunePath(offset);
+                return ZX_ERR_NO_MEMORY;
+            }
+            node->count_++;
+        }
+        node = child.inner;
+    }
 
-        list_.insert(fbl::move(pl));
-    } else {
-        pln->AddPage(p, index);
+    auto& slot = node->children_[ChildIndex(offset, 1)];
+    if (!slot.leaf) {
+        slot.leaf = new (&ac) VmPageListNode(node_offset);
+        if (!ac.check()) {
+            slot.leaf = nullptr;
+            PrunePath(offset);
+            return ZX_ERR_NO_MEMORY;
+        }
+        LTRACEF("allocating new leaf node %p\n", slot.leaf);
+        node->count_++;
     }
 
-    return ZX_OK;
+    return slot.leaf->AddPage(p, index);
 }
 
 vm_page* VmPageList::GetPage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
-    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
-                  index);
+    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " index %zu\n", this, offset, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    // lookup the leaf that holds this page
+    VmPageListNode* pln = FindLeaf(offset);
+    if (!pln) {
         return nullptr;
     }
 
     return pln->GetPage(index);
 }
 
+zx_status_t VmPageList::ReplacePage(vm_page* p, uint64_t offset, vm_page** old) {
+    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+
+    LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " index %zu\n", this, p, offset, index);
+
+    // swap within the existing leaf so it is never pruned and reallocated
+    VmPageListNode* pln = FindLeaf(offset);
+    if (!pln) {
+        *old = nullptr;
+        return AddPage(p, offset);
+    }
+
+    *old = pln->RemovePage(index);
+    zx_status_t status = pln->AddPage(p, index);
+    DEBUG_ASSERT(status == ZX_OK);
+    return status;
+}
+
+// free the leaf and any interior nodes on the path to |offset| that have become
+// empty, bottom up
+void VmPageList::PrunePath(uint64_t offset) {
+    if (!root_ || !InRange(offset)) {
+        return;
+    }
+
+    // record the path from the root, path[level] being the node on |level|
+    VmPageListInnerNode* path[64 / VmPageListInnerNode::kFanOutShift + 2] = {};
+    VmPageListInnerNode* node = root_;
+    uint level = height_;
+    path[level] = node;
+    while (level > 1) {
+        node = node->children_[ChildIndex(offset, level)].inner;
+        if (!node) {
+            break;
+        }
+        path[--level] = node;
+    }
+
+    if (level == 1) {
+        auto& slot = node->children_[ChildIndex(offset, 1)];
+        if (slot.leaf && slot.leaf->IsEmpty()) {
+            LTRACEF_LEVEL(2, "%p freeing the leaf node\n", this);
+            delete slot.leaf;
+            slot.leaf = nullptr;
+            node->count_--;
+        }
+    }
+
+    for (; level < height_; level++) {
+        if (path[level]->count_ != 0) {
+            return;
+        }
+        auto& slot = path[level + 1]->children_[ChildIndex(offset, level + 1)];
+        DEBUG_ASSERT(slot.inner == path[level]);
+        delete path[level];
+        slot.inner = nullptr;
+        path[level + 1]->count_--;
+    }
+
+    if (root_->count_ == 0) {
+        delete root_;
+        root_ = nullptr;
+        height_ = 0;
+    }
+}
+
 zx_status_t VmPageList::FreePage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
-    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
-                  index);
+    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " index %zu\n", this, offset, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    // lookup the leaf that holds this page
+    VmPageListNode* pln = FindLeaf(offset);
+    if (!pln) {
         return ZX_ERR_NOT_FOUND;
     }
 
@@ -134,8 +259,7 @@ zx_status_t VmPageList::FreePage(uint64_t offset) {
     if (page) {
         // if it was the last page in the node, remove the node from the tree
         if (pln->IsEmpty()) {
-            LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
-            list_.erase(*pln);
+            PrunePath(offset);
         }
 
         pmm_free_page(page);
@@ -144,6 +268,81 @@ zx_status_t VmPageList::FreePage(uint64_t offset) {
     return ZX_OK;
 }
 
+// free the empty leaves and interior nodes below |node| that overlap
+// [start_offset, end_offset). returns true if |node| itself is now empty.
+bool VmPageList::PruneRange(VmPageListInnerNode* node, uint level, uint64_t node_base,
+                            uint64_t start_offset, uint64_t end_offset) {
+    const uint shift = ChildShift(level);
+    size_t first = 0;
+    if (start_offset > node_base) {
+        first = static_cast<size_t>((start_offset - node_base) >> shift);
+    }
+    for (size_t i = first; i < VmPageListInnerNode::kFanOut; i++) {
+        uint64_t child_base = node_base + (static_cast<uint64_t>(i) << shift);
+        if (child_base >= end_offset) {
+            break;
+        }
+
+        auto& slot = node->children_[i];
+        if (level == 1) {
+            if (slot.leaf && slot.leaf->IsEmpty()) {
+                delete slot.leaf;
+                slot.leaf = nullptr;
+                node->count_--;
+            }
+        } else if (slot.inner &&
+                   PruneRange(slot.inner, level - 1, child_base, start_offset, end_offset)) {
+            delete slot.inner;
+            slot.inner = nullptr;
+            node->count_--;
+        }
+    }
+    return node->count_ == 0;
+}
+
+size_t VmPageList::FreePages(uint64_t start_offset, uint64_t end_offset) {
+    LTRACEF("%p start %#" PRIx64 " end %#" PRIx64 "\n", this, start_offset, end_offset);
+
+    if (!root_ || start_offset >= end_offset) {
+        return 0;
+    }
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    size_t count = 0;
+
+    // pull the pages out of the leaves, then drop whatever nodes that emptied
+    ForEveryPageInRange([&](vm_page*& p, uint64_t offset) {
+        list_add_tail(&list, &p->queue_node);
+        p = nullptr;
+        count++;
+        return ZX_ERR_NEXT;
+    }, start_offset, end_offset);
+
+    if (PruneRange(root_, height_, 0, start_offset, end_offset)) {
+        delete root_;
+        root_ = nullptr;
+        height_ = 0;
+    }
+
+    // return all the pages to the pmm at once
+    pmm_free(&list);
+
+    return count;
+}
+
+void VmPageList::DeleteTree(VmPageListInnerNode* node, uint level) {
+    for (auto& slot : node->children_) {
+        if (level == 1) {
+            delete slot.leaf;
+        } else if (slot.inner) {
+            DeleteTree(slot.inner, level - 1);
+        }
+        slot.inner = nullptr;
+    }
+    node->count_ = 0;
+    delete node;
+}
+
 size_t VmPageList::FreeAllPages() {
     LTRACEF("%p\n", this);
 
@@ -169,11 +368,15 @@ size_t VmPageList::FreeAllPages() {
     pmm_free(&list);
 
     // empty the tree
-    list_.clear();
+    if (root_) {
+        DeleteTree(root_, height_);
+        root_ = nullptr;
+        height_ = 0;
+    }
 
     return count;
 }
 
 bool VmPageList::IsEmpty() {
-    return list_.is_empty();
+    return root_ == nullptr;
 }
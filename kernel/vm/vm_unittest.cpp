@@ -6,9 +6,15 @@
 
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/array.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
 #include <lib/unittest/unittest.h>
+#include <platform.h>
+#include <pow2.h>
 #include <vm/physmap.h>
 #include <vm/vm.h>
 #include <vm/vm_address_region.h>
@@ -16,6 +22,7 @@
 #include <vm/vm_object.h>
 #include <vm/vm_object_paged.h>
 #include <vm/vm_object_physical.h>
+#include <vm/vm_page_list.h>
 #include <zircon/types.h>
 
 static const uint kArchRwFlags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
@@ -84,6 +91,64 @@ static bool pmm_alloc_contiguous_one_test() {
     END_TEST;
 }
 
+// Frees a page and allocates again on the same cpu, which should hand back the
+// same page out of the cpu's free page cache.
+static bool pmm_cache_reuse_test() {
+    BEGIN_TEST;
+    thread_t* self = get_current_thread();
+    cpu_mask_t old_affinity = self->cpu_affinity;
+    thread_set_cpu_affinity(self, cpu_num_to_mask(arch_curr_cpu_num()));
+
+    vm_page_t* page;
+    zx_status_t status = pmm_alloc_page(0, &page);
+    ASSERT_EQ(ZX_OK, status, "pmm_alloc single page");
+    pmm_free_page(page);
+
+    vm_page_t* page2;
+    status = pmm_alloc_page(0, &page2);
+    EXPECT_EQ(ZX_OK, status, "pmm_alloc single page");
+    EXPECT_EQ(page, page2, "freed page comes back out of the cache");
+    pmm_free_page(page2);
+
+    thread_set_cpu_affinity(self, old_affinity);
+    END_TEST;
+}
+
+// Frees enough single pages to overflow the local free page cache, then asks
+// for the last one back by address. It is still sitting in the cache, so the
+// cache has to be drained for the search to find it.
+static bool pmm_cache_drain_test() {
+    BEGIN_TEST;
+    static const size_t count = 256;
+    fbl::AllocChecker ac;
+    fbl::Array<vm_page_t*> pages(new (&ac) vm_page_t*[count], count);
+    ASSERT_TRUE(ac.check(), "allocating array");
+
+    thread_t* self = get_current_thread();
+    cpu_mask_t old_affinity = self->cpu_affinity;
+    thread_set_cpu_affinity(self, cpu_num_to_mask(arch_curr_cpu_num()));
+
+    for (size_t i = 0; i < count; i++) {
+        zx_status_t status = pmm_alloc_page(0, &pages[i]);
+        ASSERT_EQ(ZX_OK, status, "pmm_alloc single page");
+    }
+    paddr_t pa = pages[count - 1]->paddr();
+    for (size_t i = 0; i < count; i++) {
+        pmm_free_page(pages[i]);
+    }
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    zx_status_t status = pmm_alloc_range(pa, 1, &list);
+    EXPECT_EQ(ZX_OK, status, "reallocating cached page by address");
+    if (status == ZX_OK) {
+        EXPECT_EQ(pages[count - 1], list_peek_head_type(&list, vm_page_t, queue_node), "");
+        pmm_free(&list);
+    }
+
+    thread_set_cpu_affinity(self, old_affinity);
+    END_TEST;
+}
+
 static uint32_t test_rand(uint32_t seed) {
     return (seed = seed * 1664525 + 1013904223);
 }
@@ -626,6 +691,73 @@ static bool vmo_demand_paged_map_test() {
     END_TEST;
 }
 
+// Maps a large-page aligned contiguous vm object, then protects and unmaps
+// single pages out of the middle to make sure the large mapping is split
+// rather than dropped wholesale.
+static bool vmo_contiguous_large_page_map_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = 2 * VmMapping::kLargePageSize;
+    static const uint8_t align_log2 = log2_uint_floor(VmMapping::kLargePageSize);
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::CreateContiguous(PMM_ALLOC_FLAG_ANY, alloc_size,
+                                                         align_log2, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+
+    paddr_t base_pa;
+    auto lookup_fn = [](void* ctx, size_t offset, size_t index, paddr_t pa) {
+        *static_cast<paddr_t*>(ctx) = pa;
+        return ZX_OK;
+    };
+    status = vmo->Lookup(0, PAGE_SIZE, 0, lookup_fn, &base_pa);
+    ASSERT_EQ(status, ZX_OK, "vmo lookup\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    status = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                   align_log2, 0, kArchRwFlags);
+    ASSERT_EQ(status, ZX_OK, "mapping object\n");
+    auto va = reinterpret_cast<vaddr_t>(ptr);
+
+    // Faulting on one page brings in the whole large page around it.
+    EXPECT_TRUE(fill_and_test(ptr, PAGE_SIZE), "faulting first page\n");
+    paddr_t pa;
+    uint flags;
+    status = ka->arch_aspace().Query(va + VmMapping::kLargePageSize - PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "query end of large page\n");
+    EXPECT_EQ(base_pa + VmMapping::kLargePageSize - PAGE_SIZE, pa, "query end of large page\n");
+
+    if (!fill_and_test(ptr, alloc_size)) {
+        all_ok = false;
+    }
+
+    status = ka->RootVmar()->Protect(va + PAGE_SIZE, PAGE_SIZE, ARCH_MMU_FLAG_PERM_READ);
+    EXPECT_EQ(ZX_OK, status, "protecting one page\n");
+    status = ka->arch_aspace().Query(va + PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "query protected page\n");
+    EXPECT_EQ(base_pa + PAGE_SIZE, pa, "query protected page\n");
+    EXPECT_EQ(0u, flags & ARCH_MMU_FLAG_PERM_WRITE, "protected page is read only\n");
+    status = ka->arch_aspace().Query(va + 2 * PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "query neighbouring page\n");
+    EXPECT_NE(0u, flags & ARCH_MMU_FLAG_PERM_WRITE, "neighbouring page is writable\n");
+
+    status = ka->RootVmar()->Unmap(va + 3 * PAGE_SIZE, PAGE_SIZE);
+    EXPECT_EQ(ZX_OK, status, "unmapping one page\n");
+    status = ka->arch_aspace().Query(va + 3 * PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, status, "query unmapped page\n");
+    status = ka->arch_aspace().Query(va + 4 * PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "query page after the hole\n");
+    EXPECT_EQ(base_pa + 4 * PAGE_SIZE, pa, "query page after the hole\n");
+
+    // What is left of the split page must still be usable.
+    if (!fill_and_test(reinterpret_cast<void*>(va + 4 * PAGE_SIZE), alloc_size - 4 * PAGE_SIZE)) {
+        all_ok = false;
+    }
+
+    status = ka->RootVmar()->Unmap(va, alloc_size);
+    EXPECT_EQ(ZX_OK, status, "unmapping object\n");
+    END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test() {
     BEGIN_TEST;
@@ -829,6 +961,50 @@ static bool vmo_read_write_smoke_test() {
     END_TEST;
 }
 
+// Moves pages into a mapped vm object and checks that the mapping sees
+// them, and that a batch running past the end of the object is cut short.
+static bool vmo_replace_pages_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 4;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    uint8_t* ptr;
+    status = ka->MapObjectInternal(vmo, "test", 0, alloc_size, (void**)&ptr,
+                                   0, VmAspace::VMM_FLAG_COMMIT, kArchRwFlags);
+    ASSERT_EQ(ZX_OK, status, "mapping object");
+    memset(ptr, 0xaa, alloc_size);
+
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    ASSERT_EQ(ZX_OK, pmm_alloc_pages(3, 0, &pages), "");
+    vm_page_t* page;
+    list_for_every_entry (&pages, page, vm_page_t, queue_node) {
+        memset(paddr_to_physmap(page->paddr()), 0x55, PAGE_SIZE);
+    }
+
+    // only two of the three pages fit, the last stays with the caller
+    size_t replaced = 0;
+    EXPECT_EQ(ZX_OK, vmo->ReplacePages(2 * PAGE_SIZE, &pages, 3, &replaced), "");
+    EXPECT_EQ(2u, replaced, "");
+    EXPECT_EQ(1u, list_length(&pages), "");
+
+    // the old pages must be gone from the mapping
+    EXPECT_EQ(0xaa, ptr[0], "");
+    EXPECT_EQ(0xaa, ptr[2 * PAGE_SIZE - 1], "");
+    EXPECT_EQ(0x55, ptr[2 * PAGE_SIZE], "");
+    EXPECT_EQ(0x55, ptr[alloc_size - 1], "");
+
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, vmo->ReplacePages(alloc_size, &pages, 1, &replaced), "");
+    EXPECT_EQ(0u, replaced, "");
+    EXPECT_EQ(1u, list_length(&pages), "");
+
+    ka->FreeRegion((vaddr_t)ptr);
+    pmm_free(&pages);
+    END_TEST;
+}
+
 static bool vmo_cache_test() {
     BEGIN_TEST;
 
@@ -1038,6 +1214,202 @@ static bool arch_noncontiguous_map() {
     END_TEST;
 }
 
+// Exercises the page list with offsets that need several levels of interior
+// nodes, and checks that removing a range leaves neighbouring pages alone.
+static bool vmpl_sparse_test() {
+    BEGIN_TEST;
+    static const uint64_t offsets[] = {
+        0, PAGE_SIZE, 15 * PAGE_SIZE, 16 * PAGE_SIZE, 1ull << 30,
+        (1ull << 30) + PAGE_SIZE, 1ull << 36, (1ull << 40) - PAGE_SIZE,
+    };
+    static const size_t count = fbl::count_of(offsets);
+
+    VmPageList pl;
+    EXPECT_TRUE(pl.IsEmpty(), "new list is empty\n");
+    vm_page_t* pages[count];
+    for (size_t i = 0; i < count; i++) {
+        zx_status_t status = pmm_alloc_page(0, &pages[i]);
+        ASSERT_EQ(ZX_OK, status, "allocating page\n");
+        EXPECT_EQ(ZX_OK, pl.AddPage(pages[i], offsets[i]), "adding page\n");
+    }
+    EXPECT_EQ(ZX_ERR_ALREADY_EXISTS, pl.AddPage(pages[0], offsets[0]), "adding duplicate\n");
+
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(pages[i], pl.GetPage(offsets[i]), "looking up page\n");
+    }
+    EXPECT_NULL(pl.GetPage(2 * PAGE_SIZE), "looking up hole\n");
+    EXPECT_NULL(pl.GetPage(1ull << 41), "looking up past the tree\n");
+
+    // Pages must be visited in offset order.
+    size_t visited = 0;
+    uint64_t last = 0;
+    bool ordered = true;
+    pl.ForEveryPage([&](const vm_page_t* p, uint64_t off) {
+        if (visited > 0 && off <= last) {
+            ordered = false;
+        }
+        last = off;
+        visited++;
+        return ZX_ERR_NEXT;
+    });
+    EXPECT_EQ(count, visited, "visiting every page\n");
+    EXPECT_TRUE(ordered, "visiting pages in order\n");
+
+    visited = 0;
+    pl.ForEveryPageInRange([&](const vm_page_t* p, uint64_t off) {
+        visited++;
+        return ZX_ERR_NEXT;
+    }, PAGE_SIZE, (1ull << 30) + PAGE_SIZE);
+    EXPECT_EQ(4u, visited, "visiting a range\n");
+
+    // Drop the middle of the list; the pages on either side stay put.
+    EXPECT_EQ(3u, pl.FreePages(16 * PAGE_SIZE, 1ull << 36), "freeing a range\n");
+    EXPECT_EQ(pages[2], pl.GetPage(offsets[2]), "page before the range\n");
+    EXPECT_NULL(pl.GetPage(offsets[4]), "page inside the range\n");
+    EXPECT_EQ(pages[6], pl.GetPage(offsets[6]), "page after the range\n");
+
+    EXPECT_EQ(count - 3, pl.FreeAllPages(), "freeing the rest\n");
+    EXPECT_TRUE(pl.IsEmpty(), "list is empty again\n");
+    END_TEST;
+}
+
+// Times faulting, committing and decommitting a sparse set of pages spread
+// across a 4GB vm object, which is the shape of a large shared buffer that is
+// touched a little at a time.
+static bool vmo_large_page_list_benchmark() {
+    BEGIN_TEST;
+    static const uint64_t vmo_size = 4ull << 30;
+    static const uint64_t stride = 1ull << 20;
+    static const size_t samples = vmo_size / stride;
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, vmo_size, &vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    status = ka->MapObjectInternal(vmo, "test", 0, vmo_size, &ptr, 0, 0, kArchRwFlags);
+    ASSERT_EQ(ZX_OK, status, "mapping object\n");
+    auto base = static_cast<volatile uint8_t*>(ptr);
+
+    // Even pages of each stride are committed directly, odd ones are faulted in.
+    zx_time_t t = current_time();
+    for (size_t i = 0; i < samples; i++) {
+        uint64_t committed;
+        status = vmo->CommitRange(i * stride, PAGE_SIZE, &committed);
+        if (status != ZX_OK) {
+            break;
+        }
+    }
+    zx_duration_t commit_time = current_time() - t;
+    EXPECT_EQ(ZX_OK, status, "committing pages\n");
+
+    t = current_time();
+    for (size_t i = 0; i < samples; i++) {
+        base[i * stride + PAGE_SIZE] = 1;
+    }
+    zx_duration_t fault_time = current_time() - t;
+
+    // Faulting on pages that are already present is all page list lookup.
+    t = current_time();
+    size_t pages_seen = 0;
+    for (size_t i = 0; i < samples; i++) {
+        vmo->Lookup(i * stride, 2 * PAGE_SIZE, 0,
+                    [](void* ctx, size_t off, size_t index, paddr_t pa) {
+                        (*static_cast<size_t*>(ctx))++;
+                        return ZX_OK;
+                    }, &pages_seen);
+    }
+    zx_duration_t lookup_time = current_time() - t;
+    EXPECT_EQ(2 * samples, pages_seen, "looking up committed pages\n");
+
+    t = current_time();
+    uint64_t decommitted = 0;
+    status = vmo->DecommitRange(0, vmo_size, &decommitted);
+    zx_duration_t decommit_time = current_time() - t;
+    EXPECT_EQ(ZX_OK, status, "decommitting pages\n");
+    EXPECT_EQ(2 * samples * PAGE_SIZE, decommitted, "decommitting pages\n");
+
+    printf("%zu pages across %" PRIu64 "MB: commit %" PRIi64 "ns/page, fault %" PRIi64
+           "ns/page, lookup %" PRIi64 "ns/page, decommit %" PRIi64 "ns/page\n",
+           samples, vmo_size >> 20, commit_time / samples, fault_time / samples,
+           lookup_time / (2 * samples), decommit_time / (2 * samples));
+
+    status = ka->FreeRegion(reinterpret_cast<vaddr_t>(ptr));
+    EXPECT_EQ(ZX_OK, status, "unmapping object\n");
+    END_TEST;
+}
+
+// Has one thread per online cpu fault in the pages of its own demand paged
+// kernel mapping, which is the pattern that contends on page allocation.
+static bool pmm_parallel_fault_benchmark() {
+    BEGIN_TEST;
+    static const size_t region_size = 16 * 1024 * 1024;
+    static const int rounds = 8;
+
+    struct FaultThread {
+        thread_t* thread;
+        zx_status_t status;
+        zx_duration_t elapsed;
+    };
+
+    auto fault_thread = [](void* arg) -> int {
+        auto ft = static_cast<FaultThread*>(arg);
+        auto ka = VmAspace::kernel_aspace();
+        zx_time_t t = current_time();
+        for (int r = 0; r < rounds; r++) {
+            void* ptr;
+            zx_status_t status = ka->Alloc("fault bench", region_size, &ptr, 0, 0, kArchRwFlags);
+            if (status != ZX_OK) {
+                ft->status = status;
+                return 0;
+            }
+            auto base = static_cast<volatile uint8_t*>(ptr);
+            for (size_t off = 0; off < region_size; off += PAGE_SIZE) {
+                base[off] = 1;
+            }
+            ka->FreeRegion(reinterpret_cast<vaddr_t>(ptr));
+        }
+        ft->elapsed = current_time() - t;
+        ft->status = ZX_OK;
+        return 0;
+    };
+
+    cpu_mask_t online = mp_get_online_mask();
+    FaultThread threads[SMP_MAX_CPUS] = {};
+    size_t thread_count = 0;
+    zx_time_t t = current_time();
+    for (cpu_num_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (!(online & cpu_num_to_mask(cpu))) {
+            continue;
+        }
+        FaultThread* ft = &threads[thread_count];
+        ft->thread = thread_create("fault bench", fault_thread, ft, DEFAULT_PRIORITY);
+        ASSERT_NONNULL(ft->thread, "creating thread");
+        thread_set_cpu_affinity(ft->thread, cpu_num_to_mask(cpu));
+        thread_resume(ft->thread);
+        thread_count++;
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        thread_join(threads[i].thread, nullptr, ZX_TIME_INFINITE);
+        EXPECT_EQ(ZX_OK, threads[i].status, "faulting in pages\n");
+    }
+    zx_duration_t wall_time = current_time() - t;
+
+    const uint64_t pages_per_thread = rounds * (region_size / PAGE_SIZE);
+    zx_duration_t thread_time = 0;
+    for (size_t i = 0; i < thread_count; i++) {
+        thread_time += threads[i].elapsed;
+    }
+    printf("%zu threads faulted %" PRIu64 " pages each: %" PRIi64 "ns/page per thread, "
+           "%" PRIu64 " pages/sec overall\n",
+           thread_count, pages_per_thread,
+           thread_time / static_cast<zx_duration_t>(thread_count * pages_per_thread),
+           thread_count * pages_per_thread * ZX_SEC(1) /
+               static_cast<uint64_t>(fbl::max<zx_duration_t>(wall_time, 1)));
+    END_TEST;
+}
+
 // Use the function name as the test name
 #define VM_UNITTEST(fname) UNITTEST(#fname, fname)
 
@@ -1047,6 +1419,8 @@ VM_UNITTEST(pmm_smoke_test)
 //VM_UNITTEST(pmm_large_alloc_test)
 //VM_UNITTEST(pmm_oversized_alloc_test)
 VM_UNITTEST(pmm_alloc_contiguous_one_test)
+VM_UNITTEST(pmm_cache_reuse_test)
+VM_UNITTEST(pmm_cache_drain_test)
 VM_UNITTEST(vmm_alloc_smoke_test)
 VM_UNITTEST(vmm_alloc_contiguous_smoke_test)
 VM_UNITTEST(multiple_regions_test)
@@ -1066,12 +1440,17 @@ VM_UNITTEST(vmo_create_contiguous_test)
 VM_UNITTEST(vmo_contiguous_decommit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_contiguous_large_page_map_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
 VM_UNITTEST(vmo_read_write_smoke_test)
+VM_UNITTEST(vmo_replace_pages_test)
 VM_UNITTEST(vmo_cache_test)
 VM_UNITTEST(vmo_lookup_test)
+VM_UNITTEST(vmpl_sparse_test)
+VM_UNITTEST(vmo_large_page_list_benchmark)
+VM_UNITTEST(pmm_parallel_fault_benchmark)
 VM_UNITTEST(arch_noncontiguous_map)
 // Uncomment for debugging
 // VM_UNITTEST(dump_all_aspaces)  // Run last
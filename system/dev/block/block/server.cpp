@@ -285,9 +285,11 @@ zx_status_t BlockServer::Create(block_protocol_t* bp, fzl::fifo<block_fifo_reque
     }
 
     // Notably, drop ZX_RIGHT_SIGNAL_PEER, since we use bs->fifo for thread
-    // signalling internally within the block server.
+    // signalling internally within the block server.  The property rights
+    // let clients set thresholds, which only affect their own end.
     zx_rights_t rights = ZX_RIGHT_TRANSFER | ZX_RIGHT_READ | ZX_RIGHT_WRITE |
-            ZX_RIGHT_SIGNAL | ZX_RIGHT_WAIT;
+            ZX_RIGHT_SIGNAL | ZX_RIGHT_WAIT | ZX_RIGHT_GET_PROPERTY |
+            ZX_RIGHT_SET_PROPERTY;
     if ((status = fifo_out->replace(rights, fifo_out)) != ZX_OK) {
         delete bs;
         return status;
@@ -40,6 +40,14 @@ private:
     zx_status_t Fsck() override;
     zx_status_t Add() override;
 
+    // Frees the blobs in the image which are not in |blob_list_|, keeping
+    // those which are, and adds the rest.
+    zx_status_t Update() override;
+
+    // Calculates the merkle trees of the blobs in |blob_list_| into
+    // |merkle_list_|, dropping duplicates.
+    zx_status_t PreprocessBlobs(bool compress);
+
     // A comparison function used to quickly compare MerkleInfo.
     struct DigestCompare {
         inline bool operator()(const blobfs::MerkleInfo& lhs, const blobfs::MerkleInfo& rhs) const {
@@ -50,12 +58,7 @@ private:
                 rhs.digest.ReleaseBytes();
             });
 
-            for (size_t i = 0; i < digest::Digest::kLength; i++) {
-                if (lhs_bytes[i] < rhs_bytes[i]) {
-                    return true;
-                }
-            }
-            return false;
+            return memcmp(lhs_bytes, rhs_bytes, digest::Digest::kLength) < 0;
         }
     };
 
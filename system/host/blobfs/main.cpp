@@ -12,26 +12,6 @@
 
 #include "blobfs.h"
 
-namespace {
-
-// Add the blob described by |info| on host to the |blobfs| blobfs store.
-zx_status_t AddBlob(blobfs::Blobfs* blobfs, const blobfs::MerkleInfo& info) {
-    const char* path = info.path.c_str();
-    fbl::unique_fd data_fd(open(path, O_RDONLY, 0644));
-    if (!data_fd) {
-        fprintf(stderr, "error: cannot open '%s'\n", path);
-        return ZX_ERR_IO;
-    }
-    zx_status_t status = blobfs::blobfs_add_blob_with_merkle(blobfs, data_fd.get(), info);
-    if (status != ZX_OK && status != ZX_ERR_ALREADY_EXISTS) {
-        fprintf(stderr, "blobfs: Failed to add blob '%s': %d\n", path, status);
-        return status;
-    }
-    return ZX_OK;
-}
-
-} // namespace
-
 zx_status_t BlobfsCreator::Usage() {
     zx_status_t status = FsCreator::Usage();
 
@@ -48,6 +28,7 @@ bool BlobfsCreator::IsCommandValid(Command command) {
     case Command::kMkfs:
     case Command::kFsck:
     case Command::kAdd:
+    case Command::kUpdate:
         return true;
     default:
         return false;
@@ -112,60 +93,32 @@ zx_status_t BlobfsCreator::ProcessCustom(int argc, char** argv, uint8_t* process
     return ZX_OK;
 }
 
-zx_status_t BlobfsCreator::CalculateRequiredSize(off_t* out) {
-    std::vector<std::thread> threads;
-    unsigned blob_index = 0;
-    unsigned n_threads = std::thread::hardware_concurrency();
-    if (!n_threads) {
-        n_threads = 4;
-    }
-    zx_status_t status = ZX_OK;
+zx_status_t BlobfsCreator::PreprocessBlobs(bool compress) {
     std::mutex mtx;
-    for (unsigned j = n_threads; j > 0; j--) {
-        threads.push_back(std::thread([&] {
-            unsigned i = 0;
-            while (true) {
-                mtx.lock();
-                if (status != ZX_OK) {
-                    mtx.unlock();
-                    return;
-                }
-                i = blob_index++;
-                mtx.unlock();
-                if (i >= blob_list_.size()) {
-                    return;
-                }
-                const char* path = blob_list_[i].c_str();
-                zx_status_t res;
-                if ((res = AppendDepfile(path)) != ZX_OK) {
-                    mtx.lock();
-                    status = res;
-                    mtx.unlock();
-                    return;
-                }
-
-                blobfs::MerkleInfo info;
-                fbl::unique_fd data_fd(open(path, O_RDONLY, 0644));
-
-                if ((res = blobfs::blobfs_preprocess(data_fd.get(), ShouldCompress(), &info))
-                    != ZX_OK) {
-                    status = res;
-                    mtx.unlock();
-                    return;
-                }
-
-                info.path = path;
-
-                mtx.lock();
-                merkle_list_.push_back(fbl::move(info));
-                mtx.unlock();
-            }
-        }));
-    }
+    merkle_list_.clear();
+    merkle_list_.reserve(blob_list_.size());
+    zx_status_t status = blobfs::ForEachInParallel(blob_list_.size(), [&](size_t i) {
+        const char* path = blob_list_[i].c_str();
+        zx_status_t res;
+        if ((res = AppendDepfile(path)) != ZX_OK) {
+            return res;
+        }
 
-    for (unsigned i = 0; i < threads.size(); i++) {
-        threads[i].join();
-    }
+        blobfs::MerkleInfo info;
+        fbl::unique_fd data_fd(open(path, O_RDONLY, 0644));
+        if (!data_fd) {
+            fprintf(stderr, "error: cannot open '%s'\n", path);
+            return ZX_ERR_IO;
+        } else if ((res = blobfs::blobfs_preprocess(data_fd.get(), compress, &info)) != ZX_OK) {
+            return res;
+        }
+
+        info.path = path;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        merkle_list_.push_back(fbl::move(info));
+        return ZX_OK;
+    });
 
     if (status != ZX_OK) {
         return status;
@@ -179,6 +132,14 @@ zx_status_t BlobfsCreator::CalculateRequiredSize(off_t* out) {
     };
     auto it = std::unique(merkle_list_.begin(), merkle_list_.end(), compare);
     merkle_list_.resize(std::distance(merkle_list_.begin(), it));
+    return ZX_OK;
+}
+
+zx_status_t BlobfsCreator::CalculateRequiredSize(off_t* out) {
+    zx_status_t status;
+    if ((status = PreprocessBlobs(ShouldCompress())) != ZX_OK) {
+        return status;
+    }
 
     for (const auto& info : merkle_list_) {
         blobfs::Inode node;
@@ -229,47 +190,56 @@ zx_status_t BlobfsCreator::Add() {
     }
 
     zx_status_t status = ZX_OK;
+    // When creating an image, the blobs were already processed to size it.
+    if (merkle_list_.empty() && (status = PreprocessBlobs(ShouldCompress())) != ZX_OK) {
+        return status;
+    }
+
     fbl::unique_ptr<blobfs::Blobfs> blobfs;
     if ((status = blobfs_create(&blobfs, fbl::move(fd_))) != ZX_OK) {
         return status;
     }
 
-    std::vector<std::thread> threads;
-    std::mutex mtx;
+    return blobfs::blobfs_add_blobs(blobfs.get(), merkle_list_);
+}
 
-    unsigned n_threads = std::thread::hardware_concurrency();
-    if (!n_threads) {
-        n_threads = 4;
+zx_status_t BlobfsCreator::Update() {
+    if (blob_list_.is_empty()) {
+        fprintf(stderr, "Updating an image requires an additional file argument\n");
+        return Usage();
     }
-    unsigned blob_index = 0;
-    for (unsigned j = n_threads; j > 0; j--) {
-        threads.push_back(std::thread([&] {
-            unsigned i = 0;
-            while (true) {
-                mtx.lock();
-                i = blob_index++;
-                if (i >= merkle_list_.size()) {
-                    mtx.unlock();
-                    return;
-                }
-                mtx.unlock();
-
-                zx_status_t res;
-                if ((res = AddBlob(blobfs.get(), merkle_list_[i])) < 0) {
-                    mtx.lock();
-                    status = res;
-                    mtx.unlock();
-                    return;
-                }
-            }
-        }));
+
+    // Only the Merkle roots are needed to tell which blobs are unchanged, so
+    // compression is deferred until the new blobs are known.
+    zx_status_t status;
+    if ((status = PreprocessBlobs(false)) != ZX_OK) {
+        return status;
     }
 
-    for (unsigned i = 0; i < threads.size(); i++) {
-        threads[i].join();
+    fbl::unique_ptr<blobfs::Blobfs> blobfs;
+    if ((status = blobfs_create(&blobfs, fbl::move(fd_))) != ZX_OK) {
+        return status;
+    } else if ((status = blobfs::blobfs_prune_blobs(blobfs.get(), &merkle_list_)) != ZX_OK) {
+        return status;
     }
 
-    return status;
+    if (ShouldCompress()) {
+        status = blobfs::ForEachInParallel(merkle_list_.size(), [&](size_t i) {
+            blobfs::MerkleInfo* info = &merkle_list_[i];
+            fbl::unique_fd data_fd(open(info->path.c_str(), O_RDONLY, 0644));
+            if (!data_fd) {
+                fprintf(stderr, "error: cannot open '%s'\n", info->path.c_str());
+                return ZX_ERR_IO;
+            }
+            return blobfs::blobfs_compress(data_fd.get(), info);
+        });
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    // This also writes out the metadata of the blobs which were removed.
+    return blobfs::blobfs_add_blobs(blobfs.get(), merkle_list_);
 }
 
 int main(int argc, char** argv) {
@@ -94,6 +94,16 @@ zx_status_t MinfsFormat::MakeFvmReady(size_t slice_size, uint32_t vpart_index) {
     fvm_info_.dat_block = minfs::kFVMBlockDataStart;
     fvm_info_.flags |= minfs::kMinfsFlagFVM;
 
+    // The journal moves into the remainder of the superblock's slice, which is
+    // zero-filled: an empty journal.
+    fvm_info_.journal_block = 0;
+    fvm_info_.journal_block_count = 0;
+    if (kBlocksPerSlice - 1 >= minfs::kMinfsMinimumJournalBlocks) {
+        fvm_info_.journal_block = 1;
+        fvm_info_.journal_block_count = static_cast<uint32_t>(
+            fbl::min(kBlocksPerSlice - 1, static_cast<size_t>(minfs::kMinfsDefaultJournalBlocks)));
+    }
+
     zx_status_t status;
     // Check if bitmaps are the wrong size, slice extents run on too long, etc.
     if ((status = CheckSuperblock(&fvm_info_, bc_.get())) != ZX_OK) {
@@ -317,4 +317,7 @@ static_assert(sizeof(block_fifo_request_t) == sizeof(block_fifo_response_t),
               "FIFO messages are the same size in both directions");
 
 #define BLOCK_FIFO_ESIZE (sizeof(block_fifo_request_t))
-#define BLOCK_FIFO_MAX_DEPTH (4096 / BLOCK_FIFO_ESIZE)
+#define BLOCK_FIFO_MAX_DEPTH (16384 / BLOCK_FIFO_ESIZE)
+
+static_assert(BLOCK_FIFO_MAX_DEPTH * BLOCK_FIFO_ESIZE <= ZX_FIFO_MAX_SIZE_BYTES,
+              "Block FIFOs must fit in a Zircon FIFO");
@@ -21,7 +21,7 @@
      ZX_RIGHT_SIGNAL | ZX_RIGHT_SIGNAL_PEER)
 
 #define ZX_DEFAULT_FIFO_RIGHTS \
-    (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO |\
+    (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO | ZX_RIGHTS_PROPERTY |\
      ZX_RIGHT_SIGNAL | ZX_RIGHT_SIGNAL_PEER)
 
 #define ZX_DEFAULT_GUEST_RIGHTS \
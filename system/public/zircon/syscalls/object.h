@@ -425,6 +425,10 @@ typedef struct zx_info_resource {
 // Terminate this job if the system is low on memory.
 #define ZX_PROP_JOB_KILL_ON_OOM             15u
 
+// Argument is a size_t, a number of fifo elements.
+#define ZX_PROP_FIFO_RX_THRESHOLD           16u
+#define ZX_PROP_FIFO_TX_THRESHOLD           17u
+
 // Basic thread states, in zx_info_thread_t.state.
 #define ZX_THREAD_STATE_NEW                 ((zx_thread_state_t) 0x0000u)
 #define ZX_THREAD_STATE_RUNNING             ((zx_thread_state_t) 0x0001u)
@@ -143,6 +143,8 @@ typedef uint32_t zx_signals_t;
 #define ZX_FIFO_READABLE            __ZX_OBJECT_READABLE
 #define ZX_FIFO_WRITABLE            __ZX_OBJECT_WRITABLE
 #define ZX_FIFO_PEER_CLOSED         __ZX_OBJECT_PEER_CLOSED
+#define ZX_FIFO_READ_THRESHOLD      __ZX_OBJECT_SIGNAL_10
+#define ZX_FIFO_WRITE_THRESHOLD     __ZX_OBJECT_SIGNAL_11
 
 // Task signals (process, thread, job)
 #define ZX_TASK_TERMINATED          __ZX_OBJECT_SIGNALED
@@ -188,6 +190,15 @@ typedef struct zx_channel_call_args {
     uint32_t rd_num_handles;
 } zx_channel_call_args_t;
 
+// One fragment of a message for zx_channel_write() with
+// ZX_CHANNEL_WRITE_USE_IOVEC or zx_channel_read() with
+// ZX_CHANNEL_READ_USE_IOVEC.
+typedef struct zx_channel_iovec {
+    void* buffer;
+    uint32_t capacity;
+    uint32_t reserved;
+} zx_channel_iovec_t;
+
 // Maximum number of wait items allowed for zx_object_wait_many()
 // TODO(ZX-1349) Re-lower this.
 #define ZX_WAIT_MANY_MAX_ITEMS ((size_t)16)
@@ -312,9 +323,15 @@ typedef uint64_t zx_off_t;
 
 // Channel options and limits.
 #define ZX_CHANNEL_READ_MAY_DISCARD         ((uint32_t)1u)
+#define ZX_CHANNEL_READ_USE_IOVEC           ((uint32_t)1u << 1)
+#define ZX_CHANNEL_WRITE_USE_IOVEC          ((uint32_t)1u << 1)
 
 #define ZX_CHANNEL_MAX_MSG_BYTES            ((uint32_t)65536u)
 #define ZX_CHANNEL_MAX_MSG_HANDLES          ((uint32_t)64u)
+#define ZX_CHANNEL_MAX_MSG_IOVECS           ((uint32_t)64u)
+
+// Fifo limits.
+#define ZX_FIFO_MAX_SIZE_BYTES              ((uint32_t)65536u)
 
 // Socket options and limits.
 // These options can be passed to zx_socket_write()
@@ -327,11 +344,31 @@ typedef uint64_t zx_off_t;
 #define ZX_SOCKET_DATAGRAM                  ((uint32_t)1u << 0)
 #define ZX_SOCKET_HAS_CONTROL               ((uint32_t)1u << 1)
 #define ZX_SOCKET_HAS_ACCEPT                ((uint32_t)1u << 2)
-#define ZX_SOCKET_CREATE_MASK               (ZX_SOCKET_DATAGRAM | ZX_SOCKET_HAS_CONTROL | ZX_SOCKET_HAS_ACCEPT)
+#define ZX_SOCKET_RING                      ((uint32_t)1u << 3)
+#define ZX_SOCKET_CREATE_MASK               (ZX_SOCKET_DATAGRAM | ZX_SOCKET_HAS_CONTROL | \
+                                             ZX_SOCKET_HAS_ACCEPT | ZX_SOCKET_RING)
 
 // These can be passed to zx_socket_read() and zx_socket_write().
 #define ZX_SOCKET_CONTROL                   ((uint32_t)1u << 2)
 
+// This can be passed to zx_socket_read() on a ZX_SOCKET_RING socket.
+#define ZX_SOCKET_CONSUME                   ((uint32_t)1u << 3)
+
+// The VMO returned by zx_socket_get_ring() starts with this header.  The
+// ring itself is |size| bytes starting at ZX_SOCKET_RING_DATA_OFFSET.
+// |head| and |tail| count every byte ever written to and consumed from the
+// ring, so the unread bytes are [tail, head), and byte |i| lives at ring
+// offset (i % size).  Only the kernel updates the header; it stores |head|
+// after the bytes it covers.
+typedef struct zx_socket_ring_header {
+    uint64_t head;
+    uint64_t tail;
+    uint64_t size;
+    uint64_t reserved;
+} zx_socket_ring_header_t;
+
+#define ZX_SOCKET_RING_DATA_OFFSET          ((uint64_t)4096u)
+
 // Flags which can be used to to control cache policy for APIs which map memory.
 #define ZX_CACHE_POLICY_CACHED              ((uint32_t)0u)
 #define ZX_CACHE_POLICY_UNCACHED            ((uint32_t)1u)
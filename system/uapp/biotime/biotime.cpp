@@ -16,6 +16,7 @@
 #include <perftest/results.h>
 #include <zircon/device/block.h>
 #include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
 #include <zircon/time.h>
 #include <zircon/types.h>
 
@@ -124,8 +125,10 @@ typedef struct {
     size_t xfer;
     uint64_t seed;
     int max_pending;
+    int batch;
     bool write;
     bool linear;
+    size_t wakeups;
 
     fbl::atomic<int> pending;
     sync_completion_t signal;
@@ -211,32 +214,54 @@ static zx_status_t bio_random(bio_random_args_t* a, uint64_t* _total, zx_duratio
     size_t count = a->count;
     zx_handle_t fifo = a->blk->fifo;
 
+    // With a batch size, only wake up once that many responses are queued,
+    // as long as that many requests are outstanding.
+    if (a->batch > 1) {
+        size_t threshold = a->batch;
+        zx_status_t r = zx_object_set_property(fifo, ZX_PROP_FIFO_RX_THRESHOLD,
+                                               &threshold, sizeof(threshold));
+        if (r != ZX_OK) {
+            fprintf(stderr, "error: cannot set fifo read threshold: %d\n", r);
+            return r;
+        }
+    }
+    a->wakeups = 0;
+
     zx_time_t t0 = zx_clock_get_monotonic();
     thrd_create(&t, bio_random_thread, a);
 
     while (count > 0) {
-        block_fifo_response_t resp;
-        zx_status_t r = zx_fifo_read(fifo, sizeof(resp), &resp, 1, NULL);
+        block_fifo_response_t resp[BLOCK_FIFO_MAX_DEPTH];
+        size_t actual;
+        zx_status_t r = zx_fifo_read(fifo, sizeof(resp[0]), resp, BLOCK_FIFO_MAX_DEPTH, &actual);
         if (r == ZX_ERR_SHOULD_WAIT) {
-            r = zx_object_wait_one(fifo, ZX_FIFO_READABLE | ZX_FIFO_PEER_CLOSED,
-                                   ZX_TIME_INFINITE, NULL);
+            zx_signals_t signals = ZX_FIFO_PEER_CLOSED;
+            if (a->batch > 1 && a->pending.load() >= a->batch) {
+                signals |= ZX_FIFO_READ_THRESHOLD;
+            } else {
+                signals |= ZX_FIFO_READABLE;
+            }
+            r = zx_object_wait_one(fifo, signals, ZX_TIME_INFINITE, NULL);
             if (r != ZX_OK) {
                 fprintf(stderr, "failed waiting for fifo: %d\n", r);
                 goto fail;
             }
+            a->wakeups++;
             continue;
         } else if (r < 0) {
             fprintf(stderr, "error: failed reading fifo: %d\n", r);
             goto fail;
         }
-        if (resp.status != ZX_OK) {
-            fprintf(stderr, "error: io txn failed %d (%zu remaining)\n",
-                    resp.status, count);
-            goto fail;
-        }
-        count--;
-        if (a->pending.fetch_sub(1) == a->max_pending) {
-            sync_completion_signal(&a->signal);
+        for (size_t i = 0; i < actual; i++) {
+            if (resp[i].status != ZX_OK) {
+                fprintf(stderr, "error: io txn failed %d (%zu remaining)\n",
+                        resp[i].status, count);
+                goto fail;
+            }
+            count--;
+            if (a->pending.fetch_sub(1) == a->max_pending) {
+                sync_completion_signal(&a->signal);
+            }
         }
     }
 
@@ -261,15 +286,16 @@ void usage(void) {
                     "\n"
                     "args:  -bs <num>     transfer block size (multiple of 4K)\n"
                     "       -tt <num>     total bytes to transfer\n"
-                    "       -mo <num>     maximum outstanding ops (1..128)\n"
+                    "       -mo <num>     maximum outstanding ops (1..%zu)\n"
+                    "       -batch <num>  wait for <num> responses at a time (default 1)\n"
                     "       -read         test reading from the block device (default)\n"
                     "       -write        test writing to the block device\n"
                     "       -live-dangerously  required if using \"-write\"\n"
                     "       -linear       transfers in linear order (default)\n"
                     "       -random       random transfers across total range\n"
                     "       -output-file <filename>  destination file for "
-                    "writing results in JSON format\n"
-                    );
+                    "writing results in JSON format\n",
+                    BLOCK_FIFO_MAX_DEPTH);
 }
 
 #define needparam() do { \
@@ -290,6 +316,7 @@ int main(int argc, char** argv) {
     a.xfer = 32768;
     a.seed = 7891263897612ULL;
     a.max_pending = 128;
+    a.batch = 1;
     a.write = false;
     a.linear = true;
     const char* output_file = nullptr;
@@ -313,10 +340,17 @@ int main(int argc, char** argv) {
         } else if (!strcmp(argv[0], "-mo")) {
             needparam();
             size_t n = number(argv[0]);
-            if ((n < 1) || (n > 128)) {
-                error("error: max pending must be between 1 and 128\n");
+            if ((n < 1) || (n > BLOCK_FIFO_MAX_DEPTH)) {
+                error("error: max pending must be between 1 and %zu\n", BLOCK_FIFO_MAX_DEPTH);
             }
             a.max_pending = static_cast<int>(n);
+        } else if (!strcmp(argv[0], "-batch")) {
+            needparam();
+            size_t n = number(argv[0]);
+            if ((n < 1) || (n > BLOCK_FIFO_MAX_DEPTH)) {
+                error("error: batch must be between 1 and %zu\n", BLOCK_FIFO_MAX_DEPTH);
+            }
+            a.batch = static_cast<int>(n);
         } else if (!strcmp(argv[0], "-read")) {
             a.write = false;
         } else if (!strcmp(argv[0], "-write")) {
@@ -344,6 +378,9 @@ int main(int argc, char** argv) {
     if (argc > 1) {
         error("error: unexpected arguments\n");
     }
+    if (a.batch > a.max_pending) {
+        error("error: batch may not exceed max pending\n");
+    }
     if (a.write && !live_dangerously) {
         error("error: the option \"-live-dangerously\" is required when using"
               " \"-write\"\n");
@@ -377,6 +414,8 @@ int main(int argc, char** argv) {
     bytes_per_second(total, res);
     fprintf(stderr, "%zu ops in %zu ns: ", a.count, res);
     ops_per_second(a.count, res);
+    fprintf(stderr, "%zu wakeups for %zu ops (queue depth %d, batch %d)\n",
+            a.wakeups, a.count, a.max_pending, a.batch);
 
     if (output_file) {
         perftest::ResultsSet results;
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fbl/algorithm.h>
 #include <fbl/unique_ptr.h>
@@ -36,7 +37,59 @@ struct TestArgs {
     uint32_t queue;
 };
 
-void do_test(uint32_t duration_sec, const TestArgs& test_args) {
+// How the message bytes get to and from the channel.  The split modes treat
+// the message as a header followed by a payload kept in separate buffers, as
+// FIDL messages with out-of-line data are.
+enum class Transfer {
+    // One contiguous buffer.
+    kContiguous,
+    // The header and payload are copied into a scratch buffer before each
+    // write and out of it after each read.
+    kLinearized,
+    // The header and payload are passed to the kernel as iovecs.
+    kIovec,
+};
+
+constexpr uint32_t kHeaderSize = 16;
+
+// Where the message buffer lives.  The kernel can move whole pages of a large
+// message into a page aligned read buffer instead of copying them.
+enum class Placement {
+    kHeap,
+    kPageAligned,
+    // Just past a page boundary, so the kernel has to copy.
+    kMisaligned,
+};
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kMisalignment = 8;
+
+const char* placement_name(Placement placement) {
+    switch (placement) {
+    case Placement::kHeap:
+        return "";
+    case Placement::kPageAligned:
+        return ", page aligned";
+    case Placement::kMisaligned:
+        return ", misaligned";
+    }
+    return "";
+}
+
+const char* transfer_name(Transfer transfer) {
+    switch (transfer) {
+    case Transfer::kContiguous:
+        return "write/read";
+    case Transfer::kLinearized:
+        return "linearized write/read";
+    case Transfer::kIovec:
+        return "iovec write/read";
+    }
+    return "?";
+}
+
+void do_test(uint32_t duration_sec, const TestArgs& test_args, Transfer transfer,
+             Placement placement = Placement::kHeap) {
     __UNUSED zx_status_t status;
 
     zx_duration_t duration_ns = ZX_SEC(duration_sec);
@@ -51,9 +104,20 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     assert(zx_event_create(0u, &event) == ZX_OK);
 
     // Storage space for our messages' stuff.
-    fbl::unique_ptr<uint8_t[]> data;
+    void* storage = nullptr;
+    uint8_t* data = nullptr;
     if (test_args.size) {
-        data.reset(new uint8_t[test_args.size]);
+        if (placement == Placement::kHeap) {
+            storage = malloc(test_args.size);
+            data = static_cast<uint8_t*>(storage);
+        } else {
+            size_t len = fbl::round_up(test_args.size + kMisalignment, kPageSize);
+            storage = aligned_alloc(kPageSize, len);
+            data = static_cast<uint8_t*>(storage);
+            if (placement == Placement::kMisaligned)
+                data += kMisalignment;
+        }
+        assert(storage);
         for (uint32_t i = 0; i < test_args.size; i++)
             data[i] = static_cast<uint8_t>(i);
     }
@@ -61,10 +125,22 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     if (test_args.handles)
         handles.reset(new zx_handle_t[test_args.handles]);
 
+    // The split modes keep the header and payload apart from |data|.
+    const uint32_t header_size = fbl::min(kHeaderSize, test_args.size);
+    const uint32_t payload_size = test_args.size - header_size;
+    uint8_t header[kHeaderSize] = {};
+    fbl::unique_ptr<uint8_t[]> payload;
+    if (payload_size)
+        payload.reset(new uint8_t[payload_size]);
+    zx_channel_iovec_t iovecs[2] = {
+        {header, header_size, 0},
+        {payload.get(), payload_size, 0},
+    };
+
     // Pre-queue |test_args.queue| messages (there'll always be this many messages in the queue).
     for (uint32_t i = 0; i < test_args.queue; i++) {
         duplicate_handles(test_args.handles, event, handles.get());
-        status = zx_channel_write(mp[0], 0u, data.get(), test_args.size,
+        status = zx_channel_write(mp[0], 0u, data, test_args.size,
                                   handles.get(), test_args.handles);
         assert(status == ZX_OK);
     }
@@ -78,14 +154,37 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     for (;;) {
         big_its++;
         for (uint32_t i = 0; i < big_it_size; i++) {
-            status = zx_channel_write(mp[0], 0, data.get(), test_args.size,
-                                      handles.get(), test_args.handles);
-            assert(status == ZX_OK);
-
             uint32_t r_size = test_args.size;
             uint32_t r_handles = test_args.handles;
-            status = zx_channel_read(mp[1], 0u, data.get(), handles.get(), r_size,
-                                     r_handles, &r_size, &r_handles);
+            switch (transfer) {
+            case Transfer::kContiguous:
+                status = zx_channel_write(mp[0], 0, data, test_args.size,
+                                          handles.get(), test_args.handles);
+                assert(status == ZX_OK);
+                status = zx_channel_read(mp[1], 0u, data, handles.get(), r_size,
+                                         r_handles, &r_size, &r_handles);
+                break;
+            case Transfer::kLinearized:
+                memcpy(data, header, header_size);
+                if (payload_size)
+                    memcpy(data + header_size, payload.get(), payload_size);
+                status = zx_channel_write(mp[0], 0, data, test_args.size,
+                                          handles.get(), test_args.handles);
+                assert(status == ZX_OK);
+                status = zx_channel_read(mp[1], 0u, data, handles.get(), r_size,
+                                         r_handles, &r_size, &r_handles);
+                memcpy(header, data, header_size);
+                if (payload_size)
+                    memcpy(payload.get(), data + header_size, payload_size);
+                break;
+            case Transfer::kIovec:
+                status = zx_channel_write(mp[0], ZX_CHANNEL_WRITE_USE_IOVEC, iovecs, 2,
+                                          handles.get(), test_args.handles);
+                assert(status == ZX_OK);
+                status = zx_channel_read(mp[1], ZX_CHANNEL_READ_USE_IOVEC, iovecs,
+                                         handles.get(), 2, r_handles, &r_size, &r_handles);
+                break;
+            }
             assert(status == ZX_OK);
             assert(r_size == test_args.size);
             assert(r_handles == test_args.handles);
@@ -100,6 +199,7 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
         status = zx_handle_close(handles[i]);
         assert(status == ZX_OK);
     }
+    free(storage);
     status = zx_handle_close(event);
     assert(status == ZX_OK);
     status = zx_handle_close(mp[0]);
@@ -109,9 +209,30 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
 
     double real_duration = static_cast<double>(zx_time_sub_time(end_ns, start_ns)) / 1000000000.0;
     double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
-    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
+    printf("%s %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued%s): "
                "%.0f iterations/second\n",
-           test_args.size, test_args.handles, test_args.queue, its_per_second);
+           transfer_name(transfer), test_args.size, test_args.handles, test_args.queue,
+           placement_name(placement), its_per_second);
+}
+
+// Compares page aligned buffers, which let the kernel move the whole pages of
+// large messages, with misaligned ones, which make it copy, across sizes.
+void do_page_sweep(uint32_t duration_sec) {
+    static constexpr uint32_t sizes[] = {4096, 8192, 12288, 16384, 32768, 65536};
+    for (size_t i = 0; i < fbl::count_of(sizes); i++) {
+        TestArgs test_args = {sizes[i], 0, 0};
+        do_test(duration_sec, test_args, Transfer::kContiguous, Placement::kMisaligned);
+        do_test(duration_sec, test_args, Transfer::kContiguous, Placement::kPageAligned);
+    }
+}
+
+void do_tests(uint32_t duration_sec, const TestArgs& test_args, bool split) {
+    if (split) {
+        do_test(duration_sec, test_args, Transfer::kLinearized);
+        do_test(duration_sec, test_args, Transfer::kIovec);
+    } else {
+        do_test(duration_sec, test_args, Transfer::kContiguous);
+    }
 }
 
 }  // namespace
@@ -124,6 +245,10 @@ int main(int argc, char** argv) {
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
         "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -P    run a size sweep of page aligned against misaligned buffers\n"
+        "        (ignores -S/-H/-Q/-V)\n"
+        "  -V    split each message into a header and a payload, and compare\n"
+        "        copying them into one buffer against passing them as iovecs\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
@@ -131,6 +256,8 @@ int main(int argc, char** argv) {
         "  -Q N  set message pre-queue count to N messages (default: 0)\n";
 
     bool run_suite = false;  // -o/-s
+    bool split = false;      // -V
+    bool page_sweep = false; // -P
     uint32_t duration = 5;   // -d
     uint32_t repeats = 1;    // -n
     // Ignored when running a suite:
@@ -141,7 +268,7 @@ int main(int argc, char** argv) {
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosPVn:d:S:H:Q:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -163,6 +290,12 @@ int main(int argc, char** argv) {
             case 's':
                 run_suite = true;
                 break;
+            case 'P':
+                page_sweep = true;
+                break;
+            case 'V':
+                split = true;
+                break;
             case 'n':
                 assert(optarg);
                 repeats = value;
@@ -199,7 +332,9 @@ int main(int argc, char** argv) {
                    repeats);
         }
 
-        if (run_suite) {
+        if (page_sweep) {
+            do_page_sweep(duration);
+        } else if (run_suite) {
             static constexpr TestArgs suite[] = {
                 {10, 0, 0},
                 {100, 0, 0},
@@ -218,9 +353,9 @@ int main(int argc, char** argv) {
                 {1000, 0, 1},
             };
             for (size_t i = 0; i < fbl::count_of(suite); i++)
-                do_test(duration, suite[i]);
+                do_tests(duration, suite[i], split);
         } else {
-            do_test(duration, test_args);
+            do_tests(duration, test_args, split);
         }
     }
 
@@ -0,0 +1,237 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how futex operations scale with the number of threads in a process
+// when every thread (or pair of threads) uses its own futex.  Unrelated
+// futexes should not contend with each other in the kernel.
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/compiler.h>
+#include <zircon/syscalls.h>
+#include <zircon/time.h>
+#include <zircon/types.h>
+
+namespace {
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+enum class Workload {
+    // Each thread wakes its own futex and then waits on it with a stale
+    // value.  Neither call blocks, so this measures the cost of getting in
+    // and out of the futex table.
+    kWakeWait,
+    // Threads are paired up and pass a token back and forth through a futex
+    // private to the pair, blocking and waking each other.
+    kPingPong,
+};
+
+const char* workload_name(Workload workload) {
+    return workload == Workload::kWakeWait ? "wake/wait" : "ping-pong";
+}
+
+struct alignas(64) ThreadState {
+    zx_futex_t futex;
+    uint64_t iterations;
+};
+
+struct TestState {
+    Workload workload;
+    ThreadState* threads;
+    volatile bool start;
+    volatile bool stop;
+};
+
+struct ThreadArgs {
+    TestState* test;
+    uint32_t index;
+};
+
+int wake_wait_thread(TestState* test, ThreadState* self) {
+    uint64_t iterations = 0;
+    while (!test->stop) {
+        __UNUSED zx_status_t status = zx_futex_wake(&self->futex, 1);
+        assert(status == ZX_OK);
+        status = zx_futex_wait(&self->futex, self->futex + 1, ZX_TIME_INFINITE);
+        assert(status == ZX_ERR_BAD_STATE);
+        iterations++;
+    }
+    self->iterations = iterations;
+    return 0;
+}
+
+// The futex of the even thread of each pair holds whose turn it is: 0 for the
+// even thread, 1 for the odd one.
+int ping_pong_thread(TestState* test, ThreadState* self, ThreadState* pair, int me) {
+    zx_futex_t* turn = me == 0 ? &self->futex : &pair->futex;
+    uint64_t iterations = 0;
+    while (!test->stop) {
+        int value;
+        while ((value = __atomic_load_n(turn, __ATOMIC_ACQUIRE)) != me) {
+            if (test->stop)
+                break;
+            zx_futex_wait(turn, value, zx_deadline_after(ZX_MSEC(10)));
+        }
+        __atomic_store_n(turn, 1 - me, __ATOMIC_RELEASE);
+        zx_futex_wake(turn, 1);
+        iterations++;
+    }
+    self->iterations = iterations;
+    return 0;
+}
+
+int test_thread(void* arg) {
+    ThreadArgs* args = static_cast<ThreadArgs*>(arg);
+    TestState* test = args->test;
+    ThreadState* self = &test->threads[args->index];
+    while (!test->start) {
+    }
+    if (test->workload == Workload::kWakeWait)
+        return wake_wait_thread(test, self);
+    int me = args->index % 2;
+    ThreadState* pair = &test->threads[args->index ^ 1];
+    return ping_pong_thread(test, self, pair, me);
+}
+
+void do_test(uint32_t duration_sec, Workload workload, uint32_t num_threads) {
+    if (workload == Workload::kPingPong && num_threads % 2 != 0) {
+        printf("%s needs an even number of threads, skipping %" PRIu32 "\n",
+               workload_name(workload), num_threads);
+        return;
+    }
+
+    fbl::unique_ptr<ThreadState[]> threads(new ThreadState[num_threads]);
+    fbl::unique_ptr<ThreadArgs[]> args(new ThreadArgs[num_threads]);
+    fbl::unique_ptr<thrd_t[]> handles(new thrd_t[num_threads]);
+    TestState test = {workload, threads.get(), false, false};
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        threads[i].futex = 0;
+        threads[i].iterations = 0;
+        args[i] = {&test, i};
+        __UNUSED int ret = thrd_create(&handles[i], test_thread, &args[i]);
+        assert(ret == thrd_success);
+    }
+
+    zx_time_t start_ns = zx_clock_get_monotonic();
+    test.start = true;
+    zx_nanosleep(zx_deadline_after(ZX_SEC(duration_sec)));
+    test.stop = true;
+    for (uint32_t i = 0; i < num_threads; i++)
+        thrd_join(handles[i], nullptr);
+    zx_time_t end_ns = zx_clock_get_monotonic();
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < num_threads; i++)
+        total += threads[i].iterations;
+
+    double real_duration = static_cast<double>(zx_time_sub_time(end_ns, start_ns)) / 1000000000.0;
+    double ops_per_second = static_cast<double>(total) / real_duration;
+    printf("%s, %2" PRIu32 " threads: %.0f iterations/second (%.0f per thread)\n",
+           workload_name(workload), num_threads, ops_per_second, ops_per_second / num_threads);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -o    run single test (default)\n"
+        "  -s    run suite of thread counts for both workloads (ignores -t/-p)\n"
+        "  -p    use the ping-pong workload instead of wake/wait\n"
+        "  -n N  set test repetition count to N (default: 1)\n"
+        "  -d N  set test duration to N seconds (default: 5)\n"
+        "  -t N  set thread count to N (default: 4)\n";
+
+    bool run_suite = false;                   // -o/-s
+    Workload workload = Workload::kWakeWait;  // -p
+    uint32_t duration = 5;                    // -d
+    uint32_t repeats = 1;                     // -n
+    uint32_t num_threads = 4;                 // -t
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hospn:d:t:")) != -1) {
+        // Our option values are always unsigned numbers.
+        uint32_t value = 0;
+        if (optarg) {
+            errno = 0;
+            char* endptr = nullptr;
+            unsigned long long v = strtoull(optarg, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || v > UINT32_MAX)
+                argument_error(argv[0], "invalid numeric optional value");
+            value = static_cast<uint32_t>(v);
+        }
+
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0]);
+                return EXIT_SUCCESS;
+            case 'o':
+                run_suite = false;
+                break;
+            case 's':
+                run_suite = true;
+                break;
+            case 'p':
+                workload = Workload::kPingPong;
+                break;
+            case 'n':
+                assert(optarg);
+                repeats = value;
+                break;
+            case 'd':
+                assert(optarg);
+                duration = value;
+                break;
+            case 't':
+                assert(optarg);
+                if (value == 0)
+                    argument_error(argv[0], "thread count must be positive");
+                num_threads = value;
+                break;
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+
+    for (uint32_t i = 0; i < repeats; i++) {
+        if (repeats > 1u) {
+            if (i > 0u)
+                printf("\n");
+            printf("Test iteration #%" PRIu32 " (of %" PRIu32 "):\n", i + 1,
+                   repeats);
+        }
+
+        if (run_suite) {
+            static constexpr Workload workloads[] = {Workload::kWakeWait, Workload::kPingPong};
+            static constexpr uint32_t suite[] = {2, 4, 8, 16, 32};
+            for (size_t w = 0; w < fbl::count_of(workloads); w++) {
+                for (size_t j = 0; j < fbl::count_of(suite); j++)
+                    do_test(duration, workloads[w], suite[j]);
+            }
+        } else {
+            do_test(duration, workload, num_threads);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Prints kernel counters by mapping the VMOs the kernel exports them in,
+// so sampling them takes no system calls at all.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lib/fdio/io.h>
+#include <lib/zircon-internal/kcounters.h>
+#include <zircon/process.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+
+namespace {
+
+constexpr char kDescPath[] = "/boot/kernel/" KCOUNTER_DESC_VMO_NAME;
+constexpr char kArenaPath[] = "/boot/kernel/" KCOUNTER_ARENA_VMO_NAME;
+
+// Maps the whole of the VMO behind |path| read-only.
+zx_status_t map_file(const char* path, const void** data, uint64_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "kcounter: cannot open %s: %s\n", path, strerror(errno));
+        return ZX_ERR_NOT_FOUND;
+    }
+    zx_handle_t vmo;
+    zx_status_t status = fdio_get_vmo_exact(fd, &vmo);
+    close(fd);
+    if (status != ZX_OK) {
+        fprintf(stderr, "kcounter: cannot get VMO for %s: %s\n", path,
+                zx_status_get_string(status));
+        return status;
+    }
+    status = zx_vmo_get_size(vmo, size);
+    if (status == ZX_OK) {
+        uintptr_t addr;
+        status = zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ, 0, vmo, 0, *size, &addr);
+        *data = reinterpret_cast<const void*>(addr);
+    }
+    zx_handle_close(vmo);
+    if (status != ZX_OK) {
+        fprintf(stderr, "kcounter: cannot map %s: %s\n", path, zx_status_get_string(status));
+    }
+    return status;
+}
+
+bool matches(const char* name, int argc, char** argv) {
+    if (argc == 0)
+        return true;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+            return true;
+    }
+    return false;
+}
+
+void print_counters(const kcounter_desc_vmo_t* desc, const int64_t* arena,
+                    int argc, char** argv) {
+    for (uint32_t i = 0; i < desc->num_counters; i++) {
+        const char* name = desc->descriptors[i].name;
+        if (!matches(name, argc, argv))
+            continue;
+        int64_t value = 0;
+        for (uint32_t cpu = 0; cpu < desc->max_cpus; cpu++)
+            value += arena[cpu * desc->num_counters + i];
+        printf("%s = %" PRId64 "\n", name, value);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...] [prefix ...]\n"
+        "\n"
+        "Prints the kernel counters whose names start with any of the\n"
+        "prefixes, or all of them.\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -w N  print the counters again every N seconds\n";
+
+    uint32_t watch_sec = 0;  // -w
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hw:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf(help, argv[0]);
+            return EXIT_SUCCESS;
+        case 'w': {
+            char* endptr = nullptr;
+            unsigned long v = strtoul(optarg, &endptr, 10);
+            if (*endptr != '\0' || v == 0 || v > UINT32_MAX) {
+                fprintf(stderr, "%s: error: invalid interval\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+            watch_sec = static_cast<uint32_t>(v);
+            break;
+        }
+        default:  // '?'
+            fprintf(stderr, "%s: error: invalid option\nRun with -h for help.\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const void* desc_data;
+    const void* arena_data;
+    uint64_t desc_size, arena_size;
+    if (map_file(kDescPath, &desc_data, &desc_size) != ZX_OK ||
+        map_file(kArenaPath, &arena_data, &arena_size) != ZX_OK) {
+        return EXIT_FAILURE;
+    }
+
+    const auto* desc = static_cast<const kcounter_desc_vmo_t*>(desc_data);
+    if (desc_size < sizeof(*desc) || desc->magic != KCOUNTER_DESC_MAGIC ||
+        desc_size < sizeof(*desc) + desc->num_counters * sizeof(desc->descriptors[0]) ||
+        arena_size < uint64_t{desc->max_cpus} * desc->num_counters * sizeof(int64_t)) {
+        fprintf(stderr, "kcounter: unexpected layout of the counter VMOs\n");
+        return EXIT_FAILURE;
+    }
+    const auto* arena = static_cast<const int64_t*>(arena_data);
+
+    argc -= optind;
+    argv += optind;
+    print_counters(desc, arena, argc, argv);
+    while (watch_sec > 0) {
+        zx_nanosleep(zx_deadline_after(ZX_SEC(watch_sec)));
+        printf("\n");
+        print_counters(desc, arena, argc, argv);
+    }
+    return EXIT_SUCCESS;
+}
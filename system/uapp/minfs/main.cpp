@@ -82,6 +82,7 @@ int usage() {
                     "    -v|--verbose                  Some debug messages\n"
                     "    -r|--readonly                 Mount filesystem read-only\n"
                     "    -m|--metrics                  Collect filesystem metrics\n"
+                    "    -n|--no-readahead             Do not read ahead of sequential reads\n"
                     "    -s|--fvm_data_slices SLICES   When mkfs on top of FVM,\n"
                     "                                  preallocate |SLICES| slices of data. \n"
                     "    -h|--help                     Display this message\n"
@@ -120,12 +121,13 @@ int main(int argc, char** argv) {
             {"readonly", no_argument, nullptr, 'r'},
             {"metrics", no_argument, nullptr, 'm'},
             {"verbose", no_argument, nullptr, 'v'},
+            {"no-readahead", no_argument, nullptr, 'n'},
             {"fvm_data_slices", required_argument, nullptr, 's'},
             {"help", no_argument, nullptr, 'h'},
             {nullptr, 0, nullptr, 0},
         };
         int opt_index;
-        int c = getopt_long(argc, argv, "rmvhs:", opts, &opt_index);
+        int c = getopt_long(argc, argv, "rmvnhs:", opts, &opt_index);
         if (c < 0) {
             break;
         }
@@ -139,6 +141,9 @@ int main(int argc, char** argv) {
         case 'v':
             options.verbose = true;
             break;
+        case 'n':
+            options.readahead = false;
+            break;
         case 's':
             options.fvm_data_slices = static_cast<uint32_t>(strtoul(optarg, NULL, 0));
             break;
@@ -26,6 +26,9 @@
 // The port wait key associated with the dispatcher's control messages.
 #define KEY_CONTROL (0u)
 
+// The most packets a single dispatch thread takes from the port at a time.
+#define PACKET_BATCH_SIZE (16u)
+
 static zx_time_t async_loop_now(async_dispatcher_t* dispatcher);
 static zx_status_t async_loop_begin_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
 static zx_status_t async_loop_cancel_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
@@ -90,9 +93,19 @@ typedef struct async_loop {
     list_node_t due_list; // due tasks, earliest deadline first
     list_node_t thread_list; // earliest created thread first
     list_node_t exception_list; // most recently added first
+
+    // Packets taken from the port by zx_port_wait_batch() but not dispatched
+    // yet, oldest first, starting at |pending_head|.  Guarded by |lock|.
+    zx_port_packet_t pending[PACKET_BATCH_SIZE];
+    size_t pending_head;
+    size_t pending_count;
 } async_loop_t;
 
 static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline);
+static zx_status_t async_loop_wait_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* packet);
+static zx_status_t async_loop_dispatch_port_packet(async_loop_t* loop,
+                                                   const zx_port_packet_t* packet);
 static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wait,
                                             zx_status_t status, const zx_packet_signal_t* signal);
 static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop);
@@ -109,6 +122,8 @@ static zx_status_t async_loop_dispatch_exception(async_loop_t* loop,
                                                  zx_status_t status,
                                                  const zx_port_packet_t* report);
 static void async_loop_wake_threads(async_loop_t* loop);
+static zx_status_t async_loop_cancel_pending_wait_locked(async_loop_t* loop,
+                                                         async_wait_t* wait);
 static void async_loop_insert_task_locked(async_loop_t* loop, async_task_t* task);
 static void async_loop_restart_timer_locked(async_loop_t* loop);
 static void async_loop_invoke_prologue(async_loop_t* loop);
@@ -259,48 +274,94 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
         return ZX_ERR_CANCELED;
 
     zx_port_packet_t packet;
-    zx_status_t status = zx_port_wait(loop->port, deadline, &packet);
+    zx_status_t status = async_loop_wait_packet(loop, deadline, &packet);
+    if (status != ZX_OK)
+        return status;
+    return async_loop_dispatch_port_packet(loop, &packet);
+}
+
+// Takes the next packet, either one already taken from the port by an
+// earlier call or a fresh one from the port.
+//
+// A thread running the loop alone drains as many packets as are available
+// with one system call and keeps the rest in |loop->pending| for its next
+// iterations.  Packets parked there cannot be picked up by threads blocked
+// in the port, so while several threads run the loop each takes just one.
+static zx_status_t async_loop_wait_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* packet) {
+    mtx_lock(&loop->lock);
+    if (loop->pending_count > 0) {
+        *packet = loop->pending[loop->pending_head];
+        loop->pending_head = (loop->pending_head + 1) % PACKET_BATCH_SIZE;
+        loop->pending_count--;
+        mtx_unlock(&loop->lock);
+        return ZX_OK;
+    }
+    mtx_unlock(&loop->lock);
+
+    if (atomic_load_explicit(&loop->active_threads, memory_order_acquire) > 1u)
+        return zx_port_wait(loop->port, deadline, packet);
+
+    zx_port_packet_t packets[PACKET_BATCH_SIZE];
+    size_t actual;
+    zx_status_t status = zx_port_wait_batch(loop->port, deadline, packets,
+                                            PACKET_BATCH_SIZE, &actual);
     if (status != ZX_OK)
         return status;
 
-    if (packet.key == KEY_CONTROL) {
+    // Only a thread that found itself alone parks packets, and the ring was
+    // empty when it looked, so all of them fit.  Threads that joined since
+    // then only ever take from the ring.
+    *packet = packets[0];
+    mtx_lock(&loop->lock);
+    ZX_DEBUG_ASSERT(loop->pending_count == 0);
+    loop->pending_head = 0;
+    for (size_t i = 1; i < actual; i++)
+        loop->pending[loop->pending_count++] = packets[i];
+    mtx_unlock(&loop->lock);
+    return ZX_OK;
+}
+
+static zx_status_t async_loop_dispatch_port_packet(async_loop_t* loop,
+                                                   const zx_port_packet_t* packet) {
+    if (packet->key == KEY_CONTROL) {
         // Handle wake-up packets.
-        if (packet.type == ZX_PKT_TYPE_USER)
+        if (packet->type == ZX_PKT_TYPE_USER)
             return ZX_OK;
 
         // Handle task timer expirations.
-        if (packet.type == ZX_PKT_TYPE_SIGNAL_REP &&
-            packet.signal.observed & ZX_TIMER_SIGNALED) {
+        if (packet->type == ZX_PKT_TYPE_SIGNAL_REP &&
+            packet->signal.observed & ZX_TIMER_SIGNALED) {
             return async_loop_dispatch_tasks(loop);
         }
     } else {
         // Handle wait completion packets.
-        if (packet.type == ZX_PKT_TYPE_SIGNAL_ONE) {
-            async_wait_t* wait = (void*)(uintptr_t)packet.key;
+        if (packet->type == ZX_PKT_TYPE_SIGNAL_ONE) {
+            async_wait_t* wait = (void*)(uintptr_t)packet->key;
             mtx_lock(&loop->lock);
             list_delete(wait_to_node(wait));
             mtx_unlock(&loop->lock);
-            return async_loop_dispatch_wait(loop, wait, packet.status, &packet.signal);
+            return async_loop_dispatch_wait(loop, wait, packet->status, &packet->signal);
         }
 
         // Handle queued user packets.
-        if (packet.type == ZX_PKT_TYPE_USER) {
-            async_receiver_t* receiver = (void*)(uintptr_t)packet.key;
-            return async_loop_dispatch_packet(loop, receiver, packet.status, &packet.user);
+        if (packet->type == ZX_PKT_TYPE_USER) {
+            async_receiver_t* receiver = (void*)(uintptr_t)packet->key;
+            return async_loop_dispatch_packet(loop, receiver, packet->status, &packet->user);
         }
 
         // Handle guest bell trap packets.
-        if (packet.type == ZX_PKT_TYPE_GUEST_BELL) {
-            async_guest_bell_trap_t* trap = (void*)(uintptr_t)packet.key;
+        if (packet->type == ZX_PKT_TYPE_GUEST_BELL) {
+            async_guest_bell_trap_t* trap = (void*)(uintptr_t)packet->key;
             return async_loop_dispatch_guest_bell_trap(
-                loop, trap, packet.status, &packet.guest_bell);
+                loop, trap, packet->status, &packet->guest_bell);
         }
 
         // Handle exception packets.
-        if (ZX_PKT_IS_EXCEPTION(packet.type)) {
-            async_exception_t* exception = (void*)(uintptr_t)packet.key;
-            return async_loop_dispatch_exception(loop, exception, packet.status,
-                                                 &packet);
+        if (ZX_PKT_IS_EXCEPTION(packet->type)) {
+            async_exception_t* exception = (void*)(uintptr_t)packet->key;
+            return async_loop_dispatch_exception(loop, exception, packet->status,
+                                                 packet);
         }
     }
 
@@ -528,6 +589,8 @@ static zx_status_t async_loop_cancel_wait(async_dispatcher_t* async, async_wait_
     // to cancel then we assume we lost the race.
     zx_status_t status = zx_port_cancel(loop->port, wait->object,
                                         (uintptr_t)wait);
+    if (status == ZX_ERR_NOT_FOUND)
+        status = async_loop_cancel_pending_wait_locked(loop, wait);
     if (status == ZX_OK) {
         list_delete(node);
     } else {
@@ -539,6 +602,22 @@ static zx_status_t async_loop_cancel_wait(async_dispatcher_t* async, async_wait_
     return status;
 }
 
+// The packet of a wait may have been taken from the port already and parked
+// in |loop->pending|, where zx_port_cancel() cannot see it.  Turns it into a
+// wake-up packet, which is dispatched as a no-op.
+static zx_status_t async_loop_cancel_pending_wait_locked(async_loop_t* loop,
+                                                         async_wait_t* wait) {
+    for (size_t i = 0; i < loop->pending_count; i++) {
+        zx_port_packet_t* packet = &loop->pending[(loop->pending_head + i) % PACKET_BATCH_SIZE];
+        if (packet->key == (uintptr_t)wait && packet->type == ZX_PKT_TYPE_SIGNAL_ONE) {
+            packet->key = KEY_CONTROL;
+            packet->type = ZX_PKT_TYPE_USER;
+            return ZX_OK;
+        }
+    }
+    return ZX_ERR_NOT_FOUND;
+}
+
 static zx_status_t async_loop_post_task(async_dispatcher_t* async, async_task_t* task) {
     async_loop_t* loop = (async_loop_t*)async;
     ZX_DEBUG_ASSERT(loop);
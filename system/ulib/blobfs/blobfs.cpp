@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,6 +38,14 @@ using digest::MerkleTree;
 namespace blobfs {
 namespace {
 
+// Number of data blocks in each chunk of a chunk-compressed blob.
+constexpr uint64_t kChunkBlocks = kBlobfsChunkSize / kBlobfsBlockSize;
+
+// Blobs populated on demand are verified one block at a time, which requires
+// that each block is exactly one leaf of the Merkle tree.
+static_assert(kBlobfsBlockSize == MerkleTree::kNodeSize,
+              "Blobfs blocks must align with Merkle tree leaves");
+
 zx_status_t CheckFvmConsistency(const Superblock* info, int block_fd) {
     if ((info->flags & kBlobFlagFVM) == 0) {
         return ZX_OK;
@@ -140,6 +149,20 @@ zx_status_t EnqueuePaginated(fbl::unique_ptr<WritebackWork>* work, Blobfs* blobf
     return ZX_OK;
 }
 
+// Enqueues the blob-relative blocks [blob_block, blob_block + nblocks), sourced
+// from |vmo| starting at |vmo_block|, to the on-disk locations described by
+// |extents|. Each contiguous run is paginated as by |EnqueuePaginated()|.
+zx_status_t EnqueueExtents(fbl::unique_ptr<WritebackWork>* work, Blobfs* blobfs, VnodeBlob* vn,
+                           const fbl::Vector<Extent>& extents, zx_handle_t vmo,
+                           uint64_t vmo_block, uint64_t blob_block, uint64_t nblocks) {
+    const uint64_t data_start = DataStartBlock(blobfs->info_);
+    return ForEachExtentRun(extents, blob_block, nblocks,
+                            [&](uint64_t block, uint64_t data_block, uint64_t count) {
+        return EnqueuePaginated(work, blobfs, vn, vmo, vmo_block + (block - blob_block),
+                                data_start + data_block, count);
+    });
+}
+
 }  // namespace
 
 Inode* Blobfs::GetNode(size_t index) const {
@@ -184,6 +207,10 @@ zx_status_t VnodeBlob::InitVmos() {
     auto cleanup = fbl::MakeAutoCall([this]() { BlobCloseHandles(); });
 
     zx_status_t status;
+    if ((status = LoadExtents()) != ZX_OK) {
+        FS_TRACE_ERROR("Failed to load blob extents; error: %d\n", status);
+        return status;
+    }
     uint64_t data_blocks = BlobDataBlocks(inode_);
     uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
     uint64_t num_blocks = data_blocks + merkle_blocks;
@@ -201,10 +228,26 @@ zx_status_t VnodeBlob::InitVmos() {
         return status;
     }
 
-    if ((inode_.flags & kBlobFlagLZ4Compressed) != 0) {
+    if ((inode_.flags & kBlobFlagChunkCompressed) != 0 && merkle_blocks > 0) {
+        // Chunk-compressed blobs are decompressed and verified on demand, one
+        // chunk at a time, as their data is accessed.
+        if ((status = InitChunked()) != ZX_OK) {
+            return status;
+        }
+        cleanup.cancel();
+        return ZX_OK;
+    } else if ((inode_.flags & (kBlobFlagLZ4Compressed | kBlobFlagChunkCompressed)) != 0) {
         if ((status = InitCompressed()) != ZX_OK) {
             return status;
         }
+    } else if (merkle_blocks > 0) {
+        // Uncompressed blobs large enough to have a Merkle tree are read and
+        // verified on demand, as their data is accessed.
+        if ((status = InitLazy()) != ZX_OK) {
+            return status;
+        }
+        cleanup.cancel();
+        return ZX_OK;
     } else {
         if ((status = InitUncompressed()) != ZX_OK) {
             return status;
@@ -223,7 +266,6 @@ zx_status_t VnodeBlob::InitCompressed() {
                    "blocks", inode_.num_blocks);
     fs::Ticker ticker(blobfs_->CollectingMetrics());
     fs::ReadTxn txn(blobfs_);
-    uint64_t start = inode_.start_block + DataStartBlock(blobfs_->info_);
     uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
 
     fbl::unique_ptr<fzl::MappedVmo> compressed_blob;
@@ -251,9 +293,14 @@ zx_status_t VnodeBlob::InitCompressed() {
     });
 
     // Read the uncompressed merkle tree.
-    txn.Enqueue(vmoid_, 0, start, merkle_blocks);
+    if ((status = EnqueueRead(&txn, vmoid_, 0, 0, merkle_blocks)) != ZX_OK) {
+        return status;
+    }
     // Read the compressed data.
-    txn.Enqueue(compressed_vmoid, 0, start + merkle_blocks, compressed_blocks);
+    if ((status = EnqueueRead(&txn, compressed_vmoid, 0, merkle_blocks,
+                              compressed_blocks)) != ZX_OK) {
+        return status;
+    }
 
     if ((status = txn.Transact()) != ZX_OK) {
         FS_TRACE_ERROR("Failed to flush read transaction: %d\n", status);
@@ -265,8 +312,13 @@ zx_status_t VnodeBlob::InitCompressed() {
 
     // Decompress the compressed data into the target buffer.
     size_t target_size = inode_.blob_size;
-    status = Decompressor::Decompress(GetData(), &target_size,
-                                      compressed_blob->GetData(), &compressed_size);
+    if (inode_.flags & kBlobFlagChunkCompressed) {
+        status = ChunkedDecompressor::Decompress(GetData(), &target_size,
+                                                 compressed_blob->GetData(), &compressed_size);
+    } else {
+        status = Decompressor::Decompress(GetData(), &target_size,
+                                          compressed_blob->GetData(), &compressed_size);
+    }
     if (status != ZX_OK) {
         FS_TRACE_ERROR("Failed to decompress data: %d\n", status);
         return status;
@@ -286,16 +338,309 @@ zx_status_t VnodeBlob::InitUncompressed() {
                    "blocks", inode_.num_blocks);
     fs::Ticker ticker(blobfs_->CollectingMetrics());
     fs::ReadTxn txn(blobfs_);
-    uint64_t start = inode_.start_block + DataStartBlock(blobfs_->info_);
 
     // Read both the uncompressed merkle tree and data.
     uint64_t length = BlobDataBlocks(inode_) + MerkleTreeBlocks(inode_);
-    txn.Enqueue(vmoid_, 0, start, length);
-    zx_status_t status = txn.Transact();
+    zx_status_t status = EnqueueRead(&txn, vmoid_, 0, 0, length);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = txn.Transact();
     blobfs_->UpdateMerkleDiskReadMetrics(length * kBlobfsBlockSize, ticker.End());
     return status;
 }
 
+zx_status_t VnodeBlob::InitLazy() {
+    TRACE_DURATION("blobfs", "Blobfs::InitLazy", "size", inode_.blob_size,
+                   "blocks", inode_.num_blocks);
+    fs::Ticker ticker(blobfs_->CollectingMetrics());
+    fs::ReadTxn txn(blobfs_);
+
+    // Read only the uncompressed merkle tree; the data is read as it is accessed.
+    uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
+    zx_status_t status = EnqueueRead(&txn, vmoid_, 0, 0, merkle_blocks);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = txn.Transact();
+    blobfs_->UpdateMerkleDiskReadMetrics(merkle_blocks * kBlobfsBlockSize, ticker.End());
+    if (status != ZX_OK) {
+        return status;
+    }
+    return populated_blocks_.Reset(BlobDataBlocks(inode_));
+}
+
+zx_status_t VnodeBlob::InitChunked() {
+    TRACE_DURATION("blobfs", "Blobfs::InitChunked", "size", inode_.blob_size,
+                   "blocks", inode_.num_blocks);
+    fs::Ticker ticker(blobfs_->CollectingMetrics());
+    fs::ReadTxn txn(blobfs_);
+    const uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
+    const uint64_t compressed_blocks = inode_.num_blocks - merkle_blocks;
+    const uint64_t table_blocks = fbl::round_up(ChunkedDecompressor::TableSize(inode_.blob_size),
+                                                kBlobfsBlockSize) / kBlobfsBlockSize;
+    if (table_blocks > compressed_blocks) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    zx_status_t status = fzl::MappedVmo::Create(compressed_blocks * kBlobfsBlockSize,
+                                               "compressed-blob", &compressed_blob_);
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("Failed to initialized compressed vmo; error: %d\n", status);
+        return status;
+    }
+    if ((status = blobfs_->AttachVmo(compressed_blob_->GetVmo(), &compressed_vmoid_)) != ZX_OK) {
+        compressed_blob_ = nullptr;
+        FS_TRACE_ERROR("Failed to attach commpressed VMO to blkdev: %d\n", status);
+        return status;
+    }
+
+    // Read the uncompressed merkle tree, and the table locating each chunk.
+    if ((status = EnqueueRead(&txn, vmoid_, 0, 0, merkle_blocks)) != ZX_OK) {
+        return status;
+    }
+    if ((status = EnqueueRead(&txn, compressed_vmoid_, 0, merkle_blocks,
+                              table_blocks)) != ZX_OK) {
+        return status;
+    }
+    status = txn.Transact();
+    blobfs_->UpdateMerkleDiskReadMetrics((merkle_blocks + table_blocks) * kBlobfsBlockSize,
+                                         ticker.End());
+    if (status != ZX_OK) {
+        return status;
+    }
+    if ((status = ChunkedDecompressor::ValidateTable(compressed_blob_->GetData(),
+                                                     compressed_blocks * kBlobfsBlockSize,
+                                                     inode_.blob_size)) != ZX_OK) {
+        FS_TRACE_ERROR("blobfs: Invalid chunk table: %d\n", status);
+        return status;
+    }
+    return populated_blocks_.Reset(BlobDataBlocks(inode_));
+}
+
+zx_status_t VnodeBlob::PopulateRange(uint64_t offset, uint64_t length) {
+    TRACE_DURATION("blobfs", "Blobfs::PopulateRange", "offset", offset, "length", length);
+    const uint64_t data_blocks = populated_blocks_.size();
+    if (data_blocks == 0 || length == 0) {
+        return ZX_OK;
+    }
+
+    ZX_DEBUG_ASSERT(offset + length <= inode_.blob_size);
+    uint64_t start = offset / kBlobfsBlockSize;
+    uint64_t end = fbl::round_up(offset + length, kBlobfsBlockSize) / kBlobfsBlockSize;
+    if (populated_blocks_.Get(start, end)) {
+        return ZX_OK;
+    }
+    end = fbl::min(end + kLazyReadAheadBlocks, data_blocks);
+
+    // Compressed data can only be populated a whole chunk at a time.
+    const bool chunked = compressed_blob_ != nullptr;
+    if (chunked) {
+        start = fbl::round_down(start, kChunkBlocks);
+        end = fbl::min(fbl::round_up(end, kChunkBlocks), data_blocks);
+    }
+
+    // Invokes |func| on each run of unpopulated blocks within [start, end).
+    auto for_each_run = [this, start, end](auto func) -> zx_status_t {
+        uint64_t block = start;
+        while (block < end) {
+            size_t run_start;
+            if (populated_blocks_.Scan(block, end, true, &run_start)) {
+                break;
+            }
+            size_t run_end = end;
+            populated_blocks_.Scan(run_start, end, false, &run_end);
+            zx_status_t status = func(run_start, run_end - run_start);
+            if (status != ZX_OK) {
+                return status;
+            }
+            block = run_end;
+        }
+        return ZX_OK;
+    };
+
+    // Returns the chunks [first, last) holding the data blocks [block, block + count).
+    auto chunk_range = [](uint64_t block, uint64_t count,
+                                      uint32_t* first, uint32_t* last) {
+        *first = static_cast<uint32_t>(block / kChunkBlocks);
+        *last = static_cast<uint32_t>(fbl::round_up(block + count, kChunkBlocks) /
+                                      kChunkBlocks);
+    };
+
+    fs::Ticker ticker(blobfs_->CollectingMetrics());
+    fs::ReadTxn txn(blobfs_);
+    const uint64_t merkle_blocks = MerkleTreeBlocks(inode_);
+    uint64_t blocks_read = 0;
+    zx_status_t status = for_each_run([&](uint64_t block, uint64_t count) {
+        if (!chunked) {
+            blocks_read += count;
+            return EnqueueRead(&txn, vmoid_, merkle_blocks + block, merkle_blocks + block,
+                               count);
+        }
+        // Read the compressed blocks backing these chunks into the same
+        // offsets of the compressed VMO.
+        uint32_t first, last;
+        chunk_range(block, count, &first, &last);
+        uint64_t compressed_offset, compressed_length;
+        ChunkedDecompressor::ChunkRange(compressed_blob_->GetData(), first, last,
+                                        &compressed_offset, &compressed_length);
+        uint64_t first_block = compressed_offset / kBlobfsBlockSize;
+        uint64_t last_block = fbl::round_up(compressed_offset + compressed_length,
+                                            kBlobfsBlockSize) / kBlobfsBlockSize;
+        blocks_read += last_block - first_block;
+        return EnqueueRead(&txn, compressed_vmoid_, first_block, merkle_blocks + first_block,
+                           last_block - first_block);
+    });
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = txn.Transact();
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("blobfs: Failed to read blob data: %d\n", status);
+        return status;
+    }
+
+    if (chunked) {
+        fs::Duration read_time = ticker.End();
+        fs::Ticker decompress_ticker(blobfs_->CollectingMetrics());
+        uint64_t decompressed = 0;
+        uint8_t* data = static_cast<uint8_t*>(GetData());
+        status = for_each_run([&](uint64_t block, uint64_t count) {
+            uint32_t first, last;
+            chunk_range(block, count, &first, &last);
+            for (uint32_t chunk = first; chunk < last; chunk++) {
+                uint64_t chunk_offset = static_cast<uint64_t>(chunk) * kBlobfsChunkSize;
+                size_t chunk_length = fbl::min<uint64_t>(inode_.blob_size - chunk_offset,
+                                                         kBlobfsChunkSize);
+                zx_status_t decompress_status = ChunkedDecompressor::DecompressChunk(
+                    data + chunk_offset, chunk_length, compressed_blob_->GetData(), chunk);
+                if (decompress_status != ZX_OK) {
+                    FS_TRACE_ERROR("blobfs: Failed to decompress chunk %u: %d\n", chunk,
+                                   decompress_status);
+                    return decompress_status;
+                }
+                decompressed += chunk_length;
+            }
+            return ZX_OK;
+        });
+        blobfs_->UpdateMerkleDecompressMetrics(blocks_read * kBlobfsBlockSize, decompressed,
+                                               read_time, decompress_ticker.End());
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    Digest digest(digest_);
+    const void* data = GetData();
+    const void* tree = GetMerkle();
+    const uint64_t merkle_size = MerkleTree::GetTreeLength(inode_.blob_size);
+    status = for_each_run([&](uint64_t block, uint64_t count) {
+        uint64_t run_offset = block * kBlobfsBlockSize;
+        uint64_t run_length = fbl::min(count * kBlobfsBlockSize, inode_.blob_size - run_offset);
+        zx_status_t verify_status = MerkleTree::Verify(data, inode_.blob_size, tree,
+                                                       merkle_size, run_offset, run_length,
+                                                       digest);
+        if (verify_status != ZX_OK) {
+            char name[Digest::kLength * 2 + 1];
+            ZX_ASSERT(digest.ToString(name, sizeof(name)) == ZX_OK);
+            FS_TRACE_ERROR("blobfs verify(%s) Failure at block %" PRIu64 ": %s\n", name,
+                           block, zx_status_get_string(verify_status));
+            return verify_status;
+        }
+        return populated_blocks_.Set(block, block + count);
+    });
+    blobfs_->UpdateOnDemandMetrics(blocks_read, ticker.End());
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // Once every block is resident, the blob behaves as if it were read eagerly.
+    if (populated_blocks_.Get(0, data_blocks)) {
+        populated_blocks_.Reset(0);
+        if (chunked) {
+            blobfs_->DetachVmo(compressed_vmoid_);
+            compressed_blob_ = nullptr;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t VnodeBlob::LoadExtents() {
+    if (!extents_.is_empty() || inode_.num_blocks == 0) {
+        return ZX_OK;
+    }
+    return blobfs_->LoadExtents(inode_, &extents_);
+}
+
+zx_status_t VnodeBlob::EnqueueRead(fs::ReadTxn* txn, vmoid_t vmoid, uint64_t vmo_block,
+                                   uint64_t blob_block, uint64_t count) const {
+    const uint64_t data_start = DataStartBlock(blobfs_->info_);
+    return ForEachExtentRun(extents_, blob_block, count,
+                            [&](uint64_t block, uint64_t data_block, uint64_t run) {
+        txn->Enqueue(vmoid, vmo_block + (block - blob_block), data_start + data_block, run);
+        return ZX_OK;
+    });
+}
+
+void VnodeBlob::TrimExtents(uint64_t num_blocks) {
+    ZX_DEBUG_ASSERT(num_blocks > 0);
+    uint64_t kept = 0;
+    size_t count = 0;
+    while (count < extents_.size() && kept < num_blocks) {
+        Extent& extent = extents_[count++];
+        if (kept + extent.length > num_blocks) {
+            uint64_t length = num_blocks - kept;
+            blobfs_->UnreserveBlocks(extent.length - length, extent.start + length);
+            extent.length = length;
+        }
+        kept += extent.length;
+    }
+    while (extents_.size() > count) {
+        const Extent& extent = extents_[extents_.size() - 1];
+        blobfs_->UnreserveBlocks(extent.length, extent.start);
+        extents_.pop_back();
+    }
+
+    // A blob which now fits within a single extent does not need an extent table.
+    if (extents_.size() == 1 && (inode_.flags & kBlobFlagExtentTable)) {
+        blobfs_->UnreserveBlocks(1, inode_.start_block);
+        inode_.start_block = extents_[0].start;
+        inode_.flags &= ~kBlobFlagExtentTable;
+    }
+    inode_.num_blocks = num_blocks;
+}
+
+void VnodeBlob::UnreserveExtents() {
+    for (const auto& extent : extents_) {
+        blobfs_->UnreserveBlocks(extent.length, extent.start);
+    }
+    if (inode_.flags & kBlobFlagExtentTable) {
+        blobfs_->UnreserveBlocks(1, inode_.start_block);
+        inode_.flags &= ~kBlobFlagExtentTable;
+    }
+    extents_.reset();
+}
+
+zx_status_t VnodeBlob::WriteExtentTable(WritebackWork* wb) {
+    ZX_DEBUG_ASSERT(extents_.size() > 1 && extents_.size() <= kBlobfsMaxExtents);
+    zx_status_t status = fzl::MappedVmo::Create(kBlobfsBlockSize, "blob-extents",
+                                               &write_info_->extent_table);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    ExtentTable* table = reinterpret_cast<ExtentTable*>(write_info_->extent_table->GetData());
+    table->magic = kBlobfsExtentTableMagic;
+    table->extent_count = extents_.size();
+    for (size_t i = 0; i < extents_.size(); i++) {
+        table->extents[i] = extents_[i];
+    }
+    wb->Enqueue(write_info_->extent_table->GetVmo(), 0,
+                DataStartBlock(blobfs_->info_) + inode_.start_block, 1);
+    blobfs_->PersistBlocks(wb, 1, inode_.start_block);
+    return ZX_OK;
+}
+
 void VnodeBlob::PopulateInode(size_t node_index) {
     ZX_DEBUG_ASSERT(map_index_ == 0);
     ZX_DEBUG_ASSERT(inode_.start_block < kStartBlockMinimum);
@@ -325,6 +670,11 @@ VnodeBlob::VnodeBlob(Blobfs* bs)
 
 void VnodeBlob::BlobCloseHandles() {
     blob_ = nullptr;
+    populated_blocks_.Reset(0);
+    if (compressed_blob_ != nullptr) {
+        blobfs_->DetachVmo(compressed_vmoid_);
+        compressed_blob_ = nullptr;
+    }
     readable_event_.reset();
 }
 
@@ -377,9 +727,18 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     }
 
     // Reserve space for the blob.
-    if ((status = blobfs_->ReserveBlocks(inode_.num_blocks, &inode_.start_block)) != ZX_OK) {
+    if ((status = blobfs_->ReserveExtents(inode_.num_blocks, &extents_)) != ZX_OK) {
         goto fail;
     }
+    if (extents_.size() == 1) {
+        inode_.start_block = extents_[0].start;
+    } else {
+        // A fragmented blob needs one more block to describe where it lives.
+        if ((status = blobfs_->ReserveBlocks(1, &inode_.start_block)) != ZX_OK) {
+            goto fail;
+        }
+        inode_.flags |= kBlobFlagExtentTable;
+    }
 
     write_info_ = fbl::make_unique<WritebackInfo>();
     if (inode_.blob_size >= kCompressionMinBytesSaved) {
@@ -389,7 +748,8 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
             return status;
         }
         status = write_info_->compressor.Initialize(write_info_->compressed_blob->GetData(),
-                                                    write_info_->compressed_blob->GetSize());
+                                                    write_info_->compressed_blob->GetSize(),
+                                                    inode_.blob_size);
         if (status != ZX_OK) {
             fprintf(stderr, "blobfs: Failed to initialize compressor: %d\n", status);
             return status;
@@ -402,6 +762,7 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
 
 fail:
     BlobCloseHandles();
+    UnreserveExtents();
     blobfs_->FreeNode(nullptr, map_index_);
     return status;
 }
@@ -421,6 +782,14 @@ zx_status_t VnodeBlob::WriteMetadata(fbl::unique_ptr<WritebackWork> wb) {
     // Update the on-disk hash.
     memcpy(inode_.merkle_root_hash, &digest_[0], Digest::kLength);
 
+    if (inode_.flags & kBlobFlagExtentTable) {
+        zx_status_t status = WriteExtentTable(wb.get());
+        if (status != ZX_OK) {
+            SetState(kBlobStateError);
+            return status;
+        }
+    }
+
     // All data has been written to the containing VMO.
     SetState(kBlobStateReadable);
     if (readable_event_.is_valid()) {
@@ -434,8 +803,8 @@ zx_status_t VnodeBlob::WriteMetadata(fbl::unique_ptr<WritebackWork> wb) {
     atomic_store(&syncing_, true);
 
     // Allocate and persist previously reserved blocks/node.
-    if (inode_.blob_size) {
-        blobfs_->PersistBlocks(wb.get(), inode_.num_blocks, inode_.start_block);
+    for (const auto& extent : extents_) {
+        blobfs_->PersistBlocks(wb.get(), extent.length, extent.start);
     }
 
     blobfs_->PersistNode(wb.get(), map_index_, inode_);
@@ -494,25 +863,21 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             ConsiderCompressionAbort();
         }
 
-        uint64_t dev_offset = DataStartBlock(blobfs_->info_) + inode_.start_block + merkle_blocks;
         if (write_info_->compressor.Compressing()) {
             uint64_t blocks = fbl::round_up(write_info_->compressor.Size(),
                                             kBlobfsBlockSize) / kBlobfsBlockSize;
-            if ((status = EnqueuePaginated(&wb, blobfs_, this,
-                                           write_info_->compressed_blob->GetVmo(),
-                                           0, dev_offset, blocks)) != ZX_OK) {
+            ZX_DEBUG_ASSERT(inode_.num_blocks > blocks + merkle_blocks);
+            TrimExtents(blocks + merkle_blocks);
+            inode_.flags |= kBlobFlagChunkCompressed;
+            if ((status = EnqueueExtents(&wb, blobfs_, this, extents_,
+                                         write_info_->compressed_blob->GetVmo(),
+                                         0, merkle_blocks, blocks)) != ZX_OK) {
                 return status;
             }
-            blocks += MerkleTreeBlocks(inode_);
-            ZX_DEBUG_ASSERT(inode_.num_blocks > blocks);
-            blobfs_->UnreserveBlocks(inode_.num_blocks - blocks,
-                                     inode_.start_block + blocks);
-            inode_.num_blocks = blocks;
-            inode_.flags |= kBlobFlagLZ4Compressed;
         } else {
             uint64_t blocks = fbl::round_up(inode_.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
-            if ((status = EnqueuePaginated(&wb, blobfs_, this, blob_->GetVmo(),
-                                           merkle_blocks, dev_offset, blocks)) != ZX_OK) {
+            if ((status = EnqueueExtents(&wb, blobfs_, this, extents_, blob_->GetVmo(),
+                                         merkle_blocks, merkle_blocks, blocks)) != ZX_OK) {
                 return status;
             }
         }
@@ -528,8 +893,12 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             const void* blob_data = GetData();
             fs::Ticker ticker(blobfs_->CollectingMetrics()); // Tracking generation time.
 
+            size_t num_threads = 1;
+            if (inode_.blob_size >= kMerkleThreadMinBytes) {
+                num_threads = zx_system_get_num_cpus();
+            }
             if ((status = MerkleTree::Create(blob_data, inode_.blob_size, merkle_data,
-                                             merkle_size, &digest)) != ZX_OK) {
+                                             merkle_size, &digest, num_threads)) != ZX_OK) {
                 SetState(kBlobStateError);
                 return status;
             } else if (digest != digest_) {
@@ -538,8 +907,11 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
                 return ZX_ERR_IO_DATA_INTEGRITY;
             }
 
-            uint64_t dev_offset = DataStartBlock(blobfs_->info_) + inode_.start_block;
-            wb->Enqueue(blob_->GetVmo(), 0, dev_offset, merkle_blocks);
+            if ((status = EnqueueExtents(&wb, blobfs_, this, extents_, blob_->GetVmo(),
+                                         0, 0, merkle_blocks)) != ZX_OK) {
+                SetState(kBlobStateError);
+                return status;
+            }
             generation_time = ticker.End();
         } else if ((status = Verify()) != ZX_OK) {
             // Small blobs may not have associated Merkle Trees, and will
@@ -604,6 +976,12 @@ zx_status_t VnodeBlob::CloneVmo(zx_rights_t rights, zx_handle_t* out) {
         return status;
     }
 
+    // TODO(ZX-1481): Clients access the clone directly, so without a pager
+    // the entire blob must be resident and verified before it is handed out.
+    if ((status = PopulateRange(0, inode_.blob_size)) != ZX_OK) {
+        return status;
+    }
+
     // TODO(smklein): Only clone / verify the part of the vmo that
     // was requested.
     const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
@@ -675,6 +1053,10 @@ zx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         len = inode_.blob_size - off;
     }
 
+    if ((status = PopulateRange(off, len)) != ZX_OK) {
+        return status;
+    }
+
     const size_t merkle_bytes = MerkleTreeBlocks(inode_) * kBlobfsBlockSize;
     status = zx_vmo_read(blob_->GetVmo(), data, merkle_bytes + off, len);
     if (status == ZX_OK) {
@@ -705,6 +1087,12 @@ zx_status_t VnodeBlob::VerifyBlob(Blobfs* bs, size_t node_index) {
 
     // Set blob state to "Purged" so we do not try to add it to the cached map on recycle.
     vn->SetState(kBlobStatePurged);
+
+    // Blobs initialized lazily must be read in their entirety before they can be verified.
+    zx_status_t status;
+    if ((status = vn->PopulateRange(0, inode->blob_size)) != ZX_OK) {
+        return status;
+    }
     return vn->Verify();
 }
 
@@ -763,6 +1151,69 @@ zx_status_t Blobfs::ReserveBlocks(size_t num_blocks, size_t* block_index_out) {
     return ZX_OK;
 }
 
+zx_status_t Blobfs::FindExtents(size_t num_blocks, fbl::Vector<Extent>* out) {
+    fbl::Vector<Extent> extents;
+    size_t start = 0;
+    while (num_blocks > 0) {
+        // Find the next block which is neither allocated nor reserved.
+        size_t block_num;
+        if (FindBlocks(start, 1, &block_num) != ZX_OK) {
+            return ZX_ERR_NO_SPACE;
+        }
+
+        // Extend the run up to the next allocated or reserved block.
+        size_t upper_limit = block_map_.size();
+        block_map_.Scan(block_num, block_map_.size(), false, &upper_limit);
+        size_t reserved;
+        if (reserved_blocks_.Find(true, block_num, upper_limit, 1, &reserved) == ZX_OK) {
+            upper_limit = reserved;
+        }
+
+        if (extents.size() == kBlobfsMaxExtents) {
+            return ZX_ERR_NO_SPACE;
+        }
+        size_t length = fbl::min(upper_limit - block_num, num_blocks);
+        fbl::AllocChecker ac;
+        extents.push_back({block_num, length}, &ac);
+        if (!ac.check()) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        num_blocks -= length;
+        start = block_num + length;
+    }
+
+    *out = fbl::move(extents);
+    return ZX_OK;
+}
+
+zx_status_t Blobfs::ReserveExtents(size_t num_blocks, fbl::Vector<Extent>* out) {
+    fbl::Vector<Extent> extents;
+    fbl::AllocChecker ac;
+    size_t block_index;
+    zx_status_t status;
+    if ((status = ReserveBlocks(num_blocks, &block_index)) == ZX_OK) {
+        extents.push_back({block_index, num_blocks}, &ac);
+        if (!ac.check()) {
+            UnreserveBlocks(num_blocks, block_index);
+            return ZX_ERR_NO_MEMORY;
+        }
+        *out = fbl::move(extents);
+        return ZX_OK;
+    }
+
+    // No contiguous range is available, even after attempting to grow the
+    // partition: fall back to piecing the blob together from free fragments.
+    if ((status = FindExtents(num_blocks, &extents)) != ZX_OK) {
+        return status;
+    }
+    for (const auto& extent : extents) {
+        status = reserved_blocks_.Set(extent.start, extent.start + extent.length);
+        ZX_DEBUG_ASSERT(status == ZX_OK);
+    }
+    *out = fbl::move(extents);
+    return ZX_OK;
+}
+
 void Blobfs::UnreserveBlocks(size_t num_blocks, size_t block_index) {
     // Ensure the blocks are already reserved.
     size_t blkno_out;
@@ -818,6 +1269,45 @@ void Blobfs::FreeBlocks(WritebackWork* wb, size_t num_blocks, size_t block_index
     ZX_DEBUG_ASSERT(status == ZX_OK);
 }
 
+zx_status_t Blobfs::LoadExtents(const Inode& inode, fbl::Vector<Extent>* out) {
+    fbl::Vector<Extent> extents;
+    if ((inode.flags & kBlobFlagExtentTable) == 0) {
+        if (inode.num_blocks > 0) {
+            fbl::AllocChecker ac;
+            extents.push_back({inode.start_block, inode.num_blocks}, &ac);
+            if (!ac.check()) {
+                return ZX_ERR_NO_MEMORY;
+            }
+        }
+        *out = fbl::move(extents);
+        return ZX_OK;
+    }
+
+    if (inode.start_block >= info_.block_count) {
+        FS_TRACE_ERROR("blobfs: extent table @%" PRIu64 " out of range\n", inode.start_block);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    fbl::unique_ptr<fzl::MappedVmo> table;
+    zx_status_t status = fzl::MappedVmo::Create(kBlobfsBlockSize, "blob-extents", &table);
+    if (status != ZX_OK) {
+        return status;
+    }
+    vmoid_t vmoid;
+    if ((status = AttachVmo(table->GetVmo(), &vmoid)) != ZX_OK) {
+        return status;
+    }
+    auto detach = fbl::MakeAutoCall([this, &vmoid]() { DetachVmo(vmoid); });
+
+    fs::ReadTxn txn(this);
+    txn.Enqueue(vmoid, 0, DataStartBlock(info_) + inode.start_block, 1);
+    if ((status = txn.Transact()) != ZX_OK) {
+        return status;
+    }
+    return ParseExtentTable(info_, inode, *reinterpret_cast<const ExtentTable*>(table->GetData()),
+                            out);
+}
+
 zx_status_t Blobfs::FindNode(size_t* node_index_out) {
     for (size_t i = free_node_lower_bound_; i < info_.inode_count; ++i) {
         if (GetNode(i)->start_block == kStartBlockFree) {
@@ -1030,16 +1520,22 @@ zx_status_t Blobfs::PurgeBlob(VnodeBlob* vn) {
     case kBlobStateDataWrite:
     case kBlobStateError: {
         size_t node_index = vn->GetMapIndex();
-        uint64_t start_block = vn->GetNode().start_block;
-        uint64_t nblocks = vn->GetNode().num_blocks;
         zx_status_t status;
+        if ((status = vn->LoadExtents()) != ZX_OK) {
+            return status;
+        }
         fbl::unique_ptr<WritebackWork> wb;
         if ((status = CreateWork(&wb, vn)) != ZX_OK) {
             return status;
         }
 
         FreeNode(wb.get(), node_index);
-        FreeBlocks(wb.get(), nblocks, start_block);
+        for (const auto& extent : vn->GetExtents()) {
+            FreeBlocks(wb.get(), extent.length, extent.start);
+        }
+        if (vn->GetNode().flags & kBlobFlagExtentTable) {
+            FreeBlocks(wb.get(), 1, vn->GetNode().start_block);
+        }
         VnodeReleaseHard(vn);
         EnqueueWork(fbl::move(wb));
         return ZX_OK;
@@ -1371,6 +1867,13 @@ void Blobfs::UpdateMerkleVerifyMetrics(uint64_t size_data, uint64_t size_merkle,
     }
 }
 
+void Blobfs::UpdateOnDemandMetrics(uint64_t blocks, const fs::Duration& duration) {
+    if (CollectingMetrics()) {
+        metrics_.blocks_populated_on_demand += blocks;
+        metrics_.total_on_demand_time_ticks += duration;
+    }
+}
+
 Blobfs::Blobfs(fbl::unique_fd fd, const Superblock* info)
     : blockfd_(fbl::move(fd)) {
     memcpy(&info_, info, sizeof(Superblock));
@@ -38,6 +38,43 @@ uint64_t MerkleTreeBlocks(const Inode& blobNode) {
     return fbl::round_up(size_merkle, kBlobfsBlockSize) / kBlobfsBlockSize;
 }
 
+zx_status_t ParseExtentTable(const Superblock& info, const Inode& inode,
+                             const ExtentTable& table, fbl::Vector<Extent>* out) {
+    if (table.magic != kBlobfsExtentTableMagic) {
+        FS_TRACE_ERROR("blobfs: bad extent table magic\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    if (table.extent_count < 2 || table.extent_count > kBlobfsMaxExtents) {
+        FS_TRACE_ERROR("blobfs: bad extent count %" PRIu64 "\n", table.extent_count);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    fbl::Vector<Extent> extents;
+    fbl::AllocChecker ac;
+    extents.reserve(table.extent_count, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    uint64_t total = 0;
+    for (size_t i = 0; i < table.extent_count; i++) {
+        const Extent& extent = table.extents[i];
+        if (extent.length == 0 || extent.start < kStartBlockMinimum ||
+            extent.start >= info.block_count || extent.length > info.block_count - extent.start) {
+            FS_TRACE_ERROR("blobfs: extent %zu out of range\n", i);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        total += extent.length;
+        extents.push_back(extent);
+    }
+    if (total != inode.num_blocks) {
+        FS_TRACE_ERROR("blobfs: extents cover %" PRIu64 " blocks, expected %" PRIu64 "\n",
+                       total, inode.num_blocks);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    *out = fbl::move(extents);
+    return ZX_OK;
+}
+
 // Sanity check the metadata for the blobfs, given a maximum number of
 // available blocks.
 zx_status_t CheckSuperblock(const Superblock* info, uint64_t max) {
@@ -17,21 +17,37 @@ namespace blobfs {
 
 void BlobfsChecker::TraverseInodeBitmap() {
     for (unsigned n = 0; n < blobfs_->info_.inode_count; n++) {
-        Inode* inode = blobfs_->GetNode(n);
-        if (inode->start_block >= kStartBlockMinimum) {
+        // Copy the inode, since reading its extents may invalidate |GetNode()|.
+        Inode inode = *blobfs_->GetNode(n);
+        if (inode.start_block >= kStartBlockMinimum) {
             alloc_inodes_++;
-            inode_blocks_ += static_cast<uint32_t>(inode->num_blocks);
-
-            size_t start_block = inode->start_block;
-            size_t end_block = inode->start_block + inode->num_blocks;
+            inode_blocks_ += static_cast<uint32_t>(inode.num_blocks);
             bool valid = true;
 
-            size_t first_unset = 0;
-            if (!blobfs_->block_map_.Get(start_block, end_block, &first_unset)) {
-                FS_TRACE_ERROR("check: ino %u using blocks [%zu, %zu). "
-                               "Not fully allocated in block bitmap; first unset @%zu\n",
-                               n, start_block, end_block, first_unset);
+            fbl::Vector<Extent> extents;
+            if (blobfs_->LoadExtents(inode, &extents) != ZX_OK) {
+                FS_TRACE_ERROR("check: ino %u has invalid extents\n", n);
                 valid = false;
+            } else if (inode.flags & kBlobFlagExtentTable) {
+                // The block describing the blob's extents counts towards its allocation.
+                inode_blocks_++;
+                if (!blobfs_->block_map_.Get(inode.start_block, inode.start_block + 1)) {
+                    FS_TRACE_ERROR("check: ino %u extent table @%" PRIu64 " not allocated in "
+                                   "block bitmap\n", n, inode.start_block);
+                    valid = false;
+                }
+            }
+
+            for (const auto& extent : extents) {
+                size_t start_block = extent.start;
+                size_t end_block = extent.start + extent.length;
+                size_t first_unset = 0;
+                if (!blobfs_->block_map_.Get(start_block, end_block, &first_unset)) {
+                    FS_TRACE_ERROR("check: ino %u using blocks [%zu, %zu). "
+                                   "Not fully allocated in block bitmap; first unset @%zu\n",
+                                   n, start_block, end_block, first_unset);
+                    valid = false;
+                }
             }
 
             if (blobfs_->VerifyBlob(n) != ZX_OK) {
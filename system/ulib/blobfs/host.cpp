@@ -10,6 +10,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <thread>
+
 #include <digest/digest.h>
 #include <digest/merkle-tree.h>
 #include <fbl/algorithm.h>
@@ -49,15 +52,38 @@ zx_status_t readblk_offset(int fd, uint64_t bno, off_t offset, void* data) {
     return ZX_OK;
 }
 
-zx_status_t writeblk_offset(int fd, uint64_t bno, off_t offset, const void* data) {
+// Read or write |count| blocks at block |bno|, without moving the file offset.
+// These may be used from multiple threads at once.
+zx_status_t readblks_offset(int fd, uint64_t bno, off_t offset, void* data, size_t count) {
+    uint8_t* buf = static_cast<uint8_t*>(data);
+    size_t len = count * kBlobfsBlockSize;
     off_t off = offset + bno * kBlobfsBlockSize;
-    if (lseek(fd, off, SEEK_SET) < 0) {
-        fprintf(stderr, "blobfs: cannot seek to block %" PRIu64 "\n", bno);
-        return ZX_ERR_IO;
+    while (len > 0) {
+        ssize_t r = pread(fd, buf, len, off);
+        if (r <= 0) {
+            fprintf(stderr, "blobfs: cannot read blocks at %" PRIu64 "\n", bno);
+            return ZX_ERR_IO;
+        }
+        buf += r;
+        len -= r;
+        off += r;
     }
-    if (write(fd, data, kBlobfsBlockSize) != kBlobfsBlockSize) {
-        fprintf(stderr, "blobfs: cannot write block %" PRIu64 "\n", bno);
-        return ZX_ERR_IO;
+    return ZX_OK;
+}
+
+zx_status_t writeblks_offset(int fd, uint64_t bno, off_t offset, const void* data, size_t count) {
+    const uint8_t* buf = static_cast<const uint8_t*>(data);
+    size_t len = count * kBlobfsBlockSize;
+    off_t off = offset + bno * kBlobfsBlockSize;
+    while (len > 0) {
+        ssize_t r = pwrite(fd, buf, len, off);
+        if (r <= 0) {
+            fprintf(stderr, "blobfs: cannot write blocks at %" PRIu64 "\n", bno);
+            return ZX_ERR_IO;
+        }
+        buf += r;
+        len -= r;
+        off += r;
     }
     return ZX_OK;
 }
@@ -70,8 +96,14 @@ zx_status_t buffer_create_merkle(const FileMapping& mapping, MerkleInfo* out_inf
     zx_status_t status;
     size_t merkle_size = MerkleTree::GetTreeLength(mapping.length());
     auto merkle_tree = fbl::unique_ptr<uint8_t[]>(new uint8_t[merkle_size]);
+    // Blobs are usually preprocessed several at a time, so only large blobs,
+    // which would otherwise be left hashing alone at the end, are split up.
+    size_t num_threads = 1;
+    if (mapping.length() >= kMerkleThreadMinBytes) {
+        num_threads = fbl::max(std::thread::hardware_concurrency(), 1u);
+    }
     if ((status = MerkleTree::Create(mapping.data(), mapping.length(), merkle_tree.get(),
-                                     merkle_size, &out_info->digest)) != ZX_OK) {
+                                     merkle_size, &out_info->digest, num_threads)) != ZX_OK) {
         return status;
     }
     out_info->merkle.reset(merkle_tree.release(), merkle_size);
@@ -80,7 +112,7 @@ zx_status_t buffer_create_merkle(const FileMapping& mapping, MerkleInfo* out_inf
 }
 
 zx_status_t buffer_compress(const FileMapping& mapping, MerkleInfo* out_info) {
-    Compressor compressor;
+    ChunkedCompressor compressor;
     size_t max = compressor.BufferMax(mapping.length());
     out_info->compressed_data.reset(new uint8_t[max]);
     out_info->compressed = false;
@@ -90,7 +122,8 @@ zx_status_t buffer_compress(const FileMapping& mapping, MerkleInfo* out_info) {
     }
 
     zx_status_t status;
-    if ((status = compressor.Initialize(out_info->compressed_data.get(), max)) != ZX_OK) {
+    if ((status = compressor.Initialize(out_info->compressed_data.get(), max,
+                                        mapping.length())) != ZX_OK) {
         fprintf(stderr, "Failed to initialize blobfs compressor: %d\n", status);
         return status;
     }
@@ -113,23 +146,18 @@ zx_status_t buffer_compress(const FileMapping& mapping, MerkleInfo* out_info) {
     return ZX_OK;
 }
 
-// Given a buffer (and pre-computed merkle tree), add the buffer as a
-// blob in Blobfs.
-zx_status_t blobfs_add_mapped_blob_with_merkle(Blobfs* bs, const FileMapping& mapping,
-                                               const MerkleInfo& info) {
-    ZX_ASSERT(mapping.length() == info.length);
-    const void* data;
-
-    if (info.compressed) {
-        data = info.compressed_data.get();
-    } else {
-        data = mapping.data();
-    }
-
-    // After we've pre-calculated all necessary information, actually add the
-    // blob to the filesystem itself.
-    static std::mutex add_blob_mutex_;
-    std::lock_guard<std::mutex> lock(add_blob_mutex_);
+// A blob which has been assigned a node and blocks, but whose data may not
+// have been written yet.
+struct PlacedBlob {
+    const MerkleInfo* info;
+    const Inode* inode;
+    fbl::Vector<Extent> extents;
+};
+
+// Assigns a node and blocks to the blob described by |info|.  This only
+// updates the in-memory metadata of |bs|, apart from the extent table of a
+// fragmented blob.
+zx_status_t blobfs_place_blob(Blobfs* bs, const MerkleInfo& info, PlacedBlob* out) {
     fbl::unique_ptr<InodeBlock> inode_block;
     zx_status_t status;
     if ((status = bs->NewBlob(info.digest, &inode_block)) < 0) {
@@ -141,27 +169,80 @@ zx_status_t blobfs_add_mapped_blob_with_merkle(Blobfs* bs, const FileMapping& ma
     }
 
     Inode* inode = inode_block->GetInode();
-    inode->blob_size = mapping.length();
+    inode->blob_size = info.length;
     inode->num_blocks = MerkleTreeBlocks(*inode) + info.GetDataBlocks();
-    inode->flags |= (info.compressed ? kBlobFlagLZ4Compressed : 0);
+    inode->flags |= (info.compressed ? kBlobFlagChunkCompressed : 0);
 
-    if ((status = bs->AllocateBlocks(inode->num_blocks,
-                                     reinterpret_cast<size_t*>(&inode->start_block))) != ZX_OK) {
+    fbl::Vector<Extent> extents;
+    if ((status = bs->AllocateBlocks(inode->num_blocks, &extents)) != ZX_OK) {
         fprintf(stderr, "error: No blocks available\n");
         return status;
-    } else if ((status = bs->WriteData(inode, info.merkle.get(), data)) != ZX_OK) {
-        return status;
-    } else if ((status = bs->WriteBitmap(inode->num_blocks, inode->start_block)) != ZX_OK) {
-        return status;
-    } else if ((status = bs->WriteNode(fbl::move(inode_block))) != ZX_OK) {
+    }
+
+    for (const auto& extent : extents) {
+        if ((status = bs->WriteBitmap(extent.length, extent.start)) != ZX_OK) {
+            return status;
+        }
+    }
+
+    if (extents.size() == 1) {
+        inode->start_block = extents[0].start;
+    } else {
+        // Fragmented blobs record the location of their blocks in an extent table.
+        fbl::Vector<Extent> table;
+        if ((status = bs->AllocateBlocks(1, &table)) != ZX_OK) {
+            fprintf(stderr, "error: No blocks available\n");
+            return status;
+        }
+        inode->start_block = table[0].start;
+        inode->flags |= kBlobFlagExtentTable;
+        if ((status = bs->WriteExtentTable(inode->start_block, extents)) != ZX_OK) {
+            return status;
+        } else if ((status = bs->WriteBitmap(1, inode->start_block)) != ZX_OK) {
+            return status;
+        }
+    }
+
+    if ((status = bs->WriteNode(fbl::move(inode_block))) != ZX_OK) {
         return status;
     } else if ((status = bs->WriteInfo()) != ZX_OK) {
         return status;
     }
 
+    out->info = &info;
+    out->inode = inode;
+    out->extents = fbl::move(extents);
     return ZX_OK;
 }
 
+// Writes the merkle tree and data of a placed blob.  |mapping| holds the
+// blob's uncompressed contents, and is unused if the blob is compressed.
+zx_status_t blobfs_write_blob(Blobfs* bs, const PlacedBlob& blob, const FileMapping& mapping) {
+    const MerkleInfo& info = *blob.info;
+    const void* data = info.compressed ? info.compressed_data.get() : mapping.data();
+    return bs->WriteData(*blob.inode, blob.extents, info.merkle.get(), data);
+}
+
+// Given a buffer (and pre-computed merkle tree), add the buffer as a
+// blob in Blobfs.
+zx_status_t blobfs_add_mapped_blob_with_merkle(Blobfs* bs, const FileMapping& mapping,
+                                               const MerkleInfo& info) {
+    ZX_ASSERT(mapping.length() == info.length);
+
+    // After we've pre-calculated all necessary information, actually add the
+    // blob to the filesystem itself.
+    static std::mutex add_blob_mutex_;
+    std::lock_guard<std::mutex> lock(add_blob_mutex_);
+    PlacedBlob blob;
+    zx_status_t status;
+    if ((status = blobfs_place_blob(bs, info, &blob)) != ZX_OK) {
+        return status;
+    } else if ((status = blobfs_write_blob(bs, blob, mapping)) != ZX_OK) {
+        return status;
+    }
+    return bs->Flush();
+}
+
 } // namespace
 
 zx_status_t blobfs_create(fbl::unique_ptr<Blobfs>* out, fbl::unique_fd fd) {
@@ -294,6 +375,118 @@ zx_status_t blobfs_add_blob_with_merkle(Blobfs* bs, int data_fd, const MerkleInf
     return blobfs_add_mapped_blob_with_merkle(bs, mapping, info);
 }
 
+zx_status_t blobfs_compress(int data_fd, MerkleInfo* info) {
+    FileMapping mapping;
+    zx_status_t status = mapping.Map(data_fd);
+    if (status != ZX_OK) {
+        return status;
+    } else if (mapping.length() != info->length) {
+        return ZX_ERR_BAD_STATE;
+    }
+    return buffer_compress(mapping, info);
+}
+
+zx_status_t blobfs_prune_blobs(Blobfs* bs, std::vector<MerkleInfo>* infos) {
+    Blobfs::DigestSet keep;
+    for (const auto& info : *infos) {
+        std::array<uint8_t, Digest::kLength> key;
+        info.digest.CopyTo(key.data(), key.size());
+        keep.insert(key);
+    }
+    zx_status_t status;
+    if ((status = bs->RemoveBlobsExcept(keep)) != ZX_OK) {
+        return status;
+    }
+    auto present = [bs](const MerkleInfo& info) { return bs->HasBlob(info.digest); };
+    infos->erase(std::remove_if(infos->begin(), infos->end(), present), infos->end());
+    return ZX_OK;
+}
+
+zx_status_t blobfs_add_blobs(Blobfs* bs, const std::vector<MerkleInfo>& infos) {
+    // Placement is cheap and updates shared state, so it happens serially.
+    // Blobs are laid out in the order given.
+    zx_status_t status;
+    std::vector<PlacedBlob> blobs;
+    blobs.reserve(infos.size());
+    for (const auto& info : infos) {
+        PlacedBlob blob;
+        if ((status = blobfs_place_blob(bs, info, &blob)) == ZX_ERR_ALREADY_EXISTS) {
+            continue;
+        } else if (status != ZX_OK) {
+            fprintf(stderr, "blobfs: Failed to add blob '%s': %d\n", info.path.c_str(), status);
+            return status;
+        }
+        blobs.push_back(fbl::move(blob));
+    }
+
+    // Each blob occupies its own blocks, so their data can be written in
+    // parallel.
+    status = ForEachInParallel(blobs.size(), [&](size_t i) {
+        const PlacedBlob& blob = blobs[i];
+        const char* path = blob.info->path.c_str();
+        FileMapping mapping;
+        zx_status_t res;
+        if (!blob.info->compressed) {
+            fbl::unique_fd data_fd(open(path, O_RDONLY, 0644));
+            if (!data_fd) {
+                fprintf(stderr, "error: cannot open '%s'\n", path);
+                return ZX_ERR_IO;
+            } else if ((res = mapping.Map(data_fd.get())) != ZX_OK) {
+                return res;
+            } else if (mapping.length() != blob.info->length) {
+                fprintf(stderr, "error: '%s' changed size\n", path);
+                return ZX_ERR_BAD_STATE;
+            }
+        }
+        return blobfs_write_blob(bs, blob, mapping);
+    });
+
+    if (status != ZX_OK) {
+        return status;
+    }
+    return bs->Flush();
+}
+
+zx_status_t ForEachInParallel(size_t count, const fbl::Function<zx_status_t(size_t)>& func) {
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    size_t index = 0;
+    zx_status_t status = ZX_OK;
+
+    unsigned n_threads = std::thread::hardware_concurrency();
+    if (!n_threads) {
+        n_threads = 4;
+    }
+    for (unsigned j = n_threads; j > 0; j--) {
+        threads.push_back(std::thread([&] {
+            while (true) {
+                mtx.lock();
+                size_t i = index++;
+                if (status != ZX_OK || i >= count) {
+                    mtx.unlock();
+                    return;
+                }
+                mtx.unlock();
+
+                zx_status_t res;
+                if ((res = func(i)) != ZX_OK) {
+                    mtx.lock();
+                    if (status == ZX_OK) {
+                        status = res;
+                    }
+                    mtx.unlock();
+                    return;
+                }
+            }
+        }));
+    }
+
+    for (unsigned i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    return status;
+}
+
 zx_status_t blobfs_fsck(fbl::unique_fd fd, off_t start, off_t end,
                         const fbl::Vector<size_t>& extent_lengths) {
     fbl::unique_ptr<Blobfs> blob;
@@ -309,7 +502,7 @@ zx_status_t blobfs_fsck(fbl::unique_fd fd, off_t start, off_t end,
 Blobfs::Blobfs(fbl::unique_fd fd, off_t offset, const info_block_t& info_block,
                const fbl::Array<size_t>& extent_lengths)
     : blockfd_(fbl::move(fd)),
-      dirty_(false), offset_(offset) {
+      offset_(offset) {
     ZX_ASSERT(extent_lengths.size() == EXTENT_COUNT);
     memcpy(&info_block_, info_block.block, kBlobfsBlockSize);
     cache_.bno = 0;
@@ -345,6 +538,9 @@ zx_status_t Blobfs::Create(fbl::unique_fd blockfd_, off_t offset, const info_blo
     if ((status = fs->LoadBitmap()) < 0) {
         fprintf(stderr, "blobfs: Failed to load bitmaps\n");
         return status;
+    } else if ((status = fs->LoadNodeMap()) < 0) {
+        fprintf(stderr, "blobfs: Failed to load node map\n");
+        return status;
     }
 
     *out = fbl::move(fs);
@@ -371,142 +567,294 @@ zx_status_t Blobfs::LoadBitmap() {
             memcpy(bmdata, cache_.blk, kBlobfsBlockSize);
         }
     }
+    dirty_bitmap_blocks_.assign(block_map_block_count_, false);
     return ZX_OK;
 }
 
-zx_status_t Blobfs::NewBlob(const Digest& digest, fbl::unique_ptr<InodeBlock>* out) {
-    size_t ino = info_.inode_count;
-
-    for (size_t i = 0; i < info_.inode_count; ++i) {
-        size_t bno = (i / kBlobfsInodesPerBlock) + node_map_start_block_;
-
-        zx_status_t status;
-        if ((status = ReadBlock(bno)) != ZX_OK) {
-            return status;
+zx_status_t Blobfs::LoadNodeMap() {
+    size_t inode_count = node_map_block_count_ * kBlobfsInodesPerBlock;
+    fbl::AllocChecker ac;
+    node_map_.reset(new (&ac) Inode[inode_count]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    zx_status_t status;
+    if ((status = readblks_offset(blockfd_.get(), node_map_start_block_, offset_,
+                                  node_map_.get(), node_map_block_count_)) != ZX_OK) {
+        return status;
+    }
+    for (size_t i = 0; i < inode_count; ++i) {
+        if (node_map_[i].start_block >= kStartBlockMinimum) {
+            std::array<uint8_t, Digest::kLength> key;
+            memcpy(key.data(), node_map_[i].merkle_root_hash, key.size());
+            node_digests_.insert(key);
         }
+    }
+    dirty_node_blocks_.assign(node_map_block_count_, false);
+    return ZX_OK;
+}
 
-        auto iblk = reinterpret_cast<const Inode*>(cache_.blk);
-        auto observed_inode = &iblk[i % kBlobfsInodesPerBlock];
-        if (observed_inode->start_block >= kStartBlockMinimum) {
-            if (digest == observed_inode->merkle_root_hash) {
-                return ZX_ERR_ALREADY_EXISTS;
-            }
-        } else if (ino >= info_.inode_count) {
-            // If |ino| has not already been set to a valid value, set it to the
-            // first free value we find.
-            // We still check all the remaining inodes to avoid adding a duplicate blob.
+zx_status_t Blobfs::NewBlob(const Digest& digest, fbl::unique_ptr<InodeBlock>* out) {
+    std::array<uint8_t, Digest::kLength> key;
+    digest.CopyTo(key.data(), key.size());
+    if (node_digests_.find(key) != node_digests_.end()) {
+        return ZX_ERR_ALREADY_EXISTS;
+    }
+
+    size_t inode_count = fbl::min(static_cast<size_t>(info_.inode_count),
+                                  node_map_block_count_ * kBlobfsInodesPerBlock);
+    size_t ino = inode_count;
+    for (size_t n = 0; n < inode_count; ++n) {
+        size_t i = (node_hint_ + n) % inode_count;
+        if (node_map_[i].start_block < kStartBlockMinimum) {
             ino = i;
+            break;
         }
     }
 
-    if (ino >= info_.inode_count) {
+    if (ino >= inode_count) {
         return ZX_ERR_NO_RESOURCES;
     }
 
-    size_t bno = (ino / kBlobfsInodesPerBlock) + NodeMapStartBlock(info_);
-    zx_status_t status;
-    if ((status = ReadBlock(bno)) != ZX_OK) {
-        return status;
-    }
-
+    size_t bno = (ino / kBlobfsInodesPerBlock) + node_map_start_block_;
     fbl::AllocChecker ac;
-    Inode* inodes = reinterpret_cast<Inode*>(cache_.blk);
-
-    fbl::unique_ptr<InodeBlock> ino_block(
-        new (&ac) InodeBlock(bno, &inodes[ino % kBlobfsInodesPerBlock], digest));
+    fbl::unique_ptr<InodeBlock> ino_block(new (&ac) InodeBlock(bno, &node_map_[ino], digest));
 
     if (!ac.check()) {
         return ZX_ERR_INTERNAL;
     }
 
-    dirty_ = true;
+    node_hint_ = ino + 1;
+    node_digests_.insert(key);
     info_.alloc_inode_count++;
     *out = fbl::move(ino_block);
     return ZX_OK;
 }
 
-zx_status_t Blobfs::AllocateBlocks(size_t nblocks, size_t* blkno_out) {
-    zx_status_t status;
-    if ((status = block_map_.Find(false, 0, block_map_.size(), nblocks, blkno_out)) != ZX_OK) {
-        return status;
-    } else if ((status = block_map_.Set(*blkno_out, *blkno_out + nblocks)) != ZX_OK) {
-        return status;
+bool Blobfs::HasBlob(const Digest& digest) const {
+    std::array<uint8_t, Digest::kLength> key;
+    digest.CopyTo(key.data(), key.size());
+    return node_digests_.find(key) != node_digests_.end();
+}
+
+zx_status_t Blobfs::RemoveBlobsExcept(const DigestSet& keep) {
+    size_t inode_count = fbl::min(static_cast<size_t>(info_.inode_count),
+                                  node_map_block_count_ * kBlobfsInodesPerBlock);
+    for (size_t i = 0; i < inode_count; ++i) {
+        Inode* inode = &node_map_[i];
+        if (inode->start_block < kStartBlockMinimum) {
+            continue;
+        }
+        std::array<uint8_t, Digest::kLength> key;
+        memcpy(key.data(), inode->merkle_root_hash, key.size());
+        if (keep.find(key) != keep.end()) {
+            continue;
+        }
+
+        zx_status_t status;
+        fbl::Vector<Extent> extents;
+        if ((status = LoadExtents(*inode, &extents)) != ZX_OK) {
+            return status;
+        }
+        if (inode->flags & kBlobFlagExtentTable) {
+            extents.push_back({inode->start_block, 1});
+        }
+        // The blocks stay allocated until |Flush|, so that data written for new
+        // blobs in the meantime can't overwrite blocks which the inodes still on
+        // disk point at.
+        for (const auto& extent : extents) {
+            pending_free_.push_back(extent);
+        }
+
+        memset(inode, 0, sizeof(*inode));
+        dirty_node_blocks_[i / kBlobfsInodesPerBlock] = true;
+        node_digests_.erase(key);
+        node_hint_ = fbl::min(node_hint_, i);
+        info_.alloc_inode_count--;
+        WriteInfo();
+    }
+    return ZX_OK;
+}
+
+zx_status_t Blobfs::AllocateBlocks(size_t nblocks, fbl::Vector<Extent>* out) {
+    fbl::Vector<Extent> extents;
+    size_t blkno;
+    if (block_map_.Find(false, block_hint_, block_map_.size(), nblocks, &blkno) == ZX_OK ||
+        block_map_.Find(false, 0, block_map_.size(), nblocks, &blkno) == ZX_OK) {
+        extents.push_back({blkno, nblocks});
+    } else {
+        // Free space is too fragmented to hold the blob contiguously.
+        size_t remaining = nblocks;
+        size_t start = 0;
+        while (remaining > 0) {
+            if (block_map_.Find(false, start, block_map_.size(), 1, &blkno) != ZX_OK ||
+                extents.size() == kBlobfsMaxExtents) {
+                return ZX_ERR_NO_SPACE;
+            }
+            size_t end = block_map_.size();
+            block_map_.Scan(blkno, block_map_.size(), false, &end);
+            size_t length = fbl::min(end - blkno, remaining);
+            extents.push_back({blkno, length});
+            remaining -= length;
+            start = blkno + length;
+        }
     }
 
+    for (const auto& extent : extents) {
+        zx_status_t status = block_map_.Set(extent.start, extent.start + extent.length);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    block_hint_ = extents[extents.size() - 1].start + extents[extents.size() - 1].length;
     info_.alloc_block_count += nblocks;
+    *out = fbl::move(extents);
     return ZX_OK;
 }
 
 zx_status_t Blobfs::WriteBitmap(size_t nblocks, size_t start_block) {
     uint64_t bbm_start_block = start_block / kBlobfsBlockBits;
     uint64_t bbm_end_block = fbl::round_up(start_block + nblocks, kBlobfsBlockBits) / kBlobfsBlockBits;
-    const void* bmstart = block_map_.StorageUnsafe()->GetData();
     for (size_t n = bbm_start_block; n < bbm_end_block; n++) {
-        const void* data = fs::GetBlock(kBlobfsBlockSize, bmstart, n);
-        uint64_t bno = block_map_start_block_ + n;
-        zx_status_t status;
-        if ((status = WriteBlock(bno, data)) != ZX_OK) {
-            return status;
-        }
+        dirty_bitmap_blocks_[n] = true;
     }
-
     return ZX_OK;
 }
 
 zx_status_t Blobfs::WriteNode(fbl::unique_ptr<InodeBlock> ino_block) {
-    if (ino_block->GetBno() != cache_.bno) {
-        return ZX_ERR_ACCESS_DENIED;
+    size_t n = ino_block->GetBno() - node_map_start_block_;
+    if (n >= node_map_block_count_) {
+        return ZX_ERR_OUT_OF_RANGE;
     }
-
-    dirty_ = false;
-    return WriteBlock(cache_.bno, cache_.blk);
+    dirty_node_blocks_[n] = true;
+    return ZX_OK;
 }
 
-zx_status_t Blobfs::WriteData(Inode* inode, const void* merkle_data, const void* blob_data) {
-    const size_t merkle_blocks = MerkleTreeBlocks(*inode);
-    const size_t data_blocks = inode->num_blocks - merkle_blocks;
-    for (size_t n = 0; n < merkle_blocks; n++) {
-        const void* data = fs::GetBlock(kBlobfsBlockSize, merkle_data, n);
-        uint64_t bno = data_start_block_ + inode->start_block + n;
+zx_status_t Blobfs::WriteData(const Inode& inode, const fbl::Vector<Extent>& extents,
+                              const void* merkle_data, const void* blob_data) {
+    const uint64_t merkle_blocks = MerkleTreeBlocks(inode);
+    const uint64_t full_data_blocks = inode.blob_size / kBlobfsBlockSize;
+    return ForEachExtentRun(extents, 0, inode.num_blocks,
+                            [&](uint64_t block, uint64_t data_block, uint64_t count) {
         zx_status_t status;
-        if ((status = WriteBlock(bno, data)) != ZX_OK) {
-            return status;
+        uint64_t bno = data_start_block_ + data_block;
+        // The merkle tree and all but the last block of data are written
+        // straight from their buffers, a run at a time.
+        if (block < merkle_blocks) {
+            uint64_t run = fbl::min(count, merkle_blocks - block);
+            const void* data = fs::GetBlock(kBlobfsBlockSize, merkle_data, block);
+            if ((status = WriteBlocks(bno, data, run)) != ZX_OK) {
+                return status;
+            }
+            block += run;
+            bno += run;
+            count -= run;
+        }
+        uint64_t n = block - merkle_blocks;
+        if (count > 0 && n < full_data_blocks) {
+            uint64_t run = fbl::min(count, full_data_blocks - n);
+            const void* data = fs::GetBlock(kBlobfsBlockSize, blob_data, n);
+            if ((status = WriteBlocks(bno, data, run)) != ZX_OK) {
+                return status;
+            }
+            n += run;
+            bno += run;
+            count -= run;
+        }
+        // Read the partial last block into a block-sized buffer which
+        // zero-pads the data.
+        for (; count > 0; n++, bno++, count--) {
+            uint8_t last_data[kBlobfsBlockSize];
+            memset(last_data, 0, kBlobfsBlockSize);
+            size_t off = n * kBlobfsBlockSize;
+            if (off < inode.blob_size) {
+                memcpy(last_data, fs::GetBlock(kBlobfsBlockSize, blob_data, n),
+                       inode.blob_size - off);
+            }
+            if ((status = WriteBlock(bno, last_data)) != ZX_OK) {
+                return status;
+            }
         }
+        return ZX_OK;
+    });
+}
+
+zx_status_t Blobfs::WriteExtentTable(size_t bno, const fbl::Vector<Extent>& extents) {
+    ZX_ASSERT(extents.size() <= kBlobfsMaxExtents);
+    fbl::unique_ptr<ExtentTable> table(new ExtentTable());
+    table->magic = kBlobfsExtentTableMagic;
+    table->extent_count = extents.size();
+    for (size_t i = 0; i < extents.size(); i++) {
+        table->extents[i] = extents[i];
     }
+    return WriteBlock(data_start_block_ + bno, table.get());
+}
 
-    for (size_t n = 0; n < data_blocks; n++) {
-        const void* data = fs::GetBlock(kBlobfsBlockSize, blob_data, n);
+zx_status_t Blobfs::WriteInfo() {
+    dirty_info_ = true;
+    return ZX_OK;
+}
 
-        // If we try to write a block, will it be reaching beyond the end of the
-        // mapped file?
-        size_t off = n * kBlobfsBlockSize;
-        uint8_t last_data[kBlobfsBlockSize];
-        if (inode->blob_size < off + kBlobfsBlockSize) {
-            // Read the partial block from a block-sized buffer which zero-pads the data.
-            memset(last_data, 0, kBlobfsBlockSize);
-            memcpy(last_data, data, inode->blob_size - off);
-            data = last_data;
+zx_status_t Blobfs::Flush() {
+    zx_status_t status;
+    // Blocks of removed blobs are released along with the node map changes
+    // that stop referencing them.
+    for (const auto& extent : pending_free_) {
+        if ((status = block_map_.Clear(extent.start, extent.start + extent.length)) != ZX_OK) {
+            return status;
         }
+        WriteBitmap(extent.length, extent.start);
+        info_.alloc_block_count -= extent.length;
+        WriteInfo();
+    }
+    if (!pending_free_.empty()) {
+        // Let later blobs fill the space that was freed.
+        pending_free_.clear();
+        block_hint_ = 0;
+    }
 
-        uint64_t bno = data_start_block_ + inode->start_block + merkle_blocks + n;
-        zx_status_t status;
-        if ((status = WriteBlock(bno, data)) != ZX_OK) {
+    const uint8_t* bmstart = static_cast<const uint8_t*>(block_map_.StorageUnsafe()->GetData());
+    const uint8_t* nmstart = reinterpret_cast<const uint8_t*>(node_map_.get());
+    if ((status = FlushBlocks(&dirty_bitmap_blocks_, bmstart, block_map_start_block_)) != ZX_OK) {
+        return status;
+    } else if ((status = FlushBlocks(&dirty_node_blocks_, nmstart,
+                                     node_map_start_block_)) != ZX_OK) {
+        return status;
+    }
+    // The superblock goes last, once everything it accounts for is on disk.
+    if (dirty_info_) {
+        if ((status = WriteBlock(0, info_block_)) != ZX_OK) {
             return status;
         }
+        dirty_info_ = false;
     }
-
     return ZX_OK;
 }
 
-zx_status_t Blobfs::WriteInfo() {
-    return WriteBlock(0, info_block_);
+zx_status_t Blobfs::FlushBlocks(std::vector<bool>* dirty, const uint8_t* data,
+                                size_t start_block) {
+    size_t n = 0;
+    while (n < dirty->size()) {
+        if (!(*dirty)[n]) {
+            n++;
+            continue;
+        }
+        size_t end = n;
+        while (end < dirty->size() && (*dirty)[end]) {
+            (*dirty)[end++] = false;
+        }
+        zx_status_t status;
+        if ((status = WriteBlocks(start_block + n, data + n * kBlobfsBlockSize,
+                                  end - n)) != ZX_OK) {
+            return status;
+        }
+        n = end;
+    }
+    return ZX_OK;
 }
 
 zx_status_t Blobfs::ReadBlock(size_t bno) {
-    if (dirty_) {
-        return ZX_ERR_ACCESS_DENIED;
-    }
-
     zx_status_t status;
     if ((cache_.bno != bno) && ((status = readblk_offset(blockfd_.get(), bno, offset_, &cache_.blk)) != ZX_OK)) {
         return status;
@@ -517,14 +865,14 @@ zx_status_t Blobfs::ReadBlock(size_t bno) {
 }
 
 zx_status_t Blobfs::WriteBlock(size_t bno, const void* data) {
-    return writeblk_offset(blockfd_.get(), bno, offset_, data);
+    return writeblks_offset(blockfd_.get(), bno, offset_, data, 1);
 }
 
-zx_status_t Blobfs::ResetCache() {
-    if (dirty_) {
-        return ZX_ERR_ACCESS_DENIED;
-    }
+zx_status_t Blobfs::WriteBlocks(size_t bno, const void* data, size_t count) {
+    return writeblks_offset(blockfd_.get(), bno, offset_, data, count);
+}
 
+zx_status_t Blobfs::ResetCache() {
     if (cache_.bno != 0) {
         memset(cache_.blk, 0, kBlobfsBlockSize);
         cache_.bno = 0;
@@ -533,24 +881,65 @@ zx_status_t Blobfs::ResetCache() {
 }
 
 Inode* Blobfs::GetNode(size_t index) {
-    size_t bno = node_map_start_block_ + index / kBlobfsInodesPerBlock;
+    if (index < node_map_block_count_ * kBlobfsInodesPerBlock) {
+        return &node_map_[index];
+    }
 
-    if (bno >= data_start_block_) {
-        // Set cache to 0 so we can return a pointer to an empty inode
-        if (ResetCache() != ZX_OK) {
-            return nullptr;
-        }
-    } else if (ReadBlock(bno) < 0) {
+    // Set cache to 0 so we can return a pointer to an empty inode
+    if (ResetCache() != ZX_OK) {
         return nullptr;
     }
-
     auto iblock = reinterpret_cast<Inode*>(cache_.blk);
     return &iblock[index % kBlobfsInodesPerBlock];
 }
 
+zx_status_t Blobfs::LoadExtents(const Inode& inode, fbl::Vector<Extent>* out) {
+    fbl::Vector<Extent> extents;
+    if ((inode.flags & kBlobFlagExtentTable) == 0) {
+        if (inode.num_blocks > 0) {
+            extents.push_back({inode.start_block, inode.num_blocks});
+        }
+        *out = fbl::move(extents);
+        return ZX_OK;
+    }
+
+    if (inode.start_block >= data_block_count_) {
+        fprintf(stderr, "blobfs: extent table @%" PRIu64 " out of range\n", inode.start_block);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    zx_status_t status;
+    if ((status = ReadBlock(data_start_block_ + inode.start_block)) != ZX_OK) {
+        return status;
+    }
+    return ParseExtentTable(info_, inode, *reinterpret_cast<const ExtentTable*>(cache_.blk), out);
+}
+
+zx_status_t Blobfs::ReadBlobBlocks(const fbl::Vector<Extent>& extents, uint64_t blob_block,
+                                   uint64_t count, uint8_t* out) {
+    return ForEachExtentRun(extents, blob_block, count,
+                            [&](uint64_t block, uint64_t data_block, uint64_t run) {
+        for (size_t i = 0; i < run; i++) {
+            zx_status_t status;
+            if ((status = ReadBlock(data_start_block_ + data_block + i)) != ZX_OK) {
+                return status;
+            }
+            memcpy(out + (block - blob_block + i) * kBlobfsBlockSize, cache_.blk,
+                   kBlobfsBlockSize);
+        }
+        return ZX_OK;
+    });
+}
+
 zx_status_t Blobfs::VerifyBlob(size_t node_index) {
     Inode inode = *GetNode(node_index);
 
+    zx_status_t status;
+    fbl::Vector<Extent> extents;
+    if ((status = LoadExtents(inode, &extents)) != ZX_OK) {
+        return status;
+    }
+
     // Determine size for (uncompressed) data buffer.
     uint64_t data_blocks = BlobDataBlocks(inode);
     uint64_t merkle_blocks = MerkleTreeBlocks(inode);
@@ -564,11 +953,10 @@ zx_status_t Blobfs::VerifyBlob(size_t node_index) {
     // Create data buffer.
     fbl::unique_ptr<uint8_t[]> data(new uint8_t[target_size]);
 
-    if (inode.flags & kBlobFlagLZ4Compressed) {
+    if (inode.flags & (kBlobFlagLZ4Compressed | kBlobFlagChunkCompressed)) {
         // Read in uncompressed merkle blocks.
-        for (unsigned i = 0; i < merkle_blocks; i++) {
-            ReadBlock(data_start_block_ + inode.start_block + i);
-            memcpy(data.get() + (i * kBlobfsBlockSize), cache_.blk, kBlobfsBlockSize);
+        if ((status = ReadBlobBlocks(extents, 0, merkle_blocks, data.get())) != ZX_OK) {
+            return status;
         }
 
         // Determine size for compressed data buffer.
@@ -583,17 +971,22 @@ zx_status_t Blobfs::VerifyBlob(size_t node_index) {
         fbl::unique_ptr<uint8_t[]> compressed_data(new uint8_t[compressed_size]);
 
         // Read in all compressed blob data.
-        for (unsigned i = 0; i < compressed_blocks; i++) {
-            ReadBlock(data_start_block_ + inode.start_block + i + merkle_blocks);
-            memcpy(compressed_data.get() + (i * kBlobfsBlockSize), cache_.blk, kBlobfsBlockSize);
+        if ((status = ReadBlobBlocks(extents, merkle_blocks, compressed_blocks,
+                                     compressed_data.get())) != ZX_OK) {
+            return status;
         }
 
         // Decompress the compressed data into the target buffer.
-        zx_status_t status;
         target_size = inode.blob_size;
         uint8_t* data_ptr = data.get() + (merkle_blocks * kBlobfsBlockSize);
-        if ((status = Decompressor::Decompress(data_ptr, &target_size, compressed_data.get(),
-                                               &compressed_size)) != ZX_OK) {
+        if (inode.flags & kBlobFlagChunkCompressed) {
+            status = ChunkedDecompressor::Decompress(data_ptr, &target_size,
+                                                     compressed_data.get(), &compressed_size);
+        } else {
+            status = Decompressor::Decompress(data_ptr, &target_size, compressed_data.get(),
+                                              &compressed_size);
+        }
+        if (status != ZX_OK) {
             return status;
         }
         if (target_size != inode.blob_size) {
@@ -603,9 +996,8 @@ zx_status_t Blobfs::VerifyBlob(size_t node_index) {
         }
     } else {
         // For uncompressed blobs, read entire blob straight into the data buffer.
-        for (unsigned i = 0; i < inode.num_blocks; i++) {
-            ReadBlock(data_start_block_ + inode.start_block + i);
-            memcpy(data.get() + (i * kBlobfsBlockSize), cache_.blk, kBlobfsBlockSize);
+        if ((status = ReadBlobBlocks(extents, 0, inode.num_blocks, data.get())) != ZX_OK) {
+            return status;
         }
     }
 
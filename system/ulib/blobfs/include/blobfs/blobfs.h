@@ -25,6 +25,7 @@
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_fd.h>
 #include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
 #include <fs/block-txn.h>
 #include <fs/managed-vfs.h>
 #include <fs/ticker.h>
@@ -76,6 +77,10 @@ constexpr BlobFlags kBlobOtherMask        = 0x0000FF00;
 
 // clang-format on
 
+// The number of data blocks read ahead of a request when an uncompressed
+// blob is being populated on demand.
+constexpr uint64_t kLazyReadAheadBlocks = 16;
+
 class VnodeBlob final : public fs::Vnode, public fbl::Recyclable<VnodeBlob> {
 public:
     // Intrusive methods and structures
@@ -117,6 +122,16 @@ public:
         return inode_;
     }
 
+    // Loads the location of the blob's blocks on disk, reading its extent
+    // table if the blob is fragmented.
+    zx_status_t LoadExtents();
+
+    // Returns the on-disk extents holding the Merkle Tree followed by the blob's
+    // data. Only valid after |LoadExtents()|, or once space has been allocated.
+    const fbl::Vector<Extent>& GetExtents() const {
+        return extents_;
+    }
+
     // Constructs the "directory" blob
     VnodeBlob(Blobfs* bs);
     // Constructs actual blobs
@@ -238,10 +253,45 @@ private:
     // Does not verify the blob.
     zx_status_t InitUncompressed();
 
+    // Initialize a decompressed blob by reading only its Merkle tree from disk.
+    // The data is read and verified on demand by |PopulateRange()|.
+    zx_status_t InitLazy();
+
+    // Initialize a chunk-compressed blob by reading its Merkle tree and
+    // ChunkTable from disk. The data is read, decompressed and verified on
+    // demand by |PopulateRange()|, one chunk at a time.
+    zx_status_t InitChunked();
+
+    // Ensures that the data within [offset, offset + length) has been read from
+    // disk and verified, one Merkle tree leaf at a time. Unpopulated blocks are
+    // read up to |kLazyReadAheadBlocks| past the end of the requested range.
+    // Chunk-compressed blobs are populated in whole chunks.
+    //
+    // This is a no-op for blobs which were not initialized lazily, or which
+    // have already been entirely populated.
+    // InitVmos() must have already been called for this blob.
+    zx_status_t PopulateRange(uint64_t offset, uint64_t length);
+
     // Verify the integrity of the in-memory Blob.
     // InitVmos() must have already been called for this blob.
     zx_status_t Verify() const;
 
+    // Enqueues reads of the blob-relative blocks [blob_block, blob_block + count)
+    // into |vmoid| at |vmo_block|, following the blob's extents.
+    zx_status_t EnqueueRead(fs::ReadTxn* txn, vmoid_t vmoid, uint64_t vmo_block,
+                            uint64_t blob_block, uint64_t count) const;
+
+    // Releases the reservation on all blocks past the first |num_blocks| blocks
+    // of a blob being written, dropping its extent table if it is no longer needed.
+    void TrimExtents(uint64_t num_blocks);
+
+    // Releases the reservation on all blocks backing a blob being written.
+    void UnreserveExtents();
+
+    // Writes out the extent table of a fragmented blob, and allocates the block
+    // holding it.
+    zx_status_t WriteExtentTable(WritebackWork* wb);
+
     // Called by Blob once the last write has completed, updating the
     // on-disk metadata.
     zx_status_t WriteMetadata(fbl::unique_ptr<WritebackWork> wb);
@@ -262,6 +312,17 @@ private:
     fbl::unique_ptr<fzl::MappedVmo> blob_ = {};
     vmoid_t vmoid_ = {};
 
+    // For blobs populated on demand, one bit per data block, set once the
+    // block has been read from disk and verified. Empty when the blob is
+    // either entirely populated or not populated lazily.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> populated_blocks_ = {};
+
+    // For chunk-compressed blobs populated on demand, holds the compressed
+    // data as it is read from disk, at the same offsets as on disk. Released
+    // once the blob is entirely populated.
+    fbl::unique_ptr<fzl::MappedVmo> compressed_blob_ = {};
+    vmoid_t compressed_vmoid_ = {};
+
     // Watches any clones of "blob_" provided to clients.
     // Observes the ZX_VMO_ZERO_CHILDREN signal.
     async::WaitMethod<VnodeBlob, &VnodeBlob::HandleNoClones> clone_watcher_;
@@ -279,11 +340,16 @@ private:
     size_t map_index_ = {};
     Inode inode_ = {};
 
+    // The on-disk location of the Merkle Tree followed by the blob's data.
+    // Loaded on demand for blobs which already exist on disk.
+    fbl::Vector<Extent> extents_ = {};
+
     // Data used exclusively during writeback.
     struct WritebackInfo {
         uint64_t bytes_written = {};
-        Compressor compressor;
+        ChunkedCompressor compressor;
         fbl::unique_ptr<fzl::MappedVmo> compressed_blob = {};
+        fbl::unique_ptr<fzl::MappedVmo> extent_table = {};
     };
 
     fbl::unique_ptr<WritebackInfo> write_info_ = {};
@@ -469,6 +535,10 @@ public:
     void UpdateMerkleVerifyMetrics(uint64_t size_data, uint64_t size_merkle,
                                    const fs::Duration& duration);
 
+    // Updates aggregate information about blob data which was read and
+    // verified on demand since mounting.
+    void UpdateOnDemandMetrics(uint64_t blocks, const fs::Duration& duration);
+
     Superblock info_;
 
     zx_status_t CreateWork(fbl::unique_ptr<WritebackWork>* out, VnodeBlob* vnode) {
@@ -531,9 +601,19 @@ private:
     // Searches for |nblocks| free blocks between the block_map_ and reserved_blocks_ bitmaps.
     zx_status_t FindBlocks(size_t start, size_t nblocks, size_t* blkno_out);
 
+    // Searches for free blocks between the block_map_ and reserved_blocks_ bitmaps
+    // which are not necessarily contiguous, collecting at most kBlobfsMaxExtents
+    // runs which together hold |nblocks| blocks.
+    zx_status_t FindExtents(size_t nblocks, fbl::Vector<Extent>* out);
+
     // Reserves space for a block in memory. Does not update disk.
     zx_status_t ReserveBlocks(size_t nblocks, size_t* blkno_out);
 
+    // Reserves space for |nblocks| blocks in memory, preferring a single contiguous
+    // extent, but splitting the allocation across multiple extents if free space
+    // is too fragmented. Does not update disk.
+    zx_status_t ReserveExtents(size_t nblocks, fbl::Vector<Extent>* out);
+
     // Unreserves space for blocks in memory. Does not update disk.
     void UnreserveBlocks(size_t nblocks, size_t blkno_start);
 
@@ -564,6 +644,10 @@ private:
     // No updates should occur directly on the blobfs's node.
     Inode* GetNode(size_t index) const;
 
+    // Returns the extents holding the blocks of |inode|, reading its extent table
+    // from disk if the blob is fragmented.
+    zx_status_t LoadExtents(const Inode& inode, fbl::Vector<Extent>* out);
+
     // Given a contiguous number of blocks after a starting block,
     // write out the bitmap to disk for the corresponding blocks.
     // Should only be called by PersistBlocks and FreeBlocks.
@@ -11,6 +11,7 @@
 #include <bitmap/storage.h>
 #include <fbl/algorithm.h>
 #include <fbl/macros.h>
+#include <fbl/vector.h>
 #include <fs/block-txn.h>
 #include <zircon/types.h>
 
@@ -28,6 +29,10 @@ namespace blobfs {
 constexpr uint64_t kCompressionMinBlocksSaved = 8;
 constexpr uint64_t kCompressionMinBytesSaved = kCompressionMinBlocksSaved * kBlobfsBlockSize;
 
+// The minimum blob size for which the Merkle tree is built on several threads.
+// Below this, starting the threads costs more than hashing the blob.
+constexpr uint64_t kMerkleThreadMinBytes = 1 << 22;
+
 #ifdef __Fuchsia__
 using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
 #else
@@ -45,6 +50,38 @@ int Mkfs(int fd, uint64_t block_count);
 
 uint64_t MerkleTreeBlocks(const Inode& blobNode);
 
+// Validates the contents of the extent table |table| belonging to |inode|, and
+// copies the extents it describes into |out|.
+zx_status_t ParseExtentTable(const Superblock& info, const Inode& inode,
+                             const ExtentTable& table, fbl::Vector<Extent>* out);
+
+// Invokes |func(uint64_t blob_block, uint64_t data_block, uint64_t count)| for
+// each contiguous on-disk run backing the blob-relative blocks
+// [block, block + count) of a blob stored in |extents|. |data_block| is relative
+// to the start of the data section.
+//
+// Stops and returns the first error returned by |func|.
+template <typename Func>
+zx_status_t ForEachExtentRun(const fbl::Vector<Extent>& extents, uint64_t block, uint64_t count,
+                             Func func) {
+    uint64_t extent_block = 0;
+    for (size_t i = 0; i < extents.size() && count > 0; i++) {
+        const Extent& extent = extents[i];
+        if (block < extent_block + extent.length) {
+            uint64_t offset = block - extent_block;
+            uint64_t run = fbl::min(extent.length - offset, count);
+            zx_status_t status = func(block, extent.start + offset, run);
+            if (status != ZX_OK) {
+                return status;
+            }
+            block += run;
+            count -= run;
+        }
+        extent_block += extent.length;
+    }
+    return count == 0 ? ZX_OK : ZX_ERR_OUT_OF_RANGE;
+}
+
 // Get a pointer to the nth block of the bitmap.
 inline void* GetRawBitmapData(const RawBitmap& bm, uint64_t n) {
     assert(n * kBlobfsBlockSize < bm.size());             // Accessing beyond end of bitmap
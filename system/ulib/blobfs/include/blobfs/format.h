@@ -27,7 +27,7 @@ namespace blobfs {
 
 constexpr uint64_t kBlobfsMagic0  = (0xac2153479e694d21ULL);
 constexpr uint64_t kBlobfsMagic1  = (0x985000d4d4d3d314ULL);
-constexpr uint32_t kBlobfsVersion = 0x00000006;
+constexpr uint32_t kBlobfsVersion = 0x00000008;
 
 constexpr uint32_t kBlobFlagClean        = 1;
 constexpr uint32_t kBlobFlagDirty        = 2;
@@ -135,6 +135,12 @@ constexpr uint64_t kStartBlockMinimum  = 1; // Smallest 'data' block possible.
 
 // Identifies that the on-disk storage of the blob is LZ4 compressed.
 constexpr uint32_t kBlobFlagLZ4Compressed = 0x00000001;
+// Identifies that the blob is not stored contiguously. |start_block| refers
+// to an ExtentTable block describing where the blob's blocks live.
+constexpr uint32_t kBlobFlagExtentTable   = 0x00000002;
+// Identifies that the on-disk storage of the blob is a ChunkTable followed by
+// independently LZ4 compressed chunks of the blob.
+constexpr uint32_t kBlobFlagChunkCompressed = 0x00000004;
 
 using digest::Digest;
 
@@ -152,6 +158,58 @@ static_assert(sizeof(Inode) == kBlobfsInodeSize,
 static_assert(kBlobfsBlockSize % kBlobfsInodeSize == 0,
               "Blobfs Inodes should fit cleanly within a blobfs block");
 
+// A contiguous run of blocks, relative to the start of the data section.
+struct Extent {
+    uint64_t start;
+    uint64_t length;
+};
+
+constexpr uint64_t kBlobfsExtentTableMagic = (0x6578746e74626c30ULL);
+constexpr size_t kBlobfsMaxExtents = (kBlobfsBlockSize - 2 * sizeof(uint64_t)) / sizeof(Extent);
+
+// Block referenced by a fragmented blob's |start_block|. The extents, in
+// order, back the blob's merkle tree followed by its data, and their lengths
+// sum to the inode's |num_blocks|. The table block itself is allocated in the
+// block map in addition to |num_blocks|.
+struct ExtentTable {
+    uint64_t magic;
+    uint64_t extent_count;
+    Extent   extents[kBlobfsMaxExtents];
+};
+
+static_assert(sizeof(ExtentTable) == kBlobfsBlockSize,
+              "Blobfs ExtentTable should occupy exactly one block");
+
+constexpr uint64_t kBlobfsChunkTableMagic = (0x63686e6b74626c30ULL);
+
+// Number of uncompressed bytes in each chunk of a chunk-compressed blob (the
+// last chunk may be shorter). Chunks start on Merkle tree leaf boundaries, so
+// each chunk can be decompressed and verified without the rest of the blob.
+constexpr uint32_t kBlobfsChunkSize = 4 * kBlobfsBlockSize;
+static_assert(kBlobfsChunkSize % digest::MerkleTree::kNodeSize == 0,
+              "Blobfs chunks must hold whole Merkle tree leaves");
+
+// Location of one chunk of a chunk-compressed blob, relative to the start of
+// the compressed data (that is, the start of the ChunkTable).
+struct ChunkTableEntry {
+    uint64_t offset;
+    // A chunk whose compressed length would not be smaller than its
+    // uncompressed length is stored uncompressed.
+    uint64_t length;
+};
+
+// Seek table at the start of the data of a chunk-compressed blob, followed by
+// |chunk_count| entries and then the chunks themselves, in order. Currently
+// |chunk_size| is always kBlobfsChunkSize.
+struct ChunkTable {
+    uint64_t magic;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+};
+
+static_assert(sizeof(ChunkTable) == 2 * sizeof(uint64_t),
+              "Blobfs ChunkTable header size is wrong");
+
 // Number of blocks reserved for the blob itself
 constexpr uint64_t BlobDataBlocks(const Inode& blobNode) {
     return fbl::round_up(blobNode.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
@@ -17,6 +17,7 @@
 #include <bitmap/storage.h>
 #include <digest/digest.h>
 #include <fbl/algorithm.h>
+#include <fbl/function.h>
 #include <fbl/macros.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
@@ -26,11 +27,14 @@
 #include <fbl/vector.h>
 #include <zircon/types.h>
 
+#include <array>
 #include <assert.h>
 #include <limits.h>
 #include <mutex>
+#include <set>
 #include <stdbool.h>
 #include <stdint.h>
+#include <vector>
 
 #include <blobfs/common.h>
 #include <blobfs/format.h>
@@ -135,6 +139,9 @@ class Blobfs : public fbl::RefCounted<Blobfs> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Blobfs);
 
+    // A set of Merkle roots.
+    using DigestSet = std::set<std::array<uint8_t, Digest::kLength>>;
+
     // Creates an instance of Blobfs from the file at |blockfd|.
     // The blobfs partition is expected to start at |offset| bytes into the file.
     static zx_status_t Create(fbl::unique_fd blockfd, off_t offset, const info_block_t& info_block,
@@ -146,15 +153,35 @@ public:
     // Checks to see if a blob already exists, and if not allocates a new node
     zx_status_t NewBlob(const Digest& digest, fbl::unique_ptr<InodeBlock>* out);
 
-    // Allocate |nblocks| starting at |*blkno_out| in memory
-    zx_status_t AllocateBlocks(size_t nblocks, size_t* blkno_out);
+    // Returns true if a blob with the Merkle root |digest| exists.
+    bool HasBlob(const Digest& digest) const;
+
+    // Frees the nodes and blocks of every blob whose Merkle root is not in
+    // |keep|.  Like the other metadata updates, this reaches the disk on
+    // |Flush|.  The freed blocks are not handed out again until then, so new
+    // blobs written before the flush never overwrite the removed ones.
+    zx_status_t RemoveBlobsExcept(const DigestSet& keep);
+
+    // Allocate |nblocks| in memory, contiguously if possible, otherwise split
+    // across at most kBlobfsMaxExtents extents.
+    zx_status_t AllocateBlocks(size_t nblocks, fbl::Vector<Extent>* out);
+
+    // Writes the merkle tree and data of a blob to |extents|, one write per
+    // extent.  Safe to call concurrently for blobs with disjoint extents.
+    zx_status_t WriteData(const Inode& inode, const fbl::Vector<Extent>& extents,
+                          const void* merkle_data, const void* blob_data);
+    zx_status_t WriteExtentTable(size_t bno, const fbl::Vector<Extent>& extents);
 
-    zx_status_t WriteData(Inode* inode, const void* merkle_data,
-                          const void* blob_data);
+    // The block bitmap, node map and superblock are kept in memory.  These
+    // mark the affected blocks dirty; they reach the disk on |Flush|.
     zx_status_t WriteBitmap(size_t nblocks, size_t start_block);
     zx_status_t WriteNode(fbl::unique_ptr<InodeBlock> ino_block);
     zx_status_t WriteInfo();
 
+    // Writes all dirty metadata blocks, coalescing adjacent blocks into a
+    // single write.
+    zx_status_t Flush();
+
 private:
     struct BlockCache {
         size_t bno;
@@ -166,10 +193,24 @@ private:
     Blobfs(fbl::unique_fd fd, off_t offset, const info_block_t& info_block,
            const fbl::Array<size_t>& extent_lengths);
     zx_status_t LoadBitmap();
+    zx_status_t LoadNodeMap();
+
+    // Writes the dirty blocks in |dirty|, taking their contents from |data|,
+    // to the region starting at block |start_block|.
+    zx_status_t FlushBlocks(std::vector<bool>* dirty, const uint8_t* data, size_t start_block);
 
     // Access the |index|th inode
     Inode* GetNode(size_t index);
 
+    // Returns the extents holding the blocks of |inode|, reading its extent table
+    // if the blob is fragmented.
+    zx_status_t LoadExtents(const Inode& inode, fbl::Vector<Extent>* out);
+
+    // Read the blob-relative blocks [blob_block, blob_block + count) of a blob
+    // stored in |extents| into |out|.
+    zx_status_t ReadBlobBlocks(const fbl::Vector<Extent>& extents, uint64_t blob_block,
+                               uint64_t count, uint8_t* out);
+
     // Read data from block |bno| into the block cache.
     // If the block cache already contains data from the specified bno, nothing happens.
     // Cannot read while a dirty block is pending.
@@ -178,14 +219,35 @@ private:
     // Write |data| into block |bno|
     zx_status_t WriteBlock(size_t bno, const void* data);
 
+    // Write |count| blocks of |data| starting at block |bno|.
+    zx_status_t WriteBlocks(size_t bno, const void* data, size_t count);
+
     zx_status_t ResetCache();
 
     zx_status_t VerifyBlob(size_t node_index);
 
     RawBitmap block_map_{};
 
+    // Block allocation resumes searching from here, so filling an image with
+    // blobs doesn't rescan the allocated prefix of the bitmap for every blob.
+    size_t block_hint_ = 0;
+
+    // Extents of blobs removed since the last |Flush|.  They are still marked
+    // allocated in |block_map_|, and are cleared from it by |Flush|.
+    std::vector<Extent> pending_free_;
+
+    // An in-memory copy of the node map, and the digests of the allocated
+    // nodes within it.
+    fbl::unique_ptr<Inode[]> node_map_;
+    DigestSet node_digests_;
+    size_t node_hint_ = 0;
+
+    // Metadata blocks modified since the last |Flush|.
+    std::vector<bool> dirty_bitmap_blocks_;
+    std::vector<bool> dirty_node_blocks_;
+    bool dirty_info_ = false;
+
     fbl::unique_fd blockfd_;
-    bool dirty_;
     off_t offset_;
 
     size_t block_map_start_block_;
@@ -219,6 +281,28 @@ zx_status_t blobfs_add_blob(Blobfs* bs, int data_fd);
 // Identical to blobfs_add_blob, but uses a precomputed Merkle Tree and digest.
 zx_status_t blobfs_add_blob_with_merkle(Blobfs* bs, int data_fd, const MerkleInfo& info);
 
+// Compresses the blob read from |data_fd| into |info|, if doing so saves
+// enough space.  |info| must already describe the blob's Merkle tree.
+zx_status_t blobfs_compress(int data_fd, MerkleInfo* info);
+
+// Prepares |bs| to hold exactly the blobs in |infos|.  Blobs whose Merkle
+// roots are absent from |infos| are freed, and blobs which |bs| already holds
+// are dropped from |infos|, leaving only those which must be passed to
+// |blobfs_add_blobs|.  The freed blocks are only reused after the metadata is
+// flushed, so the image must have room for the new blobs beside the old ones.
+zx_status_t blobfs_prune_blobs(Blobfs* bs, std::vector<MerkleInfo>* infos);
+
+// Adds every blob in |infos|, read from the file at each |path|.  Nodes and
+// blocks are assigned to the blobs up front, their data is then written by a
+// pool of threads, and the bitmap, node map and superblock are written once at
+// the end.  Blobs which already exist are skipped.
+zx_status_t blobfs_add_blobs(Blobfs* bs, const std::vector<MerkleInfo>& infos);
+
+// Calls |func| with every index below |count| from a pool of threads, one per
+// CPU.  Once a call fails no further indices are handed out, and the first
+// error is returned.
+zx_status_t ForEachInParallel(size_t count, const fbl::Function<zx_status_t(size_t)>& func);
+
 zx_status_t blobfs_fsck(fbl::unique_fd fd, off_t start, off_t end,
                         const fbl::Vector<size_t>& extent_lengths);
 
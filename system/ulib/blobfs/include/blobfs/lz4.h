@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include <blobfs/format.h>
 #include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
 #include <lz4/lz4frame.h>
 #include <zircon/types.h>
 
@@ -75,4 +77,95 @@ public:
                                   const void* src_buf, size_t* src_size);
 };
 
+// A ChunkedCompressor compresses a blob into the seekable format identified by
+// |kBlobFlagChunkCompressed|: a ChunkTable, followed by each |kBlobfsChunkSize|
+// chunk of the blob compressed on its own.
+//
+// It is used like a Compressor, except that the size of the blob must be known
+// up front to lay out the ChunkTable.
+class ChunkedCompressor {
+public:
+    ChunkedCompressor();
+
+    ~ChunkedCompressor();
+
+    // Identifies if compression is underway.
+    bool Compressing() const {
+        return buf_ != nullptr;
+    }
+
+    // Resets the compression process.
+    void Reset();
+
+    // Returns the compressed size of the blob so far, including the ChunkTable.
+    size_t Size() const;
+
+    // Initializes the compression object to compress a blob of |blob_size|
+    // bytes into a provided buffer of a specified size.
+    //
+    // Although ChunkedCompressor uses this buffer, it does not own the buffer,
+    // assuming that a parent object is responsible for the lifetime.
+    zx_status_t Initialize(void* buf, size_t buf_max, uint64_t blob_size);
+
+    // Returns the maximum possible size a buffer would need to be
+    // in order to compress a blob of size |blob_size|.
+    size_t BufferMax(size_t blob_size) const;
+
+    // Continues the compression after initialization.
+    zx_status_t Update(const void* data, size_t length);
+
+    // Finishes the compression process, once all |blob_size| bytes have been
+    // provided. Must be called before compression is considered complete.
+    zx_status_t End();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ChunkedCompressor);
+
+    // Compresses the next chunk of the blob, |length| bytes at |data|.
+    zx_status_t CompressChunk(const void* data, size_t length);
+
+    // Returns the uncompressed length of the next chunk.
+    size_t NextChunkLength() const;
+
+    void* buf_;
+    size_t buf_max_;
+    size_t buf_used_;
+    uint64_t blob_size_;
+    uint32_t chunk_index_;
+
+    // Accumulates a chunk which arrives across several calls to |Update()|.
+    fbl::unique_ptr<uint8_t[]> chunk_;
+    size_t chunk_used_;
+};
+
+// A ChunkedDecompressor reads blobs compressed by a ChunkedCompressor. |src|
+// always refers to the start of the compressed data (the ChunkTable).
+class ChunkedDecompressor {
+public:
+    // Returns the size of the ChunkTable of a blob of |blob_size| bytes.
+    static size_t TableSize(uint64_t blob_size);
+
+    // Validates the ChunkTable at the start of |src|, which holds |src_size|
+    // bytes of compressed data for a blob of |blob_size| bytes. Only the first
+    // |TableSize(blob_size)| bytes of |src| are accessed.
+    static zx_status_t ValidateTable(const void* src, size_t src_size, uint64_t blob_size);
+
+    // Returns the range of compressed bytes holding chunks [start, end).
+    // The table must have been validated.
+    static void ChunkRange(const void* src, uint32_t start, uint32_t end,
+                           uint64_t* out_offset, uint64_t* out_length);
+
+    // Decompresses chunk |chunk| into |target|, which holds the |target_size|
+    // bytes of the chunk's uncompressed contents. The table must have been
+    // validated, and the compressed bytes of the chunk must be present.
+    static zx_status_t DecompressChunk(void* target, size_t target_size, const void* src,
+                                       uint32_t chunk);
+
+    // Decompresses an entire blob of |*target_size| bytes, validating its
+    // ChunkTable. On success, |*src_size| is set to the length of the
+    // compressed data.
+    static zx_status_t Decompress(void* target_buf, size_t* target_size,
+                                  const void* src_buf, size_t* src_size);
+};
+
 } // namespace blobfs
@@ -61,6 +61,9 @@ struct BlobfsMetrics {
     uint64_t blobs_verified_total_size_data = 0;
     uint64_t blobs_verified_total_size_merkle = 0;
     zx::ticks total_verification_time_ticks = {};
+    // Blob data read and verified on demand, rather than when the blob was opened.
+    uint64_t blocks_populated_on_demand = 0;
+    zx::ticks total_on_demand_time_ticks = {};
 
     // FVM STATS
     // TODO(smklein)
@@ -2,11 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <lz4/lz4.h>
 #include <lz4/lz4frame.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <fbl/macros.h>
 #include <fbl/unique_ptr.h>
@@ -129,4 +132,236 @@ zx_status_t Decompressor::Decompress(void* target_buf_, size_t* target_size,
     return ZX_OK;
 }
 
+namespace {
+
+uint64_t ChunkCount(uint64_t blob_size, uint64_t chunk_size) {
+    return fbl::round_up(blob_size, chunk_size) / chunk_size;
+}
+
+const ChunkTableEntry* ChunkEntries(const void* src) {
+    return reinterpret_cast<const ChunkTableEntry*>(reinterpret_cast<uintptr_t>(src) +
+                                                    sizeof(ChunkTable));
+}
+
+} // namespace
+
+ChunkedCompressor::ChunkedCompressor() : buf_(nullptr) {}
+
+ChunkedCompressor::~ChunkedCompressor() {
+    Reset();
+}
+
+void ChunkedCompressor::Reset() {
+    buf_ = nullptr;
+    chunk_.reset();
+}
+
+zx_status_t ChunkedCompressor::Initialize(void* buf, size_t buf_max, uint64_t blob_size) {
+    ZX_DEBUG_ASSERT(!Compressing());
+    const uint64_t chunk_count = ChunkCount(blob_size, kBlobfsChunkSize);
+    if (chunk_count > UINT32_MAX) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    const size_t table_size = ChunkedDecompressor::TableSize(blob_size);
+    if (buf_max < table_size) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+
+    fbl::AllocChecker ac;
+    chunk_.reset(new (&ac) uint8_t[kBlobfsChunkSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    buf_ = buf;
+    buf_max_ = buf_max;
+    blob_size_ = blob_size;
+    chunk_index_ = 0;
+    chunk_used_ = 0;
+
+    ChunkTable* table = reinterpret_cast<ChunkTable*>(buf_);
+    table->magic = kBlobfsChunkTableMagic;
+    table->chunk_size = kBlobfsChunkSize;
+    table->chunk_count = static_cast<uint32_t>(chunk_count);
+    buf_used_ = table_size;
+    return ZX_OK;
+}
+
+size_t ChunkedCompressor::BufferMax(size_t blob_size) const {
+    // Chunks which do not compress are stored as-is.
+    return ChunkedDecompressor::TableSize(blob_size) + blob_size;
+}
+
+size_t ChunkedCompressor::NextChunkLength() const {
+    const uint64_t offset = static_cast<uint64_t>(chunk_index_) * kBlobfsChunkSize;
+    return static_cast<size_t>(fbl::min<uint64_t>(blob_size_ - offset, kBlobfsChunkSize));
+}
+
+zx_status_t ChunkedCompressor::CompressChunk(const void* data, size_t length) {
+    uint8_t* out = reinterpret_cast<uint8_t*>(buf_) + buf_used_;
+    const size_t remaining = buf_max_ - buf_used_;
+
+    // Only accept compressed output which is smaller than the chunk itself.
+    int capacity = static_cast<int>(fbl::min(remaining, length - 1));
+    int r = LZ4_compress_default(reinterpret_cast<const char*>(data),
+                                 reinterpret_cast<char*>(out), static_cast<int>(length),
+                                 capacity);
+    size_t written;
+    if (r > 0) {
+        written = static_cast<size_t>(r);
+    } else if (remaining >= length) {
+        memcpy(out, data, length);
+        written = length;
+    } else {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    ChunkTableEntry* entry = const_cast<ChunkTableEntry*>(ChunkEntries(buf_)) + chunk_index_;
+    entry->offset = buf_used_;
+    entry->length = written;
+    buf_used_ += written;
+    chunk_index_++;
+    return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::Update(const void* data, size_t length) {
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    while (length > 0) {
+        if (static_cast<uint64_t>(chunk_index_) * kBlobfsChunkSize >= blob_size_) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        const size_t chunk_length = NextChunkLength();
+        zx_status_t status;
+        if (chunk_used_ == 0 && length >= chunk_length) {
+            // Compress whole chunks straight from the caller's buffer.
+            if ((status = CompressChunk(src, chunk_length)) != ZX_OK) {
+                return status;
+            }
+            src += chunk_length;
+            length -= chunk_length;
+            continue;
+        }
+
+        const size_t copy = fbl::min(length, chunk_length - chunk_used_);
+        memcpy(chunk_.get() + chunk_used_, src, copy);
+        chunk_used_ += copy;
+        src += copy;
+        length -= copy;
+        if (chunk_used_ == chunk_length) {
+            if ((status = CompressChunk(chunk_.get(), chunk_length)) != ZX_OK) {
+                return status;
+            }
+            chunk_used_ = 0;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t ChunkedCompressor::End() {
+    ZX_DEBUG_ASSERT(Compressing());
+    if (chunk_index_ != ChunkCount(blob_size_, kBlobfsChunkSize)) {
+        return ZX_ERR_BAD_STATE;
+    }
+    chunk_.reset();
+    return ZX_OK;
+}
+
+size_t ChunkedCompressor::Size() const {
+    ZX_DEBUG_ASSERT(Compressing());
+    return buf_used_;
+}
+
+size_t ChunkedDecompressor::TableSize(uint64_t blob_size) {
+    return sizeof(ChunkTable) +
+           ChunkCount(blob_size, kBlobfsChunkSize) * sizeof(ChunkTableEntry);
+}
+
+zx_status_t ChunkedDecompressor::ValidateTable(const void* src, size_t src_size,
+                                               uint64_t blob_size) {
+    if (src_size < sizeof(ChunkTable)) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const ChunkTable* table = reinterpret_cast<const ChunkTable*>(src);
+    if (table->magic != kBlobfsChunkTableMagic || table->chunk_size != kBlobfsChunkSize ||
+        table->chunk_count != ChunkCount(blob_size, table->chunk_size)) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const uint64_t table_size = sizeof(ChunkTable) +
+                                static_cast<uint64_t>(table->chunk_count) *
+                                sizeof(ChunkTableEntry);
+    if (table_size > src_size) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    // Chunks are stored in order, after the table, within the compressed data.
+    const ChunkTableEntry* entries = ChunkEntries(src);
+    uint64_t next = table_size;
+    for (uint32_t i = 0; i < table->chunk_count; i++) {
+        const uint64_t offset = static_cast<uint64_t>(i) * table->chunk_size;
+        const uint64_t chunk_length = fbl::min<uint64_t>(blob_size - offset, table->chunk_size);
+        if (entries[i].offset != next || entries[i].length == 0 ||
+            entries[i].length > chunk_length || entries[i].length > src_size - next) {
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        next += entries[i].length;
+    }
+    return ZX_OK;
+}
+
+void ChunkedDecompressor::ChunkRange(const void* src, uint32_t start, uint32_t end,
+                                     uint64_t* out_offset, uint64_t* out_length) {
+    ZX_DEBUG_ASSERT(start < end);
+    const ChunkTableEntry* entries = ChunkEntries(src);
+    *out_offset = entries[start].offset;
+    *out_length = entries[end - 1].offset + entries[end - 1].length - entries[start].offset;
+}
+
+zx_status_t ChunkedDecompressor::DecompressChunk(void* target, size_t target_size,
+                                                 const void* src, uint32_t chunk) {
+    TRACE_DURATION("blobfs", "ChunkedDecompressor::DecompressChunk", "chunk", chunk);
+    const ChunkTableEntry& entry = ChunkEntries(src)[chunk];
+    const char* data = reinterpret_cast<const char*>(src) + entry.offset;
+    if (entry.length == target_size) {
+        memcpy(target, data, target_size);
+        return ZX_OK;
+    }
+    int r = LZ4_decompress_safe(data, reinterpret_cast<char*>(target),
+                                static_cast<int>(entry.length), static_cast<int>(target_size));
+    if (r < 0 || static_cast<size_t>(r) != target_size) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    return ZX_OK;
+}
+
+zx_status_t ChunkedDecompressor::Decompress(void* target_buf, size_t* target_size,
+                                            const void* src_buf, size_t* src_size) {
+    TRACE_DURATION("blobfs", "ChunkedDecompressor::Decompress", "target_size", *target_size,
+                   "src_size", *src_size);
+    const uint64_t blob_size = *target_size;
+    zx_status_t status;
+    if ((status = ValidateTable(src_buf, *src_size, blob_size)) != ZX_OK) {
+        return status;
+    }
+
+    const ChunkTable* table = reinterpret_cast<const ChunkTable*>(src_buf);
+    uint8_t* target = reinterpret_cast<uint8_t*>(target_buf);
+    for (uint32_t i = 0; i < table->chunk_count; i++) {
+        const uint64_t offset = static_cast<uint64_t>(i) * table->chunk_size;
+        const size_t length = static_cast<size_t>(fbl::min<uint64_t>(blob_size - offset,
+                                                                     table->chunk_size));
+        if ((status = DecompressChunk(target + offset, length, src_buf, i)) != ZX_OK) {
+            return status;
+        }
+    }
+
+    if (table->chunk_count > 0) {
+        uint64_t offset, length;
+        ChunkRange(src_buf, 0, table->chunk_count, &offset, &length);
+        *src_size = offset + length;
+    } else {
+        *src_size = sizeof(ChunkTable);
+    }
+    return ZX_OK;
+}
+
 } // namespace blobfs
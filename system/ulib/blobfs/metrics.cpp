@@ -45,6 +45,9 @@ void BlobfsMetrics::Dump() const {
            TicksToMs(total_read_from_disk_time_ticks),
            bytes_read_from_disk / mb,
            TicksToMs(total_verification_time_ticks));
+    printf("  Populated %zu blocks on demand in %zu ms\n",
+           blocks_populated_on_demand,
+           TicksToMs(total_on_demand_time_ticks));
 }
 
 } // namespace blobfs
@@ -46,6 +46,11 @@ void VnodeBlob::TearDown() {
         blobfs_->DetachVmo(vmoid_);
     }
     blob_ = nullptr;
+    populated_blocks_.Reset(0);
+    if (compressed_blob_ != nullptr) {
+        blobfs_->DetachVmo(compressed_vmoid_);
+    }
+    compressed_blob_ = nullptr;
 }
 
 VnodeBlob::~VnodeBlob() {
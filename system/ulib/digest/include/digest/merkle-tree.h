@@ -58,6 +58,13 @@ public:
     static zx_status_t Create(const void* data, size_t data_len, void* tree,
                               size_t tree_len, Digest* digest);
 
+    // Like |Create| above, but the nodes in each level of the tree are
+    // independent, so they are divided among up to |num_threads| threads.
+    // Small levels are always hashed on the calling thread.
+    static zx_status_t Create(const void* data, size_t data_len, void* tree,
+                              size_t tree_len, Digest* digest,
+                              size_t num_threads);
+
     // Checks the integrity of a the region of data given by the offset and
     // length.  It checks integrity using the given Merkle tree and trusted root
     // digest. |tree_len| must be at least as much as returned by
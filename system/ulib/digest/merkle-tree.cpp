@@ -4,6 +4,7 @@
 
 #include <digest/merkle-tree.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -26,6 +27,14 @@ const size_t kDigestsPerNode = MerkleTree::kNodeSize / Digest::kLength;
 
 namespace {
 
+// Zeros used to pad the last node of a level.
+const uint8_t kZeroNode[MerkleTree::kNodeSize] = {0};
+
+// When creating a tree with multiple threads, each thread is given at least
+// this many nodes of a level to hash.  Smaller levels aren't worth the cost of
+// starting a thread.
+const size_t kMinNodesPerThread = 32;
+
 // Digest wrapper functions.  These functions implement how a node in the Merkle
 // tree is hashed:
 //    digest = Hash((offset | level) + length + node_data + padding)
@@ -67,10 +76,7 @@ size_t DigestUpdate(Digest* digest, const uint8_t* in, size_t offset, size_t len
 void DigestFinal(Digest* digest, size_t offset) {
     offset = offset % MerkleTree::kNodeSize;
     if (offset != 0) {
-        size_t pad_len = MerkleTree::kNodeSize - offset;
-        uint8_t pad[pad_len];
-        memset(pad, 0, pad_len);
-        digest->Update(pad, pad_len);
+        digest->Update(kZeroNode, MerkleTree::kNodeSize - offset);
     }
     digest->Final();
 }
@@ -94,6 +100,94 @@ size_t NextAligned(size_t length) {
     return fbl::round_up(NextLength(length), MerkleTree::kNodeSize);
 }
 
+////////
+// Helper functions for creating a whole level of the tree at once.
+
+// Describes a contiguous run of nodes in one level of the tree to be hashed,
+// possibly on a separate thread.
+struct LevelSpan {
+    const uint8_t* data;
+    size_t data_len;
+    uint64_t level;
+    size_t first;
+    size_t last;
+    uint8_t* out;
+    zx_status_t rc;
+};
+
+// Hashes the nodes from |span->first| up to |span->last| of a level, and writes
+// their digests to |span->out|.  A single digest context is reused for every
+// node.
+void HashSpan(LevelSpan* span) {
+    Digest digest;
+    span->rc = ZX_OK;
+    for (size_t i = span->first; i < span->last; ++i) {
+        size_t offset = i * MerkleTree::kNodeSize;
+        size_t length = span->data_len - offset;
+        if ((span->rc = DigestInit(&digest, offset | span->level, length)) != ZX_OK) {
+            return;
+        }
+        offset += DigestUpdate(&digest, span->data + offset, offset, length);
+        DigestFinal(&digest, offset);
+        digest.CopyTo(span->out + (i * Digest::kLength), Digest::kLength);
+    }
+}
+
+void* HashSpanThread(void* arg) {
+    HashSpan(static_cast<LevelSpan*>(arg));
+    return nullptr;
+}
+
+// Hashes every node in a level of |data_len| bytes of |data| and writes the
+// digests to |out|, which must have room for |NextAligned(data_len)| bytes.
+// The nodes are divided among up to |num_threads| threads.
+zx_status_t HashLevel(const uint8_t* data, size_t data_len, uint64_t level, uint8_t* out,
+                      size_t num_threads) {
+    size_t num_nodes = fbl::round_up(data_len, MerkleTree::kNodeSize) / MerkleTree::kNodeSize;
+    size_t digests_len = num_nodes * Digest::kLength;
+    memset(out + digests_len, 0, NextAligned(data_len) - digests_len);
+
+    num_threads = fbl::max(fbl::min(num_threads, num_nodes / kMinNodesPerThread),
+                           static_cast<size_t>(1));
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<LevelSpan[]> spans(new (&ac) LevelSpan[num_threads]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    fbl::unique_ptr<pthread_t[]> threads(new (&ac) pthread_t[num_threads]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    fbl::unique_ptr<bool[]> started(new (&ac) bool[num_threads]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    // The calling thread hashes the last span itself.  If a thread can't be
+    // started, its span is hashed inline instead.
+    size_t first = 0;
+    for (size_t i = 0; i < num_threads; ++i) {
+        size_t last = (num_nodes * (i + 1)) / num_threads;
+        spans[i] = {data, data_len, level, first, last, out, ZX_OK};
+        first = last;
+        started[i] = i + 1 < num_threads &&
+                     pthread_create(&threads[i], nullptr, HashSpanThread, &spans[i]) == 0;
+        if (!started[i]) {
+            HashSpan(&spans[i]);
+        }
+    }
+    zx_status_t rc = ZX_OK;
+    for (size_t i = 0; i < num_threads; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], nullptr);
+        }
+        if (rc == ZX_OK) {
+            rc = spans[i].rc;
+        }
+    }
+    return rc;
+}
+
 } // namespace
 
 ////////
@@ -106,13 +200,41 @@ size_t MerkleTree::GetTreeLength(size_t data_len) {
 
 zx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree, size_t tree_len,
                                Digest* digest) {
+    return Create(data, data_len, tree, tree_len, digest, 1);
+}
+
+zx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree, size_t tree_len,
+                               Digest* digest, size_t num_threads) {
     zx_status_t rc;
-    MerkleTree mt;
-    if ((rc = mt.CreateInit(data_len, tree_len)) != ZX_OK ||
-        (rc = mt.CreateUpdate(data, data_len, tree)) != ZX_OK ||
-        (rc = mt.CreateFinal(tree, digest)) != ZX_OK) {
+    // Must have room for the whole tree.
+    if (tree_len < GetTreeLength(data_len)) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    // Must have data to read, a root to write, and a tree to fill if expecting
+    // more than one digest.
+    if ((!data && data_len != 0) || !digest || (!tree && data_len > kNodeSize)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    // Unlike |CreateUpdate|, all of the data is available up front, so the tree
+    // can be built a level at a time rather than a node at a time.
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    uint8_t* out = static_cast<uint8_t*>(tree);
+    uint64_t level = 0;
+    while (data_len > kNodeSize) {
+        if ((rc = HashLevel(in, data_len, level, out, num_threads)) != ZX_OK) {
+            return rc;
+        }
+        // Ascend the tree.
+        in = out;
+        data_len = NextAligned(data_len);
+        out += data_len;
+        ++level;
+    }
+    if ((rc = DigestInit(digest, level, data_len)) != ZX_OK) {
         return rc;
     }
+    DigestUpdate(digest, in, 0, data_len);
+    DigestFinal(digest, data_len);
     return ZX_OK;
 }
 
@@ -64,6 +64,8 @@ struct {
         "List contents of directory."},
     {"manifest", Command::kManifest, O_RDWR,           ArgType::kOne,
         "Add files to fs as specified in manifest (deprecated)."},
+    {"update",   Command::kUpdate,   O_RDWR,           ArgType::kMany,
+        "Update an fs image to hold exactly the files given (additional arguments required)."},
 };
 
 // Arguments struct.
@@ -448,6 +450,8 @@ zx_status_t FsCreator::RunCommand() {
         return Add();
     case Command::kLs:
         return Ls();
+    case Command::kUpdate:
+        return Update();
     default:
         fprintf(stderr, "Error: Command not defined\n");
         return ZX_ERR_INTERNAL;
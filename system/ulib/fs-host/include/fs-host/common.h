@@ -25,6 +25,7 @@ enum class Command {
     kCp,
     kManifest,
     kMkdir,
+    kUpdate,
 };
 
 enum class Option {
@@ -112,6 +113,9 @@ protected:
     virtual zx_status_t Add()  { return ZX_ERR_NOT_SUPPORTED; }
     // Runs ls on the fs at fd_, at the specified path (if any).
     virtual zx_status_t Ls()   { return ZX_ERR_NOT_SUPPORTED; }
+    // Brings the existing fs at fd_ in line with the files specified in manifests or other
+    // command line arguments, keeping the files it already holds where possible.
+    virtual zx_status_t Update() { return ZX_ERR_NOT_SUPPORTED; }
 
     Command GetCommand() const { return command_; }
     off_t GetOffset() const { return offset_; }
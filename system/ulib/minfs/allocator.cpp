@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include <bitmap/raw-bitmap.h>
+#include <fbl/algorithm.h>
 
 #include <minfs/allocator.h>
 #include <minfs/block-txn.h>
@@ -13,6 +14,9 @@
 namespace minfs {
 namespace {
 
+// The number of free elements a new run of allocations starts within.
+constexpr size_t kRunLength = 32;
+
 // Returns the number of blocks necessary to store a pool containing
 // |size| bits.
 blk_t BitmapBlocksForSize(size_t size) {
@@ -35,6 +39,13 @@ size_t AllocatorPromise::Allocate(WriteTxn* txn) {
     return allocator_->Allocate(txn);
 }
 
+size_t AllocatorPromise::AllocateAfter(WriteTxn* txn, size_t prev) {
+    ZX_DEBUG_ASSERT(allocator_ != nullptr);
+    ZX_DEBUG_ASSERT(reserved_ > 0);
+    reserved_--;
+    return allocator_->AllocateAfter(txn, prev);
+}
+
 AllocatorFvmMetadata::AllocatorFvmMetadata() = default;
 AllocatorFvmMetadata::AllocatorFvmMetadata(uint32_t* data_slices,
                                            uint32_t* metadata_slices,
@@ -138,14 +149,42 @@ size_t Allocator::Allocate(WriteTxn* txn) {
         ZX_ASSERT(map_.Find(false, 0, hint_, 1, &bitoff_start) == ZX_OK);
     }
 
-    ZX_ASSERT(map_.Set(bitoff_start, bitoff_start + 1) == ZX_OK);
+    Claim(txn, bitoff_start);
+    hint_ = bitoff_start + 1;
+    return bitoff_start;
+}
+
+size_t Allocator::AllocateAfter(WriteTxn* txn, size_t prev) {
+    ZX_DEBUG_ASSERT(reserved_ > 0);
+    if (prev == 0) {
+        return Allocate(txn);
+    }
 
-    Persist(txn, bitoff_start, 1);
+    size_t bitoff_start = prev + 1;
+    if ((bitoff_start < map_.size()) && !map_.Get(bitoff_start, bitoff_start + 1)) {
+        Claim(txn, bitoff_start);
+        return bitoff_start;
+    }
+
+    if (map_.Find(false, hint_, map_.size(), kRunLength, &bitoff_start) != ZX_OK &&
+        map_.Find(false, 0, hint_, kRunLength, &bitoff_start) != ZX_OK) {
+        // Too fragmented for a new run; settle for any free element.
+        return Allocate(txn);
+    }
+
+    Claim(txn, bitoff_start);
+    // Unrelated allocations skip past the new run, leaving it room to grow.
+    hint_ = fbl::min(bitoff_start + kRunLength, map_.size());
+    return bitoff_start;
+}
+
+void Allocator::Claim(WriteTxn* txn, size_t index) {
+    ZX_ASSERT(map_.Set(index, index + 1) == ZX_OK);
+
+    Persist(txn, index, 1);
     metadata_.PoolAllocate(1);
     reserved_ -= 1;
     sb_->Write(txn);
-    hint_ = bitoff_start + 1;
-    return bitoff_start;
 }
 
 void Allocator::Free(WriteTxn* txn, size_t index) {
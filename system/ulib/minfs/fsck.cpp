@@ -173,6 +173,12 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
     bool dot = false;
     bool dotdot = false;
     uint32_t dirent_count = 0;
+    const uint32_t buckets = inode->dir_buckets;
+
+    if (buckets > kMinfsMaxDirectoryBuckets) {
+        FS_TRACE_ERROR("check: ino#%u: bad directory bucket count (%u)\n", ino, buckets);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
 
     zx_status_t status;
     fbl::RefPtr<VnodeMinfs> vn;
@@ -204,6 +210,18 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
             FS_TRACE_ERROR("check: ino#%u: de[%u]: bad dirent reclen (%u)\n", ino, eno, rlen);
             return ZX_ERR_IO_DATA_INTEGRITY;
         }
+        if (buckets != 0) {
+            // Records of a hashed directory stay within their bucket's block;
+            // only the final bucket holds the last record.
+            const size_t block_end = (off / kMinfsBlockSize + 1) * kMinfsBlockSize;
+            const size_t rec_end = off + (is_last ? (de->ino ? dlen : MINFS_DIRENT_SIZE) : rlen);
+            if ((rec_end > block_end) ||
+                (is_last && (off / kMinfsBlockSize != buckets - 1))) {
+                FS_TRACE_ERROR("check: ino#%u: de[%u]: dirent crosses bucket boundary\n",
+                               ino, eno);
+                return ZX_ERR_IO_DATA_INTEGRITY;
+            }
+        }
         if (de->ino == 0) {
             if (flags & CD_DUMP) {
                 xprintf("ino#%u: de[%u]: <empty> reclen=%u\n", ino, eno, rlen);
@@ -243,6 +261,13 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino,
                     FS_TRACE_ERROR("check: ino#%u: de[%u]: '..' ino=%u (not parent!)\n", ino, eno, de->ino);
                 }
             }
+            if ((buckets != 0) &&
+                (DirentBucket(fbl::StringPiece(de->name, de->namelen), buckets) !=
+                 off / kMinfsBlockSize)) {
+                FS_TRACE_ERROR("check: ino#%u: de[%u]: '%.*s' is in the wrong bucket\n",
+                               ino, eno, de->namelen, de->name);
+                return ZX_ERR_IO_DATA_INTEGRITY;
+            }
             //TODO: check for cycles (non-dot/dotdot dir ref already in checked bitmap)
             if (flags & CD_DUMP) {
                 xprintf("ino#%u: de[%u]: ino=%u type=%u '%.*s' %s\n", ino, eno, de->ino, de->type,
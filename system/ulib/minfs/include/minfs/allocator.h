@@ -40,6 +40,10 @@ public:
 
     // Allocate a new item in allocator_. Return the index of the newly allocated item.
     size_t Allocate(WriteTxn* txn);
+
+    // Allocate a new item in allocator_ to follow |prev|, as in Allocator::AllocateAfter.
+    // Return the index of the newly allocated item.
+    size_t AllocateAfter(WriteTxn* txn, size_t prev);
 private:
     friend class Allocator;
 
@@ -215,6 +219,18 @@ private:
     // Allocate an element and return the newly allocated index.
     size_t Allocate(WriteTxn* txn);
 
+    // Allocate an element to follow |prev|, the element most recently allocated to the
+    // same object (or zero, if there is none), and return the newly allocated index.
+    //
+    // The element immediately after |prev| is preferred, so that objects allocated this
+    // way occupy contiguous runs. Otherwise, a new run is started at the beginning of a
+    // free extent, and the remainder of that extent is left for the run to grow into.
+    // If |prev| is zero, this is the same as Allocate().
+    size_t AllocateAfter(WriteTxn* txn, size_t prev);
+
+    // Mark |index| as allocated, consuming one reserved element.
+    void Claim(WriteTxn* txn, size_t index);
+
     // Write back the allocation of the following items to disk.
     void Persist(WriteTxn* txn, size_t index, size_t count);
 
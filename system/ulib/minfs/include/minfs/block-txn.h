@@ -21,6 +21,9 @@ struct WriteRequest {
     size_t vmo_offset;
     size_t dev_offset;
     size_t length;
+    // Metadata is committed to the journal before being written in place;
+    // file data is written in place directly.
+    bool journaled;
 };
 
 // A transaction consisting of enqueued VMOs to be written
@@ -37,21 +40,35 @@ public:
         ZX_DEBUG_ASSERT_MSG(requests_.size() == 0, "WriteTxn still has pending requests");
     }
 
-    // Identify that a block should be written to disk at a later point in time.
-    void Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks);
+    // Identify that a block of metadata should be written to disk at a later
+    // point in time.
+    void Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks) {
+        EnqueueRequest(vmo, vmo_offset, dev_offset, nblocks, true);
+    }
+
+    // Identify that a block of file data should be written to disk at a later
+    // point in time. File data bypasses the metadata journal.
+    void EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                     uint64_t nblocks) {
+        EnqueueRequest(vmo, vmo_offset, dev_offset, nblocks, false);
+    }
 
     fbl::Vector<WriteRequest>& Requests() { return requests_; }
 
     size_t BlkCount() const;
 
+    // Returns the number of blocks which are written through the journal.
+    size_t JournaledBlkCount() const;
+
 protected:
-    // Activate the transaction, writing it out to disk.
-    //
-    // Each transaction uses the |vmo| / |vmoid| pair supplied, since the
-    // transactions should be all reading from a single in-memory buffer.
-    zx_status_t Flush(zx_handle_t vmo, vmoid_t vmoid);
+    // Discards all enqueued requests, once they have been written out to
+    // disk by the writeback buffer.
+    void Clear() { requests_.reset(); }
 
 private:
+    void EnqueueRequest(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                        uint64_t nblocks, bool journaled);
+
     Bcache* bc_;
     fbl::Vector<WriteRequest> requests_;
 };
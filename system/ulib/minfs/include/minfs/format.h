@@ -33,7 +33,7 @@ typedef uint32_t ino_t;
 
 constexpr uint64_t kMinfsMagic0         = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1         = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion        = 0x00000005;
+constexpr uint32_t kMinfsVersion        = 0x00000008;
 
 constexpr ino_t    kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 0x00000001; // Currently unused
@@ -43,6 +43,8 @@ constexpr uint32_t kMinfsBlockBits      = (kMinfsBlockSize * 8);
 constexpr uint32_t kMinfsInodeSize      = 256;
 constexpr uint32_t kMinfsInodesPerBlock = (kMinfsBlockSize / kMinfsInodeSize);
 
+// Files are mapped block by block rather than by extents; the allocator
+// keeps them in contiguous runs instead (see docs/minfs.md).
 constexpr uint32_t kMinfsDirect         = 16;
 constexpr uint32_t kMinfsIndirect       = 31;
 constexpr uint32_t kMinfsDoublyIndirect = 1;
@@ -79,6 +81,13 @@ constexpr size_t kMinfsMinimumSlices = 5;
 
 constexpr uint64_t kMinfsDefaultInodeCount = 32768;
 
+// The default size of the metadata journal. On FVM, the journal lives in the
+// remainder of the superblock's slice, and may be smaller than this.
+constexpr uint32_t kMinfsDefaultJournalBlocks = 256;
+// The smallest usable journal: info block, entry header, one block of
+// payload, and entry commit block.
+constexpr uint32_t kMinfsMinimumJournalBlocks = 4;
+
 struct Superblock {
     uint64_t magic0;
     uint64_t magic1;
@@ -101,11 +110,15 @@ struct Superblock {
     uint32_t abm_slices;    // Slices allocated to block bitmap
     uint32_t ino_slices;    // Slices allocated to inode table
     uint32_t dat_slices;    // Slices allocated to file data section
+    blk_t journal_block;          // first blockno of the metadata journal
+    uint32_t journal_block_count; // number of blocks in the metadata journal
 };
 
 // Notes:
 // - the ibm, abm, ino, and dat regions must be in that order
 //   and may not overlap
+// - the journal region, if present, lies between the info block (0)
+//   and the ibm. A journal_block_count of zero disables journaling
 // - the abm has an entry for every block on the volume, including
 //   the info block (0), the bitmaps, etc
 // - data blocks referenced from direct and indirect block tables
@@ -117,6 +130,44 @@ struct Superblock {
 //   at offset: ino % kMinfsInodesPerBlock
 // - inode 0 is never used, should be marked allocated but ignored
 
+constexpr uint64_t kMinfsJournalMagic       = (0x6c6e724a53464d21ULL);
+constexpr uint64_t kMinfsJournalEntryMagic  = (0x7972744e53464d21ULL);
+constexpr uint64_t kMinfsJournalCommitMagic = (0x74696d4353464d21ULL);
+
+// The first block of the journal region. Journal entries with a sequence
+// number older than |sequence| have already been written in place, and are
+// never replayed.
+struct JournalInfo {
+    uint64_t magic;
+    uint64_t sequence;
+};
+
+constexpr uint32_t kMinfsJournalEntryMaxBlocks = (kMinfsBlockSize - 24) / sizeof(blk_t);
+
+// The header of a journal entry, written to the block following the
+// JournalInfo. It is followed by |block_count| blocks of metadata payload
+// and a JournalCommit block. Payload block |i| belongs at device block
+// |target[i]|.
+struct JournalEntry {
+    uint64_t magic;
+    uint64_t sequence;
+    uint32_t block_count;
+    uint32_t reserved;
+    blk_t target[kMinfsJournalEntryMaxBlocks];
+};
+
+static_assert(sizeof(JournalEntry) == kMinfsBlockSize, "minfs journal entry size is wrong");
+
+// Marks a journal entry as complete. |checksum| covers the entry header and
+// every payload block; an entry with a missing or mismatched commit block was
+// torn by a crash, and is discarded at replay.
+struct JournalCommit {
+    uint64_t magic;
+    uint64_t sequence;
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
 struct Inode {
     uint32_t magic;
     uint32_t size;
@@ -127,7 +178,8 @@ struct Inode {
     uint32_t seq_num;               // bumped when modified
     uint32_t gen_num;               // bumped when deleted
     uint32_t dirent_count;          // for directories
-    uint32_t rsvd[5];
+    uint32_t dir_buckets;           // for directories: hash buckets, or 0 if linear
+    uint32_t rsvd[4];
     blk_t dnum[kMinfsDirect];    // direct blocks
     blk_t inum[kMinfsIndirect];  // indirect blocks
     blk_t dinum[kMinfsDoublyIndirect]; // doubly indirect blocks
@@ -156,7 +208,7 @@ constexpr uint8_t kMinfsMaxNameSize       = 255;
 // The 'dirent->reclen' field may be larger after coalescing
 // entries.
 constexpr uint32_t kMinfsMaxDirentSize    = DirentSize(kMinfsMaxNameSize);
-constexpr uint32_t kMinfsMaxDirectorySize = (((1 << 20) - 1) & (~3));
+constexpr uint32_t kMinfsMaxDirectorySize = (((1 << 24) - 1) & (~3));
 
 static_assert(kMinfsMaxNameSize >= NAME_MAX,
               "MinFS names must be large enough to hold NAME_MAX characters");
@@ -173,6 +225,12 @@ constexpr uint32_t MinfsReclen(Dirent* de, size_t off) {
 static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
               "MinFS directory size must be smaller than reclen mask");
 
+// The largest hash index a directory may use. Each bucket is one block.
+constexpr uint32_t kMinfsMaxDirectoryBuckets = kMinfsMaxDirectorySize / kMinfsBlockSize;
+
+static_assert(kMinfsMaxDirectoryBuckets * kMinfsBlockSize <= kMinfsMaxDirectorySize,
+              "MinFS directory index must fit within a directory");
+
 // Notes:
 // - dirents with ino of 0 are free, and skipped over on lookup
 // - reclen must be a multiple of 4
@@ -180,6 +238,16 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 //   actual size of this record can be computed from the offset at which this
 //   record starts. If the MAX_DIR_SIZE is increased, this 'last' record will
 //   also increase in size.
+// - directories with a nonzero "dir_buckets" are hashed: block N holds exactly
+//   the entries whose names hash to bucket N (see DirentBucket), and no record
+//   crosses a block boundary, except that the last record of the final bucket
+//   keeps the "kMinfsReclenLast" flag. "." and ".." always live in bucket 0.
+//   Since the records still form one chain, a hashed directory can be read
+//   (and treated) as a linear one by clearing "dir_buckets".
+// - the index grows by linear hashing: with N buckets and 2^L <= N < 2^(L+1),
+//   a name hashes to bucket (hash mod 2^L), unless that is below N - 2^L, in
+//   which case it hashes to (hash mod 2^(L+1)). Growing the index by one
+//   bucket splits bucket N - 2^L between itself and the new bucket N.
 
 
 // blocksize   8K    16K    32K
@@ -26,6 +26,8 @@ struct MountOptions {
     bool readonly;
     bool metrics;
     bool verbose;
+    // Read ahead of sequential reads of file contents.
+    bool readahead = true;
 
     // Number of slices to preallocate for data when the filesystem is created.
     uint32_t fvm_data_slices = 1;
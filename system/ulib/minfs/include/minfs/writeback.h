@@ -17,6 +17,7 @@
 #include <fbl/macros.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
 
 #include <fs/queue.h>
 #include <fs/vfs.h>
@@ -46,12 +47,13 @@ public:
     void Reset();
 
 #ifdef __Fuchsia__
-    // Actually transacts the enqueued work, and resets the WritebackWork to
-    // its initial state.
+    // Signals the completion of the enqueued work, which has been transacted
+    // by the writeback buffer with result |status|, and resets the
+    // WritebackWork to its initial state.
     //
     // Returns the number of blocks of the writeback buffer that have been
     // consumed.
-    size_t Complete(zx_handle_t vmo, vmoid_t vmoid);
+    size_t Complete(zx_status_t status);
 
     // Adds a closure to the WritebackWork, such that it will be signalled
     // when the WritebackWork is flushed to disk.
@@ -96,9 +98,11 @@ public:
         return inode_promise_->Allocate(work_.get());
     }
 
-    size_t AllocateBlock() {
+    // Allocates a block to follow |prev|, the block most recently allocated to the
+    // same vnode (or zero).
+    size_t AllocateBlock(size_t prev) {
         ZX_DEBUG_ASSERT(block_promise_ != nullptr);
-        return block_promise_->Allocate(work_.get());
+        return block_promise_->AllocateAfter(work_.get(), prev);
     }
 
     void SetWork(fbl::unique_ptr<WritebackWork> work) {
@@ -125,11 +129,16 @@ private:
 
 // WritebackBuffer which manages a writeback buffer (and background thread,
 // which flushes this buffer out to disk).
+//
+// Metadata is written through the journal described by the superblock: the
+// background thread groups all pending WritebackWork into a single journal
+// entry, commits it with one sequential write, and only then writes the
+// metadata in place.
 class WritebackBuffer {
 public:
     // Calls constructor, return an error if anything goes wrong.
     static zx_status_t Create(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo> buffer,
-                              fbl::unique_ptr<WritebackBuffer>* out);
+                              const Superblock& info, fbl::unique_ptr<WritebackBuffer>* out);
     ~WritebackBuffer();
 
     // Enqueues work into the writeback buffer.
@@ -143,7 +152,38 @@ public:
     void Enqueue(fbl::unique_ptr<WritebackWork> work) __TA_EXCLUDES(writeback_lock_);
 
 private:
-    WritebackBuffer(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo> buffer);
+    using WorkBatch = fbl::Vector<fbl::unique_ptr<WritebackWork>>;
+
+    WritebackBuffer(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo> buffer,
+                    const Superblock& info);
+
+    // Reads the journal info block, and prepares the buffer used to write
+    // journal headers, commit blocks, and the info block itself.
+    zx_status_t InitJournal();
+
+    // Returns the number of metadata blocks which fit in a single journal
+    // entry, or zero if the filesystem has no journal.
+    size_t JournalCapacity() const;
+
+    // Moves as much of the queued work as fits into a single journal entry
+    // into |batch|. Always moves at least one unit of work.
+    void DequeueBatchLocked(WorkBatch* batch) __TA_REQUIRES(writeback_lock_);
+
+    // Writes all of |batch| to disk: file data in place, metadata to the
+    // journal, and then metadata in place.
+    zx_status_t TransactBatch(WorkBatch* batch);
+
+    // Writes |requests|, which refer to blocks of the writeback buffer, in
+    // place.
+    zx_status_t WriteBlocks(const fbl::Vector<WriteRequest>& requests);
+
+    // Writes |metadata| to the journal as a single entry, and flushes the
+    // device so the entry is durable.
+    zx_status_t CommitJournalEntry(const fbl::Vector<WriteRequest>& metadata);
+
+    // Records that the most recently committed journal entry has been written
+    // in place, so it is never replayed.
+    zx_status_t RetireJournalEntry();
 
     // Blocks until |blocks| blocks of data are free for the caller.
     // Returns |ZX_OK| with the lock still held in this case.
@@ -197,8 +237,23 @@ private:
     size_t start_ __TA_GUARDED(writeback_lock_){};
     size_t len_ __TA_GUARDED(writeback_lock_){};
     const size_t cap_ = 0;
+
+    // Only accessed by the writeback thread after creation.
+    const blk_t journal_start_ = 0;
+    const size_t journal_blocks_ = 0;
+    uint64_t sequence_ = 0;
+    // Holds the JournalInfo, JournalEntry, and JournalCommit blocks, in that
+    // order.
+    fbl::unique_ptr<fzl::MappedVmo> journal_buffer_{};
+    vmoid_t journal_vmoid_ = VMOID_INVALID;
 };
 
+// Replays the most recently committed journal entry of the filesystem
+// described by |info|, if it was not fully written in place before the
+// filesystem was last unmounted. Sets |out_replayed| if any metadata was
+// rewritten; in this case, the superblock itself may have changed on disk.
+zx_status_t ReplayJournal(Bcache* bc, const Superblock& info, bool* out_replayed);
+
 #endif
 
 } // namespace minfs
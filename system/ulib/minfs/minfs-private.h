@@ -10,6 +10,7 @@
 #include <inttypes.h>
 
 #ifdef __Fuchsia__
+#include <bitmap/rle-bitmap.h>
 #include <fbl/auto_lock.h>
 #include <fs/managed-vfs.h>
 #include <fs/remote.h>
@@ -78,6 +79,10 @@ constexpr uint32_t kMxFsSyncCtime = (1 << 1);
 
 constexpr uint32_t kMinfsBlockCacheSize = 64;
 
+// Bounds of the per-vnode read-ahead window, in blocks.
+constexpr uint32_t kMinfsMinReadahead = 4;
+constexpr uint32_t kMinfsMaxReadahead = 128;
+
 // Used by fsck
 class MinfsChecker;
 class VnodeMinfs;
@@ -145,8 +150,9 @@ public:
     fbl::RefPtr<VnodeMinfs> VnodeLookup(uint32_t ino) FS_TA_EXCLUDES(hash_lock_);
     void VnodeRelease(VnodeMinfs* vn) FS_TA_EXCLUDES(hash_lock_);
 
-    // Allocate a new data block.
-    void BlockNew(Transaction* state, blk_t* out_bno);
+    // Allocate a new data block, preferably the one following |prev| (if nonzero), so
+    // that the blocks of a file form contiguous extents on disk.
+    void BlockNew(Transaction* state, blk_t prev, blk_t* out_bno);
 
     // Free a data block.
     void BlockFree(WriteTxn* txn, blk_t bno);
@@ -208,10 +214,21 @@ public:
     void SetMetrics(bool enable) { collecting_metrics_ = enable; }
     fs::Ticker StartTicker() { return fs::Ticker(collecting_metrics_); }
 
+    // Controls whether sequential reads of a vnode fetch blocks beyond the
+    // requested range into its VMO.
+    void SetReadahead(bool enable) { readahead_ = enable; }
+    bool ReadaheadEnabled() const { return readahead_; }
+
     // Update aggregate information about VMO initialization.
-    void UpdateInitMetrics(uint32_t dnum_count, uint32_t inum_count,
-                           uint32_t dinum_count, uint64_t user_data_size,
+    void UpdateInitMetrics();
+    // Update aggregate information about reading file blocks into VMOs.
+    // |demand_blocks| were read to satisfy an access, |readahead_blocks| in
+    // anticipation of one.
+    void UpdateLoadMetrics(uint32_t demand_blocks, uint32_t readahead_blocks,
                            const fs::Duration& duration);
+    // Update aggregate information about sequential reads, and whether they
+    // were satisfied without going to disk.
+    void UpdateSequentialReadMetrics(bool cache_hit);
     // Update aggregate information about looking up vnodes by name.
     void UpdateLookupMetrics(bool success, const fs::Duration& duration);
     // Update aggregate information about looking up vnodes by inode.
@@ -292,6 +309,7 @@ private:
     HashTable vnode_hash_ FS_TA_GUARDED(hash_lock_){};
 
     bool collecting_metrics_ = false;
+    bool readahead_ = true;
 #ifdef __Fuchsia__
     fbl::Closure on_unmount_{};
     fuchsia_minfs_Metrics metrics_ = {};
@@ -417,8 +435,25 @@ private:
 
     using DirentCallback = zx_status_t (*)(fbl::RefPtr<VnodeMinfs>, Dirent*, DirArgs*);
 
-    // Enumerates directories.
+    // Enumerates directories. Hashed directories only enumerate the bucket
+    // which may hold |args->name|.
     zx_status_t ForEachDirent(DirArgs* args, const DirentCallback func);
+    zx_status_t ForEachBucketDirent(DirArgs* args, const DirentCallback func);
+
+    // Returns the number of bytes the record |de|, at offset |off|, may hold.
+    uint32_t DirentCapacity(Dirent* de, size_t off) const;
+
+    // Finds space for a new direntry named |args->name| of |args->reclen| bytes, storing its
+    // location in |args->offs|. If the hash bucket for the name is full, buckets of the
+    // directory index are split until it is not. Returns ZX_ERR_NO_SPACE if the directory
+    // cannot hold the entry.
+    zx_status_t FindDirentSpace(DirArgs* args);
+
+    // Grows the index of a hashed directory by one bucket, splitting the next bucket in
+    // linear hashing order, in a transaction of its own. Returns ZX_ERR_NO_SPACE if the
+    // index is at kMinfsMaxDirectoryBuckets, or if no split could ever move an entry out
+    // of the bucket of |name|.
+    zx_status_t SplitDirectoryBucket(fbl::StringPiece name);
 
     // Directory callback functions.
     //
@@ -436,8 +471,8 @@ private:
     static zx_status_t DirentCallbackFindSpace(fbl::RefPtr<VnodeMinfs>, Dirent*, DirArgs*);
 
     // Appends a new directory at the specified offset within |args|. This requires a prior call to
-    // DirentCallbackFindSpace to find an offset where there is space for the direntry. It takes
-    // the same |args| that were passed into DirentCallbackFindSpace.
+    // FindDirentSpace to find an offset where there is space for the direntry. It takes
+    // the same |args| that were passed into FindDirentSpace.
     zx_status_t AppendDirent(DirArgs* args);
 
     zx_status_t UnlinkChild(Transaction* state, fbl::RefPtr<VnodeMinfs> child,
@@ -617,9 +652,26 @@ private:
                            zxrio_node_info_t* extra) final;
     void Sync(SyncCallback closure) final;
     zx_status_t AttachRemote(fs::MountChannel h) final;
+    // Creates the vnode's VMO. File blocks are read into it on demand, by
+    // LoadVmoBlocks.
     zx_status_t InitVmo();
     zx_status_t InitIndirectVmo();
 
+    // Reads any blocks within [start, end) which are not yet present in the
+    // VMO from disk, along with up to |readahead| blocks following |end|
+    // (clipped to the end of the file).
+    zx_status_t LoadVmoBlocks(blk_t start, blk_t end, blk_t readahead);
+
+    // Loads the blocks backing the byte range [off, off + len) ahead of a
+    // read, growing the read-ahead window while the vnode is being read
+    // sequentially.
+    zx_status_t PrepareVmoRead(size_t off, size_t len);
+
+    // Enqueues block |n| of the vnode's VMO to be written to data block |bno|.
+    // Directory contents are metadata, and are written through the journal;
+    // file contents are not.
+    void EnqueueVmoBlock(WriteTxn* txn, blk_t n, blk_t bno);
+
     // Loads indirect blocks up to and including the doubly indirect block at |index|.
     zx_status_t LoadIndirectWithinDoublyIndirect(uint32_t index);
 
@@ -655,11 +707,20 @@ private:
 
 #ifdef __Fuchsia__
     // TODO(smklein): When we have can register MinFS as a pager service, and
-    // it can properly handle pages faults on a vnode's contents, then we can
-    // avoid reading the entire file up-front. Until then, read the contents of
-    // a VMO into memory when it is read/written.
+    // it can properly handle pages faults on a vnode's contents, then the
+    // kernel can fault in the contents of |vmo_|. Until then, blocks are read
+    // into the VMO when they are read/written, and |vmo_loaded_| tracks which
+    // blocks (including holes) hold the file's contents.
     zx::vmo vmo_{};
     uint64_t vmo_size_ = 0;
+    bitmap::RleBitmap vmo_loaded_;
+
+    // Sequential access detection. A read starting where the previous read
+    // ended is sequential; while that holds, each read which misses the VMO
+    // fetches |readahead_blocks_| further blocks, doubling the window up to
+    // kMinfsMaxReadahead.
+    size_t last_read_end_ = 0;
+    blk_t readahead_blocks_ = 0;
 
     // vmo_indirect_ contains all indirect and doubly indirect blocks in the following order:
     // First kMinfsIndirect blocks                                - initial set of indirect blocks
@@ -678,6 +739,12 @@ private:
     ino_t ino_{};
     Inode inode_{};
 
+    // The data block most recently allocated to this vnode. Once the vnode
+    // outgrows its direct blocks, new blocks are allocated after it where
+    // possible, laying large files out in contiguous extents which can be read
+    // and written with few block FIFO requests.
+    blk_t last_bno_{};
+
     // This field tracks the current number of file descriptors with
     // an open reference to this Vnode. Notably, this is distinct from the
     // VnodeMinfs's own refcount, since there may still be filesystem
@@ -717,6 +784,9 @@ void SyncVnode(fbl::RefPtr<VnodeMinfs> vn, uint32_t flags);
 void DumpInfo(const Superblock* info);
 void DumpInode(const Inode* inode, ino_t ino);
 void InitializeDirectory(void* bdata, ino_t ino_self, ino_t ino_parent);
+// Returns the hash bucket which holds |name| in a directory with |buckets|
+// buckets, which must be nonzero.
+uint32_t DirentBucket(fbl::StringPiece name, uint32_t buckets);
 
 // Given an input bcache, initialize the filesystem and return a reference to the
 // root node.
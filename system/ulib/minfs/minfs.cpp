@@ -83,6 +83,8 @@ void DumpInfo(const Superblock* info) {
     xprintf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     xprintf("minfs: inode table  @ %10u\n", info->ino_block);
     xprintf("minfs: data blocks  @ %10u\n", info->dat_block);
+    xprintf("minfs: journal      @ %10u (%u blocks)\n", info->journal_block,
+            info->journal_block_count);
     xprintf("minfs: FVM-aware: %s\n", (info->flags & kMinfsFlagFVM) ? "YES" : "NO");
 }
 
@@ -110,6 +112,16 @@ zx_status_t CheckSuperblock(const Superblock* info, Bcache* bc) {
         FS_TRACE_ERROR("minfs: bsz/isz %u/%u unsupported\n", info->block_size, info->inode_size);
         return ZX_ERR_INVALID_ARGS;
     }
+    if (info->journal_block_count != 0) {
+        if (info->journal_block_count < kMinfsMinimumJournalBlocks) {
+            FS_TRACE_ERROR("minfs: Journal too small\n");
+            return ZX_ERR_INVALID_ARGS;
+        } else if ((info->journal_block == 0) ||
+                   (info->journal_block + info->journal_block_count > info->ibm_block)) {
+            FS_TRACE_ERROR("minfs: Journal collides with other metadata\n");
+            return ZX_ERR_INVALID_ARGS;
+        }
+    }
     if ((info->flags & kMinfsFlagFVM) == 0) {
         if (info->dat_block + info->block_count > max) {
             FS_TRACE_ERROR("minfs: too large for device\n");
@@ -183,6 +195,10 @@ zx_status_t CheckSuperblock(const Superblock* info, Bcache* bc) {
 #endif
         // Verify that the allocated slices are sufficient to hold
         // the allocated data structures of the filesystem.
+        if (info->journal_block + info->journal_block_count > kBlocksPerSlice) {
+            FS_TRACE_ERROR("minfs: Journal does not fit in superblock slice\n");
+            return ZX_ERR_INVALID_ARGS;
+        }
         size_t ibm_blocks_needed = (info->inode_count + kMinfsBlockBits - 1) / kMinfsBlockBits;
         size_t ibm_blocks_allocated = info->ibm_slices * kBlocksPerSlice;
         if (ibm_blocks_needed > ibm_blocks_allocated) {
@@ -545,8 +561,8 @@ zx_status_t Minfs::VnodeGet(fbl::RefPtr<VnodeMinfs>* out, ino_t ino) {
 }
 
 // Allocate a new data block from the block bitmap.
-void Minfs::BlockNew(Transaction* state, blk_t* out_bno) {
-    size_t allocated_bno = state->AllocateBlock();
+void Minfs::BlockNew(Transaction* state, blk_t prev, blk_t* out_bno) {
+    size_t allocated_bno = state->AllocateBlock(prev);
     *out_bno = static_cast<blk_t>(allocated_bno);
 }
 
@@ -575,6 +591,22 @@ void InitializeDirectory(void* bdata, ino_t ino_self, ino_t ino_parent) {
     de->name[1] = '.';
 }
 
+uint32_t DirentBucket(fbl::StringPiece name, uint32_t buckets) {
+    ZX_DEBUG_ASSERT(buckets != 0);
+    if (name == "." || name == "..") {
+        return 0;
+    }
+    // The largest power of two not above |buckets|; the buckets below
+    // |buckets - level| have already been split.
+    uint32_t level = 1u << (31 - __builtin_clz(buckets));
+    uint32_t hash = fnv1a32(name.data(), name.length());
+    uint32_t bucket = hash & (level - 1);
+    if (bucket < buckets - level) {
+        bucket = hash & (2 * level - 1);
+    }
+    return bucket;
+}
+
 zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const Superblock* info,
                           fbl::unique_ptr<Minfs>* out) {
 #ifndef __Fuchsia__
@@ -587,6 +619,25 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const Superblock* info,
     fbl::unique_ptr<SuperblockManager> sb;
     zx_status_t status;
 
+#ifdef __Fuchsia__
+    // Recover any metadata which was committed to the journal, but not
+    // written in place, before reading anything else. The journal may hold a
+    // newer copy of the superblock itself.
+    char blk[kMinfsBlockSize];
+    bool replayed;
+    if ((status = ReplayJournal(bc.get(), *info, &replayed)) != ZX_OK) {
+        FS_TRACE_ERROR("Minfs::Create failed to replay journal: %d\n", status);
+        return status;
+    }
+    if (replayed) {
+        if ((status = bc->Readblk(0, blk)) != ZX_OK) {
+            FS_TRACE_ERROR("Minfs::Create failed to reread superblock: %d\n", status);
+            return status;
+        }
+        info = reinterpret_cast<const Superblock*>(blk);
+    }
+#endif
+
     if ((status = SuperblockManager::Create(bc.get(), info, &sb)) != ZX_OK) {
         FS_TRACE_ERROR("Minfs::Create failed to initialize superblock: %d\n", status);
         return status;
@@ -655,7 +706,8 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const Superblock* info,
     }
 
     fbl::unique_ptr<WritebackBuffer> writeback;
-    if ((status = WritebackBuffer::Create(bc.get(), fbl::move(buffer), &writeback)) != ZX_OK) {
+    if ((status = WritebackBuffer::Create(bc.get(), fbl::move(buffer), sb->Info(),
+                                          &writeback)) != ZX_OK) {
         return status;
     }
 
@@ -767,6 +819,7 @@ zx_status_t MountAndServe(const MountOptions* options, async_dispatcher_t* dispa
     Minfs* vfs = vn->fs_;
     vfs->SetReadonly(options->readonly);
     vfs->SetMetrics(options->metrics);
+    vfs->SetReadahead(options->readahead);
     vfs->SetUnmountCallback(fbl::move(on_unmount));
     vfs->SetDispatcher(dispatcher);
     return vfs->ServeDirectory(fbl::move(vn), fbl::move(mount_channel));
@@ -854,6 +907,14 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
         }
         info.ino_slices = 1;
 
+        // The journal occupies the remainder of the superblock's slice, if
+        // there is enough room for one.
+        if (kBlocksPerSlice - 1 >= kMinfsMinimumJournalBlocks) {
+            info.journal_block = 1;
+            info.journal_block_count = static_cast<uint32_t>(
+                fbl::min(kBlocksPerSlice - 1, static_cast<size_t>(kMinfsDefaultJournalBlocks)));
+        }
+
         ZX_ASSERT(options.fvm_data_slices > 0);
         request.length = options.fvm_data_slices;
         request.offset = kFVMBlockDataStart / kBlocksPerSlice;
@@ -883,7 +944,8 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
     info.alloc_inode_count = 0;
     if ((info.flags & kMinfsFlagFVM) == 0) {
         // Aligning distinct data areas to 8 block groups.
-        uint32_t non_dat_blocks = (8 + fbl::round_up(ibmblks, 8u) + inoblks);
+        uint32_t non_dat_blocks = (8 + kMinfsDefaultJournalBlocks + fbl::round_up(ibmblks, 8u) +
+                                   inoblks);
         if (non_dat_blocks >= blocks) {
             fprintf(stderr, "mkfs: Partition size (%" PRIu64 " bytes) is too small\n",
                     static_cast<uint64_t>(blocks) * kMinfsBlockSize);
@@ -893,7 +955,9 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
         uint32_t dat_block_count_ = blocks - non_dat_blocks;
         abmblks = (dat_block_count_ + kMinfsBlockBits - 1) / kMinfsBlockBits;
         info.block_count = dat_block_count_ - fbl::round_up(abmblks, 8u);
-        info.ibm_block = 8;
+        info.journal_block = 8;
+        info.journal_block_count = kMinfsDefaultJournalBlocks;
+        info.ibm_block = info.journal_block + kMinfsDefaultJournalBlocks;
         info.abm_block = info.ibm_block + fbl::round_up(ibmblks, 8u);
         info.ino_block = info.abm_block + fbl::round_up(abmblks, 8u);
         info.dat_block = info.ino_block + inoblks;
@@ -965,6 +1029,16 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
         bc->Writeblk(info.ibm_block + n, blk);
     }
 
+    // write an empty journal
+    if (info.journal_block_count != 0) {
+        memset(blk, 0, sizeof(blk));
+        bc->Writeblk(info.journal_block + 1, blk);
+        JournalInfo* journal_info = reinterpret_cast<JournalInfo*>(&blk[0]);
+        journal_info->magic = kMinfsJournalMagic;
+        journal_info->sequence = 0;
+        bc->Writeblk(info.journal_block, blk);
+    }
+
     // write inodes
     memset(blk, 0, sizeof(blk));
     for (uint32_t n = 0; n < inoblks; n++) {
@@ -978,6 +1052,7 @@ zx_status_t Mkfs(const MountOptions& options, fbl::unique_ptr<Bcache> bc) {
     ino[kMinfsRootIno].block_count = 1;
     ino[kMinfsRootIno].link_count = 2;
     ino[kMinfsRootIno].dirent_count = 2;
+    ino[kMinfsRootIno].dir_buckets = 1;
     ino[kMinfsRootIno].dnum[0] = 1;
     bc->Writeblk(info.ino_block, blk);
 
@@ -1048,16 +1123,31 @@ zx_status_t SparseFsck(fbl::unique_fd fd, off_t start, off_t end,
 }
 #endif
 
-void Minfs::UpdateInitMetrics(uint32_t dnum_count, uint32_t inum_count, uint32_t dinum_count,
-                              uint64_t user_data_size, const fs::Duration& duration) {
+void Minfs::UpdateInitMetrics() {
 #ifdef FS_WITH_METRICS
     if (collecting_metrics_) {
         metrics_.initialized_vmos++;
-        metrics_.init_user_data_size += user_data_size;
-        metrics_.init_user_data_ticks += duration.get();
-        metrics_.init_dnum_count += dnum_count;
-        metrics_.init_inum_count += inum_count;
-        metrics_.init_dinum_count += dinum_count;
+    }
+#endif
+}
+
+void Minfs::UpdateLoadMetrics(uint32_t demand_blocks, uint32_t readahead_blocks,
+                              const fs::Duration& duration) {
+#ifdef FS_WITH_METRICS
+    if (collecting_metrics_) {
+        metrics_.load_calls++;
+        metrics_.load_demand_blocks += demand_blocks;
+        metrics_.load_readahead_blocks += readahead_blocks;
+        metrics_.load_ticks += duration.get();
+    }
+#endif
+}
+
+void Minfs::UpdateSequentialReadMetrics(bool cache_hit) {
+#ifdef FS_WITH_METRICS
+    if (collecting_metrics_) {
+        metrics_.sequential_reads++;
+        metrics_.sequential_reads_cache_hit += cache_hit ? 1 : 0;
     }
 #endif
 }
@@ -75,6 +75,54 @@ zx_status_t NextDirent(Dirent* de, DirectoryOffset* offs) {
     return kDirIteratorNext;
 }
 
+// Packs the live direntries of the bucket block 'src', of which the first
+// 'len' bytes are in use and which starts at directory offset 'src_off', for
+// which 'keep' returns true into the block 'dst'. The final record is padded
+// out to the end of the block and, if 'last', marked kMinfsReclenLast.
+template <typename Keep>
+zx_status_t PackBucket(uint8_t* src, size_t len, size_t src_off, uint8_t* dst, bool last,
+                       Keep keep) {
+    memset(dst, 0, kMinfsBlockSize);
+    size_t fill = 0;
+    size_t prev = 0;
+
+    size_t off = 0;
+    while (off + MINFS_DIRENT_SIZE <= len) {
+        Dirent* de = reinterpret_cast<Dirent*>(src + off);
+        zx_status_t status;
+        if ((status = ValidateDirent(de, len - off, src_off + off)) != ZX_OK) {
+            return status;
+        }
+        if (de->ino != 0 && keep(de)) {
+            uint32_t size = DirentSize(de->namelen);
+            if (off + size > len) {
+                return ZX_ERR_IO;
+            }
+            // Live records only ever leave a bucket, so they fit.
+            Dirent* out = reinterpret_cast<Dirent*>(dst + fill);
+            memcpy(out, de, size);
+            out->reclen = size;
+            prev = fill;
+            fill += size;
+        }
+        if (de->reclen & kMinfsReclenLast) {
+            break;
+        }
+        off += MinfsReclen(de, src_off + off);
+    }
+
+    uint32_t flags = last ? kMinfsReclenLast : 0;
+    uint32_t remaining = static_cast<uint32_t>(kMinfsBlockSize - fill);
+    if (remaining >= MINFS_DIRENT_SIZE) {
+        Dirent* de = reinterpret_cast<Dirent*>(dst + fill);
+        de->reclen = remaining | flags;
+    } else {
+        Dirent* de = reinterpret_cast<Dirent*>(dst + prev);
+        de->reclen = (de->reclen + remaining) | flags;
+    }
+    return ZX_OK;
+}
+
 #ifdef __Fuchsia__
 
 // MinfsConnection overrides the base Connection class to allow Minfs to
@@ -256,12 +304,9 @@ zx_status_t VnodeMinfs::InitIndirectVmo() {
 }
 
 // Since we cannot yet register the filesystem as a paging service (and cleanly
-// fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
-//
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// fault on pages when they are actually needed), file blocks are read into the
+// VMO by the filesystem itself as they are accessed. |vmo_loaded_| tracks the
+// blocks which have been read (or written) so far.
 zx_status_t VnodeMinfs::InitVmo() {
     if (vmo_.is_valid()) {
         return ZX_OK;
@@ -281,99 +326,94 @@ zx_status_t VnodeMinfs::InitVmo() {
         vmo_.reset();
         return status;
     }
-    fs::ReadTxn txn(fs_->bc_.get());
-    uint32_t dnum_count = 0;
-    uint32_t inum_count = 0;
-    uint32_t dinum_count = 0;
-    fs::Ticker ticker(fs_->StartTicker());
-    auto get_metrics = fbl::MakeAutoCall([&]() {
-        fs_->UpdateInitMetrics(dnum_count, inum_count, dinum_count, vmo_size,
-                               ticker.End());
-    });
-
-    // Initialize all direct blocks
-    blk_t bno;
-    for (uint32_t d = 0; d < kMinfsDirect; d++) {
-        if ((bno = inode_.dnum[d]) != 0) {
-            fs_->ValidateBno(bno);
-            dnum_count++;
-            txn.Enqueue(vmoid_, d, bno + fs_->Info().dat_block, 1);
-        }
-    }
-
-    // Initialize all indirect blocks
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        blk_t ibno;
-        if ((ibno = inode_.inum[i]) != 0) {
-            fs_->ValidateBno(ibno);
-            inum_count++;
 
-            // Only initialize the indirect vmo if it is being used.
-            if ((status = InitIndirectVmo()) != ZX_OK) {
-                vmo_.reset();
-                return status;
-            }
+    vmo_loaded_.ClearAll();
+    last_read_end_ = 0;
+    readahead_blocks_ = 0;
+    fs_->UpdateInitMetrics();
+    ValidateVmoTail();
+    return ZX_OK;
+}
 
-            uint32_t* ientry;
-            ReadIndirectVmoBlock(i, &ientry);
+zx_status_t VnodeMinfs::LoadVmoBlocks(blk_t start, blk_t end, blk_t readahead) {
+    ZX_DEBUG_ASSERT(vmo_.is_valid());
+    const blk_t file_blocks = static_cast<blk_t>(fbl::round_up(inode_.size, kMinfsBlockSize) /
+                                                 kMinfsBlockSize);
+    const blk_t limit = fbl::min(fbl::max(end, file_blocks), end + readahead);
+    size_t first_unset;
+    if (vmo_loaded_.Get(start, limit, &first_unset)) {
+        return ZX_OK;
+    }
 
-            for (uint32_t j = 0; j < kMinfsDirectPerIndirect; j++) {
-                if ((bno = ientry[j]) != 0) {
-                    fs_->ValidateBno(bno);
-                    uint32_t n = kMinfsDirect + i * kMinfsDirectPerIndirect + j;
-                    txn.Enqueue(vmoid_, n, bno + fs_->Info().dat_block, 1);
-                }
+    fs::Ticker ticker(fs_->StartTicker());
+    fs::ReadTxn txn(fs_->bc_.get());
+    uint32_t demand_blocks = 0;
+    uint32_t readahead_read = 0;
+    for (blk_t n = static_cast<blk_t>(first_unset); n < limit; n++) {
+        if (vmo_loaded_.Get(n, n + 1)) {
+            continue;
+        }
+        blk_t bno;
+        zx_status_t status;
+        if ((status = BlockGet(nullptr, n, &bno)) != ZX_OK) {
+            return status;
+        }
+        // Holes are already zero-filled in the VMO.
+        if (bno != 0) {
+            fs_->ValidateBno(bno);
+            txn.Enqueue(vmoid_, n, bno + fs_->Info().dat_block, 1);
+            if (n < end) {
+                demand_blocks++;
+            } else {
+                readahead_read++;
             }
         }
     }
 
-    // Initialize all doubly indirect blocks
-    for (uint32_t i = 0; i < kMinfsDoublyIndirect; i++) {
-        blk_t dibno;
+    zx_status_t status;
+    if ((status = txn.Transact()) != ZX_OK) {
+        return status;
+    }
+    if ((status = vmo_loaded_.Set(first_unset, limit)) != ZX_OK) {
+        return status;
+    }
+    fs_->UpdateLoadMetrics(demand_blocks, readahead_read, ticker.End());
+    return ZX_OK;
+}
 
-        if ((dibno = inode_.dinum[i]) != 0) {
-            fs_->ValidateBno(dibno);
-            dinum_count++;
+zx_status_t VnodeMinfs::PrepareVmoRead(size_t off, size_t len) {
+    const blk_t start = static_cast<blk_t>(off / kMinfsBlockSize);
+    const blk_t end = static_cast<blk_t>(fbl::round_up(off + len, kMinfsBlockSize) /
+                                         kMinfsBlockSize);
+    // Directories are searched rather than streamed; only files read ahead.
+    const bool sequential = !IsDirectory() && fs_->ReadaheadEnabled() &&
+                            (off == last_read_end_);
+    last_read_end_ = off + len;
 
-            // Only initialize the doubly indirect vmo if it is being used.
-            if ((status = InitIndirectVmo()) != ZX_OK) {
-                vmo_.reset();
-                return status;
-            }
+    if (!sequential) {
+        readahead_blocks_ = 0;
+        return LoadVmoBlocks(start, end, 0);
+    }
 
-            uint32_t* dientry;
-            ReadIndirectVmoBlock(GetVmoOffsetForDoublyIndirect(i), &dientry);
-
-            for (uint32_t j = 0; j < kMinfsDirectPerIndirect; j++) {
-                blk_t ibno;
-                if ((ibno = dientry[j]) != 0) {
-                    fs_->ValidateBno(ibno);
-
-                    // Only initialize the indirect vmo if it is being used.
-                    if ((status = LoadIndirectWithinDoublyIndirect(i)) != ZX_OK) {
-                        vmo_.reset();
-                        return status;
-                    }
-
-                    uint32_t* ientry;
-                    ReadIndirectVmoBlock(GetVmoOffsetForIndirect(i) + j, &ientry);
-
-                    for (uint32_t k = 0; k < kMinfsDirectPerIndirect; k++) {
-                        if ((bno = ientry[k]) != 0) {
-                            fs_->ValidateBno(bno);
-                            uint32_t n = kMinfsDirect + kMinfsIndirect * kMinfsDirectPerIndirect
-                                         + j * kMinfsDirectPerIndirect + k;
-                            txn.Enqueue(vmoid_, n, bno + fs_->Info().dat_block, 1);
-                        }
-                    }
-                }
-            }
-        }
+    bool hit = vmo_loaded_.Get(start, end);
+    fs_->UpdateSequentialReadMetrics(hit);
+    if (hit) {
+        return ZX_OK;
     }
 
-    status = txn.Transact();
-    ValidateVmoTail();
-    return status;
+    // The read missed; fetch a window beyond it, and widen the window for the
+    // next miss.
+    readahead_blocks_ = (readahead_blocks_ == 0) ? kMinfsMinReadahead :
+                        fbl::min(readahead_blocks_ * 2, kMinfsMaxReadahead);
+    return LoadVmoBlocks(start, end, readahead_blocks_);
+}
+
+void VnodeMinfs::EnqueueVmoBlock(WriteTxn* txn, blk_t n, blk_t bno) {
+    if (IsDirectory()) {
+        txn->Enqueue(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+    } else {
+        txn->EnqueueData(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+    }
 }
 #endif
 
@@ -383,9 +423,10 @@ void VnodeMinfs::AllocateIndirect(Transaction* state, blk_t index, IndirectArgs*
     // *bno must not be already allocated
     ZX_DEBUG_ASSERT(args->GetBno(index) == 0);
 
-    // allocate new indirect block
+    // allocate new indirect block, inline with the data it maps
     blk_t bno;
-    fs_->BlockNew(state, &bno);
+    fs_->BlockNew(state, last_bno_, &bno);
+    last_bno_ = bno;
 
 #ifdef __Fuchsia__
     ClearIndirectVmoBlock(args->GetOffset() + index);
@@ -414,7 +455,8 @@ zx_status_t VnodeMinfs::BlockOpDirect(Transaction* state, DirectArgs* params) {
             case BlockOp::kWrite: {
                 ZX_DEBUG_ASSERT(state != nullptr);
                 if (bno == 0) {
-                    fs_->BlockNew(state, &bno);
+                    fs_->BlockNew(state, last_bno_, &bno);
+                    last_bno_ = bno;
                     inode_.block_count++;
                 }
 
@@ -718,6 +760,18 @@ zx_status_t VnodeMinfs::BlockGet(Transaction* state, blk_t n, blk_t* bno) {
     }
 #endif
 
+    if (state != nullptr) {
+        if (n < kMinfsDirect) {
+            // Small files are packed in among other allocations; only files
+            // which outgrow their direct blocks are given runs of their own.
+            last_bno_ = 0;
+        } else if (last_bno_ == 0) {
+            // Extend the run holding the preceding block.
+            BlockOpArgs prev_args(n - 1, 1, &last_bno_);
+            ApplyOperation(nullptr, BlockOp::kRead, &prev_args);
+        }
+    }
+
     BlockOpArgs op_args(n, 1, bno);
     return ApplyOperation(state, state ? BlockOp::kWrite : BlockOp::kRead, &op_args);
 }
@@ -788,8 +842,10 @@ zx_status_t VnodeMinfs::UnlinkChild(Transaction* state,
     // Verify they are free and small enough to merge.
     size_t coalesced_size = MinfsReclen(de, off);
     // Coalesce with "next" first, so the kMinfsReclenLast bit can easily flow
-    // back to "de" and "de_prev".
-    if (!(de->reclen & kMinfsReclenLast)) {
+    // back to "de" and "de_prev". Records of hashed directories never merge
+    // across the block boundary between two buckets.
+    if (!(de->reclen & kMinfsReclenLast) &&
+        !(inode_.dir_buckets != 0 && (off_next % kMinfsBlockSize) == 0)) {
         size_t len = MINFS_DIRENT_SIZE;
         if ((status = ReadExactInternal(&de_next, len, off_next)) != ZX_OK) {
             FS_TRACE_ERROR("unlink: Failed to read next dirent\n");
@@ -974,7 +1030,7 @@ zx_status_t VnodeMinfs::DirentCallbackUpdateInode(fbl::RefPtr<VnodeMinfs> vndir,
 
 zx_status_t VnodeMinfs::DirentCallbackFindSpace(fbl::RefPtr<VnodeMinfs> vndir, Dirent* de,
                                                 DirArgs* args) {
-    uint32_t reclen = static_cast<uint32_t>(MinfsReclen(de, args->offs.off));
+    uint32_t reclen = vndir->DirentCapacity(de, args->offs.off);
     if (de->ino == 0) {
         // empty entry, do we fit?
         if (args->reclen > reclen) {
@@ -1007,7 +1063,7 @@ zx_status_t VnodeMinfs::AppendDirent(DirArgs* args) {
         return status;
     }
 
-    uint32_t reclen = static_cast<uint32_t>(MinfsReclen(de, args->offs.off));
+    uint32_t reclen = DirentCapacity(de, args->offs.off);
     if (de->ino == 0) {
         // empty entry, do we fit?
         if (args->reclen > reclen) {
@@ -1072,6 +1128,10 @@ zx_status_t VnodeMinfs::AppendDirent(DirArgs* args) {
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
 zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func) {
+    if (inode_.dir_buckets != 0) {
+        return ForEachBucketDirent(args, func);
+    }
+
     char data[kMinfsMaxDirentSize];
     Dirent* de = (Dirent*) data;
     args->offs.off = 0;
@@ -1103,6 +1163,175 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
     return ZX_ERR_NOT_FOUND;
 }
 
+// Same as ForEachDirent, for hashed directories: only the bucket which may
+// hold 'args->name' is visited, and it is read in a single pass.
+zx_status_t VnodeMinfs::ForEachBucketDirent(DirArgs* args, const DirentCallback func) {
+    uint32_t data[kMinfsBlockSize / sizeof(uint32_t)];
+    const size_t start = DirentBucket(args->name, inode_.dir_buckets) * kMinfsBlockSize;
+    size_t r;
+    zx_status_t status = ReadInternal(data, kMinfsBlockSize, start, &r);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    args->offs.off = start;
+    args->offs.off_prev = start;
+    while (args->offs.off < start + r) {
+        size_t pos = args->offs.off - start;
+        Dirent* de = reinterpret_cast<Dirent*>(reinterpret_cast<uint8_t*>(data) + pos);
+        if ((status = ValidateDirent(de, r - pos, args->offs.off)) != ZX_OK) {
+            return status;
+        } else if ((de->ino != 0) && (pos + DirentSize(de->namelen) > r)) {
+            FS_TRACE_ERROR("vn_dir: dirent at %zd overruns bucket\n", args->offs.off);
+            return ZX_ERR_IO;
+        }
+
+        switch ((status = func(fbl::RefPtr<VnodeMinfs>(this), de, args))) {
+        case kDirIteratorNext:
+            break;
+        case kDirIteratorSaveSync:
+            inode_.seq_num++;
+            InodeSync(args->state->GetWork(), kMxFsSyncMtime);
+            args->state->GetWork()->PinVnode(fbl::move(fbl::WrapRefPtr(this)));
+            return ZX_OK;
+        case kDirIteratorDone:
+        default:
+            return status;
+        }
+    }
+
+    return ZX_ERR_NOT_FOUND;
+}
+
+uint32_t VnodeMinfs::DirentCapacity(Dirent* de, size_t off) const {
+    uint32_t reclen = static_cast<uint32_t>(MinfsReclen(de, off));
+    if ((inode_.dir_buckets != 0) && (de->reclen & kMinfsReclenLast)) {
+        // The last record of a hashed directory may not spill out of the final bucket.
+        reclen = fbl::min(reclen, static_cast<uint32_t>(kMinfsBlockSize - off % kMinfsBlockSize));
+    }
+    return reclen;
+}
+
+zx_status_t VnodeMinfs::FindDirentSpace(DirArgs* args) {
+    zx_status_t status;
+    while ((status = ForEachDirent(args, DirentCallbackFindSpace)) == ZX_ERR_NOT_FOUND) {
+        if (inode_.dir_buckets == 0) {
+            return ZX_ERR_NO_SPACE;
+        } else if ((status = SplitDirectoryBucket(args->name)) != ZX_OK) {
+            return status;
+        }
+    }
+    return status;
+}
+
+zx_status_t VnodeMinfs::SplitDirectoryBucket(fbl::StringPiece name) {
+    const uint32_t buckets = inode_.dir_buckets;
+    ZX_DEBUG_ASSERT(buckets != 0);
+    if (buckets >= kMinfsMaxDirectoryBuckets) {
+        return ZX_ERR_NO_SPACE;
+    }
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[4 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    uint8_t* src = buf.get();
+    uint8_t* dst = src + kMinfsBlockSize;
+    uint8_t* dst_new = dst + kMinfsBlockSize;
+    uint8_t* dst_final = dst_new + kMinfsBlockSize;
+    zx_status_t status;
+    size_t len;
+
+    // If every entry in the bucket of |name| would still share its bucket at the
+    // largest index, splitting cannot make room for it.
+    const uint32_t target = DirentBucket(name, buckets);
+    const uint32_t target_max = DirentBucket(name, kMinfsMaxDirectoryBuckets);
+    memset(src, 0, kMinfsBlockSize);
+    if ((status = ReadInternal(src, kMinfsBlockSize, target * kMinfsBlockSize, &len)) != ZX_OK) {
+        return status;
+    }
+    bool movable = false;
+    for (size_t off = 0; !movable && off + MINFS_DIRENT_SIZE <= len;) {
+        Dirent* de = reinterpret_cast<Dirent*>(src + off);
+        if ((status = ValidateDirent(de, len - off, target * kMinfsBlockSize + off)) != ZX_OK) {
+            return status;
+        }
+        fbl::StringPiece de_name(de->name, de->namelen);
+        if ((de->ino != 0) && (de_name != ".") && (de_name != "..") &&
+            (DirentBucket(de_name, kMinfsMaxDirectoryBuckets) != target_max)) {
+            movable = true;
+        }
+        if (de->reclen & kMinfsReclenLast) {
+            break;
+        }
+        off += MinfsReclen(de, target * kMinfsBlockSize + off);
+    }
+    if (!movable) {
+        return ZX_ERR_NO_SPACE;
+    }
+
+    // Bucket |split| divides between itself and the new final bucket, |buckets|.
+    const uint32_t split = buckets - (1u << (31 - __builtin_clz(buckets)));
+    memset(src, 0, kMinfsBlockSize);
+    if ((status = ReadInternal(src, kMinfsBlockSize, split * kMinfsBlockSize, &len)) != ZX_OK) {
+        return status;
+    }
+    for (int i = 0; i < 2; i++) {
+        const uint32_t keep_bucket = i == 0 ? split : buckets;
+        if ((status = PackBucket(src, len, split * kMinfsBlockSize, i == 0 ? dst : dst_new,
+                                 i == 1, [keep_bucket, buckets](Dirent* de) {
+            fbl::StringPiece de_name(de->name, de->namelen);
+            return DirentBucket(de_name, buckets + 1) == keep_bucket;
+        })) != ZX_OK) {
+            return status;
+        }
+    }
+
+    // The old final bucket gives up the kMinfsReclenLast record.
+    const uint32_t final_bucket = buckets - 1;
+    if (final_bucket != split) {
+        memset(src, 0, kMinfsBlockSize);
+        if ((status = ReadInternal(src, kMinfsBlockSize, final_bucket * kMinfsBlockSize,
+                                   &len)) != ZX_OK) {
+            return status;
+        } else if ((status = PackBucket(src, len, final_bucket * kMinfsBlockSize, dst_final,
+                                        false, [](Dirent*) { return true; })) != ZX_OK) {
+            return status;
+        }
+    }
+
+    const size_t old_len = inode_.size;
+    const size_t new_len = (buckets + 1) * kMinfsBlockSize;
+    blk_t reserve_blocks = 0;
+    if ((new_len > old_len) &&
+        (status = GetRequiredBlockCount(old_len, new_len - old_len, &reserve_blocks)) != ZX_OK) {
+        return status;
+    }
+    fbl::unique_ptr<Transaction> state;
+    if ((status = fs_->BeginTransaction(0, reserve_blocks, &state)) != ZX_OK) {
+        return status;
+    }
+    if ((status = WriteExactInternal(state.get(), dst, kMinfsBlockSize,
+                                     split * kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    } else if ((final_bucket != split) &&
+               (status = WriteExactInternal(state.get(), dst_final, kMinfsBlockSize,
+                                            final_bucket * kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    } else if ((status = WriteExactInternal(state.get(), dst_new, kMinfsBlockSize,
+                                            buckets * kMinfsBlockSize)) != ZX_OK) {
+        return status;
+    }
+
+    inode_.dir_buckets = buckets + 1;
+    // Entries may have moved; make outstanding Readdir cookies resynchronize.
+    inode_.seq_num++;
+    InodeSync(state->GetWork(), kMxFsSyncMtime);
+    state->GetWork()->PinVnode(fbl::move(fbl::WrapRefPtr(this)));
+    fs_->CommitTransaction(fbl::move(state));
+    return ZX_OK;
+}
+
 void VnodeMinfs::fbl_recycle() {
     ZX_DEBUG_ASSERT(fd_count_ == 0);
     if (!IsUnlinked()) {
@@ -1227,6 +1456,8 @@ zx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 #ifdef __Fuchsia__
     if ((status = InitVmo()) != ZX_OK) {
         return status;
+    } else if ((status = PrepareVmoRead(off, len)) != ZX_OK) {
+        return status;
     } else if ((status = vmo_.read(data, off, len)) != ZX_OK) {
         return status;
     } else {
@@ -1355,10 +1586,21 @@ zx_status_t VnodeMinfs::WriteInternal(Transaction* state, const void* data,
             vmo_size_ = new_size;
         }
 
+        // A partial write of a block holding existing data must not clobber
+        // the rest of the block.
+        if ((xfer < kMinfsBlockSize) && (n * kMinfsBlockSize < inode_.size)) {
+            if ((status = LoadVmoBlocks(n, n + 1, 0)) != ZX_OK) {
+                goto done;
+            }
+        }
+
         // Update this block of the in-memory VMO
         if ((status = vmo_.write(data, xfer_off, xfer)) != ZX_OK) {
             goto done;
         }
+        if ((status = vmo_loaded_.Set(n, n + 1)) != ZX_OK) {
+            goto done;
+        }
 
         // Update this block on-disk
         blk_t bno;
@@ -1366,7 +1608,7 @@ zx_status_t VnodeMinfs::WriteInternal(Transaction* state, const void* data,
             goto done;
         }
         ZX_DEBUG_ASSERT(bno != 0);
-        state->GetWork()->Enqueue(vmo_.get(), n, bno + fs_->Info().dat_block, 1);
+        EnqueueVmoBlock(state->GetWork(), n, bno);
 #else
         blk_t bno;
         if ((status = BlockGet(state, n, &bno))) {
@@ -1634,10 +1876,7 @@ zx_status_t VnodeMinfs::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece nam
     // before updating any other metadata.
     args.type = type;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-    status = ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
+    if ((status = FindDirentSpace(&args)) != ZX_OK) {
         return status;
     }
 
@@ -1673,6 +1912,7 @@ zx_status_t VnodeMinfs::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece nam
             return ZX_ERR_IO;
         }
         vn->inode_.dirent_count = 2;
+        vn->inode_.dir_buckets = 1;
         vn->InodeSync(state->GetWork(), kMxFsSyncDefault);
     }
 
@@ -1792,8 +2032,6 @@ zx_status_t VnodeMinfs::Truncate(size_t len) {
 zx_status_t VnodeMinfs::TruncateInternal(Transaction* state, size_t len) {
     zx_status_t r = 0;
 #ifdef __Fuchsia__
-    // TODO(smklein): We should only init up to 'len'; no need
-    // to read in the portion of a large file we plan on deleting.
     if ((r = InitVmo()) != ZX_OK) {
         FS_TRACE_ERROR("minfs: Truncate failed to initialize VMO: %d\n", r);
         return ZX_ERR_IO;
@@ -1838,6 +2076,10 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* state, size_t len) {
             if (bno != 0) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
+                if ((r = LoadVmoBlocks(rel_bno, rel_bno + 1, 0)) != ZX_OK) {
+                    FS_TRACE_ERROR("minfs: Truncate failed to load last block: %d\n", r);
+                    return ZX_ERR_IO;
+                }
                 if ((r = vmo_.read(bdata, len - adjust, adjust)) != ZX_OK) {
                     FS_TRACE_ERROR("minfs: Truncate failed to read last block: %d\n", r);
                     return ZX_ERR_IO;
@@ -1848,7 +2090,7 @@ zx_status_t VnodeMinfs::TruncateInternal(Transaction* state, size_t len) {
                     FS_TRACE_ERROR("minfs: Truncate failed to write last block: %d\n", r);
                     return ZX_ERR_IO;
                 }
-                state->GetWork()->Enqueue(vmo_.get(), rel_bno, bno + fs_->Info().dat_block, 1);
+                EnqueueVmoBlock(state->GetWork(), rel_bno, bno);
 #else
                 if (fs_->bc_->Readblk(bno + fs_->Info().dat_block, bdata)) {
                     return ZX_ERR_IO;
@@ -1944,13 +2186,10 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
 
     // Ensure that we have enough space to write the vnode's new direntry
     // before updating any other metadata.
+    args.name = newname;
     args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newname.length())));
-
-    status = newdir->ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
+    if ((status = newdir->FindDirentSpace(&args)) != ZX_OK) {
         return status;
     }
 
@@ -2043,10 +2282,7 @@ zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targ
     // before updating any other metadata.
     args.type = kMinfsTypeFile; // We can't hard link directories
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-    status = ForEachDirent(&args, DirentCallbackFindSpace);
-    if (status == ZX_ERR_NOT_FOUND) {
-        return ZX_ERR_NO_SPACE;
-    } else if (status != ZX_OK) {
+    if ((status = FindDirentSpace(&args)) != ZX_OK) {
         return status;
     }
 
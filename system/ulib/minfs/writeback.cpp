@@ -3,6 +3,8 @@
 // found in the LICENSE file.
 
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef __Fuchsia__
 #include <fbl/auto_lock.h>
@@ -28,11 +30,11 @@ namespace minfs {
 
 #ifdef __Fuchsia__
 
-void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
-                       uint64_t nblocks) {
+void WriteTxn::EnqueueRequest(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                              uint64_t nblocks, bool journaled) {
     ValidateVmoSize(vmo, static_cast<blk_t>(vmo_offset));
     for (size_t i = 0; i < requests_.size(); i++) {
-        if (requests_[i].vmo != vmo) {
+        if (requests_[i].vmo != vmo || requests_[i].journaled != journaled) {
             continue;
         }
 
@@ -53,44 +55,28 @@ void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset
     request.vmo = vmo;
     // NOTE: It's easier to compare everything when dealing
     // with blocks (not offsets!) so the following are described in
-    // terms of blocks until we Flush().
+    // terms of blocks until the writeback buffer transacts them.
     request.vmo_offset = vmo_offset;
     request.dev_offset = dev_offset;
     request.length = nblocks;
+    request.journaled = journaled;
     requests_.push_back(fbl::move(request));
 }
 
-zx_status_t WriteTxn::Flush(zx_handle_t vmo, vmoid_t vmoid) {
-    ZX_DEBUG_ASSERT(vmo != ZX_HANDLE_INVALID);
-    ZX_DEBUG_ASSERT(vmoid != VMOID_INVALID);
-
-    // Update all the outgoing transactions to be in "disk blocks",
-    // not "Minfs blocks".
-    block_fifo_request_t blk_reqs[requests_.size()];
-    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->DeviceBlockSize();
+size_t WriteTxn::BlkCount() const {
+    size_t blocks_needed = 0;
     for (size_t i = 0; i < requests_.size(); i++) {
-        blk_reqs[i].group = bc_->BlockGroupID();
-        blk_reqs[i].vmoid = vmoid;
-        blk_reqs[i].opcode = BLOCKIO_WRITE;
-        blk_reqs[i].vmo_offset = requests_[i].vmo_offset * kDiskBlocksPerMinfsBlock;
-        blk_reqs[i].dev_offset = requests_[i].dev_offset * kDiskBlocksPerMinfsBlock;
-        // TODO(ZX-2253): Remove this assertion.
-        uint64_t length = requests_[i].length * kDiskBlocksPerMinfsBlock;
-        ZX_ASSERT_MSG(length < UINT32_MAX, "Too many blocks");
-        blk_reqs[i].length = static_cast<uint32_t>(length);
-    }
-
-    // Actually send the operations to the underlying block device.
-    zx_status_t status = bc_->Transaction(blk_reqs, requests_.size());
-
-    requests_.reset();
-    return status;
+        blocks_needed += requests_[i].length;
+    }
+    return blocks_needed;
 }
 
-size_t WriteTxn::BlkCount() const {
+size_t WriteTxn::JournaledBlkCount() const {
     size_t blocks_needed = 0;
     for (size_t i = 0; i < requests_.size(); i++) {
-        blocks_needed += requests_[i].length;
+        if (requests_[i].journaled) {
+            blocks_needed += requests_[i].length;
+        }
     }
     return blocks_needed;
 }
@@ -116,9 +102,9 @@ void WritebackWork::Reset() {
 #ifdef __Fuchsia__
 // Returns the number of blocks of the writeback buffer that have been
 // consumed
-size_t WritebackWork::Complete(zx_handle_t vmo, vmoid_t vmoid) {
+size_t WritebackWork::Complete(zx_status_t status) {
     size_t blk_count = BlkCount();
-    zx_status_t status = Flush(vmo, vmoid);
+    Clear();
     if (closure_) {
         closure_(status);
     }
@@ -152,11 +138,139 @@ void WritebackWork::PinVnode(fbl::RefPtr<VnodeMinfs> vn) {
 
 #ifdef __Fuchsia__
 
+namespace {
+
+using WorkBatch = fbl::Vector<fbl::unique_ptr<WritebackWork>>;
+
+// Extends the FNV-1a hash |n| over |len| bytes at |ptr|.
+uint32_t JournalChecksum(uint32_t n, const void* ptr, size_t len) {
+    const uint8_t* data = static_cast<const uint8_t*>(ptr);
+    while (len-- > 0) {
+        n = (n ^ (*data++)) * FNV32_PRIME;
+    }
+    return n;
+}
+
+block_fifo_request_t WriteOperation(Bcache* bc, vmoid_t vmoid, uint64_t vmo_offset,
+                                    uint64_t dev_offset, uint64_t length) {
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc->DeviceBlockSize();
+    block_fifo_request_t request;
+    request.group = bc->BlockGroupID();
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_WRITE;
+    request.vmo_offset = vmo_offset * kDiskBlocksPerMinfsBlock;
+    request.dev_offset = dev_offset * kDiskBlocksPerMinfsBlock;
+    // TODO(ZX-2253): Remove this assertion.
+    length *= kDiskBlocksPerMinfsBlock;
+    ZX_ASSERT_MSG(length < UINT32_MAX, "Too many blocks");
+    request.length = static_cast<uint32_t>(length);
+    return request;
+}
+
+// A single block of the writeback buffer, headed for |dev_block|.
+struct BlockWrite {
+    size_t dev_block;
+    size_t buffer_block;
+    // Position of the write within its batch. When a block is written more
+    // than once, only the latest write reaches the disk.
+    size_t order;
+};
+
+int CompareBlockWrites(const void* a, const void* b) {
+    const BlockWrite* lhs = static_cast<const BlockWrite*>(a);
+    const BlockWrite* rhs = static_cast<const BlockWrite*>(b);
+    if (lhs->dev_block != rhs->dev_block) {
+        return lhs->dev_block < rhs->dev_block ? -1 : 1;
+    }
+    if (lhs->order != rhs->order) {
+        return lhs->order < rhs->order ? -1 : 1;
+    }
+    return 0;
+}
+
+// Gathers the requests of |batch| which are (or are not) |journaled| into
+// |out|, sorted by device block. Blocks written by several units of work are
+// only written once, with their latest contents, and adjacent blocks are
+// coalesced into a single request.
+//
+// Requests of a single batch are sent to the device together, and may
+// complete in any order; this guarantees that they never overlap.
+void CoalesceBatch(WorkBatch* batch, bool journaled, fbl::Vector<WriteRequest>* out) {
+    fbl::Vector<BlockWrite> writes;
+    size_t order = 0;
+    for (size_t i = 0; i < batch->size(); i++) {
+        auto& reqs = (*batch)[i]->Requests();
+        for (size_t j = 0; j < reqs.size(); j++) {
+            if (reqs[j].journaled != journaled) {
+                continue;
+            }
+            for (size_t b = 0; b < reqs[j].length; b++) {
+                BlockWrite write = {reqs[j].dev_offset + b, reqs[j].vmo_offset + b, order++};
+                writes.push_back(write);
+            }
+        }
+    }
+    qsort(writes.get(), writes.size(), sizeof(BlockWrite), CompareBlockWrites);
+
+    for (size_t i = 0; i < writes.size(); i++) {
+        if (i + 1 < writes.size() && writes[i + 1].dev_block == writes[i].dev_block) {
+            // Superseded by a later write to the same block.
+            continue;
+        }
+        if (!out->is_empty()) {
+            WriteRequest& last = (*out)[out->size() - 1];
+            if ((last.dev_offset + last.length == writes[i].dev_block) &&
+                (last.vmo_offset + last.length == writes[i].buffer_block)) {
+                last.length++;
+                continue;
+            }
+        }
+        WriteRequest request;
+        request.vmo = ZX_HANDLE_INVALID;
+        request.vmo_offset = writes[i].buffer_block;
+        request.dev_offset = writes[i].dev_block;
+        request.length = 1;
+        request.journaled = journaled;
+        out->push_back(request);
+    }
+}
+
+// Returns true if |work| writes file data over a block which is journaled by
+// an earlier unit of work in |batch|. Such a block was freed as metadata and
+// reallocated as data; if both writes shared a journal entry, replaying the
+// entry would clobber the new data, so |work| must wait for the next entry.
+bool OverwritesJournaledBlock(WorkBatch* batch, WritebackWork* work) {
+    auto& data = work->Requests();
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i].journaled) {
+            continue;
+        }
+        for (size_t j = 0; j < batch->size(); j++) {
+            auto& metadata = (*batch)[j]->Requests();
+            for (size_t k = 0; k < metadata.size(); k++) {
+                if (metadata[k].journaled &&
+                    (data[i].dev_offset < metadata[k].dev_offset + metadata[k].length) &&
+                    (metadata[k].dev_offset < data[i].dev_offset + data[i].length)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
 zx_status_t WritebackBuffer::Create(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo> buffer,
+                                    const Superblock& info,
                                     fbl::unique_ptr<WritebackBuffer>* out) {
-    fbl::unique_ptr<WritebackBuffer> wb(new WritebackBuffer(bc, fbl::move(buffer)));
+    fbl::unique_ptr<WritebackBuffer> wb(new WritebackBuffer(bc, fbl::move(buffer), info));
     if (wb->buffer_->GetSize() % kMinfsBlockSize != 0) {
         return ZX_ERR_INVALID_ARGS;
+    }
+    zx_status_t status = wb->InitJournal();
+    if (status != ZX_OK) {
+        return status;
     } else if (cnd_init(&wb->consumer_cvar_) != thrd_success) {
         return ZX_ERR_NO_RESOURCES;
     } else if (cnd_init(&wb->producer_cvar_) != thrd_success) {
@@ -166,7 +280,7 @@ zx_status_t WritebackBuffer::Create(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo>
                                      "minfs-writeback") != thrd_success) {
         return ZX_ERR_NO_RESOURCES;
     }
-    zx_status_t status = wb->bc_->AttachVmo(wb->buffer_->GetVmo(), &wb->buffer_vmoid_);
+    status = wb->bc_->AttachVmo(wb->buffer_->GetVmo(), &wb->buffer_vmoid_);
     if (status != ZX_OK) {
         return status;
     }
@@ -175,9 +289,11 @@ zx_status_t WritebackBuffer::Create(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo>
     return ZX_OK;
 }
 
-WritebackBuffer::WritebackBuffer(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo> buffer) :
+WritebackBuffer::WritebackBuffer(Bcache* bc, fbl::unique_ptr<fzl::MappedVmo> buffer,
+                                 const Superblock& info) :
     bc_(bc), unmounting_(false), buffer_(fbl::move(buffer)),
-    cap_(buffer_->GetSize() / kMinfsBlockSize) {}
+    cap_(buffer_->GetSize() / kMinfsBlockSize), journal_start_(info.journal_block),
+    journal_blocks_(info.journal_block_count) {}
 
 WritebackBuffer::~WritebackBuffer() {
     // Block until the background thread completes itself.
@@ -189,15 +305,49 @@ WritebackBuffer::~WritebackBuffer() {
     int r;
     thrd_join(writeback_thrd_, &r);
 
-    if (buffer_vmoid_ != VMOID_INVALID) {
-        block_fifo_request_t request;
-        request.group = bc_->BlockGroupID();
-        request.vmoid = buffer_vmoid_;
-        request.opcode = BLOCKIO_CLOSE_VMO;
-        bc_->Transaction(&request, 1);
+    vmoid_t vmoids[] = { buffer_vmoid_, journal_vmoid_ };
+    for (size_t i = 0; i < fbl::count_of(vmoids); i++) {
+        if (vmoids[i] != VMOID_INVALID) {
+            block_fifo_request_t request;
+            request.group = bc_->BlockGroupID();
+            request.vmoid = vmoids[i];
+            request.opcode = BLOCKIO_CLOSE_VMO;
+            bc_->Transaction(&request, 1);
+        }
     }
 }
 
+zx_status_t WritebackBuffer::InitJournal() {
+    if (JournalCapacity() == 0) {
+        return ZX_OK;
+    }
+
+    zx_status_t status;
+    if ((status = fzl::MappedVmo::Create(3 * kMinfsBlockSize, "minfs-journal",
+                                         &journal_buffer_)) != ZX_OK) {
+        return status;
+    } else if ((status = bc_->AttachVmo(journal_buffer_->GetVmo(), &journal_vmoid_)) != ZX_OK) {
+        return status;
+    }
+
+    // Continue numbering entries from wherever the previous mount (or journal
+    // replay) left off. A journal which has never been written starts empty.
+    JournalInfo* info = reinterpret_cast<JournalInfo*>(journal_buffer_->GetData());
+    if ((status = bc_->Readblk(journal_start_, info)) != ZX_OK) {
+        return status;
+    }
+    sequence_ = (info->magic == kMinfsJournalMagic) ? info->sequence : 0;
+    return ZX_OK;
+}
+
+size_t WritebackBuffer::JournalCapacity() const {
+    if (journal_blocks_ < kMinfsMinimumJournalBlocks) {
+        return 0;
+    }
+    // The info, entry header, and commit blocks are not available for payload.
+    return fbl::min(journal_blocks_ - 3, static_cast<size_t>(kMinfsJournalEntryMaxBlocks));
+}
+
 zx_status_t WritebackBuffer::EnsureSpaceLocked(size_t blocks) {
     if (blocks > cap_) {
         // There will never be enough room in the writeback buffer
@@ -270,6 +420,7 @@ void WritebackBuffer::CopyToBufferLocked(WriteTxn* txn) {
             request.vmo_offset = 0;
             request.dev_offset = dev_offset;
             request.length = wb_len;
+            request.journaled = reqs[i].journaled;
             i++;
             reqs.insert(i, request);
         }
@@ -310,24 +461,160 @@ void WritebackBuffer::Enqueue(fbl::unique_ptr<WritebackWork> work) {
     cnd_signal(&consumer_cvar_);
 }
 
+void WritebackBuffer::DequeueBatchLocked(WorkBatch* batch) {
+    const size_t capacity = JournalCapacity();
+    size_t journaled_blocks = 0;
+    do {
+        WritebackWork& work = work_queue_.front();
+        size_t blocks = work.JournaledBlkCount();
+        if (!batch->is_empty() &&
+            ((capacity != 0 && journaled_blocks + blocks > capacity) ||
+             OverwritesJournaledBlock(batch, &work))) {
+            break;
+        }
+        journaled_blocks += blocks;
+        batch->push_back(work_queue_.pop());
+    } while (!work_queue_.is_empty());
+}
+
+zx_status_t WritebackBuffer::TransactBatch(WorkBatch* batch) {
+    TRACE_DURATION("minfs", "WritebackBuffer::TransactBatch", "works", batch->size());
+    fbl::Vector<WriteRequest> data;
+    fbl::Vector<WriteRequest> metadata;
+    CoalesceBatch(batch, false, &data);
+    CoalesceBatch(batch, true, &metadata);
+
+    // File data is written first, so metadata never refers to blocks which
+    // do not yet contain their data.
+    zx_status_t status;
+    if ((status = WriteBlocks(data)) != ZX_OK) {
+        return status;
+    }
+
+    size_t metadata_blocks = 0;
+    for (size_t i = 0; i < metadata.size(); i++) {
+        metadata_blocks += metadata[i].length;
+    }
+    if (metadata_blocks == 0) {
+        return ZX_OK;
+    } else if (metadata_blocks > JournalCapacity()) {
+        // Either there is no journal, or a single unit of work is too large
+        // to fit within it; write the metadata in place without protection.
+        return WriteBlocks(metadata);
+    }
+
+    if ((status = CommitJournalEntry(metadata)) != ZX_OK) {
+        return status;
+    }
+    // Once the entry is committed, the metadata may be written in place in
+    // any order: if the device loses power part way through, the entry is
+    // replayed at the next mount.
+    if ((status = WriteBlocks(metadata)) != ZX_OK) {
+        return status;
+    }
+    if ((status = bc_->Sync()) != ZX_OK) {
+        return status;
+    }
+    return RetireJournalEntry();
+}
+
+zx_status_t WritebackBuffer::WriteBlocks(const fbl::Vector<WriteRequest>& requests) {
+    if (requests.is_empty()) {
+        return ZX_OK;
+    }
+    fbl::Vector<block_fifo_request_t> blk_reqs;
+    blk_reqs.reserve(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        blk_reqs.push_back(WriteOperation(bc_, buffer_vmoid_, requests[i].vmo_offset,
+                                          requests[i].dev_offset, requests[i].length));
+    }
+    return bc_->Transaction(blk_reqs.get(), blk_reqs.size());
+}
+
+zx_status_t WritebackBuffer::CommitJournalEntry(const fbl::Vector<WriteRequest>& metadata) {
+    TRACE_DURATION("minfs", "WritebackBuffer::CommitJournalEntry");
+    uint8_t* journal_data = static_cast<uint8_t*>(journal_buffer_->GetData());
+    JournalEntry* entry = reinterpret_cast<JournalEntry*>(journal_data + kMinfsBlockSize);
+    JournalCommit* commit = reinterpret_cast<JournalCommit*>(journal_data + 2 * kMinfsBlockSize);
+
+    memset(entry, 0, kMinfsBlockSize);
+    entry->magic = kMinfsJournalEntryMagic;
+    entry->sequence = sequence_;
+    for (size_t i = 0; i < metadata.size(); i++) {
+        for (size_t b = 0; b < metadata[i].length; b++) {
+            entry->target[entry->block_count++] = static_cast<blk_t>(metadata[i].dev_offset + b);
+        }
+    }
+
+    fbl::Vector<block_fifo_request_t> blk_reqs;
+    blk_reqs.reserve(metadata.size() + 2);
+    blk_reqs.push_back(WriteOperation(bc_, journal_vmoid_, 1, journal_start_ + 1, 1));
+
+    // The payload is copied straight out of the writeback buffer, directly
+    // following the entry header.
+    uint32_t checksum = JournalChecksum(FNV32_OFFSET_BASIS, entry, kMinfsBlockSize);
+    size_t dev_offset = journal_start_ + 2;
+    for (size_t i = 0; i < metadata.size(); i++) {
+        const void* payload = static_cast<uint8_t*>(buffer_->GetData()) +
+                              metadata[i].vmo_offset * kMinfsBlockSize;
+        checksum = JournalChecksum(checksum, payload, metadata[i].length * kMinfsBlockSize);
+        blk_reqs.push_back(WriteOperation(bc_, buffer_vmoid_, metadata[i].vmo_offset,
+                                          dev_offset, metadata[i].length));
+        dev_offset += metadata[i].length;
+    }
+
+    memset(commit, 0, kMinfsBlockSize);
+    commit->magic = kMinfsJournalCommitMagic;
+    commit->sequence = sequence_;
+    commit->checksum = checksum;
+    blk_reqs.push_back(WriteOperation(bc_, journal_vmoid_, 2, dev_offset, 1));
+
+    zx_status_t status = bc_->Transaction(blk_reqs.get(), blk_reqs.size());
+    if (status != ZX_OK) {
+        return status;
+    }
+    return bc_->Sync();
+}
+
+zx_status_t WritebackBuffer::RetireJournalEntry() {
+    sequence_++;
+    JournalInfo* info = reinterpret_cast<JournalInfo*>(journal_buffer_->GetData());
+    memset(info, 0, kMinfsBlockSize);
+    info->magic = kMinfsJournalMagic;
+    info->sequence = sequence_;
+
+    // This write need not be durable immediately: until it is, replaying the
+    // retired entry only rewrites metadata which is already in place. The
+    // flush which commits the next entry also persists this block.
+    block_fifo_request_t request = WriteOperation(bc_, journal_vmoid_, 0, journal_start_, 1);
+    return bc_->Transaction(&request, 1);
+}
+
 int WritebackBuffer::WritebackThread(void* arg) {
     WritebackBuffer* b = reinterpret_cast<WritebackBuffer*>(arg);
 
     b->writeback_lock_.Acquire();
     while (true) {
         while (!b->work_queue_.is_empty()) {
-            auto work = b->work_queue_.pop();
+            // Group all pending work into as few journal entries as possible.
+            WorkBatch batch;
+            b->DequeueBatchLocked(&batch);
             TRACE_DURATION("minfs", "WritebackBuffer::WritebackThread");
 
             // Stay unlocked while processing a unit of work
             b->writeback_lock_.Release();
 
             // TODO(smklein): We could add additional validation that the blocks
-            // in "work" are contiguous and in the range of [start_, len_) (including
+            // in "batch" are contiguous and in the range of [start_, len_) (including
             // wraparound).
-            size_t blks_consumed = work->Complete(b->buffer_->GetVmo(), b->buffer_vmoid_);
-            TRACE_FLOW_END("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
-            work = nullptr;
+            zx_status_t status = b->TransactBatch(&batch);
+            size_t blks_consumed = 0;
+            for (size_t i = 0; i < batch.size(); i++) {
+                blks_consumed += batch[i]->Complete(status);
+                TRACE_FLOW_END("minfs", "writeback",
+                               reinterpret_cast<trace_flow_id_t>(batch[i].get()));
+            }
+            batch.reset();
 
             // Relock before checking the state of the queue
             b->writeback_lock_.Acquire();
@@ -345,6 +632,101 @@ int WritebackBuffer::WritebackThread(void* arg) {
     }
 }
 
+zx_status_t ReplayJournal(Bcache* bc, const Superblock& info, bool* out_replayed) {
+    *out_replayed = false;
+    if ((info.magic0 != kMinfsMagic0) || (info.magic1 != kMinfsMagic1) ||
+        (info.version != kMinfsVersion)) {
+        // Let CheckSuperblock report the problem.
+        return ZX_OK;
+    } else if (info.journal_block_count < kMinfsMinimumJournalBlocks) {
+        return ZX_OK;
+    } else if ((info.journal_block == 0) ||
+               (info.journal_block + info.journal_block_count > info.ibm_block)) {
+        FS_TRACE_ERROR("minfs: Journal overlaps other metadata\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const blk_t journal_end = info.journal_block + info.journal_block_count;
+    const uint32_t capacity = fbl::min(info.journal_block_count - 3,
+                                       kMinfsJournalEntryMaxBlocks);
+
+    zx_status_t status;
+    uint8_t info_blk[kMinfsBlockSize];
+    if ((status = bc->Readblk(info.journal_block, info_blk)) != ZX_OK) {
+        return status;
+    }
+    JournalInfo* journal_info = reinterpret_cast<JournalInfo*>(info_blk);
+    if (journal_info->magic != kMinfsJournalMagic) {
+        // The journal has never been written.
+        return ZX_OK;
+    }
+
+    uint8_t entry_blk[kMinfsBlockSize];
+    if ((status = bc->Readblk(info.journal_block + 1, entry_blk)) != ZX_OK) {
+        return status;
+    }
+    const JournalEntry* entry = reinterpret_cast<const JournalEntry*>(entry_blk);
+    if ((entry->magic != kMinfsJournalEntryMagic) ||
+        (entry->sequence != journal_info->sequence) ||
+        (entry->block_count == 0) || (entry->block_count > capacity)) {
+        // The most recent entry has already been written in place.
+        return ZX_OK;
+    }
+
+    uint8_t blk[kMinfsBlockSize];
+    uint32_t checksum = JournalChecksum(FNV32_OFFSET_BASIS, entry_blk, kMinfsBlockSize);
+    for (uint32_t i = 0; i < entry->block_count; i++) {
+        if ((status = bc->Readblk(info.journal_block + 2 + i, blk)) != ZX_OK) {
+            return status;
+        }
+        checksum = JournalChecksum(checksum, blk, kMinfsBlockSize);
+    }
+    if ((status = bc->Readblk(info.journal_block + 2 + entry->block_count, blk)) != ZX_OK) {
+        return status;
+    }
+    const JournalCommit* commit = reinterpret_cast<const JournalCommit*>(blk);
+    if ((commit->magic != kMinfsJournalCommitMagic) || (commit->sequence != entry->sequence) ||
+        (commit->checksum != checksum)) {
+        // The entry was torn before it committed. None of its metadata was
+        // written in place, so the filesystem is consistent without it.
+        return ZX_OK;
+    }
+    // The checksum only shows that the entry is the one which was committed,
+    // not that it is sane. Refuse to write anywhere minfs would not.
+    const uint64_t fs_end = static_cast<uint64_t>(info.dat_block) + info.block_count;
+    for (uint32_t i = 0; i < entry->block_count; i++) {
+        if ((entry->target[i] >= info.journal_block) && (entry->target[i] < journal_end)) {
+            FS_TRACE_ERROR("minfs: Journal entry targets the journal\n");
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        } else if ((entry->target[i] >= fs_end) || (entry->target[i] >= bc->Maxblk())) {
+            FS_TRACE_ERROR("minfs: Journal entry targets block %u, beyond the filesystem\n",
+                           entry->target[i]);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+
+    FS_TRACE_WARN("minfs: Replaying journal entry %" PRIu64 " (%u blocks)\n",
+                  entry->sequence, entry->block_count);
+    for (uint32_t i = 0; i < entry->block_count; i++) {
+        if ((status = bc->Readblk(info.journal_block + 2 + i, blk)) != ZX_OK) {
+            return status;
+        } else if ((status = bc->Writeblk(entry->target[i], blk)) != ZX_OK) {
+            return status;
+        }
+    }
+    if ((status = bc->Sync()) != ZX_OK) {
+        return status;
+    }
+
+    journal_info->sequence++;
+    if ((status = bc->Writeblk(info.journal_block, info_blk)) != ZX_OK) {
+        return status;
+    } else if ((status = bc->Sync()) != ZX_OK) {
+        return status;
+    }
+    *out_replayed = true;
+    return ZX_OK;
+}
+
 #endif  // __Fuchsia__
 
 } // namespace minfs
@@ -0,0 +1,48 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+// The kernel exports its counters (see kernel/include/lib/counters.h) to
+// user space as two read-only VMOs, which show up as files under
+// /boot/kernel/counters.  Mapping both lets a privileged process sample
+// every counter without making any system call.
+//
+// KCOUNTER_DESC_VMO_NAME holds a kcounter_desc_vmo_t naming the counters,
+// sorted by name.  It never changes after boot.
+//
+// KCOUNTER_ARENA_VMO_NAME is the live counter arena: |max_cpus| rows of
+// |num_counters| int64_t slots, one row per cpu.  Slot i of each row
+// belongs to descriptors[i], and the value of a counter is the sum of its
+// slots across all the rows.  The slots are updated without synchronization,
+// so a sample is only an approximation.
+
+#define KCOUNTER_DESC_VMO_NAME  "counters/desc"
+#define KCOUNTER_ARENA_VMO_NAME "counters/arena"
+
+#define KCOUNTER_DESC_MAGIC     (0x4b434e5452534331ull) // "KCNTRSC1"
+#define KCOUNTER_MAX_NAME       (64)
+
+typedef struct kcounter_desc_entry {
+    // NUL-terminated, truncated if it does not fit
+    char name[KCOUNTER_MAX_NAME];
+} kcounter_desc_entry_t;
+
+typedef struct kcounter_desc_vmo {
+    uint64_t magic;
+    uint32_t max_cpus;
+    uint32_t num_counters;
+    kcounter_desc_entry_t descriptors[];
+} kcounter_desc_vmo_t;
+
+static_assert(sizeof(kcounter_desc_vmo_t) == 16,
+              "kcounter_desc_vmo_t header is not 16 bytes");
+
+__END_CDECLS
@@ -25,6 +25,10 @@ __BEGIN_CDECLS
 #define KTRACE_TAG_32B(e,g)       KTRACE_TAG(e,g,32)
 #define KTRACE_TAG_NAME(e,g)      KTRACE_TAG(e,g,48)
 
+// Filler with no group or event that readers skip over.  Streaming mode
+// uses it to pad out the end of a per-cpu ring.
+#define KTRACE_TAG_PAD(siz)       KTRACE_TAG(0,0,siz)
+
 #define KTRACE_LEN(tag)           (((tag)&0xF)<<3)
 #define KTRACE_GROUP(tag)         (((tag)>>20)&0xFFF)
 #define KTRACE_EVENT(tag)         (((tag)>>8)&0xFFF)
@@ -88,5 +92,6 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_START_STREAMING 5 // options = grpmask, 0 = all
 
 __END_CDECLS
@@ -109,6 +109,22 @@ protected:
     }
 };
 
+class CancelOtherWait : public TestWait {
+public:
+    CancelOtherWait(zx_handle_t object, zx_signals_t trigger)
+        : TestWait(object, trigger) {}
+
+    TestWait* other = nullptr;
+    zx_status_t cancel_result = ZX_ERR_INTERNAL;
+
+protected:
+    void Handle(async_dispatcher_t* dispatcher, zx_status_t status,
+                const zx_packet_signal_t* signal) override {
+        TestWait::Handle(dispatcher, status, signal);
+        cancel_result = other->Cancel(dispatcher);
+    }
+};
+
 class TestTask : public async_task_t {
 public:
     TestTask()
@@ -600,6 +616,30 @@ bool wait_test() {
     END_TEST;
 }
 
+// Both packets are taken from the port together, so the wait that runs
+// second has to be canceled after its packet has left the port.
+bool wait_cancel_other_test() {
+    BEGIN_TEST;
+
+    async::Loop loop(&kAsyncLoopConfigNoAttachToThread);
+    zx::event event;
+    EXPECT_EQ(ZX_OK, zx::event::create(0u, &event), "create event");
+
+    CancelOtherWait wait1(event.get(), ZX_USER_SIGNAL_0);
+    CancelOtherWait wait2(event.get(), ZX_USER_SIGNAL_0);
+    wait1.other = &wait2;
+    wait2.other = &wait1;
+    EXPECT_EQ(ZX_OK, wait1.Begin(loop.dispatcher()), "begin 1");
+    EXPECT_EQ(ZX_OK, wait2.Begin(loop.dispatcher()), "begin 2");
+    EXPECT_EQ(ZX_OK, event.signal(0u, ZX_USER_SIGNAL_0), "signal");
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(1u, wait1.run_count + wait2.run_count, "run count");
+    CancelOtherWait* ran = wait1.run_count ? &wait1 : &wait2;
+    EXPECT_EQ(ZX_OK, ran->cancel_result, "cancel result");
+
+    END_TEST;
+}
+
 bool wait_unwaitable_handle_test() {
     BEGIN_TEST;
 
@@ -1376,6 +1416,7 @@ RUN_TEST(make_default_true_test)
 RUN_TEST(quit_test)
 RUN_TEST(time_test)
 RUN_TEST(wait_test)
+RUN_TEST(wait_cancel_other_test)
 RUN_TEST(wait_unwaitable_handle_test)
 RUN_TEST(wait_shutdown_test)
 RUN_TEST(task_test)
@@ -0,0 +1,233 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <array>
+#include <vector>
+
+#include <blobfs/fsck.h>
+#include <blobfs/host.h>
+#include <fbl/string.h>
+#include <fbl/unique_fd.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+using RawDigest = std::array<uint8_t, digest::Digest::kLength>;
+
+constexpr off_t kImageSize = 64ll * (1 << 20);
+
+char test_dir[PATH_MAX];
+
+// Returns a path within the test directory.
+fbl::String TestPath(const char* name) {
+    return fbl::String::Concat({test_dir, "/", name});
+}
+
+bool CreateImage(const char* path) {
+    BEGIN_HELPER;
+    fbl::unique_fd fd(open(path, O_RDWR | O_CREAT | O_EXCL, 0644));
+    ASSERT_TRUE(fd, "Unable to create image");
+    ASSERT_EQ(ftruncate(fd.get(), kImageSize), 0);
+    uint64_t block_count;
+    ASSERT_EQ(blobfs::GetBlockCount(fd.get(), &block_count), ZX_OK);
+    ASSERT_EQ(blobfs::Mkfs(fd.get(), block_count), ZX_OK);
+    END_HELPER;
+}
+
+bool OpenImage(const char* path, fbl::unique_ptr<blobfs::Blobfs>* out) {
+    BEGIN_HELPER;
+    fbl::unique_fd fd(open(path, O_RDWR));
+    ASSERT_TRUE(fd, "Unable to open image");
+    ASSERT_EQ(blobfs::blobfs_create(out, fbl::move(fd)), ZX_OK);
+    END_HELPER;
+}
+
+// Appends the Merkle tree of the file at |path| to |infos|.
+bool AddInfo(const fbl::String& path, std::vector<blobfs::MerkleInfo>* infos) {
+    BEGIN_HELPER;
+    fbl::unique_fd fd(open(path.c_str(), O_RDONLY));
+    ASSERT_TRUE(fd, "Unable to open blob file");
+    blobfs::MerkleInfo info;
+    ASSERT_EQ(blobfs::blobfs_preprocess(fd.get(), false, &info), ZX_OK);
+    info.path = path;
+    infos->push_back(fbl::move(info));
+    END_HELPER;
+}
+
+// Writes |size| bytes generated from |seed| to the file |name|, and appends
+// its Merkle tree to |infos|.
+bool CreateBlob(const char* name, unsigned seed, size_t size,
+                std::vector<blobfs::MerkleInfo>* infos) {
+    BEGIN_HELPER;
+    fbl::String path = TestPath(name);
+    fbl::unique_fd fd(open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644));
+    ASSERT_TRUE(fd, "Unable to create blob file");
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<uint8_t>(rand_r(&seed));
+    }
+    ASSERT_EQ(write(fd.get(), data.get(), size), static_cast<ssize_t>(size));
+    ASSERT_TRUE(AddInfo(path, infos));
+    END_HELPER;
+}
+
+RawDigest ToRaw(const digest::Digest& digest) {
+    RawDigest raw;
+    digest.CopyTo(raw.data(), raw.size());
+    return raw;
+}
+
+bool HasBlob(const blobfs::Blobfs& bs, const RawDigest& raw) {
+    return bs.HasBlob(digest::Digest(raw.data()));
+}
+
+// Checks the number of allocated nodes recorded in the superblock of |path|.
+bool CheckNodeCount(const char* path, uint64_t expected) {
+    BEGIN_HELPER;
+    fbl::unique_fd fd(open(path, O_RDONLY));
+    ASSERT_TRUE(fd, "Unable to open image");
+    blobfs::info_block_t block;
+    ASSERT_EQ(pread(fd.get(), block.block, sizeof(block.block), 0),
+              static_cast<ssize_t>(sizeof(block.block)));
+    ASSERT_EQ(block.info.alloc_inode_count, expected);
+    END_HELPER;
+}
+
+// Adds many blobs at once, several of them more than once, and checks that each
+// is stored exactly once and the image is consistent.
+bool TestAddBlobsParallel() {
+    BEGIN_TEST;
+    constexpr unsigned kBlobCount = 64;
+    fbl::String image = TestPath("parallel.blk");
+    ASSERT_TRUE(CreateImage(image.c_str()));
+
+    std::vector<blobfs::MerkleInfo> infos;
+    char name[32];
+    for (unsigned i = 0; i < kBlobCount; i++) {
+        snprintf(name, sizeof(name), "parallel-%u", i);
+        ASSERT_TRUE(CreateBlob(name, i, 1 + i * 4099, &infos));
+    }
+    // The same contents under another name, and the same file twice.
+    ASSERT_TRUE(CreateBlob("parallel-copy", 0, 1, &infos));
+    ASSERT_TRUE(AddInfo(TestPath("parallel-1"), &infos));
+
+    std::vector<RawDigest> digests;
+    for (const auto& info : infos) {
+        digests.push_back(ToRaw(info.digest));
+    }
+
+    fbl::unique_ptr<blobfs::Blobfs> bs;
+    ASSERT_TRUE(OpenImage(image.c_str(), &bs));
+    ASSERT_EQ(blobfs::blobfs_add_blobs(bs.get(), infos), ZX_OK);
+    bs.reset();
+    ASSERT_TRUE(CheckNodeCount(image.c_str(), kBlobCount));
+
+    ASSERT_TRUE(OpenImage(image.c_str(), &bs));
+    for (const auto& raw : digests) {
+        ASSERT_TRUE(HasBlob(*bs, raw));
+    }
+    // Adding the same blobs again leaves the image unchanged.
+    ASSERT_EQ(blobfs::blobfs_add_blobs(bs.get(), infos), ZX_OK);
+    ASSERT_EQ(blobfs::Fsck(fbl::move(bs)), ZX_OK);
+    ASSERT_TRUE(CheckNodeCount(image.c_str(), kBlobCount));
+    END_TEST;
+}
+
+// Updates an image in place the way the "update" command does, and checks
+// that stale blobs are removed, new ones added and unchanged ones kept.
+bool TestUpdateImage() {
+    BEGIN_TEST;
+    fbl::String image = TestPath("update.blk");
+    ASSERT_TRUE(CreateImage(image.c_str()));
+
+    std::vector<blobfs::MerkleInfo> infos;
+    ASSERT_TRUE(CreateBlob("update-stale", 100, 70000, &infos));
+    ASSERT_TRUE(CreateBlob("update-kept-0", 101, 8192, &infos));
+    ASSERT_TRUE(CreateBlob("update-kept-1", 102, 123457, &infos));
+    const RawDigest stale = ToRaw(infos[0].digest);
+
+    fbl::unique_ptr<blobfs::Blobfs> bs;
+    ASSERT_TRUE(OpenImage(image.c_str(), &bs));
+    ASSERT_EQ(blobfs::blobfs_add_blobs(bs.get(), infos), ZX_OK);
+    bs.reset();
+
+    // The new manifest drops the stale blob and adds two new ones.
+    infos.erase(infos.begin());
+    ASSERT_TRUE(CreateBlob("update-new-0", 103, 1, &infos));
+    ASSERT_TRUE(CreateBlob("update-new-1", 104, 300000, &infos));
+    std::vector<RawDigest> digests;
+    for (const auto& info : infos) {
+        digests.push_back(ToRaw(info.digest));
+    }
+
+    ASSERT_TRUE(OpenImage(image.c_str(), &bs));
+    ASSERT_EQ(blobfs::blobfs_prune_blobs(bs.get(), &infos), ZX_OK);
+    ASSERT_FALSE(HasBlob(*bs, stale));
+    // Only the new blobs are left to add.
+    ASSERT_EQ(infos.size(), 2u);
+    ASSERT_TRUE(ToRaw(infos[0].digest) == digests[2]);
+    ASSERT_TRUE(ToRaw(infos[1].digest) == digests[3]);
+    ASSERT_EQ(blobfs::blobfs_add_blobs(bs.get(), infos), ZX_OK);
+    bs.reset();
+    ASSERT_TRUE(CheckNodeCount(image.c_str(), digests.size()));
+
+    // Fsck verifies the contents of every blob, including the kept ones.
+    ASSERT_TRUE(OpenImage(image.c_str(), &bs));
+    ASSERT_FALSE(HasBlob(*bs, stale));
+    for (const auto& raw : digests) {
+        ASSERT_TRUE(HasBlob(*bs, raw));
+    }
+    ASSERT_EQ(blobfs::Fsck(fbl::move(bs)), ZX_OK);
+    END_TEST;
+}
+
+bool Setup() {
+    BEGIN_HELPER;
+    snprintf(test_dir, sizeof(test_dir), "/tmp/blobfs-host-test.XXXXXX");
+    ASSERT_NONNULL(mkdtemp(test_dir), "Failed to create test path");
+    END_HELPER;
+}
+
+bool Cleanup() {
+    BEGIN_HELPER;
+    DIR* dir = opendir(test_dir);
+    ASSERT_NONNULL(dir, "Couldn't open test directory");
+    struct dirent* de;
+    while ((de = readdir(dir)) != nullptr) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+            continue;
+        }
+        ASSERT_EQ(unlinkat(dirfd(dir), de->d_name, 0), 0);
+    }
+    closedir(dir);
+    ASSERT_EQ(rmdir(test_dir), 0, "Failed to remove test path");
+    END_HELPER;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(blobfs_host_tests)
+RUN_TEST_MEDIUM(TestAddBlobsParallel)
+RUN_TEST_MEDIUM(TestUpdateImage)
+END_TEST_CASE(blobfs_host_tests)
+
+int main(int argc, char** argv) {
+    if (!Setup()) {
+        return -1;
+    }
+    int result = unittest_run_all_tests(argc, argv) ? 0 : -1;
+    if (!Cleanup()) {
+        return -1;
+    }
+    return result;
+}
@@ -23,6 +23,7 @@
 #include <fbl/intrusive_double_list.h>
 #include <fbl/unique_fd.h>
 #include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
 #include <fs-management/fvm.h>
 #include <fs-management/mount.h>
 #include <fs-management/ramdisk.h>
@@ -800,6 +801,92 @@ static bool TestMmapUseAfterClose(BlobfsTest* blobfsTest) {
     END_HELPER;
 }
 
+// Reads small, scattered portions of a large blob which is populated on
+// demand, followed by the entire blob, both through read and mmap.
+static bool TestSparseRead(BlobfsTest* blobfsTest) {
+    BEGIN_HELPER;
+    fbl::unique_ptr<blob_info_t> info;
+    ASSERT_TRUE(GenerateRandomBlob(1 << 22, &info));
+
+    fbl::unique_fd fd;
+    ASSERT_TRUE(MakeBlob(info.get(), &fd));
+    ASSERT_EQ(close(fd.release()), 0);
+
+    // Remount to ensure the blob is read back from disk.
+    ASSERT_TRUE(blobfsTest->Remount());
+    fd.reset(open(info->path, O_RDONLY));
+    ASSERT_TRUE(fd, "Failed to-reopen blob");
+
+    // Access the blob back-to-front, with reads which straddle block boundaries.
+    const size_t kReadSize = 3 * blobfs::kBlobfsBlockSize / 2;
+    char buf[kReadSize];
+    for (size_t i = 0; i < 8; i++) {
+        size_t off = info->size_data - kReadSize - i * (info->size_data / 8);
+        ASSERT_EQ(pread(fd.get(), buf, kReadSize, off), static_cast<ssize_t>(kReadSize));
+        ASSERT_EQ(memcmp(buf, &info->data[off], kReadSize), 0, "Read data, but it was bad");
+    }
+    ASSERT_TRUE(VerifyContents(fd.get(), info->data.get(), info->size_data));
+
+    void* addr = mmap(NULL, info->size_data, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    ASSERT_NE(addr, MAP_FAILED, "Could not mmap blob");
+    ASSERT_EQ(memcmp(addr, info->data.get(), info->size_data), 0, "Mmap data invalid");
+    ASSERT_EQ(munmap(addr, info->size_data), 0, "Could not unmap blob");
+    ASSERT_EQ(close(fd.release()), 0);
+
+    // Mapping a blob which has not been read at all should populate it in its entirety.
+    ASSERT_TRUE(blobfsTest->Remount());
+    fd.reset(open(info->path, O_RDONLY));
+    ASSERT_TRUE(fd, "Failed to-reopen blob");
+    addr = mmap(NULL, info->size_data, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    ASSERT_NE(addr, MAP_FAILED, "Could not mmap blob");
+    ASSERT_EQ(memcmp(addr, info->data.get(), info->size_data), 0, "Mmap data invalid");
+    ASSERT_EQ(munmap(addr, info->size_data), 0, "Could not unmap blob");
+    ASSERT_EQ(close(fd.release()), 0);
+
+    ASSERT_EQ(unlink(info->path), 0);
+    END_HELPER;
+}
+
+static bool TestSparseReadCompressed(BlobfsTest* blobfsTest) {
+    BEGIN_HELPER;
+    fbl::unique_ptr<blob_info_t> info;
+    ASSERT_TRUE(GenerateBlob([](char* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            data[i] = static_cast<char>((i / 64) % 7);
+        }
+    }, 1 << 22, &info));
+
+    fbl::unique_fd fd;
+    ASSERT_TRUE(MakeBlob(info.get(), &fd));
+    ASSERT_EQ(close(fd.release()), 0);
+
+    // Remount to ensure the blob is read back from disk, and decompressed one
+    // chunk at a time.
+    ASSERT_TRUE(blobfsTest->Remount());
+    fd.reset(open(info->path, O_RDONLY));
+    ASSERT_TRUE(fd, "Failed to-reopen blob");
+
+    // Access the blob back-to-front, with reads which straddle chunk boundaries.
+    const size_t kReadSize = 3 * blobfs::kBlobfsChunkSize / 2;
+    fbl::unique_ptr<char[]> buf(new char[kReadSize]);
+    for (size_t i = 0; i < 8; i++) {
+        size_t off = info->size_data - kReadSize - i * (info->size_data / 8);
+        ASSERT_EQ(pread(fd.get(), buf.get(), kReadSize, off), static_cast<ssize_t>(kReadSize));
+        ASSERT_EQ(memcmp(buf.get(), &info->data[off], kReadSize), 0,
+                  "Read data, but it was bad");
+    }
+    ASSERT_TRUE(VerifyContents(fd.get(), info->data.get(), info->size_data));
+
+    void* addr = mmap(NULL, info->size_data, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    ASSERT_NE(addr, MAP_FAILED, "Could not mmap blob");
+    ASSERT_EQ(memcmp(addr, info->data.get(), info->size_data), 0, "Mmap data invalid");
+    ASSERT_EQ(munmap(addr, info->size_data), 0, "Could not unmap blob");
+    ASSERT_EQ(close(fd.release()), 0);
+
+    ASSERT_EQ(unlink(info->path), 0);
+    END_HELPER;
+}
+
 static bool TestReaddir(BlobfsTest* blobfsTest) {
     BEGIN_HELPER;
     constexpr size_t kMaxEntries = 50;
@@ -2033,6 +2120,59 @@ static bool NoSpace(BlobfsTest* blobfsTest) {
     END_HELPER;
 }
 
+// Fills the disk, frees every other blob, and writes a blob which is larger than
+// any remaining contiguous free range.
+static bool TestFragmentedBlob(BlobfsTest* blobfsTest) {
+    BEGIN_HELPER;
+    fbl::Vector<fbl::unique_ptr<blob_info_t>> infos;
+
+    // Keep generating blobs until we run out of space
+    while (true) {
+        fbl::unique_ptr<blob_info_t> info;
+        ASSERT_TRUE(GenerateRandomBlob(1 << 17, &info));
+
+        fbl::unique_fd fd(open(info->path, O_CREAT | O_RDWR));
+        ASSERT_TRUE(fd, "Failed to create blob");
+        if (ftruncate(fd.get(), info->size_data) < 0) {
+            ASSERT_EQ(errno, ENOSPC, "Blobfs expected to run out of space");
+            ASSERT_EQ(close(fd.release()), 0);
+            ASSERT_EQ(unlink(info->path), 0);
+            break;
+        }
+        ASSERT_EQ(StreamAll(write, fd.get(), info->data.get(), info->size_data), 0,
+                  "Failed to write Data");
+        ASSERT_EQ(close(fd.release()), 0);
+        infos.push_back(fbl::move(info));
+    }
+    ASSERT_GT(infos.size(), 8);
+
+    // Punch holes into the allocated space, none of which can hold the new blob.
+    for (size_t i = 0; i < infos.size(); i += 2) {
+        ASSERT_EQ(unlink(infos[i]->path), 0);
+    }
+
+    fbl::unique_ptr<blob_info_t> info;
+    ASSERT_TRUE(GenerateRandomBlob(1 << 19, &info));
+    fbl::unique_fd fd;
+    ASSERT_TRUE(MakeBlob(info.get(), &fd));
+    ASSERT_EQ(close(fd.release()), 0);
+
+    // Remount, checking the filesystem, and read the fragmented blob back from disk.
+    ASSERT_TRUE(blobfsTest->Remount());
+    fd.reset(open(info->path, O_RDONLY));
+    ASSERT_TRUE(fd, "Failed to-reopen blob");
+    ASSERT_TRUE(VerifyContents(fd.get(), info->data.get(), info->size_data));
+    ASSERT_EQ(close(fd.release()), 0);
+
+    // Freeing the fragmented blob releases all of its extents.
+    ASSERT_EQ(unlink(info->path), 0);
+    for (size_t i = 1; i < infos.size(); i += 2) {
+        ASSERT_EQ(unlink(infos[i]->path), 0);
+    }
+    ASSERT_TRUE(blobfsTest->Remount());
+    END_HELPER;
+}
+
 static bool QueryDevicePath(BlobfsTest* blobfsTest) {
     BEGIN_HELPER;
     fbl::unique_fd dirfd(open(MOUNT_PATH "/.", O_RDONLY | O_ADMIN));
@@ -2306,12 +2446,70 @@ static bool TestCompressorBufferTooSmall(void) {
     END_TEST;
 }
 
+// Ensure ChunkedCompressor output can be decompressed whole, or one chunk at a time.
+static bool TestChunkedCompressorRoundTrip(void) {
+    BEGIN_TEST;
+    const size_t kChunkSize = blobfs::kBlobfsChunkSize;
+    const size_t kSizes[] = {1, kChunkSize - 1, kChunkSize, 5 * kChunkSize + 17};
+    unsigned int seed = 0;
+    for (size_t size : kSizes) {
+        fbl::AllocChecker ac;
+        fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[size]);
+        ASSERT_TRUE(ac.check());
+        // Alternate between incompressible and compressible chunks.
+        for (size_t i = 0; i < size; i++) {
+            data[i] = ((i / kChunkSize) % 2) ? static_cast<uint8_t>(i / 128)
+                                             : static_cast<uint8_t>(rand_r(&seed));
+        }
+
+        blobfs::ChunkedCompressor c;
+        const size_t buf_size = c.BufferMax(size);
+        fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[buf_size]);
+        ASSERT_TRUE(ac.check());
+        ASSERT_EQ(c.Initialize(buf.get(), buf_size, size), ZX_OK);
+
+        // Feed the compressor in pieces which do not line up with chunks.
+        for (size_t off = 0; off < size;) {
+            size_t length = fbl::min(size - off, kChunkSize / 3 + 1);
+            ASSERT_EQ(c.Update(&data[off], length), ZX_OK);
+            off += length;
+        }
+        ASSERT_EQ(c.End(), ZX_OK);
+
+        fbl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[size]);
+        ASSERT_TRUE(ac.check());
+        size_t target_size = size;
+        size_t src_size = c.Size();
+        ASSERT_EQ(blobfs::ChunkedDecompressor::Decompress(out.get(), &target_size, buf.get(),
+                                                          &src_size), ZX_OK);
+        ASSERT_EQ(target_size, size);
+        ASSERT_EQ(src_size, c.Size());
+        ASSERT_EQ(memcmp(out.get(), data.get(), size), 0);
+
+        // The last chunk can be decompressed on its own.
+        const uint32_t last = static_cast<uint32_t>((size - 1) / kChunkSize);
+        const size_t last_offset = last * kChunkSize;
+        memset(out.get(), 0, size);
+        ASSERT_EQ(blobfs::ChunkedDecompressor::DecompressChunk(out.get(), size - last_offset,
+                                                               buf.get(), last), ZX_OK);
+        ASSERT_EQ(memcmp(out.get(), &data[last_offset], size - last_offset), 0);
+
+        // A damaged table is rejected.
+        buf[0] ^= 1;
+        ASSERT_EQ(blobfs::ChunkedDecompressor::ValidateTable(buf.get(), c.Size(), size),
+                  ZX_ERR_IO_DATA_INTEGRITY);
+    }
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(blobfs_tests)
 RUN_TESTS(MEDIUM, TestBasic)
 RUN_TESTS(MEDIUM, TestNullBlob)
 RUN_TESTS(MEDIUM, TestCompressibleBlob)
 RUN_TESTS(MEDIUM, TestMmap)
 RUN_TESTS(MEDIUM, TestMmapUseAfterClose)
+RUN_TESTS(MEDIUM, TestSparseRead)
+RUN_TESTS(MEDIUM, TestSparseReadCompressed)
 RUN_TESTS(MEDIUM, TestReaddir)
 RUN_TESTS(MEDIUM, TestDiskTooSmall)
 RUN_TEST_FVM(MEDIUM, TestQueryInfo)
@@ -2341,12 +2539,14 @@ RUN_TESTS(LARGE, TestHugeBlobCompressible)
 RUN_TESTS(LARGE, CreateUmountRemountLarge)
 RUN_TESTS(LARGE, CreateUmountRemountLargeMultithreaded)
 RUN_TESTS(LARGE, NoSpace)
+RUN_TESTS(LARGE, TestFragmentedBlob)
 RUN_TESTS(MEDIUM, QueryDevicePath)
 RUN_TESTS(MEDIUM, TestReadOnly)
 RUN_TEST_FVM(MEDIUM, ResizePartition)
 RUN_TEST_FVM(MEDIUM, CorruptAtMount)
 RUN_TESTS(LARGE, CreateWriteReopen)
 RUN_TEST(TestCompressorBufferTooSmall);
+RUN_TEST(TestChunkedCompressorRoundTrip);
 END_TEST_CASE(blobfs_tests)
 
 static void print_test_help(FILE* f) {
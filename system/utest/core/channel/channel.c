@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -1025,6 +1026,70 @@ static bool channel_write_different_sizes(void) {
     END_TEST;
 }
 
+static bool channel_iovec(void) {
+    BEGIN_TEST;
+
+    zx_handle_t channel[2];
+    ASSERT_EQ(zx_channel_create(0, &channel[0], &channel[1]), ZX_OK, "");
+
+    char header[16];
+    char payload[5000];
+    for (size_t i = 0; i < sizeof(header); ++i)
+        header[i] = (char)i;
+    for (size_t i = 0; i < sizeof(payload); ++i)
+        payload[i] = (char)(i % 251);
+
+    zx_channel_iovec_t wr[2] = {
+        {header, sizeof(header), 0},
+        {payload, sizeof(payload), 0},
+    };
+    ASSERT_EQ(zx_channel_write(channel[0], ZX_CHANNEL_WRITE_USE_IOVEC, wr, 2, NULL, 0),
+              ZX_OK, "");
+
+    // A vectored write reads back as one contiguous message.
+    char data[sizeof(header) + sizeof(payload)];
+    uint32_t size;
+    ASSERT_EQ(zx_channel_read(channel[1], 0u, data, NULL, sizeof(data), 0, &size, NULL),
+              ZX_OK, "");
+    EXPECT_EQ(size, sizeof(data), "wrong size");
+    EXPECT_EQ(memcmp(data, header, sizeof(header)), 0, "");
+    EXPECT_EQ(memcmp(data + sizeof(header), payload, sizeof(payload)), 0, "");
+
+    // A vectored read scatters the message, filling each fragment in turn.
+    ASSERT_EQ(zx_channel_write(channel[0], 0u, data, sizeof(data), NULL, 0), ZX_OK, "");
+    char rd_header[sizeof(header)] = {};
+    char rd_payload[sizeof(payload) + 100] = {};
+    zx_channel_iovec_t rd[2] = {
+        {rd_header, sizeof(rd_header), 0},
+        {rd_payload, sizeof(rd_payload), 0},
+    };
+    ASSERT_EQ(zx_channel_read(channel[1], ZX_CHANNEL_READ_USE_IOVEC, rd, NULL, 2, 0,
+                              &size, NULL), ZX_OK, "");
+    EXPECT_EQ(size, sizeof(data), "wrong size");
+    EXPECT_EQ(memcmp(rd_header, header, sizeof(header)), 0, "");
+    EXPECT_EQ(memcmp(rd_payload, payload, sizeof(payload)), 0, "");
+
+    // The fragments' total capacity is what has to fit the message.
+    ASSERT_EQ(zx_channel_write(channel[0], 0u, data, sizeof(data), NULL, 0), ZX_OK, "");
+    rd[1].capacity = 10;
+    EXPECT_EQ(zx_channel_read(channel[1], ZX_CHANNEL_READ_USE_IOVEC, rd, NULL, 2, 0,
+                              &size, NULL), ZX_ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(size, sizeof(data), "wrong size");
+
+    wr[0].reserved = 1;
+    EXPECT_EQ(zx_channel_write(channel[0], ZX_CHANNEL_WRITE_USE_IOVEC, wr, 2, NULL, 0),
+              ZX_ERR_INVALID_ARGS, "");
+    wr[0].reserved = 0;
+    EXPECT_EQ(zx_channel_write(channel[0], ZX_CHANNEL_WRITE_USE_IOVEC, wr,
+                               ZX_CHANNEL_MAX_MSG_IOVECS + 1, NULL, 0),
+              ZX_ERR_OUT_OF_RANGE, "");
+
+    EXPECT_EQ(zx_handle_close(channel[0]), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(channel[1]), ZX_OK, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -1042,6 +1107,7 @@ RUN_TEST(channel_nest)
 RUN_TEST(channel_disallow_write_to_self)
 RUN_TEST(channel_read_etc)
 RUN_TEST(channel_write_different_sizes)
+RUN_TEST(channel_iovec)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -10,6 +10,7 @@
 #include <unistd.h>
 
 #include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
 #include <unittest/unittest.h>
 
 static zx_signals_t get_signals(zx_handle_t h) {
@@ -32,7 +33,7 @@ static bool basic_test(void) {
     // ensure parameter validation works
     EXPECT_EQ(zx_fifo_create(0, 0, 0, &a, &b), ZX_ERR_OUT_OF_RANGE, ""); // too small
     EXPECT_EQ(zx_fifo_create(35, 32, 0, &a, &b), ZX_ERR_OUT_OF_RANGE, ""); // not power of two
-    EXPECT_EQ(zx_fifo_create(128, 33, 0, &a, &b), ZX_ERR_OUT_OF_RANGE, ""); // too large
+    EXPECT_EQ(zx_fifo_create(2048, 33, 0, &a, &b), ZX_ERR_OUT_OF_RANGE, ""); // too large
     EXPECT_EQ(zx_fifo_create(0, 0, 1, &a, &b), ZX_ERR_OUT_OF_RANGE, ""); // invalid options
 
     // simple 8 x 8 fifo
@@ -151,6 +152,101 @@ static bool peer_closed_test(void) {
     END_TEST;
 }
 
+// A fifo may span several pages, and wraps around like any other.
+static bool multi_page_test(void) {
+    BEGIN_TEST;
+    enum { ELEM_SZ = sizeof(uint64_t), ELEM_COUNT = ZX_FIFO_MAX_SIZE_BYTES / ELEM_SZ };
+
+    zx_handle_t a, b;
+    ASSERT_EQ(zx_fifo_create(ELEM_COUNT, ELEM_SZ, 0, &a, &b), ZX_OK, "");
+
+    uint64_t* n = malloc(ZX_FIFO_MAX_SIZE_BYTES);
+    ASSERT_NONNULL(n, "");
+    for (uint64_t i = 0; i < ELEM_COUNT; i++)
+        n[i] = i;
+
+    // Offset the indices so that filling the fifo wraps.
+    size_t actual;
+    uint64_t skip[3] = {};
+    ASSERT_EQ(zx_fifo_write(a, ELEM_SZ, skip, 3, &actual), ZX_OK, "");
+    ASSERT_EQ(zx_fifo_read(b, ELEM_SZ, skip, 3, &actual), ZX_OK, "");
+
+    ASSERT_EQ(zx_fifo_write(a, ELEM_SZ, n, ELEM_COUNT, &actual), ZX_OK, "");
+    ASSERT_EQ(actual, (size_t)ELEM_COUNT, "");
+    EXPECT_SIGNALS(a, 0u);
+
+    memset(n, 0xff, ZX_FIFO_MAX_SIZE_BYTES);
+    ASSERT_EQ(zx_fifo_read(b, ELEM_SZ, n, ELEM_COUNT, &actual), ZX_OK, "");
+    ASSERT_EQ(actual, (size_t)ELEM_COUNT, "");
+    for (uint64_t i = 0; i < ELEM_COUNT; i++)
+        ASSERT_EQ(n[i], i, "");
+    EXPECT_SIGNALS(a, ZX_FIFO_WRITABLE);
+
+    free(n);
+    zx_handle_close(a);
+    zx_handle_close(b);
+    END_TEST;
+}
+
+static bool threshold_test(void) {
+    BEGIN_TEST;
+    uint64_t n[8] = {};
+    enum { ELEM_SZ = sizeof(n[0]) };
+
+    zx_handle_t a, b;
+    ASSERT_EQ(zx_fifo_create(8, ELEM_SZ, 0, &a, &b), ZX_OK, "");
+
+    size_t value = 9;
+    EXPECT_EQ(zx_object_set_property(b, ZX_PROP_FIFO_RX_THRESHOLD, &value, sizeof(value)),
+              ZX_ERR_INVALID_ARGS, "");
+
+    // The reader wants batches of 3 and the writer wants room for 6.
+    value = 3;
+    ASSERT_EQ(zx_object_set_property(b, ZX_PROP_FIFO_RX_THRESHOLD, &value, sizeof(value)),
+              ZX_OK, "");
+    value = 6;
+    ASSERT_EQ(zx_object_set_property(a, ZX_PROP_FIFO_TX_THRESHOLD, &value, sizeof(value)),
+              ZX_OK, "");
+    value = 0;
+    ASSERT_EQ(zx_object_get_property(b, ZX_PROP_FIFO_RX_THRESHOLD, &value, sizeof(value)),
+              ZX_OK, "");
+    EXPECT_EQ(value, 3u, "");
+    EXPECT_SIGNALS(a, ZX_FIFO_WRITABLE | ZX_FIFO_WRITE_THRESHOLD);
+    EXPECT_SIGNALS(b, ZX_FIFO_WRITABLE);
+
+    size_t actual;
+    ASSERT_EQ(zx_fifo_write(a, ELEM_SZ, n, 2, &actual), ZX_OK, "");
+    EXPECT_SIGNALS(a, ZX_FIFO_WRITABLE | ZX_FIFO_WRITE_THRESHOLD);
+    EXPECT_SIGNALS(b, ZX_FIFO_READABLE | ZX_FIFO_WRITABLE);
+
+    ASSERT_EQ(zx_fifo_write(a, ELEM_SZ, n, 1, &actual), ZX_OK, "");
+    EXPECT_SIGNALS(a, ZX_FIFO_WRITABLE);
+    EXPECT_SIGNALS(b, ZX_FIFO_READABLE | ZX_FIFO_WRITABLE | ZX_FIFO_READ_THRESHOLD);
+
+    ASSERT_EQ(zx_fifo_read(b, ELEM_SZ, n, 1, &actual), ZX_OK, "");
+    EXPECT_SIGNALS(a, ZX_FIFO_WRITABLE | ZX_FIFO_WRITE_THRESHOLD);
+    EXPECT_SIGNALS(b, ZX_FIFO_READABLE | ZX_FIFO_WRITABLE);
+
+    // Lowering the threshold reasserts the signal right away, and zero
+    // turns it off.
+    value = 2;
+    ASSERT_EQ(zx_object_set_property(b, ZX_PROP_FIFO_RX_THRESHOLD, &value, sizeof(value)),
+              ZX_OK, "");
+    EXPECT_SIGNALS(b, ZX_FIFO_READABLE | ZX_FIFO_WRITABLE | ZX_FIFO_READ_THRESHOLD);
+    value = 0;
+    ASSERT_EQ(zx_object_set_property(b, ZX_PROP_FIFO_RX_THRESHOLD, &value, sizeof(value)),
+              ZX_OK, "");
+    EXPECT_SIGNALS(b, ZX_FIFO_READABLE | ZX_FIFO_WRITABLE);
+
+    zx_handle_close(b);
+    EXPECT_SIGNALS(a, ZX_FIFO_PEER_CLOSED);
+    value = 1;
+    EXPECT_EQ(zx_object_set_property(a, ZX_PROP_FIFO_TX_THRESHOLD, &value, sizeof(value)),
+              ZX_ERR_PEER_CLOSED, "");
+    zx_handle_close(a);
+    END_TEST;
+}
+
 static bool options_test(void) {
     BEGIN_TEST;
 
@@ -165,6 +261,8 @@ BEGIN_TEST_CASE(fifo_tests)
 RUN_TEST(basic_test)
 RUN_TEST(peer_closed_test)
 RUN_TEST(options_test)
+RUN_TEST(multi_page_test)
+RUN_TEST(threshold_test)
 END_TEST_CASE(fifo_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -108,6 +108,56 @@ static bool queue_too_many(void) {
     END_TEST;
 }
 
+static bool wait_batch_test(void) {
+    BEGIN_TEST;
+    zx_status_t status;
+
+    zx_handle_t port;
+    status = zx_port_create(0, &port);
+    EXPECT_EQ(status, ZX_OK, "could not create port");
+
+    zx_port_packet_t out[40] = {};
+    size_t actual = 0u;
+
+    status = zx_port_wait_batch(port, 0, out, 0u, &actual);
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS);
+
+    status = zx_port_wait_batch(port, zx_deadline_after(ZX_USEC(1)), out,
+                                fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_ERR_TIMED_OUT);
+
+    // More packets than the kernel copies out at a time, fewer than asked for.
+    for (uint64_t key = 0u; key < 35u; ++key) {
+        const zx_port_packet_t in = {key, ZX_PKT_TYPE_USER, 0, { {} }};
+        status = zx_port_queue(port, &in);
+        EXPECT_EQ(status, ZX_OK);
+    }
+
+    status = zx_port_wait_batch(port, ZX_TIME_INFINITE, out, 30u, &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, 30u);
+    for (size_t ix = 0u; ix < actual; ++ix) {
+        EXPECT_EQ(out[ix].key, ix, "packets must come out in order");
+        EXPECT_EQ(out[ix].type, ZX_PKT_TYPE_USER);
+    }
+
+    status = zx_port_wait_batch(port, ZX_TIME_INFINITE, out, fbl::count_of(out), &actual);
+    EXPECT_EQ(status, ZX_OK);
+    EXPECT_EQ(actual, 5u);
+    for (size_t ix = 0u; ix < actual; ++ix) {
+        EXPECT_EQ(out[ix].key, 30u + ix, "packets must come out in order");
+    }
+
+    // Packets taken in a batch leave nothing behind for zx_port_wait().
+    status = zx_port_wait(port, zx_deadline_after(ZX_USEC(1)), &out[0]);
+    EXPECT_EQ(status, ZX_ERR_TIMED_OUT);
+
+    status = zx_handle_close(port);
+    EXPECT_EQ(status, ZX_OK);
+
+    END_TEST;
+}
+
 static bool async_wait_channel_test(void) {
     BEGIN_TEST;
     zx_status_t status;
@@ -681,6 +731,7 @@ BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
 RUN_TEST(queue_too_many)
+RUN_TEST(wait_batch_test)
 RUN_TEST(async_wait_channel_test)
 RUN_TEST(async_wait_event_test_single)
 RUN_TEST(async_wait_event_test_repeat)
@@ -3,11 +3,13 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <zircon/process.h>
 #include <zircon/syscalls.h>
 #include <unittest/unittest.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 static zx_signals_t get_satisfied_signals(zx_handle_t handle) {
@@ -1153,6 +1155,98 @@ bool socket_share_consumes_on_failure(void) {
     END_TEST;
 }
 
+static bool socket_ring(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h[2];
+    ASSERT_EQ(zx_socket_create(ZX_SOCKET_RING, h, h + 1), ZX_OK, "");
+
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_socket_get_ring(h[1], 0u, &vmo), ZX_OK, "");
+    uint64_t vmo_size;
+    ASSERT_EQ(zx_vmo_get_size(vmo, &vmo_size), ZX_OK, "");
+    ASSERT_GT(vmo_size, ZX_SOCKET_RING_DATA_OFFSET, "");
+
+    // The ring is for reading only.
+    uintptr_t addr;
+    EXPECT_EQ(zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ | ZX_VM_PERM_WRITE, 0, vmo, 0,
+                          vmo_size, &addr), ZX_ERR_ACCESS_DENIED, "");
+    ASSERT_EQ(zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ, 0, vmo, 0, vmo_size, &addr),
+              ZX_OK, "");
+    const volatile zx_socket_ring_header_t* header = (const zx_socket_ring_header_t*)addr;
+    const char* ring = (const char*)(addr + ZX_SOCKET_RING_DATA_OFFSET);
+    EXPECT_EQ(header->size, vmo_size - ZX_SOCKET_RING_DATA_OFFSET, "");
+    EXPECT_EQ(header->head, 0u, "");
+    EXPECT_EQ(header->tail, 0u, "");
+
+    static const char write_data[] = "ring buffer";
+    size_t count;
+    ASSERT_EQ(zx_socket_write(h[0], 0u, write_data, sizeof(write_data), &count), ZX_OK, "");
+    EXPECT_EQ(count, sizeof(write_data), "");
+    EXPECT_EQ(get_satisfied_signals(h[1]) & ZX_SOCKET_READABLE, ZX_SOCKET_READABLE, "");
+
+    // The data can be read in place and then consumed.
+    EXPECT_EQ(header->head, sizeof(write_data), "");
+    EXPECT_EQ(memcmp(ring, write_data, sizeof(write_data)), 0, "");
+    ASSERT_EQ(zx_socket_read(h[1], ZX_SOCKET_CONSUME, NULL, 5u, &count), ZX_OK, "");
+    EXPECT_EQ(count, 5u, "");
+    EXPECT_EQ(header->tail, 5u, "");
+
+    // An ordinary read picks up where the consumer left off.
+    char read_data[sizeof(write_data)] = {};
+    ASSERT_EQ(zx_socket_read(h[1], 0u, read_data, sizeof(read_data), &count), ZX_OK, "");
+    EXPECT_EQ(count, sizeof(write_data) - 5u, "");
+    EXPECT_EQ(memcmp(read_data, write_data + 5, count), 0, "");
+    EXPECT_EQ(header->tail, header->head, "");
+    EXPECT_EQ(get_satisfied_signals(h[1]) & ZX_SOCKET_READABLE, 0u, "");
+    EXPECT_EQ(zx_socket_read(h[1], ZX_SOCKET_CONSUME, NULL, 1u, &count), ZX_ERR_SHOULD_WAIT, "");
+
+    // Filling the ring clears ZX_SOCKET_WRITABLE, and consuming sets it again.
+    size_t ring_size = header->size;
+    char* buffer = malloc(ring_size + 1);
+    ASSERT_NONNULL(buffer, "");
+    memset(buffer, 'r', ring_size + 1);
+    ASSERT_EQ(zx_socket_write(h[0], 0u, buffer, ring_size + 1, &count), ZX_OK, "");
+    EXPECT_EQ(count, ring_size, "");
+    EXPECT_EQ(get_satisfied_signals(h[0]) & ZX_SOCKET_WRITABLE, 0u, "");
+    ASSERT_EQ(zx_socket_read(h[1], ZX_SOCKET_CONSUME, NULL, ring_size, &count), ZX_OK, "");
+    EXPECT_EQ(count, ring_size, "");
+    EXPECT_EQ(get_satisfied_signals(h[0]) & ZX_SOCKET_WRITABLE, ZX_SOCKET_WRITABLE, "");
+    free(buffer);
+
+    EXPECT_EQ(zx_vmar_unmap(zx_vmar_root_self(), addr, vmo_size), ZX_OK, "");
+    zx_handle_close(vmo);
+    zx_handle_close(h[0]);
+    zx_handle_close(h[1]);
+
+    END_TEST;
+}
+
+static bool socket_ring_invalid(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h[2];
+    EXPECT_EQ(zx_socket_create(ZX_SOCKET_RING | ZX_SOCKET_DATAGRAM, h, h + 1),
+              ZX_ERR_INVALID_ARGS, "");
+
+    ASSERT_EQ(zx_socket_create(0u, h, h + 1), ZX_OK, "");
+    zx_handle_t vmo;
+    EXPECT_EQ(zx_socket_get_ring(h[0], 0u, &vmo), ZX_ERR_NOT_SUPPORTED, "");
+    size_t count;
+    ASSERT_EQ(zx_socket_write(h[1], 0u, "x", 1u, &count), ZX_OK, "");
+    EXPECT_EQ(zx_socket_read(h[0], ZX_SOCKET_CONSUME, NULL, 1u, &count),
+              ZX_ERR_NOT_SUPPORTED, "");
+    zx_handle_close(h[0]);
+    zx_handle_close(h[1]);
+
+    ASSERT_EQ(zx_socket_create(ZX_SOCKET_RING, h, h + 1), ZX_OK, "");
+    EXPECT_EQ(zx_socket_get_ring(h[0], 1u, &vmo), ZX_ERR_INVALID_ARGS, "");
+    zx_handle_close(h[0]);
+    zx_handle_close(h[1]);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -1173,6 +1267,8 @@ RUN_TEST(socket_accept)
 RUN_TEST(socket_share_invalid_handle)
 RUN_TEST(socket_share_consumes_on_failure)
 RUN_TEST(socket_signals2)
+RUN_TEST(socket_ring)
+RUN_TEST(socket_ring_invalid)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -300,6 +300,30 @@ bool CreateAll(void) {
     END_TEST;
 }
 
+// Used by CreateThreadedAll below.
+bool CreateThreaded(size_t data_len, const char* digest) {
+    zx_status_t rc;
+    size_t tree_len = MerkleTree::GetTreeLength(data_len);
+    Digest actual;
+    ASSERT_OK(MerkleTree::Create(gData, data_len, gTree, tree_len, &actual, 4));
+    Digest expected;
+    ASSERT_OK(expected.Parse(digest, strlen(digest)));
+    ASSERT_TRUE(actual == expected, "Incorrect root digest");
+    return true;
+}
+
+bool CreateThreadedAll(void) {
+    BEGIN_TEST;
+    for (size_t i = 0; i < kNumCases; ++i) {
+        if (!CreateThreaded(kCases[i].data_len, kCases[i].digest)) {
+            unittest_printf_critical(
+                "CreateThreadedAll failed with data length of %zu\n",
+                kCases[i].data_len);
+        }
+    }
+    END_TEST;
+}
+
 // Used by CreateFinalCAll below.
 bool CreateFinalC(size_t data_len, const char* digest) {
     zx_status_t rc;
@@ -716,6 +740,7 @@ RUN_TEST(CreateFinalWithoutTree)
 RUN_TEST(CreateFinalMissingDigest)
 RUN_TEST(CreateFinalIncompleteData)
 RUN_TEST(CreateAll)
+RUN_TEST(CreateThreadedAll)
 RUN_TEST(CreateFinalCAll)
 RUN_TEST(CreateCAll)
 RUN_TEST(CreateByteByByte)
@@ -4,6 +4,7 @@
 
 // Tests for MinFS-specific behavior.
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -13,6 +14,7 @@
 
 #include <fbl/algorithm.h>
 #include <fbl/unique_fd.h>
+#include <fbl/unique_ptr.h>
 #include <fuchsia/io/c/fidl.h>
 #include <fuchsia/minfs/c/fidl.h>
 #include <fvm/fvm.h>
@@ -183,6 +185,70 @@ bool TestMetrics() {
     END_TEST;
 }
 
+// Validate that sequential reads are detected and read ahead, and that reads
+// in any order return the file's contents.
+bool TestReadahead() {
+    BEGIN_TEST;
+
+    constexpr size_t kBlockCount = 64;
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[kBlockCount * minfs::kMinfsBlockSize]);
+    for (size_t i = 0; i < kBlockCount * minfs::kMinfsBlockSize; i++) {
+        data[i] = static_cast<uint8_t>(i / minfs::kMinfsBlockSize + i);
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path) - 1, "%s/readahead-file", kMountPath);
+    fbl::unique_fd fd(open(path, O_CREAT | O_RDWR));
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(write(fd.get(), data.get(), kBlockCount * minfs::kMinfsBlockSize),
+              static_cast<ssize_t>(kBlockCount * minfs::kMinfsBlockSize));
+    ASSERT_EQ(close(fd.release()), 0);
+
+    // Remount, so nothing is cached in the vnode's VMO.
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    ASSERT_TRUE(ToggleMetrics(true));
+
+    uint8_t buf[minfs::kMinfsBlockSize];
+    fd.reset(open(path, O_RDONLY));
+    ASSERT_TRUE(fd);
+    for (size_t i = 0; i < kBlockCount; i++) {
+        ASSERT_EQ(read(fd.get(), buf, sizeof(buf)), static_cast<ssize_t>(sizeof(buf)));
+        ASSERT_EQ(memcmp(buf, &data[i * minfs::kMinfsBlockSize], sizeof(buf)), 0);
+    }
+
+    fuchsia_minfs_Metrics metrics;
+    ASSERT_TRUE(GetMetrics(&metrics));
+    ASSERT_EQ(metrics.sequential_reads, kBlockCount);
+    ASSERT_GT(metrics.sequential_reads_cache_hit, 0);
+    ASSERT_GT(metrics.load_readahead_blocks, 0);
+    ASSERT_GE(metrics.load_demand_blocks + metrics.load_readahead_blocks, kBlockCount);
+    ASSERT_LT(metrics.load_calls, kBlockCount / 4);
+    ASSERT_TRUE(ToggleMetrics(false));
+    ASSERT_EQ(close(fd.release()), 0);
+
+    // Reads in reverse order, which are not read ahead, and partial writes
+    // must observe the same contents.
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    fd.reset(open(path, O_RDWR));
+    ASSERT_TRUE(fd);
+    const uint8_t patch[] = {0xde, 0xad, 0xbe, 0xef};
+    const off_t patch_off = 3 * minfs::kMinfsBlockSize + 7;
+    ASSERT_EQ(pwrite(fd.get(), patch, sizeof(patch), patch_off),
+              static_cast<ssize_t>(sizeof(patch)));
+    memcpy(&data[patch_off], patch, sizeof(patch));
+    for (size_t i = kBlockCount; i-- > 0;) {
+        ASSERT_EQ(pread(fd.get(), buf, sizeof(buf), i * minfs::kMinfsBlockSize),
+                  static_cast<ssize_t>(sizeof(buf)));
+        ASSERT_EQ(memcmp(buf, &data[i * minfs::kMinfsBlockSize], sizeof(buf)), 0);
+    }
+    ASSERT_EQ(close(fd.release()), 0);
+    ASSERT_EQ(unlink(path), 0);
+
+    END_TEST;
+}
+
 bool GetUsedBlocks(uint32_t* used_blocks) {
     BEGIN_HELPER;
     fuchsia_io_FilesystemInfo info;
@@ -226,7 +292,8 @@ bool GetFileBlocks(int fd, uint64_t* blocks) {
     END_HELPER;
 }
 
-// Fill a directory to at most |max_blocks| full of direntries.
+// Fill a directory with direntries until it grows past |max_blocks|, then remove the
+// entry which grew it. (A hashed directory keeps the blocks it grew into.)
 // We assume the directory is empty to begin with, and any files we are adding do not already exist.
 bool FillDirectory(int dir_fd, uint32_t max_blocks) {
     BEGIN_HELPER;
@@ -330,8 +397,10 @@ bool TestFullOperations() {
     fbl::unique_fd dir_fd(openat(mnt_fd.get(), dir_path, O_RDONLY));
     ASSERT_TRUE(dir_fd);
 
-    // Fill the directory up to kMinfsDirect blocks full of direntries.
-    ASSERT_TRUE(FillDirectory(dir_fd.get(), minfs::kMinfsDirect));
+    // Fill the directory up to kMinfsDirect blocks full of direntries. The hash index of a
+    // directory doubles as it grows, so growing past kMinfsDirect / 2 blocks lands exactly
+    // on kMinfsDirect.
+    ASSERT_TRUE(FillDirectory(dir_fd.get(), minfs::kMinfsDirect / 2));
 
     // Now re-fill the partition by writing as much as possible back to the original file.
     // Attempt to leave 1 block free.
@@ -423,6 +492,387 @@ bool TestFullOperations() {
     END_TEST;
 }
 
+
+// Reads minfs block |bno| of the unmounted test disk.
+bool ReadDiskBlock(int fd, uint64_t bno, void* data) {
+    BEGIN_HELPER;
+    ASSERT_EQ(pread(fd, data, minfs::kMinfsBlockSize, bno * minfs::kMinfsBlockSize),
+              minfs::kMinfsBlockSize);
+    END_HELPER;
+}
+
+// Writes minfs block |bno| of the unmounted test disk.
+bool WriteDiskBlock(int fd, uint64_t bno, const void* data) {
+    BEGIN_HELPER;
+    ASSERT_EQ(pwrite(fd, data, minfs::kMinfsBlockSize, bno * minfs::kMinfsBlockSize),
+              minfs::kMinfsBlockSize);
+    END_HELPER;
+}
+
+// Extends the FNV-1a hash |n|, as used by journal commit blocks.
+uint32_t JournalChecksum(uint32_t n, const void* ptr, size_t len) {
+    const uint8_t* data = static_cast<const uint8_t*>(ptr);
+    while (len-- > 0) {
+        n = (n ^ (*data++)) * 16777619;
+    }
+    return n;
+}
+
+// Writes a single-block journal entry for |target| by hand, as if the
+// filesystem committed it but crashed before writing it in place. If
+// |torn|, the payload does not match the commit block.
+bool WriteJournalEntry(int fd, const minfs::Superblock& info, uint64_t sequence,
+                       minfs::blk_t target, const uint8_t* payload, bool torn) {
+    BEGIN_HELPER;
+    uint8_t entry_blk[minfs::kMinfsBlockSize];
+    memset(entry_blk, 0, sizeof(entry_blk));
+    minfs::JournalEntry* entry = reinterpret_cast<minfs::JournalEntry*>(entry_blk);
+    entry->magic = minfs::kMinfsJournalEntryMagic;
+    entry->sequence = sequence;
+    entry->block_count = 1;
+    entry->target[0] = target;
+
+    uint8_t commit_blk[minfs::kMinfsBlockSize];
+    memset(commit_blk, 0, sizeof(commit_blk));
+    minfs::JournalCommit* commit = reinterpret_cast<minfs::JournalCommit*>(commit_blk);
+    commit->magic = minfs::kMinfsJournalCommitMagic;
+    commit->sequence = sequence;
+    commit->checksum = JournalChecksum(JournalChecksum(2166136261u, entry_blk, sizeof(entry_blk)),
+                                       payload, minfs::kMinfsBlockSize);
+    if (torn) {
+        commit->checksum++;
+    }
+
+    ASSERT_TRUE(WriteDiskBlock(fd, info.journal_block + 1, entry_blk));
+    ASSERT_TRUE(WriteDiskBlock(fd, info.journal_block + 2, payload));
+    ASSERT_TRUE(WriteDiskBlock(fd, info.journal_block + 3, commit_blk));
+    END_HELPER;
+}
+
+// Verify that metadata updates are committed through the journal, and that
+// a committed entry which never reached its final location is replayed at
+// mount, while a torn entry is ignored and an entry targeting blocks outside
+// the filesystem fails the mount.
+bool TestJournalReplay() {
+    BEGIN_TEST;
+
+    fbl::unique_fd mnt_fd(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    ASSERT_EQ(mkdirat(mnt_fd.get(), "dir", 0666), 0);
+    fbl::unique_fd fd(openat(mnt_fd.get(), "dir/file", O_CREAT | O_RDWR));
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(close(fd.release()), 0);
+    ASSERT_EQ(close(mnt_fd.release()), 0);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+
+    fbl::unique_fd disk(open(test_disk_path, O_RDWR));
+    ASSERT_TRUE(disk);
+    uint8_t blk[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(disk.get(), 0, blk));
+    minfs::Superblock info;
+    memcpy(&info, blk, sizeof(info));
+    ASSERT_GE(info.journal_block_count, minfs::kMinfsMinimumJournalBlocks);
+
+    // The most recent entry was retired after being written in place.
+    ASSERT_TRUE(ReadDiskBlock(disk.get(), info.journal_block, blk));
+    minfs::JournalInfo journal_info;
+    memcpy(&journal_info, blk, sizeof(journal_info));
+    ASSERT_EQ(journal_info.magic, minfs::kMinfsJournalMagic);
+    ASSERT_TRUE(ReadDiskBlock(disk.get(), info.journal_block + 1, blk));
+    const minfs::JournalEntry* entry = reinterpret_cast<const minfs::JournalEntry*>(blk);
+    ASSERT_EQ(entry->magic, minfs::kMinfsJournalEntryMagic);
+    ASSERT_EQ(entry->sequence + 1, journal_info.sequence);
+    const uint64_t sequence = journal_info.sequence;
+
+    // Target the last data block, which is unallocated.
+    const minfs::blk_t target = info.dat_block + info.block_count - 1;
+    uint8_t payload[minfs::kMinfsBlockSize];
+    memset(payload, 0xab, sizeof(payload));
+    ASSERT_TRUE(WriteJournalEntry(disk.get(), info, sequence, target, payload, false));
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+
+    ASSERT_TRUE(ReadDiskBlock(disk.get(), target, blk));
+    ASSERT_EQ(memcmp(blk, payload, sizeof(blk)), 0, "Committed entry was not replayed");
+    ASSERT_TRUE(ReadDiskBlock(disk.get(), info.journal_block, blk));
+    memcpy(&journal_info, blk, sizeof(journal_info));
+    ASSERT_EQ(journal_info.sequence, sequence + 1, "Replayed entry was not retired");
+
+    // A torn entry must not be replayed.
+    uint8_t torn_payload[minfs::kMinfsBlockSize];
+    memset(torn_payload, 0xcd, sizeof(torn_payload));
+    ASSERT_TRUE(WriteJournalEntry(disk.get(), info, sequence + 1, target, torn_payload, true));
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+    ASSERT_TRUE(ReadDiskBlock(disk.get(), target, blk));
+    ASSERT_EQ(memcmp(blk, payload, sizeof(blk)), 0, "Torn entry was replayed");
+
+    ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    mnt_fd.reset(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    struct stat s;
+    ASSERT_EQ(fstatat(mnt_fd.get(), "dir/file", &s, 0), 0);
+
+    // A committed entry which targets a block beyond the filesystem must fail
+    // the mount rather than be written.
+    ASSERT_EQ(close(mnt_fd.release()), 0);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+    ASSERT_TRUE(ReadDiskBlock(disk.get(), info.journal_block, blk));
+    memcpy(&journal_info, blk, sizeof(journal_info));
+    const minfs::blk_t beyond = info.dat_block + info.block_count;
+    ASSERT_TRUE(WriteJournalEntry(disk.get(), info, journal_info.sequence, beyond, payload,
+                                  false));
+    ASSERT_NE(test_info->mount(test_disk_path, kMountPath), 0, "Out of range entry was replayed");
+
+    // Tear the entry so that the filesystem mounts again.
+    ASSERT_TRUE(WriteJournalEntry(disk.get(), info, journal_info.sequence, beyond, payload,
+                                  true));
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    END_TEST;
+}
+
+// Reads inode |ino| from the inode table of the unmounted test disk.
+bool ReadDiskInode(int fd, const minfs::Superblock& info, uint64_t ino, minfs::Inode* inode) {
+    BEGIN_HELPER;
+    uint8_t blk[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(fd, info.ino_block + ino / minfs::kMinfsInodesPerBlock, blk));
+    memcpy(inode, blk + (ino % minfs::kMinfsInodesPerBlock) * minfs::kMinfsInodeSize,
+           sizeof(*inode));
+    END_HELPER;
+}
+
+// Reads the superblock of the unmounted test disk.
+bool ReadDiskSuperblock(int fd, minfs::Superblock* info) {
+    BEGIN_HELPER;
+    uint8_t blk[minfs::kMinfsBlockSize];
+    ASSERT_TRUE(ReadDiskBlock(fd, 0, blk));
+    memcpy(info, blk, sizeof(*info));
+    END_HELPER;
+}
+
+// Files written concurrently should each have the blocks beyond their direct
+// blocks laid out in a contiguous run, rather than interleaved with one
+// another.
+bool TestContiguousAllocation() {
+    BEGIN_TEST;
+
+    // Past the direct blocks, but within a single run.
+    constexpr uint32_t kIndirectBlocks = 24;
+    constexpr uint32_t kBlocks = minfs::kMinfsDirect + kIndirectBlocks;
+
+    fbl::unique_fd mnt_fd(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    fbl::unique_fd fds[2];
+    uint64_t inos[2];
+    for (size_t i = 0; i < fbl::count_of(fds); i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "file_%zu", i);
+        fds[i].reset(openat(mnt_fd.get(), path, O_CREAT | O_RDWR));
+        ASSERT_TRUE(fds[i]);
+        struct stat s;
+        ASSERT_EQ(fstat(fds[i].get(), &s), 0);
+        inos[i] = s.st_ino;
+    }
+
+    char data[minfs::kMinfsBlockSize];
+    memset(data, 0xab, sizeof(data));
+    for (uint32_t n = 0; n < kBlocks; n++) {
+        for (size_t i = 0; i < fbl::count_of(fds); i++) {
+            ASSERT_EQ(write(fds[i].get(), data, sizeof(data)), sizeof(data));
+        }
+    }
+    for (size_t i = 0; i < fbl::count_of(fds); i++) {
+        ASSERT_EQ(close(fds[i].release()), 0);
+    }
+    ASSERT_EQ(close(mnt_fd.release()), 0);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+
+    fbl::unique_fd disk(open(test_disk_path, O_RDWR));
+    ASSERT_TRUE(disk);
+    minfs::Superblock info;
+    ASSERT_TRUE(ReadDiskSuperblock(disk.get(), &info));
+    for (size_t i = 0; i < fbl::count_of(inos); i++) {
+        minfs::Inode inode;
+        ASSERT_TRUE(ReadDiskInode(disk.get(), info, inos[i], &inode));
+        ASSERT_EQ(inode.size, kBlocks * minfs::kMinfsBlockSize);
+        ASSERT_NE(inode.inum[0], 0u);
+
+        // The indirect block is placed inline, ahead of the data it maps.
+        minfs::blk_t entries[minfs::kMinfsDirectPerIndirect];
+        ASSERT_TRUE(ReadDiskBlock(disk.get(), info.dat_block + inode.inum[0], entries));
+        ASSERT_EQ(entries[0], inode.inum[0] + 1, "Indirect block is not inline");
+        for (uint32_t n = 1; n < kIndirectBlocks; n++) {
+            ASSERT_EQ(entries[n], entries[n - 1] + 1, "File is not contiguous");
+        }
+    }
+
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    END_TEST;
+}
+
+// Files which fit in their direct blocks should be packed next to one another,
+// rather than each being given room to grow.
+bool TestSmallFileLocality() {
+    BEGIN_TEST;
+
+    constexpr size_t kFiles = 16;
+
+    fbl::unique_fd mnt_fd(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    uint64_t inos[kFiles];
+    char data[minfs::kMinfsBlockSize];
+    memset(data, 0xab, sizeof(data));
+    for (size_t i = 0; i < kFiles; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "small_%zu", i);
+        fbl::unique_fd fd(openat(mnt_fd.get(), path, O_CREAT | O_RDWR));
+        ASSERT_TRUE(fd);
+        ASSERT_EQ(write(fd.get(), data, sizeof(data)), sizeof(data));
+        struct stat s;
+        ASSERT_EQ(fstat(fd.get(), &s), 0);
+        inos[i] = s.st_ino;
+        ASSERT_EQ(close(fd.release()), 0);
+    }
+    ASSERT_EQ(close(mnt_fd.release()), 0);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+
+    fbl::unique_fd disk(open(test_disk_path, O_RDWR));
+    ASSERT_TRUE(disk);
+    minfs::Superblock info;
+    ASSERT_TRUE(ReadDiskSuperblock(disk.get(), &info));
+    minfs::blk_t lowest = UINT32_MAX;
+    minfs::blk_t highest = 0;
+    for (size_t i = 0; i < kFiles; i++) {
+        minfs::Inode inode;
+        ASSERT_TRUE(ReadDiskInode(disk.get(), info, inos[i], &inode));
+        ASSERT_NE(inode.dnum[0], 0u);
+        lowest = fbl::min(lowest, inode.dnum[0]);
+        highest = fbl::max(highest, inode.dnum[0]);
+    }
+    // Allow some slack for directory blocks allocated in between.
+    ASSERT_LT(highest - lowest, 2 * kFiles, "Small files are spread out");
+
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+    END_TEST;
+}
+
+// Fill a directory well past a single hash bucket, verifying that every entry
+// stays reachable as the directory index grows, across unlinks, and across a
+// remount.
+bool TestLargeDirectory() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kEntryCount = 4096;
+    fbl::unique_fd mnt_fd(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    ASSERT_EQ(mkdirat(mnt_fd.get(), "dir", 0666), 0);
+    fbl::unique_fd dir_fd(openat(mnt_fd.get(), "dir", O_RDONLY | O_DIRECTORY));
+    ASSERT_TRUE(dir_fd);
+
+    char path[128];
+    for (uint32_t i = 0; i < kEntryCount; i++) {
+        snprintf(path, sizeof(path), "entry_%u", i);
+        fbl::unique_fd fd(openat(dir_fd.get(), path, O_CREAT | O_EXCL | O_RDWR));
+        ASSERT_TRUE(fd, "Failed to create entry");
+    }
+
+    // A hashed directory spans a whole number of bucket blocks.
+    struct stat s;
+    ASSERT_EQ(fstat(dir_fd.get(), &s), 0);
+    ASSERT_GT(s.st_size, minfs::kMinfsBlockSize);
+    ASSERT_EQ(s.st_size % minfs::kMinfsBlockSize, 0);
+
+    for (uint32_t i = 0; i < kEntryCount; i += 2) {
+        snprintf(path, sizeof(path), "entry_%u", i);
+        ASSERT_EQ(unlinkat(dir_fd.get(), path, 0), 0);
+    }
+    ASSERT_EQ(fstatat(dir_fd.get(), "..", &s, 0), 0);
+    ASSERT_EQ(close(dir_fd.release()), 0);
+    ASSERT_EQ(close(mnt_fd.release()), 0);
+
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+    ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+
+    mnt_fd.reset(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    dir_fd.reset(openat(mnt_fd.get(), "dir", O_RDONLY | O_DIRECTORY));
+    ASSERT_TRUE(dir_fd);
+    for (uint32_t i = 0; i < kEntryCount; i++) {
+        snprintf(path, sizeof(path), "entry_%u", i);
+        ASSERT_EQ(fstatat(dir_fd.get(), path, &s, 0), (i % 2) ? 0 : -1);
+    }
+
+    // Readdir still sees every remaining entry exactly once.
+    DIR* dir = fdopendir(dir_fd.release());
+    ASSERT_NONNULL(dir);
+    uint32_t seen = 0;
+    struct dirent* de;
+    while ((de = readdir(dir)) != nullptr) {
+        if (strncmp(de->d_name, "entry_", 6) == 0) {
+            seen++;
+        }
+    }
+    ASSERT_EQ(closedir(dir), 0);
+    ASSERT_EQ(seen, kEntryCount / 2);
+    END_TEST;
+}
+
+// Create more long-named entries than 64 full buckets can hold, and check the
+// directory index keeps growing instead of degrading to a linear directory.
+bool TestDirectoryIndexGrowth() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kNameLen = 240;
+    constexpr uint32_t kFullBuckets = 64;
+    constexpr uint32_t kEntryCount =
+        2 * kFullBuckets * (minfs::kMinfsBlockSize / minfs::DirentSize(kNameLen));
+    fbl::unique_fd mnt_fd(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    ASSERT_EQ(mkdirat(mnt_fd.get(), "dir", 0666), 0);
+    fbl::unique_fd dir_fd(openat(mnt_fd.get(), "dir", O_RDONLY | O_DIRECTORY));
+    ASSERT_TRUE(dir_fd);
+    struct stat s;
+    ASSERT_EQ(fstat(dir_fd.get(), &s), 0);
+    const uint64_t ino = s.st_ino;
+
+    char name[kNameLen + 1];
+    memset(name, 'x', kNameLen);
+    name[kNameLen] = '\0';
+    for (uint32_t i = 0; i < kEntryCount; i++) {
+        snprintf(name + kNameLen - 8, 9, "%08u", i);
+        fbl::unique_fd fd(openat(dir_fd.get(), name, O_CREAT | O_EXCL | O_RDWR));
+        ASSERT_TRUE(fd, "Failed to create entry");
+    }
+    ASSERT_EQ(close(dir_fd.release()), 0);
+    ASSERT_EQ(close(mnt_fd.release()), 0);
+    ASSERT_EQ(test_info->unmount(kMountPath), 0);
+
+    fbl::unique_fd disk(open(test_disk_path, O_RDWR));
+    ASSERT_TRUE(disk);
+    minfs::Superblock info;
+    ASSERT_TRUE(ReadDiskSuperblock(disk.get(), &info));
+    minfs::Inode inode;
+    ASSERT_TRUE(ReadDiskInode(disk.get(), info, ino, &inode));
+    ASSERT_GT(inode.dir_buckets, kFullBuckets, "Directory index did not grow");
+    ASSERT_EQ(inode.size, inode.dir_buckets * minfs::kMinfsBlockSize);
+    ASSERT_EQ(close(disk.release()), 0);
+
+    ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, kMountPath), 0);
+
+    mnt_fd.reset(open(kMountPath, O_RDONLY));
+    ASSERT_TRUE(mnt_fd);
+    dir_fd.reset(openat(mnt_fd.get(), "dir", O_RDONLY | O_DIRECTORY));
+    ASSERT_TRUE(dir_fd);
+    for (uint32_t i = 0; i < kEntryCount; i++) {
+        snprintf(name + kNameLen - 8, 9, "%08u", i);
+        ASSERT_EQ(fstatat(dir_fd.get(), name, &s, 0), 0);
+    }
+    END_TEST;
+}
+
 }  // namespace
 
 #define RUN_MINFS_TESTS_NORMAL(name, CASE_TESTS) \
@@ -433,6 +883,12 @@ bool TestFullOperations() {
 
 RUN_MINFS_TESTS_NORMAL(FsMinfsTests,
     RUN_TEST_LARGE(TestFullOperations)
+    RUN_TEST_MEDIUM(TestJournalReplay)
+    RUN_TEST_LARGE(TestLargeDirectory)
+    RUN_TEST_LARGE(TestDirectoryIndexGrowth)
+    RUN_TEST_MEDIUM(TestContiguousAllocation)
+    RUN_TEST_MEDIUM(TestSmallFileLocality)
+    RUN_TEST_MEDIUM(TestReadahead)
 )
 
 RUN_MINFS_TESTS_FVM(FsMinfsFvmTests,
@@ -0,0 +1,97 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <digest/digest.h>
+#include <digest/merkle-tree.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+namespace {
+
+using digest::Digest;
+using digest::MerkleTree;
+
+// Test performance of creating a Merkle tree a node at a time, as is done when
+// the data arrives incrementally.
+bool MerkleTreeCreateStreamingTest(perftest::RepeatState* state, size_t size) {
+    state->SetBytesProcessedPerRun(size);
+
+    size_t tree_len = MerkleTree::GetTreeLength(size);
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    fbl::unique_ptr<uint8_t[]> tree(new uint8_t[tree_len]);
+    memset(data.get(), 0xff, size);
+
+    while (state->KeepRunning()) {
+        MerkleTree mt;
+        Digest digest;
+        ZX_ASSERT(mt.CreateInit(size, tree_len) == ZX_OK);
+        for (size_t off = 0; off < size; off += MerkleTree::kNodeSize) {
+            size_t len = fbl::min(size - off, MerkleTree::kNodeSize);
+            ZX_ASSERT(mt.CreateUpdate(data.get() + off, len, tree.get()) == ZX_OK);
+        }
+        ZX_ASSERT(mt.CreateFinal(tree.get(), &digest) == ZX_OK);
+    }
+    return true;
+}
+
+// Test performance of creating a Merkle tree a level at a time, dividing each
+// level among |num_threads| threads.
+bool MerkleTreeCreateTest(perftest::RepeatState* state, size_t size, size_t num_threads) {
+    state->SetBytesProcessedPerRun(size);
+
+    size_t tree_len = MerkleTree::GetTreeLength(size);
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    fbl::unique_ptr<uint8_t[]> tree(new uint8_t[tree_len]);
+    memset(data.get(), 0xff, size);
+
+    while (state->KeepRunning()) {
+        Digest digest;
+        ZX_ASSERT(MerkleTree::Create(data.get(), size, tree.get(), tree_len, &digest,
+                                     num_threads) == ZX_OK);
+    }
+    return true;
+}
+
+// Test performance of verifying all of the data covered by a Merkle tree.
+bool MerkleTreeVerifyTest(perftest::RepeatState* state, size_t size) {
+    state->SetBytesProcessedPerRun(size);
+
+    size_t tree_len = MerkleTree::GetTreeLength(size);
+    fbl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    fbl::unique_ptr<uint8_t[]> tree(new uint8_t[tree_len]);
+    memset(data.get(), 0xff, size);
+    Digest digest;
+    ZX_ASSERT(MerkleTree::Create(data.get(), size, tree.get(), tree_len, &digest) == ZX_OK);
+
+    while (state->KeepRunning()) {
+        ZX_ASSERT(MerkleTree::Verify(data.get(), size, tree.get(), tree_len, 0, size,
+                                     digest) == ZX_OK);
+    }
+    return true;
+}
+
+void RegisterTests() {
+    static const size_t kSizesBytes[] = {
+        64 * 1024,
+        8 * 1024 * 1024,
+    };
+    static const size_t kThreadCounts[] = {1, 4};
+    for (auto size : kSizesBytes) {
+        auto name = fbl::StringPrintf("MerkleTree/CreateStreaming/%zubytes", size);
+        perftest::RegisterTest(name.c_str(), MerkleTreeCreateStreamingTest, size);
+        for (auto num_threads : kThreadCounts) {
+            name = fbl::StringPrintf("MerkleTree/Create/%zuthreads/%zubytes", num_threads, size);
+            perftest::RegisterTest(name.c_str(), MerkleTreeCreateTest, size, num_threads);
+        }
+        name = fbl::StringPrintf("MerkleTree/Verify/%zubytes", size);
+        perftest::RegisterTest(name.c_str(), MerkleTreeVerifyTest, size);
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace